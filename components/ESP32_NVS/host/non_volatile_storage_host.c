@@ -0,0 +1,982 @@
+#include "non_volatile_storage.h"
+#include "non_volatile_storage_host.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <nvs.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+static const char *TAG = "non_volatile_storage_host";
+
+/*
+ * Values are kept in an open addressing hash map (FNV-1a of namespace and key, linear probing). Keys are unique
+ * per namespace, key and type, as on flash: a read of another type is ESP_ERR_NVS_NOT_FOUND. Erased slots stay
+ * as tombstones until nvs_host_reset(), so the probe chains are never broken.
+ */
+#define NVS_HOST_SLOTS (NVS_HOST_CAPACITY * 2)
+
+typedef enum {
+    NVS_HOST_SLOT_FREE = 0,
+    NVS_HOST_SLOT_USED,
+    NVS_HOST_SLOT_ERASED,
+} nvs_host_slot_state_t;
+
+typedef struct {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_value_type_t type;      // storage type: floats and doubles are kept as UINT32 / UINT64
+    void *data;
+    size_t length;
+    nvs_host_slot_state_t state;
+} nvs_host_slot_t;
+
+typedef struct {
+    uint32_t ops;
+    char key[NVS_KEY_NAME_MAX_SIZE];    // empty - any key
+    esp_err_t err;
+    uint32_t skip;
+    uint32_t count;                     // 0 - unlimited
+    bool active;
+} nvs_host_fault_t;
+
+/*
+ * Namespace handles of the flash backend: the last NVS_HANDLE_CACHE_SIZE namespaces stay open (least recently used
+ * one closed first), or, with the cache off, every access opens and closes its namespace. Only the open is modelled,
+ * as a delay and a counter.
+ */
+typedef struct {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t last_used;
+    bool is_open;
+} nvs_host_handle_t;
+
+static nvs_host_slot_t slots[NVS_HOST_SLOTS];
+static size_t slots_used = 0;
+static nvs_host_fault_t fault;
+static uint32_t latency_us[3];          // read, write, commit
+static nvs_host_handle_t handles[NVS_HANDLE_CACHE_SIZE];
+static uint32_t handle_clock = 0;
+static uint32_t open_latency_us = 0;
+static uint32_t open_count = 0;
+static bool handle_cache = true;
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static nvs_write_stats_t write_stats;
+#if NVS_STATS_ENABLE
+static nvs_key_stats_t key_stats[NVS_STATS_MAX_KEYS];
+static size_t key_stats_count = 0;
+static nvs_namespace_stats_t namespace_stats[NVS_STATS_MAX_NAMESPACES];
+static size_t namespace_stats_count = 0;
+#endif
+
+static uint32_t nvs_host_hash(const char *namespace, const char *key)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = namespace; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    hash = (hash ^ '.') * 16777619u;
+    for (const char *c = key; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+static nvs_value_type_t nvs_host_storage_type(nvs_value_type_t type_value)
+{
+    switch (type_value) {
+        case NVS_VALUE_FLOAT:
+            return NVS_VALUE_UINT32;
+        case NVS_VALUE_DOUBLE:
+            return NVS_VALUE_UINT64;
+        default:
+            return type_value;
+    }
+}
+
+static size_t nvs_host_number_size(nvs_value_type_t type_value)
+{
+    switch (type_value) {
+        case NVS_VALUE_INT8:
+        case NVS_VALUE_UINT8:
+            return sizeof(uint8_t);
+        case NVS_VALUE_INT16:
+        case NVS_VALUE_UINT16:
+            return sizeof(uint16_t);
+        case NVS_VALUE_INT32:
+        case NVS_VALUE_UINT32:
+        case NVS_VALUE_FLOAT:
+            return sizeof(uint32_t);
+        case NVS_VALUE_INT64:
+        case NVS_VALUE_UINT64:
+        case NVS_VALUE_DOUBLE:
+            return sizeof(uint64_t);
+        default:
+            return 0;
+    }
+}
+
+// Slot of the value, or the free slot to insert it when create is set. Must be called with the mutex held.
+static nvs_host_slot_t *nvs_host_find(const char *namespace, const char *key, nvs_value_type_t type, bool create)
+{
+    uint32_t index = nvs_host_hash(namespace, key) % NVS_HOST_SLOTS;
+    nvs_host_slot_t *reuse = NULL;
+    for (size_t probe = 0; probe < NVS_HOST_SLOTS; probe++) {
+        nvs_host_slot_t *slot = &slots[(index + probe) % NVS_HOST_SLOTS];
+        if (slot->state == NVS_HOST_SLOT_FREE) {
+            return create ? (reuse != NULL ? reuse : slot) : NULL;
+        }
+        if (slot->state == NVS_HOST_SLOT_ERASED) {
+            if (reuse == NULL) {
+                reuse = slot;
+            }
+        } else if (slot->type == type && strcmp(slot->key, key) == 0 && strcmp(slot->namespace, namespace) == 0) {
+            return slot;
+        }
+    }
+    return create ? reuse : NULL;
+}
+
+static uint64_t nvs_host_time_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000;
+}
+
+// Busy wait, nanosleep() overshoots delays of some microseconds by the timer slack
+static void nvs_host_sleep(uint32_t us)
+{
+    if (us > 0) {
+        uint64_t end_us = nvs_host_time_us() + us;
+        while (nvs_host_time_us() < end_us) {
+        }
+    }
+}
+
+// Open the namespace, unless its handle is cached. Must be called with the mutex held.
+static void nvs_host_open(const char *namespace)
+{
+    nvs_host_handle_t *victim = &handles[0];
+    for (int i = 0; i < NVS_HANDLE_CACHE_SIZE; i++) {
+        nvs_host_handle_t *handle = &handles[i];
+        if (handle->is_open && strcmp(handle->namespace, namespace) == 0) {
+            handle->last_used = ++handle_clock;
+            return;
+        }
+        if (victim->is_open && (!handle->is_open || handle->last_used < victim->last_used)) {
+            victim = handle;
+        }
+    }
+
+    nvs_host_sleep(open_latency_us);
+    open_count++;
+    if (handle_cache) {
+        snprintf(victim->namespace, sizeof(victim->namespace), "%s", namespace);
+        victim->last_used = ++handle_clock;
+        victim->is_open = true;
+    }
+}
+
+// Simulated latency and injected fault of an operation. Must be called with the mutex held.
+static esp_err_t nvs_host_operation(nvs_host_op_t op, const char *key)
+{
+    nvs_host_sleep(latency_us[op == NVS_HOST_OP_READ ? 0 : op == NVS_HOST_OP_WRITE ? 1 : 2]);
+
+    if (!fault.active || !(fault.ops & op)) {
+        return ESP_OK;
+    }
+    if (op != NVS_HOST_OP_COMMIT && fault.key[0] != '\0' && strcmp(fault.key, key) != 0) {
+        return ESP_OK;
+    }
+    if (fault.skip > 0) {
+        fault.skip--;
+        return ESP_OK;
+    }
+    if (fault.count > 0 && --fault.count == 0) {
+        fault.active = false;
+    }
+    return fault.err;
+}
+
+#if NVS_STATS_ENABLE
+static nvs_namespace_stats_t *nvs_host_namespace_stats(const char *namespace)
+{
+    for (size_t i = 0; i < namespace_stats_count; i++) {
+        if (strcmp(namespace_stats[i].namespace, namespace) == 0) {
+            return &namespace_stats[i];
+        }
+    }
+    if (namespace_stats_count == NVS_STATS_MAX_NAMESPACES) {
+        return NULL;
+    }
+    nvs_namespace_stats_t *entry = &namespace_stats[namespace_stats_count++];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->namespace, sizeof(entry->namespace), "%s", namespace);
+    return entry;
+}
+
+static nvs_key_stats_t *nvs_host_key_stats(const char *namespace, const char *key)
+{
+    for (size_t i = 0; i < key_stats_count; i++) {
+        if (strcmp(key_stats[i].key, key) == 0 && strcmp(key_stats[i].namespace, namespace) == 0) {
+            return &key_stats[i];
+        }
+    }
+    if (key_stats_count == NVS_STATS_MAX_KEYS) {
+        return NULL;
+    }
+    nvs_key_stats_t *entry = &key_stats[key_stats_count++];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->namespace, sizeof(entry->namespace), "%s", namespace);
+    snprintf(entry->key, sizeof(entry->key), "%s", key);
+    return entry;
+}
+#endif  // NVS_STATS_ENABLE
+
+static void nvs_host_stats_access(const char *namespace, const char *key, bool write, size_t bytes, uint64_t start_us)
+{
+#if NVS_STATS_ENABLE
+    uint32_t time_us = (uint32_t)(nvs_host_time_us() - start_us);
+    nvs_namespace_stats_t *ns = nvs_host_namespace_stats(namespace);
+    nvs_key_stats_t *entry = nvs_host_key_stats(namespace, key);
+    if (ns != NULL) {
+        *(write ? &ns->writes : &ns->reads) += 1;
+        *(write ? &ns->bytes_written : &ns->bytes_read) += bytes;
+        ns->time_us += time_us;
+        if (entry == NULL) {
+            ns->untracked++;
+        }
+    }
+    if (entry != NULL) {
+        *(write ? &entry->writes : &entry->reads) += 1;
+        *(write ? &entry->bytes_written : &entry->bytes_read) += bytes;
+        entry->time_us += time_us;
+    }
+#endif
+}
+
+// Commit of a namespace, counted and delayed like on flash. Must be called with the mutex held.
+static esp_err_t nvs_host_commit(const char *namespace)
+{
+    uint64_t start_us = nvs_host_time_us();
+    esp_err_t err = nvs_host_operation(NVS_HOST_OP_COMMIT, NULL);
+    write_stats.commits++;
+#if NVS_STATS_ENABLE
+    nvs_namespace_stats_t *ns = nvs_host_namespace_stats(namespace);
+    if (ns != NULL) {
+        ns->commits++;
+        ns->time_us += nvs_host_time_us() - start_us;
+    }
+#else
+    (void)start_us;
+    (void)namespace;
+#endif
+    return err;
+}
+
+// Store one value, without commit. Must be called with the mutex held.
+static esp_err_t nvs_host_set(const char *namespace, const char *key, nvs_value_type_t type_value,
+                              const void *value, size_t length)
+{
+    if ((unsigned)type_value > NVS_VALUE_BLOB) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    if (strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE || strlen(key) >= NVS_KEY_NAME_MAX_SIZE || key[0] == '\0') {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    uint64_t start_us = nvs_host_time_us();
+    esp_err_t err = nvs_host_operation(NVS_HOST_OP_WRITE, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (type_value == NVS_VALUE_STRING) {
+        length = strlen((const char *)value) + 1;
+    } else if (type_value != NVS_VALUE_BLOB) {
+        length = nvs_host_number_size(type_value);
+    }
+    nvs_value_type_t type = nvs_host_storage_type(type_value);
+
+    // A legacy string float replaced by the binary one, as the flash backend does
+    if (type_value == NVS_VALUE_FLOAT || type_value == NVS_VALUE_DOUBLE) {
+        nvs_host_slot_t *legacy = nvs_host_find(namespace, key, NVS_VALUE_STRING, false);
+        if (legacy != NULL) {
+            free(legacy->data);
+            legacy->data = NULL;
+            legacy->state = NVS_HOST_SLOT_ERASED;
+            slots_used--;
+        }
+    }
+
+    nvs_host_slot_t *slot = nvs_host_find(namespace, key, type, true);
+    if (slot == NULL || (slot->state != NVS_HOST_SLOT_USED && slots_used >= NVS_HOST_CAPACITY)) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    void *data = malloc(length > 0 ? length : 1);
+    if (data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+
+    if (slot->state == NVS_HOST_SLOT_USED) {
+        free(slot->data);
+    } else {
+        snprintf(slot->namespace, sizeof(slot->namespace), "%s", namespace);
+        snprintf(slot->key, sizeof(slot->key), "%s", key);
+        slot->type = type;
+        slot->state = NVS_HOST_SLOT_USED;
+        slots_used++;
+    }
+    slot->data = data;
+    slot->length = length;
+
+    write_stats.writes++;
+    nvs_host_stats_access(namespace, key, true, length, start_us);
+    return ESP_OK;
+}
+
+/*
+ * Read one value. Strings and blobs are read into a buffer of the given length, a string with length 0 is
+ * allocated into *(char **)value. Must be called with the mutex held.
+ */
+static esp_err_t nvs_host_get(const char *namespace, const char *key, nvs_value_type_t type_value,
+                              void *value, size_t length)
+{
+    if ((unsigned)type_value > NVS_VALUE_BLOB) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    uint64_t start_us = nvs_host_time_us();
+    esp_err_t err = nvs_host_operation(NVS_HOST_OP_READ, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    nvs_host_slot_t *slot = nvs_host_find(namespace, key, nvs_host_storage_type(type_value), false);
+    if (slot == NULL && (type_value == NVS_VALUE_FLOAT || type_value == NVS_VALUE_DOUBLE)) {
+        // Legacy "%f" string, migrated to the binary entry as the flash backend does
+        nvs_host_slot_t *legacy = nvs_host_find(namespace, key, NVS_VALUE_STRING, false);
+        if (legacy != NULL) {
+            if (type_value == NVS_VALUE_DOUBLE) {
+                *(double *)value = strtod((const char *)legacy->data, NULL);
+            } else {
+                *(float *)value = strtof((const char *)legacy->data, NULL);
+            }
+            nvs_host_stats_access(namespace, key, false, legacy->length, start_us);
+
+            // The value is valid even if the migration fails, it is retried on the next read
+            esp_err_t migrate_err = nvs_host_set(namespace, key, type_value, value, 0);
+            if (migrate_err == ESP_OK) {
+                migrate_err = nvs_host_commit(namespace);
+            }
+            if (migrate_err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to migrate %s to binary format: %d (%s)", key, migrate_err, esp_err_to_name(migrate_err));
+            }
+            return ESP_OK;
+        }
+    }
+    if (slot == NULL) {
+        nvs_host_stats_access(namespace, key, false, 0, start_us);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (type_value == NVS_VALUE_STRING && length == 0) {
+        char *string = malloc(slot->length);
+        if (string == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(string, slot->data, slot->length);
+        *(char **)value = string;
+    } else if (type_value == NVS_VALUE_STRING || type_value == NVS_VALUE_BLOB) {
+        if (length < slot->length) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(value, slot->data, slot->length);
+    } else {
+        memcpy(value, slot->data, slot->length);
+    }
+    nvs_host_stats_access(namespace, key, false, type_value == NVS_VALUE_BLOB ? length : slot->length, start_us);
+    return ESP_OK;
+}
+
+/*
+ * Public API, see non_volatile_storage.h
+ */
+esp_err_t nvs_init(void)
+{
+    return ESP_OK;
+}
+
+// Commit every namespace holding values, as the flash backend commits its open handles
+static esp_err_t nvs_host_commit_all(void)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&store_mutex);
+    for (size_t i = 0; i < NVS_HOST_SLOTS; i++) {
+        if (slots[i].state != NVS_HOST_SLOT_USED) {
+            continue;
+        }
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++) {
+            seen = slots[j].state == NVS_HOST_SLOT_USED && strcmp(slots[j].namespace, slots[i].namespace) == 0;
+        }
+        if (!seen) {
+            esp_err_t err = nvs_host_commit(slots[i].namespace);
+            if (err != ESP_OK) {
+                ret = err;
+            }
+        }
+    }
+    pthread_mutex_unlock(&store_mutex);
+    return ret;
+}
+
+esp_err_t nvs_flush(void)
+{
+    return nvs_host_commit_all();
+}
+
+esp_err_t nvs_close_all(void)
+{
+    esp_err_t err = nvs_host_commit_all();
+    pthread_mutex_lock(&store_mutex);
+    memset(handles, 0, sizeof(handles));
+    pthread_mutex_unlock(&store_mutex);
+    return err;
+}
+
+nvs_write_stats_t nvs_get_write_stats(void)
+{
+    pthread_mutex_lock(&store_mutex);
+    nvs_write_stats_t stats = write_stats;
+    pthread_mutex_unlock(&store_mutex);
+    return stats;
+}
+
+size_t nvs_get_key_stats(nvs_key_stats_t *stats, size_t max_count)
+{
+    size_t count = 0;
+#if NVS_STATS_ENABLE
+    if (stats != NULL) {
+        pthread_mutex_lock(&store_mutex);
+        count = key_stats_count < max_count ? key_stats_count : max_count;
+        memcpy(stats, key_stats, count * sizeof(nvs_key_stats_t));
+        pthread_mutex_unlock(&store_mutex);
+    }
+#endif
+    return count;
+}
+
+size_t nvs_get_namespace_stats(nvs_namespace_stats_t *stats, size_t max_count)
+{
+    size_t count = 0;
+#if NVS_STATS_ENABLE
+    if (stats != NULL) {
+        pthread_mutex_lock(&store_mutex);
+        count = namespace_stats_count < max_count ? namespace_stats_count : max_count;
+        memcpy(stats, namespace_stats, count * sizeof(nvs_namespace_stats_t));
+        pthread_mutex_unlock(&store_mutex);
+    }
+#endif
+    return count;
+}
+
+void nvs_reset_stats(void)
+{
+#if NVS_STATS_ENABLE
+    pthread_mutex_lock(&store_mutex);
+    key_stats_count = 0;
+    namespace_stats_count = 0;
+    pthread_mutex_unlock(&store_mutex);
+#endif
+}
+
+static esp_err_t nvs_host_write(const char *namespace, const char *key, nvs_value_type_t type_value,
+                                const void *value, size_t length)
+{
+    if (namespace == NULL || key == NULL || value == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to write value: namespace, key or value is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&store_mutex);
+    nvs_host_open(namespace);
+    esp_err_t err = nvs_host_set(namespace, key, type_value, value, length);
+    if (err == ESP_OK) {
+        err = nvs_host_commit(namespace);
+    }
+    pthread_mutex_unlock(&store_mutex);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write to NVS %s.%s: %d (%s)!", namespace, key, err, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t nvs_write_int8(const char *namespace, const char *key, int8_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_INT8, &value, 0);
+}
+
+esp_err_t nvs_write_uint8(const char *namespace, const char *key, uint8_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_UINT8, &value, 0);
+}
+
+esp_err_t nvs_write_int16(const char *namespace, const char *key, int16_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_INT16, &value, 0);
+}
+
+esp_err_t nvs_write_uint16(const char *namespace, const char *key, uint16_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_UINT16, &value, 0);
+}
+
+esp_err_t nvs_write_int32(const char *namespace, const char *key, int32_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_INT32, &value, 0);
+}
+
+esp_err_t nvs_write_uint32(const char *namespace, const char *key, uint32_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_UINT32, &value, 0);
+}
+
+esp_err_t nvs_write_int64(const char *namespace, const char *key, int64_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_INT64, &value, 0);
+}
+
+esp_err_t nvs_write_uint64(const char *namespace, const char *key, uint64_t value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_UINT64, &value, 0);
+}
+
+esp_err_t nvs_write_string(const char *namespace, const char *key, const char *value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_STRING, value, 0);
+}
+
+esp_err_t nvs_write_float(const char *namespace, const char *key, float value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_FLOAT, &value, 0);
+}
+
+esp_err_t nvs_write_double(const char *namespace, const char *key, double value)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_DOUBLE, &value, 0);
+}
+
+esp_err_t nvs_write_blob(const char *namespace, const char *key, const void *value, size_t length)
+{
+    return nvs_host_write(namespace, key, NVS_VALUE_BLOB, value, length);
+}
+
+static esp_err_t nvs_host_read(const char *namespace, const char *key, nvs_value_type_t type_value,
+                               void *value, size_t length)
+{
+    if (namespace == NULL || key == NULL || value == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to read value: namespace, key or value is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&store_mutex);
+    nvs_host_open(namespace);
+    esp_err_t err = nvs_host_get(namespace, key, type_value, value, length);
+    pthread_mutex_unlock(&store_mutex);
+
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Value %s.%s is not initialized yet", namespace, key);
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read from NVS %s.%s: %d (%s)", namespace, key, err, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t nvs_read_int8(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_INT8, out_value, 0);
+}
+
+esp_err_t nvs_read_uint8(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_UINT8, out_value, 0);
+}
+
+esp_err_t nvs_read_int16(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_INT16, out_value, 0);
+}
+
+esp_err_t nvs_read_uint16(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_UINT16, out_value, 0);
+}
+
+esp_err_t nvs_read_int32(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_INT32, out_value, 0);
+}
+
+esp_err_t nvs_read_uint32(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_UINT32, out_value, 0);
+}
+
+esp_err_t nvs_read_int64(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_INT64, out_value, 0);
+}
+
+esp_err_t nvs_read_uint64(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_UINT64, out_value, 0);
+}
+
+esp_err_t nvs_read_string(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_STRING, out_value, 0);
+}
+
+esp_err_t nvs_read_string_into(const char *namespace, const char *key, char *out_value, size_t length)
+{
+    if (length == 0) {
+        ESP_LOGE(TAG, "%s(): Failed to read string %s: buffer length is 0!", __func__, key != NULL ? key : "");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return nvs_host_read(namespace, key, NVS_VALUE_STRING, out_value, length);
+}
+
+esp_err_t nvs_read_float(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_FLOAT, out_value, 0);
+}
+
+esp_err_t nvs_read_double(const char *namespace, const char *key, void *out_value)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_DOUBLE, out_value, 0);
+}
+
+esp_err_t nvs_read_blob(const char *namespace, const char *key, void *out_value, size_t length)
+{
+    return nvs_host_read(namespace, key, NVS_VALUE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_read_batch(const char *namespace, nvs_batch_item_t *items, size_t count)
+{
+    if (namespace == NULL || items == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to read values: namespace or items are NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].key == NULL || items[i].value == NULL) {
+            ESP_LOGE(TAG, "%s(): Failed to read values: key or value of item %u is NULL!", __func__, (unsigned)i);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&store_mutex);
+    nvs_host_open(namespace);
+    for (size_t i = 0; i < count; i++) {
+        nvs_batch_item_t *item = &items[i];
+        item->result = nvs_host_get(namespace, item->key, item->type, item->value, item->length);
+        if (item->result == ESP_ERR_NVS_NOT_FOUND) {
+            if (ret == ESP_OK) {
+                ret = item->result;
+            }
+        } else if (item->result != ESP_OK && (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND)) {
+            ret = item->result;
+        }
+    }
+    pthread_mutex_unlock(&store_mutex);
+    return ret;
+}
+
+/*
+ * Transactions: the staged values are applied under the store mutex with a single commit
+ */
+#define NVS_HOST_TRANSACTION_INITIAL_CAPACITY 8
+
+typedef struct {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_value_type_t type;
+    void *data;             // copy of the value
+    size_t length;
+} nvs_host_staged_t;
+
+struct nvs_transaction {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    nvs_host_staged_t *items;
+    size_t count;
+    size_t capacity;
+    esp_err_t error;        // first staging error, reported by the commit
+};
+
+static void nvs_host_transaction_free(nvs_transaction_t tx)
+{
+    for (size_t i = 0; i < tx->count; i++) {
+        free(tx->items[i].data);
+    }
+    free(tx->items);
+    free(tx);
+}
+
+esp_err_t nvs_transaction_begin(const char *namespace, nvs_transaction_t *out_tx)
+{
+    if (namespace == NULL || out_tx == NULL || strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE) {
+        ESP_LOGE(TAG, "%s(): Failed to begin transaction: namespace is NULL or too long, or handle is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+    nvs_transaction_t tx = calloc(1, sizeof(struct nvs_transaction));
+    if (tx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(tx->namespace, sizeof(tx->namespace), "%s", namespace);
+    *out_tx = tx;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_host_stage(nvs_transaction_t tx, const char *key, nvs_value_type_t type,
+                                const void *value, size_t length)
+{
+    if (key == NULL || value == NULL || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        ESP_LOGE(TAG, "%s(): Failed to stage value: key or value is NULL, or key is too long!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((unsigned)type > NVS_VALUE_BLOB) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    if (type == NVS_VALUE_STRING) {
+        length = strlen((const char *)value) + 1;
+    } else if (type != NVS_VALUE_BLOB) {
+        length = nvs_host_number_size(type);
+    }
+    void *data = malloc(length > 0 ? length : 1);
+    if (data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+
+    // A key staged again replaces the previous value
+    nvs_host_staged_t *item = NULL;
+    for (size_t i = 0; i < tx->count; i++) {
+        if (strcmp(tx->items[i].key, key) == 0) {
+            item = &tx->items[i];
+            free(item->data);
+            break;
+        }
+    }
+    if (item == NULL) {
+        if (tx->count == tx->capacity) {
+            size_t capacity = tx->capacity > 0 ? tx->capacity * 2 : NVS_HOST_TRANSACTION_INITIAL_CAPACITY;
+            nvs_host_staged_t *items = realloc(tx->items, capacity * sizeof(nvs_host_staged_t));
+            if (items == NULL) {
+                free(data);
+                return ESP_ERR_NO_MEM;
+            }
+            tx->items = items;
+            tx->capacity = capacity;
+        }
+        item = &tx->items[tx->count++];
+        snprintf(item->key, sizeof(item->key), "%s", key);
+    }
+    item->type = type;
+    item->data = data;
+    item->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_transaction_set(nvs_transaction_t tx, const char *key, nvs_value_type_t type, const void *value, size_t length)
+{
+    if (tx == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = nvs_host_stage(tx, key, type, value, length);
+    if (err != ESP_OK && tx->error == ESP_OK) {
+        tx->error = err;
+    }
+    return err;
+}
+
+esp_err_t nvs_transaction_set_int8(nvs_transaction_t tx, const char *key, int8_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT8, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint8(nvs_transaction_t tx, const char *key, uint8_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT8, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_int16(nvs_transaction_t tx, const char *key, int16_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT16, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint16(nvs_transaction_t tx, const char *key, uint16_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT16, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_int32(nvs_transaction_t tx, const char *key, int32_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT32, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint32(nvs_transaction_t tx, const char *key, uint32_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT32, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_int64(nvs_transaction_t tx, const char *key, int64_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT64, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint64(nvs_transaction_t tx, const char *key, uint64_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT64, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_string(nvs_transaction_t tx, const char *key, const char *value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_STRING, value, 0);
+}
+
+esp_err_t nvs_transaction_set_float(nvs_transaction_t tx, const char *key, float value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_FLOAT, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_double(nvs_transaction_t tx, const char *key, double value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_DOUBLE, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_blob(nvs_transaction_t tx, const char *key, const void *value, size_t length)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_BLOB, value, length);
+}
+
+esp_err_t nvs_transaction_commit(nvs_transaction_t tx)
+{
+    if (tx == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = tx->error;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Transaction on NVS namespace %s discarded, a value could not be staged: %d (%s)", tx->namespace, err, esp_err_to_name(err));
+    } else if (tx->count > 0) {
+        pthread_mutex_lock(&store_mutex);
+        nvs_host_open(tx->namespace);
+        for (size_t i = 0; i < tx->count && err == ESP_OK; i++) {
+            nvs_host_staged_t *item = &tx->items[i];
+            err = nvs_host_set(tx->namespace, item->key, item->type, item->data, item->length);
+        }
+        if (err == ESP_OK) {
+            err = nvs_host_commit(tx->namespace);
+        }
+        pthread_mutex_unlock(&store_mutex);
+    }
+
+    nvs_host_transaction_free(tx);
+    return err;
+}
+
+void nvs_transaction_abort(nvs_transaction_t tx)
+{
+    if (tx != NULL) {
+        nvs_host_transaction_free(tx);
+    }
+}
+
+/*
+ * Host controls, see non_volatile_storage_host.h
+ */
+void nvs_host_reset(void)
+{
+    pthread_mutex_lock(&store_mutex);
+    for (size_t i = 0; i < NVS_HOST_SLOTS; i++) {
+        free(slots[i].data);
+    }
+    memset(slots, 0, sizeof(slots));
+    slots_used = 0;
+    memset(&fault, 0, sizeof(fault));
+    memset(latency_us, 0, sizeof(latency_us));
+    memset(handles, 0, sizeof(handles));
+    open_latency_us = 0;
+    open_count = 0;
+    handle_cache = true;
+    memset(&write_stats, 0, sizeof(write_stats));
+#if NVS_STATS_ENABLE
+    key_stats_count = 0;
+    namespace_stats_count = 0;
+#endif
+    pthread_mutex_unlock(&store_mutex);
+}
+
+void nvs_host_inject_fault(uint32_t ops, const char *key, esp_err_t err, uint32_t skip, uint32_t count)
+{
+    pthread_mutex_lock(&store_mutex);
+    fault = (nvs_host_fault_t) {
+        .ops = ops,
+        .err = err,
+        .skip = skip,
+        .count = count,
+        .active = true,
+    };
+    snprintf(fault.key, sizeof(fault.key), "%s", key != NULL ? key : "");
+    pthread_mutex_unlock(&store_mutex);
+}
+
+void nvs_host_clear_fault(void)
+{
+    pthread_mutex_lock(&store_mutex);
+    fault.active = false;
+    pthread_mutex_unlock(&store_mutex);
+}
+
+void nvs_host_set_latency(uint32_t read_us, uint32_t write_us, uint32_t commit_us)
+{
+    pthread_mutex_lock(&store_mutex);
+    latency_us[0] = read_us;
+    latency_us[1] = write_us;
+    latency_us[2] = commit_us;
+    pthread_mutex_unlock(&store_mutex);
+}
+
+void nvs_host_set_handles(uint32_t open_us, bool cache)
+{
+    pthread_mutex_lock(&store_mutex);
+    open_latency_us = open_us;
+    handle_cache = cache;
+    memset(handles, 0, sizeof(handles));
+    pthread_mutex_unlock(&store_mutex);
+}
+
+uint32_t nvs_host_open_count(void)
+{
+    pthread_mutex_lock(&store_mutex);
+    uint32_t count = open_count;
+    pthread_mutex_unlock(&store_mutex);
+    return count;
+}
+
+size_t nvs_host_count(void)
+{
+    pthread_mutex_lock(&store_mutex);
+    size_t count = slots_used;
+    pthread_mutex_unlock(&store_mutex);
+    return count;
+}
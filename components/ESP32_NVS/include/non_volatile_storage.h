@@ -25,12 +25,35 @@
 #ifndef NON_VOLATILE_STORAGE_H_
 #define NON_VOLATILE_STORAGE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef NVS_HANDLE_CACHE_SIZE
+#define NVS_HANDLE_CACHE_SIZE 4  // Number of namespaces with a handle kept open
+#endif
+
+#ifndef NVS_STATS_ENABLE
+#define NVS_STATS_ENABLE 1  // 1 - count reads, writes, commits, bytes and time per key and namespace, 0 - no counters
+#endif
+
+#ifndef NVS_STATS_MAX_KEYS
+#define NVS_STATS_MAX_KEYS 40  // Keys with own counters, the later ones are only counted in their namespace
+#endif
+
+#ifndef NVS_STATS_MAX_NAMESPACES
+#define NVS_STATS_MAX_NAMESPACES 4
+#endif
+
+#ifndef NVS_LOG_SUCCESS_AT_INFO
+#define NVS_LOG_SUCCESS_AT_INFO 0  // 1 - log successful reads and writes with their values at INFO level, 0 - at DEBUG
+#endif
+
 /**
  * @brief Initialize the default NVS partition
  *
@@ -46,6 +69,90 @@ extern "C" {
  */
 esp_err_t nvs_init(void);
 
+/**
+ * @brief Commit all cached namespace handles
+ *
+ * Handles are kept open between the calls, one per namespace (up to NVS_HANDLE_CACHE_SIZE, the least recently
+ * used one is closed when a new namespace is accessed). Every write is still committed immediately.
+ *
+ * @return
+ *         - ESP_OK if all handles were committed successfully.
+ *         - ESP_ERR_INVALID_STATE if nvs_init() was not called.
+ *         - One of the error codes from nvs_commit() otherwise.
+ */
+esp_err_t nvs_flush(void);
+
+/**
+ * @brief Commit and close all cached namespace handles (before restart or deep sleep)
+ *
+ * The handles are re-opened on the next access.
+ *
+ * @return see nvs_flush()
+ */
+esp_err_t nvs_close_all(void);
+
+/**
+ * @brief Flash write counters since boot
+ */
+typedef struct {
+    uint32_t writes;        // values written (nvs_set_*), each one a new entry in flash
+    uint32_t commits;       // nvs_commit() calls
+} nvs_write_stats_t;
+
+/**
+ * @brief Get the flash write counters since boot (zero before nvs_init())
+ */
+nvs_write_stats_t nvs_get_write_stats(void);
+
+/**
+ * @brief Access counters of one key (NVS_STATS_ENABLE)
+ *
+ * Times cover the NVS calls only, not the wait for the library lock. Bytes are the value sizes: strings with
+ * the terminating zero, blobs read by the size of the buffer.
+ */
+typedef struct {
+    char namespace[16];
+    char key[16];
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint64_t time_us;
+} nvs_key_stats_t;
+
+/**
+ * @brief Access counters of one namespace, all its keys and commits included (NVS_STATS_ENABLE)
+ */
+typedef struct {
+    char namespace[16];
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t commits;
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint64_t time_us;
+    uint32_t untracked;         // accesses to the keys beyond NVS_STATS_MAX_KEYS
+} nvs_namespace_stats_t;
+
+/**
+ * @brief Copy the key counters, in the order the keys were first accessed
+ *
+ * @return Number of entries copied, 0 without NVS_STATS_ENABLE
+ */
+size_t nvs_get_key_stats(nvs_key_stats_t *stats, size_t max_count);
+
+/**
+ * @brief Copy the namespace counters
+ *
+ * @return Number of entries copied, 0 without NVS_STATS_ENABLE
+ */
+size_t nvs_get_namespace_stats(nvs_namespace_stats_t *stats, size_t max_count);
+
+/**
+ * @brief Clear the key and namespace counters (not the write counters)
+ */
+void nvs_reset_stats(void);
+
 /**
  * @brief Write int8_t, uint8, int16... value for given key
  *
@@ -70,8 +177,8 @@ esp_err_t nvs_write_uint32(const char *namespace, const char *key, uint32_t valu
 esp_err_t nvs_write_int64(const char *namespace, const char *key, int64_t value);
 esp_err_t nvs_write_uint64(const char *namespace, const char *key, uint64_t value);
 esp_err_t nvs_write_string(const char *namespace, const char *key, const char *value);
-esp_err_t nvs_write_float(const char *namespace, const char *key, float value);
-esp_err_t nvs_write_double(const char *namespace, const char *key, double value);
+esp_err_t nvs_write_float(const char *namespace, const char *key, float value);     // stored as u32 bit pattern
+esp_err_t nvs_write_double(const char *namespace, const char *key, double value);  // stored as u64 bit pattern
 esp_err_t nvs_write_blob(const char *namespace, const char *key, const void *value, size_t length);
 
 /**
@@ -97,7 +204,8 @@ esp_err_t nvs_read_uint32(const char *namespace, const char *key, void *out_valu
 esp_err_t nvs_read_int64(const char *namespace, const char *key, void *out_value);
 esp_err_t nvs_read_uint64(const char *namespace, const char *key, void *out_value);
 esp_err_t nvs_read_string(const char *namespace, const char *key, void *out_value);  // Please see an example below.
-esp_err_t nvs_read_float(const char *namespace, const char *key, void *out_value);
+esp_err_t nvs_read_string_into(const char *namespace, const char *key, char *out_value, size_t length);  // no allocation
+esp_err_t nvs_read_float(const char *namespace, const char *key, void *out_value);   // also reads and converts the old string format
 esp_err_t nvs_read_double(const char *namespace, const char *key, void *out_value);
 esp_err_t nvs_read_blob(const char *namespace, const char *key, void *out_value, size_t length);
 
@@ -113,6 +221,142 @@ esp_err_t nvs_read_blob(const char *namespace, const char *key, void *out_value,
     // IMPORTANT NOTE!: This applies ONLY to strings. Remember to delete the pointer to avoid a memory leak.
     free(read_string);
 
+    // A string of known maximal length can be read into a buffer instead, without any allocation.
+    // length includes the terminating zero, ESP_ERR_NVS_INVALID_LENGTH is returned if the value is longer.
+    char buffer[64];
+    if (nvs_read_string_into("namespace_1", "key_2", buffer, sizeof(buffer)) == ESP_OK) {
+        ESP_LOGI(TAG, "Successfully read string from NVS: %s", buffer);
+    }
+
+*/
+
+/**
+ * @brief Value types of the batch read and the transaction
+ *
+ * Floats and doubles are stored in the same format as nvs_write_float() / nvs_write_double().
+ */
+typedef enum {
+    NVS_VALUE_INT8,
+    NVS_VALUE_UINT8,
+    NVS_VALUE_INT16,
+    NVS_VALUE_UINT16,
+    NVS_VALUE_INT32,
+    NVS_VALUE_UINT32,
+    NVS_VALUE_INT64,
+    NVS_VALUE_UINT64,
+    NVS_VALUE_STRING,
+    NVS_VALUE_FLOAT,
+    NVS_VALUE_DOUBLE,
+    NVS_VALUE_BLOB,
+} nvs_value_type_t;
+
+/**
+ * @brief One key of a batch read
+ */
+typedef struct {
+    const char *key;
+    nvs_value_type_t type;
+    void *value;            // destination, left untouched when the key can not be read
+    size_t length;          // size of the destination buffer, NVS_VALUE_STRING and NVS_VALUE_BLOB only
+    esp_err_t result;       // set by nvs_read_batch()
+} nvs_batch_item_t;
+
+/**
+ * @brief Read a table of keys from one namespace with a single open and lock
+ *
+ * Strings are read into the caller buffers (item length includes the terminating zero), no memory is allocated.
+ * The result of every key is stored in the item, so missing keys can be told apart and initialized.
+ *
+ * @param[in]     namespace Namespace name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn’t be empty.
+ * @param[in,out] items Keys to read.
+ * @param[in]     count Number of items.
+ * @return
+ *         - ESP_OK if all keys were read successfully.
+ *         - ESP_ERR_NVS_NOT_FOUND if some keys don't exist, all other keys were read.
+ *         - ESP_ERR_INVALID_ARG if a parameter is NULL.
+ *         - The first other error of a key or of opening the namespace.
+ */
+esp_err_t nvs_read_batch(const char *namespace, nvs_batch_item_t *items, size_t count);
+
+/**
+ * @brief Write transaction
+ *
+ * Values are staged in RAM and applied to one namespace at commit, with a single lock and a single nvs_commit().
+ * Readers using this library never see a commit in progress. NVS has no rollback: the flash is written key by key,
+ * so a failing key (e.g. ESP_ERR_NVS_NOT_ENOUGH_SPACE) or a power loss during the commit leaves the values before it
+ * written. Stage first the value that has to fail before anything else is written (e.g. the largest one).
+ */
+typedef struct nvs_transaction *nvs_transaction_t;
+
+/**
+ * @brief Start a transaction
+ *
+ * @param[in]  namespace Namespace name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn’t be empty.
+ * @param[out] out_tx Transaction handle, must be passed to nvs_transaction_commit() or nvs_transaction_abort().
+ * @return
+ *         - ESP_OK if the transaction was started.
+ *         - ESP_ERR_INVALID_ARG if a parameter is NULL or the namespace name is too long.
+ *         - ESP_ERR_NO_MEM if memory could not be allocated.
+ */
+esp_err_t nvs_transaction_begin(const char *namespace, nvs_transaction_t *out_tx);
+
+/**
+ * @brief Stage a value. A key staged again replaces the previous value.
+ *
+ * The value is copied. Errors are also remembered and reported by nvs_transaction_commit(), so the calls
+ * may be chained without checking every result.
+ *
+ * @param[in] tx Transaction handle.
+ * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn’t be empty.
+ * @param[in] type Value type.
+ * @param[in] value Pointer to the value, the string itself for NVS_VALUE_STRING.
+ * @param[in] length Length of the blob, ignored for other types.
+ * @return
+ *         - ESP_OK if the value was staged.
+ *         - ESP_ERR_INVALID_ARG if a parameter is NULL or the key name is too long.
+ *         - ESP_ERR_NO_MEM if memory could not be allocated.
+ */
+esp_err_t nvs_transaction_set(nvs_transaction_t tx, const char *key, nvs_value_type_t type, const void *value, size_t length);
+esp_err_t nvs_transaction_set_int8(nvs_transaction_t tx, const char *key, int8_t value);
+esp_err_t nvs_transaction_set_uint8(nvs_transaction_t tx, const char *key, uint8_t value);
+esp_err_t nvs_transaction_set_int16(nvs_transaction_t tx, const char *key, int16_t value);
+esp_err_t nvs_transaction_set_uint16(nvs_transaction_t tx, const char *key, uint16_t value);
+esp_err_t nvs_transaction_set_int32(nvs_transaction_t tx, const char *key, int32_t value);
+esp_err_t nvs_transaction_set_uint32(nvs_transaction_t tx, const char *key, uint32_t value);
+esp_err_t nvs_transaction_set_int64(nvs_transaction_t tx, const char *key, int64_t value);
+esp_err_t nvs_transaction_set_uint64(nvs_transaction_t tx, const char *key, uint64_t value);
+esp_err_t nvs_transaction_set_string(nvs_transaction_t tx, const char *key, const char *value);
+esp_err_t nvs_transaction_set_float(nvs_transaction_t tx, const char *key, float value);
+esp_err_t nvs_transaction_set_double(nvs_transaction_t tx, const char *key, double value);
+esp_err_t nvs_transaction_set_blob(nvs_transaction_t tx, const char *key, const void *value, size_t length);
+
+/**
+ * @brief Apply all staged values and commit once. The transaction is freed in any case.
+ *
+ * Values are applied in the order they were first staged, the commit stops at the first failing key. The keys written
+ * before it keep their new values.
+ *
+ * @param[in] tx Transaction handle.
+ * @return
+ *         - ESP_OK if all values were written.
+ *         - The first error of nvs_transaction_set*() calls, if any (nothing is written then).
+ *         - One of the error codes of nvs_write_*() otherwise.
+ */
+esp_err_t nvs_transaction_commit(nvs_transaction_t tx);
+
+/**
+ * @brief Discard all staged values and free the transaction
+ */
+void nvs_transaction_abort(nvs_transaction_t tx);
+
+/* For example:
+
+    nvs_transaction_t tx;
+    ESP_ERROR_CHECK(nvs_transaction_begin("namespace_1", &tx));
+    nvs_transaction_set_uint16(tx, "key_1", 42);
+    nvs_transaction_set_string(tx, "key_2", "value");
+    ESP_ERROR_CHECK(nvs_transaction_commit(tx));
+
 */
 
 #ifdef __cplusplus
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Volodymyr Pavlusha
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef NON_VOLATILE_STORAGE_HOST_H_
+#define NON_VOLATILE_STORAGE_HOST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "non_volatile_storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * In-memory backend of non_volatile_storage.h for the linux target (host builds, tests and benchmarks).
+ *
+ * Values live in a hash map keyed by namespace, key and type, with the semantics of the flash backend:
+ * ESP_ERR_NVS_NOT_FOUND for a missing key or a read of another type, ESP_ERR_NVS_INVALID_LENGTH for a too short
+ * string or blob buffer, ESP_ERR_NVS_NOT_ENOUGH_SPACE when the map is full, transactions applied at commit, floats
+ * and doubles stored as u32 / u64 bit patterns (a legacy "%f" string is migrated on the first read), and the same
+ * write, key and namespace counters. Namespace handles are modelled as the open delay of the handle cache.
+ */
+
+#ifndef NVS_HOST_CAPACITY
+#define NVS_HOST_CAPACITY 256  // Maximum number of stored values
+#endif
+
+/**
+ * @brief Operations subject to fault injection and simulated latency
+ */
+typedef enum {
+    NVS_HOST_OP_READ   = (1 << 0),
+    NVS_HOST_OP_WRITE  = (1 << 1),
+    NVS_HOST_OP_COMMIT = (1 << 2),
+} nvs_host_op_t;
+
+/**
+ * @brief Drop all stored values, open handles, counters, faults and latencies
+ */
+void nvs_host_reset(void);
+
+/**
+ * @brief Fail the matching operations with the given error
+ *
+ * @param[in] ops Mask of nvs_host_op_t.
+ * @param[in] key Only this key (reads and writes), NULL for any key. Commits match any key.
+ * @param[in] err Error returned instead of performing the operation.
+ * @param[in] skip Number of matching operations to let pass first.
+ * @param[in] count Number of operations to fail, 0 - all following ones.
+ */
+void nvs_host_inject_fault(uint32_t ops, const char *key, esp_err_t err, uint32_t skip, uint32_t count);
+
+/**
+ * @brief Remove the injected fault
+ */
+void nvs_host_clear_fault(void);
+
+/**
+ * @brief Simulate the flash timing, every operation sleeps for the given time (0 - no delay)
+ */
+void nvs_host_set_latency(uint32_t read_us, uint32_t write_us, uint32_t commit_us);
+
+/**
+ * @brief Simulate the namespace handles: an open sleeps for open_us
+ *
+ * With cache set (the default), handles stay open as in the flash backend, NVS_HANDLE_CACHE_SIZE namespaces with the
+ * least recently used one closed first. Without it every access opens its namespace, as before the handle cache.
+ */
+void nvs_host_set_handles(uint32_t open_us, bool cache);
+
+/**
+ * @brief Number of namespace opens since nvs_host_reset()
+ */
+uint32_t nvs_host_open_count(void);
+
+/**
+ * @brief Number of stored values
+ */
+size_t nvs_host_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // NON_VOLATILE_STORAGE_HOST_H_
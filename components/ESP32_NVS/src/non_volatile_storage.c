@@ -7,16 +7,54 @@
 #include <nvs.h>
 #include <nvs_flash.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
 #include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "sdkconfig.h"
 
 static const char *TAG = "non_volatile_storage";
 
+// Successful reads and writes are logged at DEBUG, unless NVS_LOG_SUCCESS_AT_INFO is set
+#if NVS_LOG_SUCCESS_AT_INFO
+#define ESP32_NVS_SUCCESS_LEVEL         ESP_LOG_INFO
+#define ESP32_NVS_SUCCESS_LEVEL_NUM     3
+#else
+#define ESP32_NVS_SUCCESS_LEVEL         ESP_LOG_DEBUG
+#define ESP32_NVS_SUCCESS_LEVEL_NUM     4
+#endif
+#define ESP32_NVS_LOG_SUCCESS(format, ...) ESP_LOG_LEVEL_LOCAL(ESP32_NVS_SUCCESS_LEVEL, TAG, format, ##__VA_ARGS__)
+
+/*
+ * Handles are opened once per namespace and kept open, so a read or write costs one lookup instead of
+ * nvs_open + operation + nvs_close. Handles are opened read-write, so a read may create an empty namespace.
+ * The mutex is held for the whole operation, so a handle is never evicted or closed while in use.
+ */
+typedef struct {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    nvs_handle_t handle;
+    uint32_t last_used;
+    bool is_open;
+} esp32_nvs_cache_entry_t;
+
+static esp32_nvs_cache_entry_t handle_cache[NVS_HANDLE_CACHE_SIZE];
+static uint32_t handle_cache_clock = 0;
+static SemaphoreHandle_t handle_cache_mutex = NULL;
+static StaticSemaphore_t handle_cache_mutex_buffer;
+
+// Flash writes since boot, updated with the mutex held
+static nvs_write_stats_t write_stats;
+
 esp_err_t nvs_init(void)
 {
+    if (handle_cache_mutex == NULL) {
+        handle_cache_mutex = xSemaphoreCreateMutexStatic(&handle_cache_mutex_buffer);
+    }
+
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
@@ -25,46 +63,312 @@ esp_err_t nvs_init(void)
     return err;
 }
 
-static esp_err_t esp32_nvs_open(const char *namespace, nvs_open_mode_t open_mode, nvs_handle_t *nvs_handle)
+static esp_err_t esp32_nvs_lock(void)
+{
+    if (handle_cache_mutex == NULL) {
+        ESP_LOGE(TAG, "%s(): NVS is not initialized, call nvs_init() first!", __func__);
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(handle_cache_mutex, portMAX_DELAY);
+    return ESP_OK;
+}
+
+static void esp32_nvs_unlock(void)
+{
+    xSemaphoreGive(handle_cache_mutex);
+}
+
+// Commit an open handle, counted in write_stats. Must be called with the mutex held.
+static esp_err_t esp32_nvs_commit(nvs_handle_t nvs_handle)
+{
+    write_stats.commits++;
+    return nvs_commit(nvs_handle);
+}
+
+nvs_write_stats_t nvs_get_write_stats(void)
+{
+    nvs_write_stats_t stats = {0};
+    if (esp32_nvs_lock() == ESP_OK) {
+        stats = write_stats;
+        esp32_nvs_unlock();
+    }
+    return stats;
+}
+
+/*
+ * Access counters per key and namespace. Entries are taken in the order of the first access and never evicted,
+ * so the counters cover the whole time since boot (or nvs_reset_stats()). Updated with the mutex held.
+ */
+#if NVS_STATS_ENABLE
+static nvs_key_stats_t key_stats[NVS_STATS_MAX_KEYS];
+static size_t key_stats_count = 0;
+static nvs_namespace_stats_t namespace_stats[NVS_STATS_MAX_NAMESPACES];
+static size_t namespace_stats_count = 0;
+
+static nvs_namespace_stats_t *esp32_nvs_namespace_stats(const char *namespace)
+{
+    for (size_t i = 0; i < namespace_stats_count; i++) {
+        if (strncmp(namespace_stats[i].namespace, namespace, sizeof(namespace_stats[i].namespace)) == 0) {
+            return &namespace_stats[i];
+        }
+    }
+    if (namespace_stats_count == NVS_STATS_MAX_NAMESPACES) {
+        return NULL;
+    }
+    nvs_namespace_stats_t *entry = &namespace_stats[namespace_stats_count++];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->namespace, sizeof(entry->namespace), "%s", namespace);
+    return entry;
+}
+
+static nvs_key_stats_t *esp32_nvs_key_stats(const char *namespace, const char *key)
+{
+    for (size_t i = 0; i < key_stats_count; i++) {
+        if (strncmp(key_stats[i].key, key, sizeof(key_stats[i].key)) == 0
+            && strncmp(key_stats[i].namespace, namespace, sizeof(key_stats[i].namespace)) == 0) {
+            return &key_stats[i];
+        }
+    }
+    if (key_stats_count == NVS_STATS_MAX_KEYS) {
+        return NULL;
+    }
+    nvs_key_stats_t *entry = &key_stats[key_stats_count++];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->namespace, sizeof(entry->namespace), "%s", namespace);
+    snprintf(entry->key, sizeof(entry->key), "%s", key);
+    return entry;
+}
+
+// Size of a value for the byte counters, value as passed to esp32_nvs_get() / esp32_nvs_set()
+static size_t esp32_nvs_value_size(nvs_value_type_t type_value, const void *value, size_t length)
+{
+    switch (type_value) {
+        case NVS_VALUE_INT8:
+        case NVS_VALUE_UINT8:
+            return 1;
+        case NVS_VALUE_INT16:
+        case NVS_VALUE_UINT16:
+            return 2;
+        case NVS_VALUE_INT32:
+        case NVS_VALUE_UINT32:
+        case NVS_VALUE_FLOAT:
+            return 4;
+        case NVS_VALUE_STRING:
+            return strlen((const char *)value) + 1;
+        case NVS_VALUE_BLOB:
+            return length;
+        default:
+            return 8;
+    }
+}
+
+static void esp32_nvs_stats_access(const char *namespace, const char *key, bool write, size_t bytes, int64_t start_us)
+{
+    uint32_t time_us = (uint32_t)(esp_timer_get_time() - start_us);
+    nvs_namespace_stats_t *ns = esp32_nvs_namespace_stats(namespace);
+    nvs_key_stats_t *entry = esp32_nvs_key_stats(namespace, key);
+    if (ns != NULL) {
+        if (write) {
+            ns->writes++;
+            ns->bytes_written += bytes;
+        } else {
+            ns->reads++;
+            ns->bytes_read += bytes;
+        }
+        ns->time_us += time_us;
+        if (entry == NULL) {
+            ns->untracked++;
+        }
+    }
+    if (entry != NULL) {
+        if (write) {
+            entry->writes++;
+            entry->bytes_written += bytes;
+        } else {
+            entry->reads++;
+            entry->bytes_read += bytes;
+        }
+        entry->time_us += time_us;
+    }
+}
+
+static void esp32_nvs_stats_commit(const char *namespace, int64_t start_us)
+{
+    nvs_namespace_stats_t *ns = esp32_nvs_namespace_stats(namespace);
+    if (ns != NULL) {
+        ns->commits++;
+        ns->time_us += (uint32_t)(esp_timer_get_time() - start_us);
+    }
+}
+
+#define ESP32_NVS_STATS_START()     int64_t stats_start_us = esp_timer_get_time()
+#define ESP32_NVS_STATS_RESTART()   stats_start_us = esp_timer_get_time()
+#define ESP32_NVS_STATS_READ(namespace, key, type_value, value, length) \
+    esp32_nvs_stats_access(namespace, key, false, esp32_nvs_value_size(type_value, value, length), stats_start_us)
+#define ESP32_NVS_STATS_WRITE(namespace, key, type_value, value, length) \
+    esp32_nvs_stats_access(namespace, key, true, esp32_nvs_value_size(type_value, value, length), stats_start_us)
+#define ESP32_NVS_STATS_COMMIT(namespace)   esp32_nvs_stats_commit(namespace, stats_start_us)
+#else
+#define ESP32_NVS_STATS_START()
+#define ESP32_NVS_STATS_RESTART()
+#define ESP32_NVS_STATS_READ(namespace, key, type_value, value, length)
+#define ESP32_NVS_STATS_WRITE(namespace, key, type_value, value, length)
+#define ESP32_NVS_STATS_COMMIT(namespace)
+#endif  // NVS_STATS_ENABLE
+
+size_t nvs_get_key_stats(nvs_key_stats_t *stats, size_t max_count)
+{
+    size_t count = 0;
+#if NVS_STATS_ENABLE
+    if (stats != NULL && esp32_nvs_lock() == ESP_OK) {
+        count = key_stats_count < max_count ? key_stats_count : max_count;
+        memcpy(stats, key_stats, count * sizeof(nvs_key_stats_t));
+        esp32_nvs_unlock();
+    }
+#endif
+    return count;
+}
+
+size_t nvs_get_namespace_stats(nvs_namespace_stats_t *stats, size_t max_count)
+{
+    size_t count = 0;
+#if NVS_STATS_ENABLE
+    if (stats != NULL && esp32_nvs_lock() == ESP_OK) {
+        count = namespace_stats_count < max_count ? namespace_stats_count : max_count;
+        memcpy(stats, namespace_stats, count * sizeof(nvs_namespace_stats_t));
+        esp32_nvs_unlock();
+    }
+#endif
+    return count;
+}
+
+void nvs_reset_stats(void)
+{
+#if NVS_STATS_ENABLE
+    if (esp32_nvs_lock() == ESP_OK) {
+        key_stats_count = 0;
+        namespace_stats_count = 0;
+        esp32_nvs_unlock();
+    }
+#endif
+}
+
+// Get a cached handle for the namespace, open it if needed. Must be called with the mutex held.
+static esp_err_t esp32_nvs_open(const char *namespace, nvs_handle_t *nvs_handle)
 {
-    esp_err_t err = nvs_open(namespace, open_mode, nvs_handle); 
+    esp32_nvs_cache_entry_t *victim = &handle_cache[0];
+    for (int i = 0; i < NVS_HANDLE_CACHE_SIZE; i++) {
+        esp32_nvs_cache_entry_t *entry = &handle_cache[i];
+        if (entry->is_open && strncmp(entry->namespace, namespace, sizeof(entry->namespace)) == 0) {
+            entry->last_used = ++handle_cache_clock;
+            *nvs_handle = entry->handle;
+            return ESP_OK;
+        }
+        // Prefer a free slot, otherwise the least recently used one
+        if (victim->is_open && (!entry->is_open || entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+
+    if (victim->is_open) {
+        ESP_LOGD(TAG, "Closing cached NVS handle of namespace %s", victim->namespace);
+        nvs_close(victim->handle);
+        victim->is_open = false;
+    }
+
+    esp_err_t err = nvs_open(namespace, NVS_READWRITE, &victim->handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "%s(): Error opening NVS namespace %s: %d (%s)!", __func__, namespace, err, esp_err_to_name(err));
+        return err;
     }
-    return err;
+    snprintf(victim->namespace, sizeof(victim->namespace), "%s", namespace);
+    victim->last_used = ++handle_cache_clock;
+    victim->is_open = true;
+    *nvs_handle = victim->handle;
+    return ESP_OK;
 }
 
-static char* value_to_string(nvs_type_t type_value, const void *value) {
+esp_err_t nvs_flush(void)
+{
+    ESP_RETURN_ON_ERROR(esp32_nvs_lock(), TAG, "Failed to lock NVS");
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < NVS_HANDLE_CACHE_SIZE; i++) {
+        if (handle_cache[i].is_open) {
+            ESP32_NVS_STATS_START();
+            esp_err_t err = esp32_nvs_commit(handle_cache[i].handle);
+            ESP32_NVS_STATS_COMMIT(handle_cache[i].namespace);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to commit NVS namespace %s: %d (%s)!", handle_cache[i].namespace, err, esp_err_to_name(err));
+                ret = err;
+            }
+        }
+    }
+
+    esp32_nvs_unlock();
+    return ret;
+}
+
+esp_err_t nvs_close_all(void)
+{
+    ESP_RETURN_ON_ERROR(esp32_nvs_lock(), TAG, "Failed to lock NVS");
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < NVS_HANDLE_CACHE_SIZE; i++) {
+        if (handle_cache[i].is_open) {
+            ESP32_NVS_STATS_START();
+            esp_err_t err = esp32_nvs_commit(handle_cache[i].handle);
+            ESP32_NVS_STATS_COMMIT(handle_cache[i].namespace);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to commit NVS namespace %s: %d (%s)!", handle_cache[i].namespace, err, esp_err_to_name(err));
+                ret = err;
+            }
+            nvs_close(handle_cache[i].handle);
+            handle_cache[i].is_open = false;
+        }
+    }
+
+    esp32_nvs_unlock();
+    return ret;
+}
+
+static char* value_to_string(nvs_value_type_t type_value, const void *value) {
     char *string_value = NULL;
     int16_t ret = -1;
 
     switch(type_value) {
-        case NVS_TYPE_I8:
+        case NVS_VALUE_INT8:
             ret = asprintf(&string_value, "%d", *((int8_t*)value));
             break;
-        case NVS_TYPE_U8:
+        case NVS_VALUE_UINT8:
             ret = asprintf(&string_value, "%u", *((uint8_t*)value));
             break;
-        case NVS_TYPE_I16:
+        case NVS_VALUE_INT16:
             ret = asprintf(&string_value, "%d", *((int16_t*)value));
             break;
-        case NVS_TYPE_U16:
+        case NVS_VALUE_UINT16:
             ret = asprintf(&string_value, "%u", *((uint16_t*)value));
             break;
-        case NVS_TYPE_I32:
+        case NVS_VALUE_INT32:
             // Correct format specifier for int32_t
             ret = asprintf(&string_value, "%ld", *((int32_t*)value));
             break;
-        case NVS_TYPE_U32:
+        case NVS_VALUE_UINT32:
             // Correct format specifier for uint32_t
             ret = asprintf(&string_value, "%lu", *((uint32_t*)value));
             break;
-        case NVS_TYPE_I64:
+        case NVS_VALUE_INT64:
             ret = asprintf(&string_value, "%lld", *((int64_t*)value));
             break;
-        case NVS_TYPE_U64:
+        case NVS_VALUE_UINT64:
             ret = asprintf(&string_value, "%llu", *((uint64_t*)value));
             break;
+        case NVS_VALUE_FLOAT:
+            ret = asprintf(&string_value, "%f", *((float*)value));
+            break;
+        case NVS_VALUE_DOUBLE:
+            ret = asprintf(&string_value, "%lf", *((double*)value));
+            break;
         default:
             ret = asprintf(&string_value, "Unsupported type: %d", type_value);
             break;
@@ -77,7 +381,161 @@ static char* value_to_string(nvs_type_t type_value, const void *value) {
     return string_value;
 }
 
-static esp_err_t esp32_nvs_write(const char *namespace, const char *key, nvs_type_t type_value,
+/*
+ * Floats and doubles are stored as their bit patterns in u32 / u64 entries, so they round-trip exactly and are
+ * read without formatting or allocation. Older versions stored them as "%f" strings: such a value is parsed on
+ * the first read and replaced by the binary one, a write replaces it directly.
+ */
+_Static_assert(sizeof(float) == sizeof(uint32_t), "float must be 32 bits wide");
+_Static_assert(sizeof(double) == sizeof(uint64_t), "double must be 64 bits wide");
+
+#define MAX_STRING_LENGTH_FOR_LEGACY_REAL 64  // Maximum length of the float / double to string representation
+
+static esp_err_t esp32_nvs_set(nvs_handle_t nvs_handle, const char *key, nvs_value_type_t type_value,
+                               const void *value, size_t length);
+
+static esp_err_t esp32_nvs_set_real(nvs_handle_t nvs_handle, const char *key, nvs_value_type_t type_value, const void *value)
+{
+    // A legacy string entry would stay next to the binary one, NVS keys are unique per type only
+    nvs_type_t found_type;
+    if (nvs_find_key(nvs_handle, key, &found_type) == ESP_OK && found_type == NVS_TYPE_STR) {
+        ESP_RETURN_ON_ERROR(nvs_erase_key(nvs_handle, key), TAG, "Failed to erase legacy value %s", key);
+    }
+
+    if (type_value == NVS_VALUE_DOUBLE) {
+        uint64_t bits;
+        memcpy(&bits, value, sizeof(bits));
+        return nvs_set_u64(nvs_handle, key, bits);
+    }
+    uint32_t bits;
+    memcpy(&bits, value, sizeof(bits));
+    return nvs_set_u32(nvs_handle, key, bits);
+}
+
+static esp_err_t esp32_nvs_get_real(nvs_handle_t nvs_handle, const char *key, nvs_value_type_t type_value, void *value)
+{
+    esp_err_t err;
+    if (type_value == NVS_VALUE_DOUBLE) {
+        uint64_t bits;
+        err = nvs_get_u64(nvs_handle, key, &bits);
+        if (err == ESP_OK) {
+            memcpy(value, &bits, sizeof(bits));
+        }
+    } else {
+        uint32_t bits;
+        err = nvs_get_u32(nvs_handle, key, &bits);
+        if (err == ESP_OK) {
+            memcpy(value, &bits, sizeof(bits));
+        }
+    }
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+
+    // Legacy string format
+    char string[MAX_STRING_LENGTH_FOR_LEGACY_REAL];
+    size_t length = sizeof(string);
+    err = nvs_get_str(nvs_handle, key, string, &length);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (type_value == NVS_VALUE_DOUBLE) {
+        *(double*)value = strtod(string, NULL);
+    } else {
+        *(float*)value = strtof(string, NULL);
+    }
+
+    // The value is valid even if the migration fails, it is retried on the next read
+    esp_err_t migrate_err = esp32_nvs_set(nvs_handle, key, type_value, value, 0);
+    if (migrate_err == ESP_OK) {
+        migrate_err = esp32_nvs_commit(nvs_handle);
+    }
+    if (migrate_err == ESP_OK) {
+        ESP32_NVS_LOG_SUCCESS("Migrated %s from string \"%s\" to binary format", key, string);
+    } else {
+        ESP_LOGE(TAG, "Failed to migrate %s to binary format: %d (%s)", key, migrate_err, esp_err_to_name(migrate_err));
+    }
+    return ESP_OK;
+}
+
+// Set one value on an open handle, without commit
+static esp_err_t esp32_nvs_set_value(nvs_handle_t nvs_handle, const char *key, nvs_value_type_t type_value,
+                               const void *value, size_t length)
+{
+    switch (type_value) {
+        case NVS_VALUE_INT8:
+            return nvs_set_i8(nvs_handle, key, *(int8_t*)value);
+        case NVS_VALUE_UINT8:
+            return nvs_set_u8(nvs_handle, key, *(uint8_t*)value);
+        case NVS_VALUE_INT16:
+            return nvs_set_i16(nvs_handle, key, *(int16_t*)value);
+        case NVS_VALUE_UINT16:
+            return nvs_set_u16(nvs_handle, key, *(uint16_t*)value);
+        case NVS_VALUE_INT32:
+            return nvs_set_i32(nvs_handle, key, *(int32_t*)value);
+        case NVS_VALUE_UINT32:
+            return nvs_set_u32(nvs_handle, key, *(uint32_t*)value);
+        case NVS_VALUE_INT64:
+            return nvs_set_i64(nvs_handle, key, *(int64_t*)value);
+        case NVS_VALUE_UINT64:
+            return nvs_set_u64(nvs_handle, key, *(uint64_t*)value);
+        case NVS_VALUE_STRING:
+            return nvs_set_str(nvs_handle, key, (char*)value);
+        case NVS_VALUE_FLOAT:
+        case NVS_VALUE_DOUBLE:
+            return esp32_nvs_set_real(nvs_handle, key, type_value, value);
+        case NVS_VALUE_BLOB:
+            return nvs_set_blob(nvs_handle, key, value, length);
+        default:
+            return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+}
+
+// Set one value on an open handle, counted in write_stats. Must be called with the mutex held.
+static esp_err_t esp32_nvs_set(nvs_handle_t nvs_handle, const char *key, nvs_value_type_t type_value,
+                               const void *value, size_t length)
+{
+    esp_err_t err = esp32_nvs_set_value(nvs_handle, key, type_value, value, length);
+    if (err == ESP_OK) {
+        write_stats.writes++;
+    }
+    return err;
+}
+
+// Get one value on an open handle, strings are read into a buffer of the given length
+static esp_err_t esp32_nvs_get(nvs_handle_t nvs_handle, const char *key, nvs_value_type_t type_value,
+                               void *value, size_t length)
+{
+    switch (type_value) {
+        case NVS_VALUE_INT8:
+            return nvs_get_i8(nvs_handle, key, (int8_t*)value);
+        case NVS_VALUE_UINT8:
+            return nvs_get_u8(nvs_handle, key, (uint8_t*)value);
+        case NVS_VALUE_INT16:
+            return nvs_get_i16(nvs_handle, key, (int16_t*)value);
+        case NVS_VALUE_UINT16:
+            return nvs_get_u16(nvs_handle, key, (uint16_t*)value);
+        case NVS_VALUE_INT32:
+            return nvs_get_i32(nvs_handle, key, (int32_t*)value);
+        case NVS_VALUE_UINT32:
+            return nvs_get_u32(nvs_handle, key, (uint32_t*)value);
+        case NVS_VALUE_INT64:
+            return nvs_get_i64(nvs_handle, key, (int64_t*)value);
+        case NVS_VALUE_UINT64:
+            return nvs_get_u64(nvs_handle, key, (uint64_t*)value);
+        case NVS_VALUE_STRING:
+            return nvs_get_str(nvs_handle, key, (char*)value, &length);
+        case NVS_VALUE_FLOAT:
+        case NVS_VALUE_DOUBLE:
+            return esp32_nvs_get_real(nvs_handle, key, type_value, value);
+        case NVS_VALUE_BLOB:
+            return nvs_get_blob(nvs_handle, key, value, &length);
+        default:
+            return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+}
+
+static esp_err_t esp32_nvs_write(const char *namespace, const char *key, nvs_value_type_t type_value,
                                  const void *value, size_t length)
 {
     if (namespace == NULL) {
@@ -93,65 +551,39 @@ static esp_err_t esp32_nvs_write(const char *namespace, const char *key, nvs_typ
         return ESP_ERR_INVALID_ARG;
     }
 
+    ESP_RETURN_ON_ERROR(esp32_nvs_lock(), TAG, "Failed to lock NVS");
+
     nvs_handle_t nvs_handle;
-    esp_err_t err = esp32_nvs_open(namespace, NVS_READWRITE, &nvs_handle);
+    esp_err_t err = esp32_nvs_open(namespace, &nvs_handle);
     if (err != ESP_OK) {
+        esp32_nvs_unlock();
         return err;
     }
 
-    switch (type_value) {
-        case NVS_TYPE_I8:
-            err = nvs_set_i8(nvs_handle, key, *(int8_t*)value);
-            break;
-        case NVS_TYPE_U8:
-            err = nvs_set_u8(nvs_handle, key, *(uint8_t*)value);
-            break;
-        case NVS_TYPE_I16:
-            err = nvs_set_i16(nvs_handle, key, *(int16_t*)value);
-            break;
-        case NVS_TYPE_U16:
-            err = nvs_set_u16(nvs_handle, key, *(uint16_t*)value);
-            break;
-        case NVS_TYPE_I32:
-            err = nvs_set_i32(nvs_handle, key, *(int32_t*)value);
-            break;
-        case NVS_TYPE_U32:
-            err = nvs_set_u32(nvs_handle, key, *(uint32_t*)value);
-            break;
-        case NVS_TYPE_I64:
-            err = nvs_set_i64(nvs_handle, key, *(int64_t*)value);
-            break;
-        case NVS_TYPE_U64:
-            err = nvs_set_u64(nvs_handle, key, *(uint64_t*)value);
-            break;
-        case NVS_TYPE_STR:
-            err = nvs_set_str(nvs_handle, key, (char*)value);
-            break;
-        case NVS_TYPE_BLOB:
-            err = nvs_set_blob(nvs_handle, key, value, length);
-            break;
-        default:
-            err = ESP_ERR_NVS_TYPE_MISMATCH;
-            break;
-    }
-
+    ESP32_NVS_STATS_START();
+    err = esp32_nvs_set(nvs_handle, key, type_value, value, length);
     if (err == ESP_OK) {
-        err = nvs_commit(nvs_handle);
+        ESP32_NVS_STATS_WRITE(namespace, key, type_value, value, length);
+        ESP32_NVS_STATS_RESTART();
+        err = esp32_nvs_commit(nvs_handle);
+        ESP32_NVS_STATS_COMMIT(namespace);
         if (err == ESP_OK) {
             switch (type_value) {
-                case NVS_TYPE_STR:
-                    ESP_LOGI(TAG, "Successfully write string to NVS %s.%s: %s", namespace, key, (const char *) value);
+                case NVS_VALUE_STRING:
+                    ESP32_NVS_LOG_SUCCESS("Successfully write string to NVS %s.%s: %s", namespace, key, (const char *) value);
                     break;
-                case NVS_TYPE_BLOB:
-                    ESP_LOGI(TAG, "Successfully write blob to NVS %s.%s", namespace, key);
+                case NVS_VALUE_BLOB:
+                    ESP32_NVS_LOG_SUCCESS("Successfully write blob to NVS %s.%s", namespace, key);
                     break;
                 default:
-                    #if CONFIG_LOG_MAXIMUM_LEVEL >= CONFIG_LOG_DEFAULT_LEVEL_INFO
+                    #if CONFIG_LOG_MAXIMUM_LEVEL >= ESP32_NVS_SUCCESS_LEVEL_NUM
+                    if (esp_log_level_get(TAG) >= ESP32_NVS_SUCCESS_LEVEL) {
                         char *string_value = value_to_string(type_value, value);
                         if (string_value != NULL) {
-                            ESP_LOGI(TAG, "Successfully write value to NVS %s.%s: %s", namespace, key, string_value);
+                            ESP32_NVS_LOG_SUCCESS("Successfully write value to NVS %s.%s: %s", namespace, key, string_value);
                             free(string_value);
                         }
+                    }
                     #endif  // CONFIG_LOG_MAXIMUM_LEVEL
                     break;
             }
@@ -160,93 +592,71 @@ static esp_err_t esp32_nvs_write(const char *namespace, const char *key, nvs_typ
         ESP_LOGE(TAG, "Failed to write to NVS %s.%s: %d (%s)!", namespace, key, err, esp_err_to_name(err));
     }
 
-    nvs_close(nvs_handle);
+    esp32_nvs_unlock();
     return err;
 }
 
 esp_err_t nvs_write_int8(const char *namespace, const char *key, int8_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_I8, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_INT8, &value, 0);
 }
 
 esp_err_t nvs_write_uint8(const char *namespace, const char *key, uint8_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_U8, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_UINT8, &value, 0);
 }
 
 esp_err_t nvs_write_int16(const char *namespace, const char *key, int16_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_I16, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_INT16, &value, 0);
 }
 
 esp_err_t nvs_write_uint16(const char *namespace, const char *key, uint16_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_U16, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_UINT16, &value, 0);
 }
 
 esp_err_t nvs_write_int32(const char *namespace, const char *key, int32_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_I32, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_INT32, &value, 0);
 }
 
 esp_err_t nvs_write_uint32(const char *namespace, const char *key, uint32_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_U32, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_UINT32, &value, 0);
 }
 
 esp_err_t nvs_write_int64(const char *namespace, const char *key, int64_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_I64, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_INT64, &value, 0);
 }
 
 esp_err_t nvs_write_uint64(const char *namespace, const char *key, uint64_t value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_U64, &value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_UINT64, &value, 0);
 }
 
 esp_err_t nvs_write_string(const char *namespace, const char *key, const char *value)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_STR, value, 0);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_STRING, value, 0);
 }
 
-#define MAX_STRING_LENGTH_FOR_FLOAT 32  // Maximum length of the float to string representation
 esp_err_t nvs_write_float(const char *namespace, const char *key, float value)
 {
-    char string[MAX_STRING_LENGTH_FOR_FLOAT];
-    int32_t result = snprintf(string, sizeof(string), "%f", value);
-
-    esp_err_t err;
-    if (result >= 0 && result < sizeof(string)) {
-        err = esp32_nvs_write(namespace, key, NVS_TYPE_STR, &string, 0);
-    } else {
-        err = ESP_FAIL;
-        ESP_LOGE(TAG, "%s(): Error occurred during formatting", __func__);
-    }
-    return err;
+    return esp32_nvs_write(namespace, key, NVS_VALUE_FLOAT, &value, 0);
 }
 
-#define MAX_STRING_LENGTH_FOR_DOUBLE 64  // Maximum length of the double to string representation
 esp_err_t nvs_write_double(const char *namespace, const char *key, double value)
 {
-    char string[MAX_STRING_LENGTH_FOR_DOUBLE];
-    int32_t result = snprintf(string, sizeof(string), "%lf", value);
-
-    esp_err_t err;
-    if (result >= 0 && result < sizeof(string)) {
-        err = esp32_nvs_write(namespace, key, NVS_TYPE_STR, &string, 0);
-    } else {
-        err = ESP_FAIL;
-        ESP_LOGE(TAG, "%s(): Error occurred during formatting", __func__);
-    }
-    return err;
+    return esp32_nvs_write(namespace, key, NVS_VALUE_DOUBLE, &value, 0);
 }
 
 esp_err_t nvs_write_blob(const char *namespace, const char *key, const void *value, size_t length)
 {
-    return esp32_nvs_write(namespace, key, NVS_TYPE_BLOB, value, length);
+    return esp32_nvs_write(namespace, key, NVS_VALUE_BLOB, value, length);
 }
 
-static esp_err_t esp32_nvs_read(const char *namespace, const char *key, nvs_type_t type_value,
+static esp_err_t esp32_nvs_read(const char *namespace, const char *key, nvs_value_type_t type_value,
                                 void *value, size_t length)
 {
     if (namespace == NULL) {
@@ -257,88 +667,64 @@ static esp_err_t esp32_nvs_read(const char *namespace, const char *key, nvs_type
         ESP_LOGE(TAG, "%s(): Failed to read value: key is NULL!", __func__);
         return ESP_ERR_INVALID_ARG;
     }
-    if (type_value != NVS_TYPE_STR) {
-        if (value == NULL) {
-            ESP_LOGE(TAG, "%s(): Failed to read NULL value!", __func__);
-            return ESP_ERR_INVALID_ARG;
-        }
+    if (value == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to read NULL value!", __func__);
+        return ESP_ERR_INVALID_ARG;
     }
 
+    ESP_RETURN_ON_ERROR(esp32_nvs_lock(), TAG, "Failed to lock NVS");
+
     nvs_handle_t nvs_handle;
-    esp_err_t err = esp32_nvs_open(namespace, NVS_READONLY, &nvs_handle);
+    esp_err_t err = esp32_nvs_open(namespace, &nvs_handle);
     if (err != ESP_OK) {
+        esp32_nvs_unlock();
         return err;
     }
 
-    switch (type_value) {
-        case NVS_TYPE_I8:
-            err = nvs_get_i8(nvs_handle, key, (int8_t*)value);
-            break;
-        case NVS_TYPE_U8:
-            err = nvs_get_u8(nvs_handle, key, (uint8_t*)value);
-            break;
-        case NVS_TYPE_I16:
-            err = nvs_get_i16(nvs_handle, key, (int16_t*)value);
-            break;
-        case NVS_TYPE_U16:
-            err = nvs_get_u16(nvs_handle, key, (uint16_t*)value);
-            break;
-        case NVS_TYPE_I32:
-            err = nvs_get_i32(nvs_handle, key, (int32_t*)value);
-            break;
-        case NVS_TYPE_U32:
-            err = nvs_get_u32(nvs_handle, key, (uint32_t*)value);
-            break;
-        case NVS_TYPE_I64:
-            err = nvs_get_i64(nvs_handle, key, (int64_t*)value);
-            break;
-        case NVS_TYPE_U64:
-            err = nvs_get_u64(nvs_handle, key, (uint64_t*)value);
-            break;
-        case NVS_TYPE_STR:
-            size_t required_string_size = 0;
-            err = nvs_get_str(nvs_handle, key, NULL, &required_string_size);
-
-            if (err == ESP_OK) {
-                *(char**)value = malloc(required_string_size);
-                if (*(char**)value != NULL) {
-                    err = nvs_get_str(nvs_handle, key, *(char**)value, &required_string_size);
-                } else {
-                    err = ESP_ERR_NO_MEM;
-                    ESP_LOGE(TAG, "%s(): Failed to allocate memory", __func__);
-                }
+    ESP32_NVS_STATS_START();
+    if (type_value == NVS_VALUE_STRING && length == 0) {
+        size_t required_string_size = 0;
+        err = nvs_get_str(nvs_handle, key, NULL, &required_string_size);
+
+        if (err == ESP_OK) {
+            *(char**)value = malloc(required_string_size);
+            if (*(char**)value != NULL) {
+                err = nvs_get_str(nvs_handle, key, *(char**)value, &required_string_size);
+            } else {
+                err = ESP_ERR_NO_MEM;
+                ESP_LOGE(TAG, "%s(): Failed to allocate memory", __func__);
             }
-            break;
-        case NVS_TYPE_BLOB:
-            size_t required_blob_size = length;
-            err = nvs_get_blob(nvs_handle, key, value, &required_blob_size);
-            break;
-        default:
-            err = ESP_ERR_NVS_TYPE_MISMATCH;
-            break;
+        }
+    } else {
+        err = esp32_nvs_get(nvs_handle, key, type_value, value, length);
     }
 
     switch (err) {
         case ESP_OK:
+            ESP32_NVS_STATS_READ(namespace, key, type_value, type_value == NVS_VALUE_STRING && length == 0 ? *(char**)value : value, length);
             switch (type_value) {
-                case NVS_TYPE_STR:
-                    ESP_LOGI(TAG, "Successfully read string from NVS %s.%s: %s", namespace, key, *(char**)value);
+                case NVS_VALUE_STRING:
+                    ESP32_NVS_LOG_SUCCESS("Successfully read string from NVS %s.%s: %s", namespace, key,
+                                          length == 0 ? *(char**)value : (char*)value);
                     break;
-                case NVS_TYPE_BLOB:
-                    ESP_LOGI(TAG, "Successfully read blob from NVS %s.%s", namespace, key);
+                case NVS_VALUE_BLOB:
+                    ESP32_NVS_LOG_SUCCESS("Successfully read blob from NVS %s.%s", namespace, key);
                     break;
                 default:
-                    #if CONFIG_LOG_MAXIMUM_LEVEL >= CONFIG_LOG_DEFAULT_LEVEL_INFO
+                    #if CONFIG_LOG_MAXIMUM_LEVEL >= ESP32_NVS_SUCCESS_LEVEL_NUM
+                    if (esp_log_level_get(TAG) >= ESP32_NVS_SUCCESS_LEVEL) {
                         char *string_value = value_to_string(type_value, value);
                         if (string_value != NULL) {
-                            ESP_LOGI(TAG, "Successfully read value from NVS %s.%s: %s", namespace, key, string_value);
+                            ESP32_NVS_LOG_SUCCESS("Successfully read value from NVS %s.%s: %s", namespace, key, string_value);
                             free(string_value);
                         }
+                    }
                     #endif  // CONFIG_LOG_MAXIMUM_LEVEL
                     break;
             }
             break;
         case ESP_ERR_NVS_NOT_FOUND:
+            ESP32_NVS_STATS_READ(namespace, key, NVS_VALUE_BLOB, NULL, 0);
             ESP_LOGW(TAG, "Value %s.%s is not initialized yet", namespace, key);
             break;
         default:
@@ -346,78 +732,423 @@ static esp_err_t esp32_nvs_read(const char *namespace, const char *key, nvs_type
             break;
     }
     
-    nvs_close(nvs_handle);
+    esp32_nvs_unlock();
     return err;
 }
 
 esp_err_t nvs_read_int8(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_I8, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_INT8, out_value, 0);
 }
 
 esp_err_t nvs_read_uint8(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_U8, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_UINT8, out_value, 0);
 }
 
 esp_err_t nvs_read_int16(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_I16, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_INT16, out_value, 0);
 }
 
 esp_err_t nvs_read_uint16(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_U16, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_UINT16, out_value, 0);
 }
 
 esp_err_t nvs_read_int32(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_I32, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_INT32, out_value, 0);
 }
 
 esp_err_t nvs_read_uint32(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_U32, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_UINT32, out_value, 0);
 }
 
 esp_err_t nvs_read_int64(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_I64, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_INT64, out_value, 0);
 }
 
 esp_err_t nvs_read_uint64(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_U64, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_UINT64, out_value, 0);
 }
 
 esp_err_t nvs_read_string(const char *namespace, const char *key, void *out_value)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_STR, out_value, 0);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_STRING, out_value, 0);
+}
+
+esp_err_t nvs_read_string_into(const char *namespace, const char *key, char *out_value, size_t length)
+{
+    if (length == 0) {
+        ESP_LOGE(TAG, "%s(): Failed to read string %s: buffer length is 0!", __func__, key != NULL ? key : "");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return esp32_nvs_read(namespace, key, NVS_VALUE_STRING, out_value, length);
 }
 
 esp_err_t nvs_read_float(const char *namespace, const char *key, void *out_value)
 {
-    char *string = NULL;
-    esp_err_t err = esp32_nvs_read(namespace, key, NVS_TYPE_STR, &string, 0);
-    if (err == ESP_OK) {
-        *(float*)out_value = strtof(string, NULL);
-        free(string);
+    return esp32_nvs_read(namespace, key, NVS_VALUE_FLOAT, out_value, 0);
+}
+
+esp_err_t nvs_read_double(const char *namespace, const char *key, void *out_value)
+{
+    return esp32_nvs_read(namespace, key, NVS_VALUE_DOUBLE, out_value, 0);
+}
+
+esp_err_t nvs_read_blob(const char *namespace, const char *key, void *out_value, size_t length)
+{
+    return esp32_nvs_read(namespace, key, NVS_VALUE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_read_batch(const char *namespace, nvs_batch_item_t *items, size_t count)
+{
+    if (namespace == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to read values: namespace is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (items == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to read values: items are NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].key == NULL || items[i].value == NULL) {
+            ESP_LOGE(TAG, "%s(): Failed to read values: key or value of item %u is NULL!", __func__, (unsigned)i);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    ESP_RETURN_ON_ERROR(esp32_nvs_lock(), TAG, "Failed to lock NVS");
+
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = esp32_nvs_open(namespace, &nvs_handle);
+    if (ret != ESP_OK) {
+        esp32_nvs_unlock();
+        for (size_t i = 0; i < count; i++) {
+            items[i].result = ret;
+        }
+        return ret;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        nvs_batch_item_t *item = &items[i];
+        ESP32_NVS_STATS_START();
+        item->result = esp32_nvs_get(nvs_handle, item->key, item->type, item->value, item->length);
+
+        switch (item->result) {
+            case ESP_OK:
+                ESP32_NVS_STATS_READ(namespace, item->key, item->type, item->value, item->length);
+                ESP_LOGD(TAG, "Successfully read value from NVS %s.%s", namespace, item->key);
+                break;
+            case ESP_ERR_NVS_NOT_FOUND:
+                ESP32_NVS_STATS_READ(namespace, item->key, NVS_VALUE_BLOB, NULL, 0);
+                ESP_LOGW(TAG, "Value %s.%s is not initialized yet", namespace, item->key);
+                if (ret == ESP_OK) {
+                    ret = item->result;
+                }
+                break;
+            default:
+                ESP_LOGE(TAG, "Failed to read from NVS %s.%s: %d (%s)", namespace, item->key, item->result, esp_err_to_name(item->result));
+                if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) {
+                    ret = item->result;
+                }
+                break;
+        }
+    }
+
+    esp32_nvs_unlock();
+    return ret;
+}
+
+/*
+ * Transactions stage copies of the values, nothing touches NVS before the commit. The values are then applied
+ * under the same mutex as all other operations, so no reader of this library observes a half-applied update.
+ */
+#define NVS_TRANSACTION_INITIAL_CAPACITY 8
+
+typedef struct {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_value_type_t type;
+    union {
+        int8_t i8;
+        uint8_t u8;
+        int16_t i16;
+        uint16_t u16;
+        int32_t i32;
+        uint32_t u32;
+        int64_t i64;
+        uint64_t u64;
+        float f;
+        double d;
+    } number;
+    void *data;             // copy of the string or blob, NULL for numbers
+    size_t length;
+} esp32_nvs_staged_t;
+
+struct nvs_transaction {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    esp32_nvs_staged_t *items;
+    size_t count;
+    size_t capacity;
+    esp_err_t error;        // first staging error, reported by the commit
+};
+
+static size_t esp32_nvs_number_size(nvs_value_type_t type_value)
+{
+    switch (type_value) {
+        case NVS_VALUE_INT8:
+        case NVS_VALUE_UINT8:
+            return sizeof(uint8_t);
+        case NVS_VALUE_INT16:
+        case NVS_VALUE_UINT16:
+            return sizeof(uint16_t);
+        case NVS_VALUE_INT32:
+        case NVS_VALUE_UINT32:
+            return sizeof(uint32_t);
+        case NVS_VALUE_INT64:
+        case NVS_VALUE_UINT64:
+            return sizeof(uint64_t);
+        case NVS_VALUE_FLOAT:
+            return sizeof(float);
+        case NVS_VALUE_DOUBLE:
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+static void esp32_nvs_transaction_free(nvs_transaction_t tx)
+{
+    for (size_t i = 0; i < tx->count; i++) {
+        free(tx->items[i].data);
+    }
+    free(tx->items);
+    free(tx);
+}
+
+esp_err_t nvs_transaction_begin(const char *namespace, nvs_transaction_t *out_tx)
+{
+    if (namespace == NULL || out_tx == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to begin transaction: namespace or handle is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE) {
+        ESP_LOGE(TAG, "%s(): Failed to begin transaction: namespace %s is too long!", __func__, namespace);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_transaction_t tx = calloc(1, sizeof(struct nvs_transaction));
+    if (tx == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to allocate memory", __func__);
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(tx->namespace, sizeof(tx->namespace), "%s", namespace);
+    *out_tx = tx;
+    return ESP_OK;
+}
+
+static esp_err_t esp32_nvs_stage(nvs_transaction_t tx, const char *key, nvs_value_type_t type,
+                                 const void *value, size_t length)
+{
+    if (key == NULL || value == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to stage value: key or value is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        ESP_LOGE(TAG, "%s(): Failed to stage value: key %s is too long!", __func__, key);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ((unsigned)type > NVS_VALUE_BLOB) {
+        ESP_LOGE(TAG, "%s(): Failed to stage value %s: unsupported type %d", __func__, key, type);
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    void *data = NULL;
+    if (type == NVS_VALUE_STRING || type == NVS_VALUE_BLOB) {
+        if (type == NVS_VALUE_STRING) {
+            length = strlen((const char*)value) + 1;
+        }
+        data = malloc(length > 0 ? length : 1);
+        if (data == NULL) {
+            ESP_LOGE(TAG, "%s(): Failed to allocate memory", __func__);
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(data, value, length);
+    }
+
+    // A key staged again replaces the previous value
+    esp32_nvs_staged_t *item = NULL;
+    for (size_t i = 0; i < tx->count; i++) {
+        if (strcmp(tx->items[i].key, key) == 0) {
+            item = &tx->items[i];
+            free(item->data);
+            break;
+        }
+    }
+
+    if (item == NULL) {
+        if (tx->count == tx->capacity) {
+            size_t capacity = tx->capacity > 0 ? tx->capacity * 2 : NVS_TRANSACTION_INITIAL_CAPACITY;
+            esp32_nvs_staged_t *items = realloc(tx->items, capacity * sizeof(esp32_nvs_staged_t));
+            if (items == NULL) {
+                free(data);
+                ESP_LOGE(TAG, "%s(): Failed to allocate memory", __func__);
+                return ESP_ERR_NO_MEM;
+            }
+            tx->items = items;
+            tx->capacity = capacity;
+        }
+        item = &tx->items[tx->count++];
+        snprintf(item->key, sizeof(item->key), "%s", key);
+    }
+
+    item->type = type;
+    item->data = data;
+    item->length = length;
+    if (data == NULL) {
+        memcpy(&item->number, value, esp32_nvs_number_size(type));
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_transaction_set(nvs_transaction_t tx, const char *key, nvs_value_type_t type, const void *value, size_t length)
+{
+    if (tx == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to stage value: transaction is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = esp32_nvs_stage(tx, key, type, value, length);
+    if (err != ESP_OK && tx->error == ESP_OK) {
+        tx->error = err;
     }
     return err;
 }
 
-esp_err_t nvs_read_double(const char *namespace, const char *key, void *out_value)
+esp_err_t nvs_transaction_set_int8(nvs_transaction_t tx, const char *key, int8_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT8, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint8(nvs_transaction_t tx, const char *key, uint8_t value)
 {
-    char *string = NULL;
-    esp_err_t err = esp32_nvs_read(namespace, key, NVS_TYPE_STR, &string, 0);
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT8, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_int16(nvs_transaction_t tx, const char *key, int16_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT16, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint16(nvs_transaction_t tx, const char *key, uint16_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT16, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_int32(nvs_transaction_t tx, const char *key, int32_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT32, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint32(nvs_transaction_t tx, const char *key, uint32_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT32, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_int64(nvs_transaction_t tx, const char *key, int64_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_INT64, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_uint64(nvs_transaction_t tx, const char *key, uint64_t value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_UINT64, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_string(nvs_transaction_t tx, const char *key, const char *value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_STRING, value, 0);
+}
+
+esp_err_t nvs_transaction_set_float(nvs_transaction_t tx, const char *key, float value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_FLOAT, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_double(nvs_transaction_t tx, const char *key, double value)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_DOUBLE, &value, 0);
+}
+
+esp_err_t nvs_transaction_set_blob(nvs_transaction_t tx, const char *key, const void *value, size_t length)
+{
+    return nvs_transaction_set(tx, key, NVS_VALUE_BLOB, value, length);
+}
+
+static esp_err_t esp32_nvs_apply(nvs_transaction_t tx)
+{
+    ESP_RETURN_ON_ERROR(esp32_nvs_lock(), TAG, "Failed to lock NVS");
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = esp32_nvs_open(tx->namespace, &nvs_handle);
+    if (err != ESP_OK) {
+        esp32_nvs_unlock();
+        return err;
+    }
+
+    for (size_t i = 0; i < tx->count; i++) {
+        esp32_nvs_staged_t *item = &tx->items[i];
+        const void *value = item->data != NULL ? item->data : (const void*)&item->number;
+        ESP32_NVS_STATS_START();
+        err = esp32_nvs_set(nvs_handle, item->key, item->type, value, item->length);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write to NVS %s.%s: %d (%s)!", tx->namespace, item->key, err, esp_err_to_name(err));
+            break;
+        }
+        ESP32_NVS_STATS_WRITE(tx->namespace, item->key, item->type, value, item->length);
+        ESP_LOGD(TAG, "Successfully staged value to NVS %s.%s", tx->namespace, item->key);
+    }
+
     if (err == ESP_OK) {
-        *(double*)out_value = strtod(string, NULL);
-        free(string);
+        ESP32_NVS_STATS_START();
+        err = esp32_nvs_commit(nvs_handle);
+        ESP32_NVS_STATS_COMMIT(tx->namespace);
+    }
+
+    esp32_nvs_unlock();
+
+    if (err == ESP_OK) {
+        ESP32_NVS_LOG_SUCCESS("Successfully committed %u values to NVS namespace %s", (unsigned)tx->count, tx->namespace);
     }
     return err;
 }
 
-esp_err_t nvs_read_blob(const char *namespace, const char *key, void *out_value, size_t length)
+esp_err_t nvs_transaction_commit(nvs_transaction_t tx)
 {
-    return esp32_nvs_read(namespace, key, NVS_TYPE_BLOB, out_value, length);
+    if (tx == NULL) {
+        ESP_LOGE(TAG, "%s(): Failed to commit: transaction is NULL!", __func__);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = tx->error;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Transaction on NVS namespace %s discarded, a value could not be staged: %d (%s)", tx->namespace, err, esp_err_to_name(err));
+    } else if (tx->count > 0) {
+        err = esp32_nvs_apply(tx);
+    }
+
+    esp32_nvs_transaction_free(tx);
+    return err;
+}
+
+void nvs_transaction_abort(nvs_transaction_t tx)
+{
+    if (tx != NULL) {
+        esp32_nvs_transaction_free(tx);
+    }
 }
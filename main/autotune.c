@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "common.h"
+#include "autotune.h"
+#include "radio.h"
+#include "power.h"
+#include "settings.h"
+#include "non_volatile_storage.h"
+
+autotune_result_t autotune_result;
+
+static volatile bool autotune_requested = false;
+
+/**
+ * Candidate intervals between samples, ms.
+ * Sampling delays are rounded down to RTOS ticks. A candidate below one tick (1 ms at CONFIG_FREERTOS_HZ=100) means
+ * back-to-back reads, closer than the burst grid can model, so it is skipped and the search starts at one tick.
+ */
+static const uint16_t autotune_interval_candidates[] = { 1, 10, 20, 50, 100 };
+
+typedef struct {
+    adc_oneshot_unit_handle_t adc_handle;
+    adc_channel_t channel;
+    int16_t *samples;
+    size_t count;
+    volatile size_t captured;
+    SemaphoreHandle_t done;
+} autotune_burst_t;
+
+/**
+ * @brief: Load the last stored auto-tune result from NVS (if any)
+ */
+esp_err_t autotune_init(void) {
+    memset(&autotune_result, 0, sizeof(autotune_result));
+    if (nvs_read_blob(S_NAMESPACE, S_KEY_SENSOR_AUTOTUNE_RESULT, &autotune_result, sizeof(autotune_result)) != ESP_OK) {
+        memset(&autotune_result, 0, sizeof(autotune_result));
+        ESP_LOGI(TAG, "No stored auto-tune result found");
+    }
+    return ESP_OK;
+}
+
+void autotune_request(void) {
+    autotune_requested = true;
+}
+
+bool autotune_take_request(void) {
+    bool requested = autotune_requested;
+    autotune_requested = false;
+    return requested;
+}
+
+/**
+ * @brief: esp_timer callback collecting one burst sample on the 1 ms grid
+ */
+static void autotune_burst_cb(void *arg) {
+    autotune_burst_t *burst = (autotune_burst_t *)arg;
+    if (burst->captured >= burst->count) {
+        return;
+    }
+
+    int adc_raw = 0;
+    if (adc_oneshot_read(burst->adc_handle, burst->channel, &adc_raw) != ESP_OK) {
+        // keep the grid regular: repeat the previous sample on a failed read
+        adc_raw = burst->captured > 0 ? burst->samples[burst->captured - 1] : 0;
+    }
+    burst->samples[burst->captured++] = (int16_t)adc_raw;
+
+    if (burst->captured == burst->count) {
+        xSemaphoreGive(burst->done);
+    }
+}
+
+/**
+ * @brief: Allan deviation (in uV) of the mean of `n` samples taken every `step` points of the burst grid.
+ *
+ * All decimation phases of the burst are used to improve the estimate. Returns UINT32_MAX if the burst is too
+ * short to provide AUTOTUNE_MIN_BLOCKS blocks.
+ */
+static uint32_t autotune_allan_deviation_uv(const int16_t *mv, size_t count, size_t step, size_t n) {
+    uint64_t sum_sq = 0;
+    size_t diffs = 0;
+
+    for (size_t offset = 0; offset < step && offset < count; offset++) {
+        size_t len = (count - offset - 1) / step + 1;
+        size_t blocks = len / n;
+        if (blocks < AUTOTUNE_MIN_BLOCKS) {
+            continue;
+        }
+
+        int32_t prev_sum = 0;
+        for (size_t b = 0; b < blocks; b++) {
+            int32_t block_sum = 0;
+            for (size_t i = 0; i < n; i++) {
+                block_sum += mv[offset + (b * n + i) * step];
+            }
+            if (b > 0) {
+                int64_t d = (int64_t)block_sum - prev_sum;
+                sum_sq += (uint64_t)(d * d);
+                diffs++;
+            }
+            prev_sum = block_sum;
+        }
+    }
+
+    if (diffs == 0) {
+        return UINT32_MAX;
+    }
+
+    // block sums are n times the block means
+    double variance = (double)sum_sq / ((double)n * n) / (2.0 * diffs);
+    return (uint32_t)(sqrt(variance) * 1000.0);
+}
+
+/**
+ * @brief: Capture a long burst, pick the cheapest sampling parameters meeting the noise target and store them in NVS.
+ */
+esp_err_t autotune_run(adc_oneshot_unit_handle_t adc_handle, adc_cali_handle_t adc_cali_handle, adc_channel_t channel, bool do_calibration) {
+
+    if (!do_calibration) {
+        ESP_LOGE(TAG, "Auto-tune requires ADC calibration. Skipped.");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Noise target of the current settings
+    settings_values_t *values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Memory allocation failed");
+        return ESP_ERR_NO_MEM;
+    }
+    settings_set_defaults(values);
+    settings_load(values);
+    uint16_t noise_target_uv = values->sensor_noise_tg;
+    free(values);
+
+    ESP_LOGI(TAG, "Auto-tune started: capturing %d samples, noise target %u uV", AUTOTUNE_BURST_SAMPLES, noise_target_uv);
+
+    // Measure the cost of a single ADC read
+    int adc_raw;
+    const int timing_reads = 32;
+    int64_t t_start = esp_timer_get_time();
+    for (int i = 0; i < timing_reads; i++) {
+        ESP_ERROR_CHECK(adc_oneshot_read(adc_handle, channel, &adc_raw));
+    }
+    uint32_t adc_read_us = (uint32_t)((esp_timer_get_time() - t_start) / timing_reads);
+
+    // Capture the burst on a regular 1 ms grid
+    autotune_burst_t burst = {
+        .adc_handle = adc_handle,
+        .channel = channel,
+        .samples = (int16_t *)malloc(AUTOTUNE_BURST_SAMPLES * sizeof(int16_t)),
+        .count = AUTOTUNE_BURST_SAMPLES,
+        .captured = 0,
+        .done = xSemaphoreCreateBinary(),
+    };
+    if (burst.samples == NULL || burst.done == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for auto-tune burst");
+        free(burst.samples);
+        if (burst.done) vSemaphoreDelete(burst.done);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_timer_handle_t burst_timer;
+    esp_timer_create_args_t timer_args = {
+        .callback = autotune_burst_cb,
+        .arg = &burst,
+        .name = "autotune_burst",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &burst_timer));
+    power_sampling_begin();
+    radio_sampling_begin();
+    ESP_ERROR_CHECK(esp_timer_start_periodic(burst_timer, AUTOTUNE_BURST_PERIOD_US));
+
+    TickType_t burst_timeout = pdMS_TO_TICKS((AUTOTUNE_BURST_SAMPLES * AUTOTUNE_BURST_PERIOD_US) / 1000 + 2000);
+    bool captured = xSemaphoreTake(burst.done, burst_timeout) == pdTRUE;
+    esp_timer_stop(burst_timer);
+    radio_sampling_end();
+    power_sampling_end();
+    esp_timer_delete(burst_timer);
+    vSemaphoreDelete(burst.done);
+
+    if (!captured) {
+        ESP_LOGE(TAG, "Auto-tune burst timed out after %u samples", (unsigned int) burst.captured);
+        free(burst.samples);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Convert to millivolts in place and collect single-sample statistics
+    int64_t sum = 0;
+    int64_t sum_sq = 0;
+    for (size_t i = 0; i < burst.count; i++) {
+        int voltage_mv = 0;
+        adc_cali_raw_to_voltage(adc_cali_handle, burst.samples[i], &voltage_mv);
+        burst.samples[i] = (int16_t)voltage_mv;
+        sum += voltage_mv;
+        sum_sq += (int64_t)voltage_mv * voltage_mv;
+    }
+    double mean_mv = (double)sum / burst.count;
+    double raw_variance = (double)sum_sq / burst.count - mean_mv * mean_mv;
+    double raw_noise_mv = raw_variance > 0 ? sqrt(raw_variance) : 0;
+
+    // Search for the cheapest (shortest cycle, then fewest reads) combination meeting the noise target
+    autotune_result_t best = { 0 };
+    autotune_result_t quietest = { 0 };
+    best.cycle_time_ms = UINT32_MAX;
+    quietest.expected_noise_uv = UINT32_MAX;
+
+    for (size_t c = 0; c < sizeof(autotune_interval_candidates) / sizeof(autotune_interval_candidates[0]); c++) {
+        uint16_t smp_int = autotune_interval_candidates[c];
+        if (smp_int < SENSOR_SAMPLING_INTERVAL_MIN || smp_int > SENSOR_SAMPLING_INTERVAL_MAX) {
+            continue;
+        }
+        TickType_t ticks = pdMS_TO_TICKS(smp_int);
+        if (ticks == 0) {
+            continue;
+        }
+        uint32_t delay_ms = ticks * portTICK_PERIOD_MS;
+        size_t step = delay_ms * 1000 / AUTOTUNE_BURST_PERIOD_US;
+
+        for (uint16_t n = SENSOR_SAMPLING_COUNT_MIN; n <= SENSOR_SAMPLING_COUNT_MAX; n++) {
+            uint32_t noise_uv = autotune_allan_deviation_uv(burst.samples, burst.count, step, n);
+            if (noise_uv == UINT32_MAX) {
+                break;  // longer blocks won't fit into the burst either
+            }
+
+            uint32_t cycle_time_ms = (uint32_t)(n * (delay_ms * 1000 + adc_read_us) / 1000);
+
+            if (noise_uv < quietest.expected_noise_uv) {
+                quietest.sensor_samples = n;
+                quietest.sensor_smp_int = smp_int;
+                quietest.expected_noise_uv = noise_uv;
+                quietest.cycle_time_ms = cycle_time_ms;
+            }
+
+            if (noise_uv <= noise_target_uv) {
+                if (cycle_time_ms < best.cycle_time_ms ||
+                    (cycle_time_ms == best.cycle_time_ms && n < best.sensor_samples)) {
+                    best.sensor_samples = n;
+                    best.sensor_smp_int = smp_int;
+                    best.expected_noise_uv = noise_uv;
+                    best.cycle_time_ms = cycle_time_ms;
+                    best.target_met = true;
+                }
+                break;  // more samples at this interval only cost more
+            }
+        }
+    }
+    free(burst.samples);
+
+    if (!best.target_met) {
+        if (quietest.expected_noise_uv == UINT32_MAX) {
+            ESP_LOGE(TAG, "Auto-tune was unable to evaluate any sampling configuration");
+            return ESP_FAIL;
+        }
+        ESP_LOGW(TAG, "Noise target %u uV is not reachable, using the quietest configuration (%lu uV)",
+                    noise_target_uv, (unsigned long) quietest.expected_noise_uv);
+        best = quietest;
+        best.target_met = false;
+    }
+
+    // Filtering threshold: keep samples within AUTOTUNE_DEVIATION_SIGMAS of the median
+    uint16_t sensor_deviate = S_DEFAULT_SENSOR_SAMPLING_MEDIAN_DEVIATION;
+    if (mean_mv > 0) {
+        sensor_deviate = (uint16_t) ceil(AUTOTUNE_DEVIATION_SIGMAS * raw_noise_mv / mean_mv * 100.0);
+    }
+    if (sensor_deviate < SENSOR_SAMPLING_MEDIAN_DEVIATION_MIN) sensor_deviate = SENSOR_SAMPLING_MEDIAN_DEVIATION_MIN;
+    if (sensor_deviate > SENSOR_SAMPLING_MEDIAN_DEVIATION_MAX) sensor_deviate = SENSOR_SAMPLING_MEDIAN_DEVIATION_MAX;
+
+    best.sensor_deviate = sensor_deviate;
+    best.noise_target_uv = noise_target_uv;
+    best.raw_noise_uv = (uint32_t)(raw_noise_mv * 1000.0);
+    best.cycle_cpu_us = best.sensor_samples * adc_read_us;
+    best.adc_read_us = adc_read_us;
+    best.valid = true;
+
+    ESP_LOGI(TAG, "Auto-tune result: samples=%u, interval=%u ms, deviation=%u%%, noise %lu uV (single sample %lu uV), "
+                  "cycle time %lu ms, CPU %lu us",
+                best.sensor_samples, best.sensor_smp_int, best.sensor_deviate,
+                (unsigned long) best.expected_noise_uv, (unsigned long) best.raw_noise_uv,
+                (unsigned long) best.cycle_time_ms, (unsigned long) best.cycle_cpu_us);
+
+    // Store the selection through the settings, so the settings blob follows and the sampler reloads its snapshot
+    values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Memory allocation failed");
+        return ESP_ERR_NO_MEM;
+    }
+    settings_set_defaults(values);
+    settings_load(values);
+    values->sensor_samples = best.sensor_samples;
+    values->sensor_smp_int = best.sensor_smp_int;
+    values->sensor_deviate = best.sensor_deviate;
+
+    esp_err_t err = settings_save(values, SETTING_FLAG_SAMPLING, NULL);
+    free(values);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to apply the auto-tune result: %s", esp_err_to_name(err));
+        return err;
+    }
+    autotune_result = best;     // in effect from the next cycle, whether stored yet or not
+
+    // Written now rather than after the coalescing window, together with the result. A failed flush is retried by
+    // the settings module, the result is stored again by the next auto-tune.
+    err = settings_flush();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store the tuned sampling settings: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_write_blob(S_NAMESPACE, S_KEY_SENSOR_AUTOTUNE_RESULT, &best, sizeof(best));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store the auto-tune result: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,54 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+
+#include "common.h"
+
+#define AUTOTUNE_BURST_SAMPLES      4096        // Number of samples captured during the auto-tune burst
+#define AUTOTUNE_BURST_PERIOD_US    1000        // Burst sampling period (1 ms grid)
+#define AUTOTUNE_MIN_BLOCKS         3           // Minimal number of averaging blocks to estimate Allan deviation
+#define AUTOTUNE_DEVIATION_SIGMAS   4           // Filtering threshold expressed in single-sample standard deviations
+
+/**
+ * Auto-tune results
+ */
+typedef struct {
+    uint16_t sensor_samples;        // chosen number of samples per measurement
+    uint16_t sensor_smp_int;        // chosen interval between samples, ms
+    uint16_t sensor_deviate;        // chosen median filtering threshold, %
+    uint16_t noise_target_uv;       // noise target the selection was made against, uV
+    uint32_t raw_noise_uv;          // single-sample standard deviation, uV
+    uint32_t expected_noise_uv;     // expected noise of the averaged reading (Allan deviation), uV
+    uint32_t cycle_time_ms;         // expected wall time of one measurement, ms
+    uint32_t cycle_cpu_us;          // expected CPU time spent in ADC reads per measurement, us
+    uint32_t adc_read_us;           // measured duration of a single ADC read, us
+    bool target_met;                // whether the noise target could be reached within the settings limits
+    bool valid;                     // results are present
+} autotune_result_t;
+
+extern autotune_result_t autotune_result;
+
+/**
+ * @brief Load the last stored auto-tune result from NVS (if any)
+ */
+esp_err_t autotune_init(void);
+
+/**
+ * @brief Ask the sensor task to run auto-tune before the next measurement
+ */
+void autotune_request(void);
+
+/**
+ * @brief Check (and clear) the pending auto-tune request
+ */
+bool autotune_take_request(void);
+
+/**
+ * @brief Capture a long burst, pick the cheapest sampling parameters meeting the noise target
+ *        and store them in NVS.
+ */
+esp_err_t autotune_run(adc_oneshot_unit_handle_t adc_handle, adc_cali_handle_t adc_cali_handle, adc_channel_t channel, bool do_calibration);
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "esp_attr.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+
+#include "common.h"
+#include "deep_sleep.h"
+#include "settings.h"
+#include "sensor.h"
+#include "mqtt.h"
+#include "wifi.h"
+#include "web.h"
+#include "hass.h"
+#include "radio.h"
+#include "power.h"
+#include "rules.h"
+#include "non_volatile_storage.h"
+
+/**
+ * Deep sleep cycle: after a cold boot the device runs normally for DEEP_SLEEP_CONFIG_WINDOW_MS, so it can
+ * be configured, then caches everything a measurement needs in RTC memory and sleeps. Every timer wake-up
+ * samples before the radio is turned on, reconnects to the last access point without scanning, publishes
+ * the reading together with the readings the broker missed and the alarm state changes, and sleeps again.
+ * Settings are not loaded, the alarm rules are evaluated from the set compiled before the cycle was entered.
+ */
+
+static RTC_DATA_ATTR deep_sleep_state_t rtc_state;
+
+// Wall clock keeps running through the deep sleep, esp_timer restarts at every boot
+static int64_t deep_sleep_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+bool deep_sleep_is_cycle_wake(void) {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && rtc_state.magic == DEEP_SLEEP_STATE_MAGIC;
+}
+
+static void deep_sleep_start(void) {
+    uint64_t interval_us = (uint64_t)rtc_state.sleep_interval * 1000000ULL;
+    uint64_t awake_us = (uint64_t)esp_timer_get_time();
+    uint64_t sleep_us = interval_us > awake_us ? interval_us - awake_us : interval_us;
+
+    ESP_LOGI(TAG, "Entering deep sleep for %llu ms (%u readings pending)", sleep_us / 1000, rtc_state.pending_count);
+    settings_flush();
+    nvs_close_all();
+    esp_sleep_enable_timer_wakeup(sleep_us);
+    esp_deep_sleep_start();
+}
+
+// Keep the newest readings when the batch is full, the rollup covers the dropped ones too
+static void deep_sleep_record(const sensor_data_t *data) {
+    deep_sleep_rollup_t *rollup = &rtc_state.rollup;
+    if (rollup->count == 0 || data->pressure < rollup->min) {
+        rollup->min = data->pressure;
+    }
+    if (rollup->count == 0 || data->pressure > rollup->max) {
+        rollup->max = data->pressure;
+    }
+    rollup->sum += data->pressure;
+    rollup->count++;
+
+    if (rtc_state.pending_count >= DEEP_SLEEP_BATCH_MAX) {
+        memmove(&rtc_state.pending[0], &rtc_state.pending[1], sizeof(rtc_state.pending[0]) * (DEEP_SLEEP_BATCH_MAX - 1));
+        rtc_state.pending_count = DEEP_SLEEP_BATCH_MAX - 1;
+        rtc_state.dropped++;
+    }
+    deep_sleep_reading_t *reading = &rtc_state.pending[rtc_state.pending_count++];
+    reading->time = deep_sleep_time_us() / 1000000LL;
+    reading->pressure = data->pressure;
+    reading->voltage = data->voltage;
+    reading->fault_flags = data->fault_flags;
+}
+
+static void deep_sleep_delivered(void) {
+    rtc_state.pending_count = 0;
+    rtc_state.dropped = 0;
+    memset(&rtc_state.rollup, 0, sizeof(rtc_state.rollup));
+}
+
+// Wait for the QoS 1 acknowledges, so nothing is lost when the chip powers down
+static bool deep_sleep_wait_acked(void) {
+    int waited_ms = 0;
+    while (radio_get_stats().publishes_in_flight > 0) {
+        if (waited_ms >= DEEP_SLEEP_ACK_TIMEOUT_MS || !mqtt_is_connected()) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DEEP_SLEEP_POLL_MS));
+        waited_ms += DEEP_SLEEP_POLL_MS;
+    }
+    return true;
+}
+
+static bool deep_sleep_wifi_connect(void) {
+    initialize_wifi();
+
+    // The cached BSSID and channel are for this boot only, do not persist them into the Wi-Fi NVS storage
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    if (rtc_state.wifi_valid) {
+        wifi_config_t wifi_config;
+        if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+            memcpy(wifi_config.sta.bssid, rtc_state.wifi_bssid, sizeof(wifi_config.sta.bssid));
+            wifi_config.sta.bssid_set = true;
+            wifi_config.sta.channel = rtc_state.wifi_channel;
+            if (esp_wifi_set_config(WIFI_IF_STA, &wifi_config) != ESP_OK) {
+                ESP_LOGW(TAG, "Failed to apply the cached Wi-Fi parameters, scanning");
+            }
+        }
+    }
+    start_wifi(true);
+
+    int waited_ms = 0;
+    while (!g_wifi_ready) {
+        if (waited_ms >= DEEP_SLEEP_WIFI_TIMEOUT_MS) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DEEP_SLEEP_POLL_MS));
+        waited_ms += DEEP_SLEEP_POLL_MS;
+    }
+    return true;
+}
+
+static void deep_sleep_publish_alarms(bool *sent) {
+    for (int i = 0; i < rtc_state.rules.count; i++) {
+        alarm_rule_t *rule = &rtc_state.rules.rules[i];
+        sent[i] = rule->unsent && mqtt_publish_alarm(rule->name, rule->active, &sensor_data) == ESP_OK;
+        if (rule->unsent && !sent[i]) {
+            ESP_LOGW(TAG, "Alarm '%s' not published, retrying with the next wake-up", rule->name);
+        }
+    }
+}
+
+static bool deep_sleep_publish(void) {
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(radio_init());
+    init_filesystem();      // CA certificate for mqtts
+
+    if (!deep_sleep_wifi_connect()) {
+        ESP_LOGW(TAG, "Network is not reachable, keeping the reading for the next wake-up");
+        rtc_state.wifi_valid = false;   // the access point may have moved, scan next time
+        return false;
+    }
+
+    if (mqtt_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Unable to start MQTT client, keeping the reading for the next wake-up");
+        return false;
+    }
+    int waited_ms = 0;
+    while (!mqtt_is_connected()) {
+        if (waited_ms >= DEEP_SLEEP_MQTT_TIMEOUT_MS) {
+            ESP_LOGW(TAG, "Broker is not reachable, keeping the reading for the next wake-up");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DEEP_SLEEP_POLL_MS));
+        waited_ms += DEEP_SLEEP_POLL_MS;
+    }
+
+    bool published = (mqtt_publish_sensor_data(&sensor_data) == ESP_OK);
+    bool alarms_sent[RULES_MAX];
+    deep_sleep_publish_alarms(alarms_sent);
+
+    // The batch carries the boot-to-publish time of the previous wake-up, this one is known after the acknowledge
+    char *batch = serialize_deep_sleep_batch(&rtc_state, deep_sleep_time_us() / 1000000LL);
+    if (batch == NULL || mqtt_publish_sensor_batch(batch) != ESP_OK) {
+        published = false;
+    }
+    free(batch);
+
+    if (!deep_sleep_wait_acked()) {
+        ESP_LOGW(TAG, "Publishes were not acknowledged, keeping the readings for the next wake-up");
+        return false;
+    }
+    for (int i = 0; i < rtc_state.rules.count; i++) {
+        if (alarms_sent[i]) {
+            rtc_state.rules.rules[i].unsent = false;
+        }
+    }
+    return published;
+}
+
+void deep_sleep_run_cycle(void) {
+    rtc_state.wake_count++;
+    ESP_LOGI(TAG, "Deep sleep wake-up #%lu", (unsigned long)rtc_state.wake_count);
+
+    // Sample first, while the radio is still off
+    adc_oneshot_unit_handle_t adc1_handle;
+    adc_cali_handle_t adc1_cali_handle = NULL;
+    bool do_calibration = sensor_adc_init(&adc1_handle, &adc1_cali_handle);
+    uint32_t fault_flags = SENSOR_FAULT_NONE;
+    sensor_data.voltage_raw = perform_smart_sampling(adc1_cali_handle, adc1_handle, PRESSURE_SENSOR_PIN, do_calibration, &rtc_state.sampling, &fault_flags);
+    ESP_ERROR_CHECK(adc_oneshot_del_unit(adc1_handle));
+    if (do_calibration) {
+        sensor_adc_calibration_deinit(adc1_cali_handle);
+    }
+
+    sensor_data.fault_flags = fault_flags;
+    sensor_data.voltage = sensor_data.voltage_raw / 1000.0;
+    sensor_data.voltage_offset = rtc_state.voltage_offset;
+    sensor_data.sensor_linear_multiplier = rtc_state.sensor_linear_multiplier;
+    sensor_data.pressure = (sensor_data.voltage - sensor_data.voltage_offset) * sensor_data.sensor_linear_multiplier;
+    sensor_data.pressure_rate = sensor_estimator_update(&rtc_state.estimator, sensor_data.pressure, deep_sleep_time_us());
+    deep_sleep_record(&sensor_data);
+    rules_update(&rtc_state.rules, &sensor_data);
+
+    ESP_LOGI(TAG, "Raw ADC Value: %d, Voltage: %.3f V, Pressure: %.2f Pa",
+             sensor_data.voltage_raw, sensor_data.voltage, sensor_data.pressure);
+
+    if (_DEVICE_ENABLE_MQTT && rtc_state.mqtt_connect > MQTT_SENSOR_MODE_DISABLE) {
+        if (deep_sleep_publish()) {
+            rtc_state.boot_to_publish_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            ESP_LOGI(TAG, "Published %u readings, boot to publish %lu ms", rtc_state.pending_count, (unsigned long)rtc_state.boot_to_publish_ms);
+            deep_sleep_delivered();
+        }
+    } else {
+        deep_sleep_delivered();     // nowhere to deliver
+        for (int i = 0; i < rtc_state.rules.count; i++) {
+            rtc_state.rules.rules[i].unsent = false;
+        }
+    }
+
+    deep_sleep_start();
+}
+
+bool deep_sleep_due(void) {
+    return power_get_stats().mode == POWER_MODE_DEEP_SLEEP && esp_timer_get_time() >= DEEP_SLEEP_CONFIG_WINDOW_MS * 1000LL;
+}
+
+void deep_sleep_enter(const sensor_estimator_t *estimator) {
+    // From settings_load(): the per-key entries may not have the saves of the last SETTINGS_COMMIT_DELAY_MS yet
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for the settings, deep sleep postponed");
+        return;
+    }
+    settings_set_defaults(values);
+    settings_load(values);
+    rtc_state.sampling.samples = values->sensor_samples;
+    rtc_state.sampling.interval = values->sensor_smp_int;
+    rtc_state.sampling.deviation = values->sensor_deviate;
+    rtc_state.voltage_offset = values->sensor_offset;
+    rtc_state.sensor_linear_multiplier = values->sensor_linear_multiplier;
+    rtc_state.mqtt_connect = values->mqtt_connect;
+    rtc_state.sleep_interval = values->sleep_interval;
+    free(values);
+    if (rtc_state.sleep_interval < SLEEP_INTERVAL_MIN) {
+        rtc_state.sleep_interval = SLEEP_INTERVAL_MIN;
+    }
+
+    // The alarm states continue across the switch, an edge not published yet is published with the first wake-up
+    rules_get(&rtc_state.rules);
+
+    // Move the estimator to the wall clock time base
+    rtc_state.estimator = *estimator;
+    rtc_state.estimator.last_time_us = deep_sleep_time_us() - (esp_timer_get_time() - estimator->last_time_us);
+
+    deep_sleep_delivered();
+    rtc_state.wake_count = 0;
+    rtc_state.boot_to_publish_ms = 0;
+    rtc_state.magic = DEEP_SLEEP_STATE_MAGIC;
+
+    if (!deep_sleep_wait_acked()) {
+        ESP_LOGW(TAG, "Entering deep sleep with unacknowledged publishes");
+    }
+    ESP_LOGI(TAG, "Configuration window is over, switching to the deep sleep cycle (every %lu s)", (unsigned long)rtc_state.sleep_interval);
+    deep_sleep_start();
+}
+
+void deep_sleep_cache_wifi(void) {
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        memcpy(rtc_state.wifi_bssid, ap_info.bssid, sizeof(rtc_state.wifi_bssid));
+        rtc_state.wifi_channel = ap_info.primary;
+        rtc_state.wifi_valid = true;
+    }
+}
+
+deep_sleep_stats_t deep_sleep_get_stats(void) {
+    deep_sleep_stats_t stats = {
+        .wake_count = rtc_state.wake_count,
+        .pending = rtc_state.pending_count,
+        .dropped = rtc_state.dropped,
+        .boot_to_publish_ms = rtc_state.boot_to_publish_ms,
+    };
+    return stats;
+}
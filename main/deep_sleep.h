@@ -0,0 +1,120 @@
+#ifndef DEEP_SLEEP_H
+#define DEEP_SLEEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "common.h"
+#include "sensor.h"
+#include "rules.h"
+
+#define DEEP_SLEEP_STATE_MAGIC          0x50534453  // "PSDS"
+#define DEEP_SLEEP_BATCH_MAX            32          // readings kept while the broker is unreachable
+#define DEEP_SLEEP_CONFIG_WINDOW_MS     120000      // after a cold boot the device stays awake for configuration
+#define DEEP_SLEEP_WIFI_TIMEOUT_MS      10000       // maximal wait for the network after a wake-up
+#define DEEP_SLEEP_MQTT_TIMEOUT_MS      5000        // maximal wait for the broker connection after a wake-up
+#define DEEP_SLEEP_ACK_TIMEOUT_MS       3000        // maximal wait for QoS 1 acknowledges before sleeping
+#define DEEP_SLEEP_POLL_MS              20
+
+/**
+ * Reading waiting for delivery
+ */
+typedef struct {
+    int64_t time;               // wall clock time of the reading, s (RTC time base, not necessarily synchronized)
+    float pressure;             // Pa
+    float voltage;              // V
+    uint32_t fault_flags;       // SENSOR_FAULT_* flags
+} deep_sleep_reading_t;
+
+/**
+ * Min / max / average of the readings since the last successful publish, including the dropped ones
+ */
+typedef struct {
+    float min;
+    float max;
+    double sum;
+    uint32_t count;
+} deep_sleep_rollup_t;
+
+/**
+ * State retained in RTC memory across the deep sleep cycles
+ */
+typedef struct {
+    uint32_t magic;                 // DEEP_SLEEP_STATE_MAGIC when the state below is valid
+
+    // configuration cached from the settings when the cycle was entered
+    sensor_sampling_t sampling;
+    float voltage_offset;
+    uint32_t sensor_linear_multiplier;
+    uint32_t sleep_interval;        // s
+    uint16_t mqtt_connect;          // mqtt_connection_mode_t
+
+    // alarm rules compiled by the awake firmware, with their last state
+    alarm_rule_set_t rules;
+
+    // Wi-Fi parameters of the last successful connection (skips the scan)
+    bool wifi_valid;
+    uint8_t wifi_bssid[6];
+    uint8_t wifi_channel;
+
+    // filter state and rollups
+    sensor_estimator_t estimator;   // time base is the wall clock, us
+    deep_sleep_rollup_t rollup;
+
+    // readings not delivered yet, oldest first
+    deep_sleep_reading_t pending[DEEP_SLEEP_BATCH_MAX];
+    uint16_t pending_count;
+    uint32_t dropped;               // readings dropped because the batch was full
+
+    // statistics
+    uint32_t wake_count;
+    uint32_t boot_to_publish_ms;    // last successful wake-up, from boot to the broker acknowledge
+} deep_sleep_state_t;
+
+/**
+ * Deep sleep cycle statistics
+ */
+typedef struct {
+    uint32_t wake_count;
+    uint16_t pending;
+    uint32_t dropped;
+    uint32_t boot_to_publish_ms;
+} deep_sleep_stats_t;
+
+/**
+ * @brief Check if the device woke up from a deep sleep cycle with a valid retained state
+ */
+bool deep_sleep_is_cycle_wake(void);
+
+/**
+ * @brief Run one cycle from the retained state: sample, evaluate the alarm rules, connect with the cached parameters,
+ *        publish the reading, the undelivered batch and the alarm state changes, go back to deep sleep. Does not return.
+ */
+void deep_sleep_run_cycle(void);
+
+/**
+ * @brief Check if the sensor task should hand over to the deep sleep cycle
+ *        (deep sleep power mode and the configuration window is over)
+ */
+bool deep_sleep_due(void);
+
+/**
+ * @brief Cache the configuration and the filter state in RTC memory and enter the deep sleep cycle. Does not return,
+ *        unless the settings cannot be loaded (the next sensor cycle tries again).
+ *
+ * @param estimator     estimator state with the esp_timer time base
+ */
+void deep_sleep_enter(const sensor_estimator_t *estimator);
+
+/**
+ * @brief Remember the parameters of the current Wi-Fi connection for the fast reconnect
+ */
+void deep_sleep_cache_wifi(void);
+
+/**
+ * @brief Get the statistics
+ */
+deep_sleep_stats_t deep_sleep_get_stats(void);
+
+#endif
@@ -0,0 +1,113 @@
+#include <string.h>
+
+#include "form.h"
+
+static int form_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Pass the value collected so far to the callback
+static void form_flush(form_parser_t *parser, bool last) {
+    if (parser->err == ESP_OK && !parser->skip && parser->key_length > 0) {
+        parser->err = parser->value(parser->key, parser->chunk, parser->used, last, parser->ctx);
+    }
+    parser->used = 0;
+}
+
+// Decoded character of the key or the value
+static void form_put(form_parser_t *parser, char c) {
+    if (!parser->in_value) {
+        if (parser->key_length < FORM_KEY_LENGTH) {
+            parser->key[parser->key_length++] = c;
+        } else {
+            parser->skip = true;
+        }
+        return;
+    }
+    if (parser->used == sizeof(parser->chunk)) {
+        form_flush(parser, false);
+    }
+    parser->chunk[parser->used++] = c;
+}
+
+// Not an escape after all: keep the '%' and the digit seen
+static void form_escape_literal(form_parser_t *parser) {
+    int digits = parser->escape;
+    parser->escape = 0;
+    form_put(parser, '%');
+    if (digits > 1) {
+        form_put(parser, parser->escape_digit);
+    }
+}
+
+// End of the field, '&' or the end of the body
+static void form_field_end(form_parser_t *parser) {
+    if (parser->escape) {
+        form_escape_literal(parser);
+    }
+    parser->key[parser->key_length] = '\0';
+    form_flush(parser, true);
+    parser->key_length = 0;
+    parser->in_value = false;
+    parser->skip = false;
+}
+
+void form_parser_init(form_parser_t *parser, form_value_t value, void *ctx) {
+    memset(parser, 0, sizeof(*parser));
+    parser->value = value;
+    parser->ctx = ctx;
+}
+
+esp_err_t form_parser_feed(form_parser_t *parser, const char *data, size_t length) {
+    for (size_t i = 0; i < length && parser->err == ESP_OK; i++) {
+        char c = data[i];
+        if (parser->escape) {
+            int digit = form_hex(c);
+            if (digit >= 0 && parser->escape == 1) {
+                parser->escape = 2;
+                parser->escape_digit = c;
+                continue;
+            }
+            if (digit >= 0) {
+                parser->escape = 0;
+                form_put(parser, (char)((form_hex(parser->escape_digit) << 4) | digit));
+                continue;
+            }
+            form_escape_literal(parser);    // c is taken as it is below
+        }
+
+        switch (c) {
+            case '%':
+                parser->escape = 1;
+                break;
+            case '+':
+                form_put(parser, ' ');
+                break;
+            case '&':
+                form_field_end(parser);
+                break;
+            case '=':
+                if (!parser->in_value) {
+                    parser->key[parser->key_length] = '\0';
+                    parser->in_value = true;
+                } else {
+                    form_put(parser, c);
+                }
+                break;
+            default:
+                form_put(parser, c);
+                break;
+        }
+    }
+    return parser->err;
+}
+
+esp_err_t form_parser_finish(form_parser_t *parser) {
+    if (parser->err == ESP_OK && (parser->key_length > 0 || parser->in_value || parser->escape)) {
+        form_field_end(parser);
+    }
+    return parser->err;
+}
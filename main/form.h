@@ -0,0 +1,61 @@
+#ifndef FORM_H
+#define FORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define FORM_KEY_LENGTH         32          // longest field name, fields of longer names are skipped
+#define FORM_VALUE_CHUNK        64          // the decoded value is passed on in pieces of this size
+
+/**
+ * Streaming parser of application/x-www-form-urlencoded bodies
+ *
+ * The body is fed in chunks as it arrives, split anywhere (also inside a %XX escape). Keys and values are decoded on
+ * the fly (%XX and '+'), the decoded value goes to a callback in pieces, so neither the body nor a whole value has
+ * to fit in memory. Malformed escapes are kept as they are, fields without a name are skipped, a field without '='
+ * has an empty value.
+ */
+
+/**
+ * @brief Receive a piece of the decoded value of the field key
+ *
+ * Called at least once per field, the last piece (last is true) might be empty. An error stops the parsing and is
+ * returned by the following form_parser_feed() / form_parser_finish().
+ */
+typedef esp_err_t (*form_value_t)(const char *key, const char *data, size_t length, bool last, void *ctx);
+
+/**
+ * Parser state, kept between the chunks
+ */
+typedef struct {
+    char key[FORM_KEY_LENGTH + 1];
+    size_t key_length;
+    bool in_value;              // the key is complete, '=' seen
+    bool skip;                  // the key is too long, the field is ignored
+    char chunk[FORM_VALUE_CHUNK];
+    size_t used;
+    int escape;                 // digits of the pending %XX escape seen so far, 0 - no escape
+    char escape_digit;
+    esp_err_t err;              // first callback error, the rest of the body is ignored
+    form_value_t value;
+    void *ctx;
+} form_parser_t;
+
+void form_parser_init(form_parser_t *parser, form_value_t value, void *ctx);
+
+/**
+ * @brief Parse the next chunk of the body
+ *
+ * @return ESP_OK or the first error of the callback
+ */
+esp_err_t form_parser_feed(form_parser_t *parser, const char *data, size_t length);
+
+/**
+ * @brief End of the body, the last field is passed on
+ *
+ * @return ESP_OK or the first error of the callback
+ */
+esp_err_t form_parser_finish(form_parser_t *parser);
+
+#endif
@@ -9,6 +9,33 @@
 #include "settings.h"
 #include "status.h"
 
+/**
+ * @brief: Copy the string settings the entities are built from, NULL for the ones not needed
+ *
+ * Taken from settings_load(), the per-key entries may not have the last saves yet.
+ */
+static esp_err_t ha_settings_strings(char *mqtt_prefix, char *device_id, char *device_serial) {
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for the settings");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = settings_load(values);
+    if (err == ESP_OK) {
+        if (mqtt_prefix != NULL) {
+            strcpy(mqtt_prefix, values->mqtt_prefix);
+        }
+        if (device_id != NULL) {
+            strcpy(device_id, values->device_id);
+        }
+        if (device_serial != NULL) {
+            strcpy(device_serial, values->device_serial);
+        }
+    }
+    free(values);
+    return err;
+}
+
 /**
  * @brief: Initialize the device entity
  */
@@ -48,16 +75,27 @@ esp_err_t ha_device_init(ha_device_t *device) {
     }
     ESP_LOGD(TAG, "DEVICE: assigned configuration_url: %s", device->configuration_url);
 
-    // Assign device name
-    device->name = NULL;
-    esp_err_t err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device->name);
+    // Device name and serial
+    char device_id[DEVICE_ID_LENGTH+1];
+    char device_serial[DEVICE_SERIAL_LENGTH+1];
+    esp_err_t err = ha_settings_strings(NULL, device_id, device_serial);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read device name from NVS");
+        ESP_LOGE(TAG, "Failed to read device name and serial from the settings");
         free(device->manufacturer);
         free(device->model);
         free(device->configuration_url);
         return err;
     }
+
+    // Assign device name
+    device->name = strdup(device_id);
+    if (device->name == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for name");
+        free(device->manufacturer);
+        free(device->model);
+        free(device->configuration_url);
+        return ESP_ERR_NO_MEM;
+    }
     ESP_LOGD(TAG, "DEVICE: assigned name: %s", device->name);
 
     // Assign via_device (set to an empty string)
@@ -73,16 +111,15 @@ esp_err_t ha_device_init(ha_device_t *device) {
     ESP_LOGD(TAG, "DEVICE: assigned via_device: %s", device->via_device);
 
     // Assign identifiers[0]
-    device->identifiers[0] = NULL;
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_SERIAL, &device->identifiers[0]);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read device serial from NVS");
+    device->identifiers[0] = strdup(device_serial);
+    if (device->identifiers[0] == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for identifiers[0]");
         free(device->manufacturer);
         free(device->model);
         free(device->configuration_url);
         free(device->name);
         free(device->via_device);
-        return err;
+        return ESP_ERR_NO_MEM;
     }
     ESP_LOGD(TAG, "DEVICE: assigned identifiers[0]: %s", device->identifiers[0]);
 
@@ -159,20 +196,12 @@ esp_err_t ha_availability_init(ha_entity_availability_t *availability) {
         return ESP_ERR_INVALID_ARG;  // Handle NULL input
     }
 
-    // Allocate and read the MQTT prefix
-    char *mqtt_prefix = NULL;
-    esp_err_t err = nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT prefix from NVS");
-        return err;
-    }
-
-    // Allocate and read the device ID
-    char *device_id = NULL;
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id);
+    // Read the MQTT prefix and the device ID
+    char mqtt_prefix[MQTT_PREFIX_LENGTH+1];
+    char device_id[DEVICE_ID_LENGTH+1];
+    esp_err_t err = ha_settings_strings(mqtt_prefix, device_id, NULL);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read device ID from NVS");
-        free(mqtt_prefix);  // Clean up previous allocation
+        ESP_LOGE(TAG, "Failed to read MQTT prefix and device ID from the settings");
         return err;
     }
 
@@ -181,8 +210,6 @@ esp_err_t ha_availability_init(ha_entity_availability_t *availability) {
     availability->topic = (char *)malloc(topic_len);
     if (availability->topic == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for availability topic");
-        free(mqtt_prefix);
-        free(device_id);
         return ESP_ERR_NO_MEM;
     }
 
@@ -190,10 +217,6 @@ esp_err_t ha_availability_init(ha_entity_availability_t *availability) {
     snprintf(availability->topic, topic_len, "%s/%s/%s", mqtt_prefix, device_id, HA_DEVICE_STATUS_PATH);
     ESP_LOGD(TAG, "DISCOVERY::AVAILABILITY: assigned availability topic: %s", availability->topic);
 
-    // Clean up temporary variables
-    free(mqtt_prefix);
-    free(device_id);
-
     return ESP_OK;
 }
 
@@ -353,22 +376,13 @@ esp_err_t ha_entity_discovery_init(ha_entity_discovery_t *discovery) {
     ESP_LOGD(TAG, "DISCOVERY::ORIGIN: sw: %s", discovery->origin->sw);
     ESP_LOGD(TAG, "DISCOVERY::ORIGIN: url: %s", discovery->origin->url);
 
-    // Allocate and read MQTT prefix and device ID from NVS
-    char *mqtt_prefix = NULL;
-    char *device_id = NULL;
+    // Read MQTT prefix and device ID from the settings
+    char mqtt_prefix[MQTT_PREFIX_LENGTH+1];
+    char device_id[DEVICE_ID_LENGTH+1];
 
-    err = nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix);
+    err = ha_settings_strings(mqtt_prefix, device_id, NULL);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT prefix from NVS");
-        free(discovery->availability);
-        free(discovery->device);
-        free(discovery->origin);
-        return err;
-    }
-
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read device ID from NVS");
+        ESP_LOGE(TAG, "Failed to read MQTT prefix and device ID from the settings");
         free(discovery->availability);
         free(discovery->device);
         free(discovery->origin);
@@ -385,8 +399,6 @@ esp_err_t ha_entity_discovery_init(ha_entity_discovery_t *discovery) {
         free(discovery->availability);
         free(discovery->device);
         free(discovery->origin);
-        free(mqtt_prefix);
-        free(device_id);
         return ESP_ERR_NO_MEM;
     }
     snprintf(discovery->json_attributes_topic, topic_len, "%s/%s/%s", mqtt_prefix, device_id, HA_DEVICE_STATE_PATH);
@@ -398,16 +410,10 @@ esp_err_t ha_entity_discovery_init(ha_entity_discovery_t *discovery) {
         free(discovery->device);
         free(discovery->origin);
         free(discovery->json_attributes_topic);
-        free(mqtt_prefix);
-        free(device_id);
         return ESP_ERR_NO_MEM;
     }
     snprintf(discovery->state_topic, topic_len, "%s/%s/%s", mqtt_prefix, device_id, HA_DEVICE_STATE_PATH);
 
-    // Cleanup temporary variables
-    free(mqtt_prefix);
-    free(device_id);
-
     return ESP_OK;
 }
 
@@ -427,37 +433,30 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
         return err;
     }
 
-    // Allocate and read device ID and device serial
-    char *device_id = NULL;
-    char *device_serial = NULL;
+    // Read device ID and device serial
+    char device_id[DEVICE_ID_LENGTH+1];
+    char device_serial[DEVICE_SERIAL_LENGTH+1];
 
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id);  // Removed & before device_id
-    if (err != ESP_OK || device_id[0] == '\0') {  // Check if the device_id was actually read
-        ESP_LOGE(TAG, "Failed to read device ID from NVS or device ID is empty");
+    err = ha_settings_strings(NULL, device_id, device_serial);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read device ID and serial from the settings");
         return err;
     }
-
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_SERIAL, &device_serial);  // Removed & before device_serial
-    if (err != ESP_OK || device_serial[0] == '\0') {  // Check if the device_serial was actually read
-        ESP_LOGE(TAG, "Failed to read device serial from NVS or device serial is empty");
-        free(device_id);
-        return err;
+    if (device_id[0] == '\0' || device_serial[0] == '\0') {
+        ESP_LOGE(TAG, "Device ID or device serial is empty");
+        return ESP_ERR_INVALID_STATE;
     }
 
     // Allocate memory for object_id and format it
-    if (device_id != NULL && metric != NULL) {  // Double-check for NULL before strlen
+    if (metric != NULL) {  // Double-check for NULL before strlen
         discovery->object_id = (char *)malloc(strlen(device_id) + strlen(metric) + 2);  // +2 for '_' and null terminator
         if (discovery->object_id == NULL) {
             ESP_LOGE(TAG, "Failed to allocate memory for object_id");
-            free(device_id);
-            free(device_serial);
             return ESP_ERR_NO_MEM;
         }
         sprintf(discovery->object_id, "%s_%s", device_id, metric);
     } else {
         ESP_LOGE(TAG, "Invalid device_id or metric");
-        free(device_id);
-        free(device_serial);
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -465,8 +464,6 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
     discovery->unique_id = (char *)malloc(strlen(device_id) + strlen(device_serial) + strlen(metric) + 3);  // +3 for two '_' and null terminator
     if (discovery->unique_id == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for unique_id");
-        free(device_id);
-        free(device_serial);
         free(discovery->object_id);
         return ESP_ERR_NO_MEM;
     }
@@ -485,18 +482,12 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
     discovery->value_template = (char *)malloc(value_template_len);
     if (discovery->value_template == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for value_template");
-        free(device_id);
-        free(device_serial);
         free(discovery->object_id);
         free(discovery->unique_id);
         return ESP_ERR_NO_MEM;
     }
     sprintf(discovery->value_template, "%s%s%s", template_prefix, metric, template_suffix);
 
-    // Clean up temporary variables
-    free(device_id);
-    free(device_serial);
-
     return ESP_OK;
 }
 
@@ -596,6 +587,16 @@ cJSON *sensor_state_to_JSON(sensor_data_t *s_data) {
         cJSON_AddItemToObject(root, "voltage_raw", j_voltage_raw);
     }
 
+    cJSON *j_pressure_rate = cJSON_CreateNumber(s_data->pressure_rate);
+    if (j_pressure_rate != NULL) {
+        cJSON_AddItemToObject(root, "pressure_rate", j_pressure_rate);
+    }
+
+    cJSON *j_fault_flags = cJSON_CreateNumber(s_data->fault_flags);
+    if (j_fault_flags != NULL) {
+        cJSON_AddItemToObject(root, "fault_flags", j_fault_flags);
+    }
+
     return root;
 }
 
@@ -659,6 +660,218 @@ char *serialize_sensor_status(sensor_status_t *s_data) {
 
 }
 
+/**
+ * @brief: Get CJSON object of autotune_result_t
+ */
+cJSON *autotune_result_to_JSON(autotune_result_t *result) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddBoolToObject(root, "valid", result->valid);
+    if (result->valid) {
+        cJSON_AddNumberToObject(root, "sensor_samples", result->sensor_samples);
+        cJSON_AddNumberToObject(root, "sensor_smp_int", result->sensor_smp_int);
+        cJSON_AddNumberToObject(root, "sensor_deviate", result->sensor_deviate);
+        cJSON_AddNumberToObject(root, "noise_target_uv", result->noise_target_uv);
+        cJSON_AddBoolToObject(root, "target_met", result->target_met);
+        cJSON_AddNumberToObject(root, "raw_noise_uv", result->raw_noise_uv);
+        cJSON_AddNumberToObject(root, "expected_noise_uv", result->expected_noise_uv);
+        cJSON_AddNumberToObject(root, "cycle_time_ms", result->cycle_time_ms);
+        cJSON_AddNumberToObject(root, "cycle_cpu_us", result->cycle_cpu_us);
+        cJSON_AddNumberToObject(root, "adc_read_us", result->adc_read_us);
+    }
+
+    return root;
+
+}
+
+/**
+ * @brief: Get CJSON object of radio_stats_t
+ */
+cJSON *radio_stats_to_JSON(radio_stats_t *stats) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "bursts", stats->bursts);
+    cJSON_AddNumberToObject(root, "bursts_overlapped", stats->bursts_overlapped);
+    cJSON_AddNumberToObject(root, "bursts_waited", stats->bursts_waited);
+    cJSON_AddNumberToObject(root, "publishes_deferred", stats->publishes_deferred);
+    cJSON_AddNumberToObject(root, "publishes_in_flight", stats->publishes_in_flight);
+    cJSON_AddBoolToObject(root, "hold_modem_sleep", stats->hold_modem_sleep);
+
+    return root;
+
+}
+
+/**
+ * @brief: Get CJSON object of power_stats_t
+ */
+cJSON *power_stats_to_JSON(power_stats_t *stats) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "mode", stats->mode);
+    cJSON_AddBoolToObject(root, "pm_supported", stats->pm_supported);
+    if (stats->cpu_stats_supported) {
+        cJSON_AddNumberToObject(root, "cpu_active_pct", stats->cpu_active_permille / 10.0);
+    } else {
+        cJSON_AddNullToObject(root, "cpu_active_pct");
+    }
+    cJSON_AddNumberToObject(root, "cpu_max_freq_pct", stats->cpu_max_freq_permille / 10.0);
+    cJSON_AddNumberToObject(root, "radio_active_pct", stats->radio_active_permille / 10.0);
+    cJSON_AddNumberToObject(root, "wake_latency_us_last", stats->wake_latency_us_last);
+    cJSON_AddNumberToObject(root, "wake_latency_us_avg", stats->wake_latency_us_avg);
+    cJSON_AddNumberToObject(root, "wake_latency_us_max", stats->wake_latency_us_max);
+
+    return root;
+
+}
+
+cJSON *deep_sleep_stats_to_JSON(deep_sleep_stats_t *stats) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "wake_count", stats->wake_count);
+    cJSON_AddNumberToObject(root, "pending", stats->pending);
+    cJSON_AddNumberToObject(root, "dropped", stats->dropped);
+    cJSON_AddNumberToObject(root, "boot_to_publish_ms", stats->boot_to_publish_ms);
+
+    return root;
+
+}
+
+cJSON *nvs_write_stats_to_JSON(nvs_write_stats_t *stats) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "writes", stats->writes);
+    cJSON_AddNumberToObject(root, "commits", stats->commits);
+
+    return root;
+
+}
+
+cJSON *settings_stats_to_JSON(settings_stats_t *stats) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "saves", stats->saves);
+    cJSON_AddNumberToObject(root, "changed", stats->changed);
+    cJSON_AddNumberToObject(root, "unchanged", stats->unchanged);
+    cJSON_AddNumberToObject(root, "commits", stats->commits);
+    cJSON_AddNumberToObject(root, "pending", stats->pending);
+
+    return root;
+
+}
+
+char *serialize_nvs_stats(const nvs_write_stats_t *write_stats, const nvs_namespace_stats_t *namespaces, size_t namespace_count,
+                          const nvs_key_stats_t *keys, size_t key_count) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddBoolToObject(root, "enabled", NVS_STATS_ENABLE);
+    cJSON_AddNumberToObject(root, "writes", write_stats->writes);
+    cJSON_AddNumberToObject(root, "commits", write_stats->commits);
+
+    cJSON *namespace_array = cJSON_CreateArray();
+    for (size_t i = 0; i < namespace_count; i++) {
+        const nvs_namespace_stats_t *stats = &namespaces[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "namespace", stats->namespace);
+        cJSON_AddNumberToObject(item, "reads", stats->reads);
+        cJSON_AddNumberToObject(item, "writes", stats->writes);
+        cJSON_AddNumberToObject(item, "commits", stats->commits);
+        cJSON_AddNumberToObject(item, "bytes_read", stats->bytes_read);
+        cJSON_AddNumberToObject(item, "bytes_written", stats->bytes_written);
+        cJSON_AddNumberToObject(item, "time_us", (double)stats->time_us);
+        cJSON_AddNumberToObject(item, "untracked", stats->untracked);
+        cJSON_AddItemToArray(namespace_array, item);
+    }
+    cJSON_AddItemToObject(root, "namespaces", namespace_array);
+
+    cJSON *key_array = cJSON_CreateArray();
+    for (size_t i = 0; i < key_count; i++) {
+        const nvs_key_stats_t *stats = &keys[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "namespace", stats->namespace);
+        cJSON_AddStringToObject(item, "key", stats->key);
+        cJSON_AddNumberToObject(item, "reads", stats->reads);
+        cJSON_AddNumberToObject(item, "writes", stats->writes);
+        cJSON_AddNumberToObject(item, "bytes_read", stats->bytes_read);
+        cJSON_AddNumberToObject(item, "bytes_written", stats->bytes_written);
+        cJSON_AddNumberToObject(item, "time_us", (double)stats->time_us);
+        cJSON_AddItemToArray(key_array, item);
+    }
+    cJSON_AddItemToObject(root, "keys", key_array);
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+
+}
+
+char *serialize_deep_sleep_batch(const deep_sleep_state_t *state, int64_t now) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "wake_count", state->wake_count);
+    cJSON_AddNumberToObject(root, "boot_to_publish_ms", state->boot_to_publish_ms);
+    cJSON_AddNumberToObject(root, "dropped", state->dropped);
+
+    if (state->rollup.count > 0) {
+        cJSON *rollup = cJSON_CreateObject();
+        cJSON_AddNumberToObject(rollup, "min", state->rollup.min);
+        cJSON_AddNumberToObject(rollup, "max", state->rollup.max);
+        cJSON_AddNumberToObject(rollup, "avg", state->rollup.sum / state->rollup.count);
+        cJSON_AddNumberToObject(rollup, "count", state->rollup.count);
+        cJSON_AddItemToObject(root, "rollup", rollup);
+    }
+
+    // Readings carry their age rather than the time, the RTC clock is not synchronized
+    cJSON *readings = cJSON_CreateArray();
+    for (int i = 0; i < state->pending_count; i++) {
+        const deep_sleep_reading_t *reading = &state->pending[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "age", (double)(now - reading->time));
+        cJSON_AddNumberToObject(item, "pressure", reading->pressure);
+        cJSON_AddNumberToObject(item, "voltage", reading->voltage);
+        cJSON_AddNumberToObject(item, "fault_flags", reading->fault_flags);
+        cJSON_AddItemToArray(readings, item);
+    }
+    cJSON_AddItemToObject(root, "readings", readings);
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+
+}
+
+char *serialize_history(const history_entry_t *entries, size_t count, int64_t now, bool restored) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddBoolToObject(root, "restored", restored);
+
+    // Readings carry their age rather than the time, the RTC clock is not synchronized
+    cJSON *readings = cJSON_CreateArray();
+    for (size_t i = 0; i < count; i++) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "age", (double)(now - entries[i].time));
+        cJSON_AddNumberToObject(item, "pressure", entries[i].pressure);
+        cJSON_AddNumberToObject(item, "voltage", entries[i].voltage);
+        cJSON_AddNumberToObject(item, "pressure_rate", entries[i].pressure_rate);
+        cJSON_AddNumberToObject(item, "fault_flags", entries[i].fault_flags);
+        cJSON_AddItemToArray(readings, item);
+    }
+    cJSON_AddItemToObject(root, "readings", readings);
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+
+}
+
 /**
  * @brief: Compile JSON object from sensor state and device status 
  */
@@ -668,6 +881,17 @@ cJSON *sensor_all_to_JSON(sensor_status_t *status, sensor_data_t *sensor) {
 
     cJSON_AddItemToObject(root, "sensor", sensor_state_to_JSON(sensor));
     cJSON_AddItemToObject(root, "status", sensor_status_to_JSON(status));
+    cJSON_AddItemToObject(root, "autotune", autotune_result_to_JSON(&autotune_result));
+    radio_stats_t radio_stats = radio_get_stats();
+    cJSON_AddItemToObject(root, "radio", radio_stats_to_JSON(&radio_stats));
+    power_stats_t power_stats = power_get_stats();
+    cJSON_AddItemToObject(root, "power", power_stats_to_JSON(&power_stats));
+    deep_sleep_stats_t deep_sleep_stats = deep_sleep_get_stats();
+    cJSON_AddItemToObject(root, "deep_sleep", deep_sleep_stats_to_JSON(&deep_sleep_stats));
+    nvs_write_stats_t nvs_stats = nvs_get_write_stats();
+    cJSON_AddItemToObject(root, "nvs", nvs_write_stats_to_JSON(&nvs_stats));
+    settings_stats_t settings_stats = settings_get_stats();
+    cJSON_AddItemToObject(root, "settings", settings_stats_to_JSON(&settings_stats));
 
     return root;
 
@@ -685,4 +909,75 @@ char *serialize_all_device_data(sensor_status_t *status, sensor_data_t *sensor)
     cJSON_Delete(c_json);
     return json;
 
-}
\ No newline at end of file
+}
+
+/**
+ * @brief: Serialize the settings of the config page (editable and device ones), secrets are left out
+ */
+char *serialize_settings(const settings_values_t *values) {
+
+    cJSON *root = cJSON_CreateObject();
+    char value_str[16];
+
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        if (!(setting->flags & (SETTING_FLAG_FORM | SETTING_FLAG_DEVICE)) || (setting->flags & SETTING_FLAG_SECRET)) {
+            continue;
+        }
+        const char *value = setting_to_string(setting, values, value_str, sizeof(value_str));
+        if (setting->type == NVS_VALUE_STRING) {
+            cJSON_AddStringToObject(root, setting->key, value);
+        } else {
+            cJSON_AddRawToObject(root, setting->key, value);   // formatted as a JSON number already
+        }
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+
+}
+
+/**
+ * @brief: Serialize the type, limits and flags of the settings of the config page
+ */
+char *serialize_settings_schema(void) {
+
+    cJSON *root = cJSON_CreateObject();
+
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        if (!(setting->flags & (SETTING_FLAG_FORM | SETTING_FLAG_DEVICE))) {
+            continue;
+        }
+        cJSON *item = cJSON_CreateObject();
+        switch (setting->type) {
+            case NVS_VALUE_STRING:
+                cJSON_AddStringToObject(item, "type", "string");
+                cJSON_AddNumberToObject(item, "length", setting->length);
+                break;
+            case NVS_VALUE_FLOAT:
+                cJSON_AddStringToObject(item, "type", "number");
+                break;
+            default:
+                cJSON_AddStringToObject(item, "type", "integer");
+                break;
+        }
+        if (setting->flags & SETTING_FLAG_RANGE) {
+            cJSON_AddNumberToObject(item, "min", setting->min);
+            cJSON_AddNumberToObject(item, "max", setting->max);
+        }
+        if (setting->flags & SETTING_FLAG_SECRET) {
+            cJSON_AddBoolToObject(item, "secret", true);
+        }
+        if (!(setting->flags & SETTING_FLAG_FORM)) {
+            cJSON_AddBoolToObject(item, "readonly", true);
+        }
+        cJSON_AddItemToObject(root, setting->key, item);
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+
+}
@@ -7,6 +7,13 @@
 #include "common.h"
 #include "sensor.h"
 #include "status.h"
+#include "autotune.h"
+#include "radio.h"
+#include "power.h"
+#include "deep_sleep.h"
+#include "history.h"
+#include "settings.h"
+#include "non_volatile_storage.h"
 
 #define HA_DEVICE_MANUFACTURER     "espressif"
 #define HA_DEVICE_MODEL            "esp32"
@@ -79,6 +86,59 @@ cJSON *sensor_state_to_JSON(sensor_data_t *s_data);
 char *serialize_sensor_state(sensor_data_t *sensor_data);
 cJSON *sensor_status_to_JSON(sensor_status_t *s_data);
 char *serialize_sensor_status(sensor_status_t *s_data);
+cJSON *autotune_result_to_JSON(autotune_result_t *result);
+
+/**
+ * @brief: Get CJSON object of radio_stats_t
+ */
+cJSON *radio_stats_to_JSON(radio_stats_t *stats);
+
+/**
+ * @brief: Get CJSON object of power_stats_t
+ */
+cJSON *power_stats_to_JSON(power_stats_t *stats);
+
+/**
+ * @brief: Get CJSON object of deep_sleep_stats_t
+ */
+cJSON *deep_sleep_stats_to_JSON(deep_sleep_stats_t *stats);
+
+/**
+ * @brief: Get CJSON object of nvs_write_stats_t
+ */
+cJSON *nvs_write_stats_to_JSON(nvs_write_stats_t *stats);
+
+/**
+ * @brief: Get CJSON object of settings_stats_t
+ */
+cJSON *settings_stats_to_JSON(settings_stats_t *stats);
+
+/**
+ * @brief: Serialize the NVS write counters and the per namespace and per key access counters
+ */
+char *serialize_nvs_stats(const nvs_write_stats_t *write_stats, const nvs_namespace_stats_t *namespaces, size_t namespace_count,
+                          const nvs_key_stats_t *keys, size_t key_count);
+
+/**
+ * @brief: Serialize the undelivered readings, rollup and cycle statistics of the deep sleep cycle
+ */
+char *serialize_deep_sleep_batch(const deep_sleep_state_t *state, int64_t now);
+
+/**
+ * @brief: Serialize the reading history, oldest first
+ */
+char *serialize_history(const history_entry_t *entries, size_t count, int64_t now, bool restored);
+
+/**
+ * @brief: Serialize the settings of the config page, key to value, the secrets are left out
+ */
+char *serialize_settings(const settings_values_t *values);
+
+/**
+ * @brief: Serialize the type ("string", "integer" or "number"), length, min, max and flags of the config page settings
+ */
+char *serialize_settings_schema(void);
+
 cJSON *sensor_all_to_JSON(sensor_status_t *status, sensor_data_t *sensor);
 char *serialize_all_device_data(sensor_status_t *status, sensor_data_t *sensor);
 
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+
+#include "common.h"
+#include "history.h"
+
+/**
+ * The history lives in RTC no-init memory, which survives software resets, panics and watchdog resets, but is
+ * left alone by the startup code. Its content is trusted only when the checksum matches. Times are kept on the
+ * wall clock, which survives the warm restarts too, while esp_timer starts from zero again.
+ */
+
+typedef struct {
+    uint32_t magic;
+    uint16_t head;                              // next entry to write
+    uint16_t count;
+    history_entry_t entries[HISTORY_LENGTH];
+    bool last_good_valid;
+    sensor_data_t last_good;                    // last reading without HISTORY_BAD_FAULTS
+    sensor_estimator_t estimator;               // wall clock time base, us
+    uint32_t crc;                               // CRC32 of everything above
+} history_rtc_t;
+
+static RTC_NOINIT_ATTR history_rtc_t history_rtc;
+
+static SemaphoreHandle_t history_mutex = NULL;
+static bool history_was_restored = false;
+
+static int64_t history_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+int64_t history_now(void) {
+    return history_time_us() / 1000000LL;
+}
+
+static uint32_t history_crc(void) {
+    return esp_rom_crc32_le(0, (const uint8_t *)&history_rtc, offsetof(history_rtc_t, crc));
+}
+
+bool history_init(void) {
+    if (history_mutex == NULL) {
+        history_mutex = xSemaphoreCreateMutex();
+        if (history_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create history mutex");
+            return false;
+        }
+    }
+
+    // After power-on the no-init memory holds garbage, a matching checksum would be a coincidence
+    esp_reset_reason_t reason = esp_reset_reason();
+    history_was_restored = reason != ESP_RST_POWERON && history_rtc.magic == HISTORY_MAGIC
+                           && history_rtc.count <= HISTORY_LENGTH && history_rtc.head < HISTORY_LENGTH
+                           && history_rtc.crc == history_crc();
+
+    if (history_was_restored) {
+        ESP_LOGI(TAG, "Reading history restored after reset (reason %i): %u readings", reason, history_rtc.count);
+    } else {
+        memset(&history_rtc, 0, sizeof(history_rtc));
+        history_rtc.magic = HISTORY_MAGIC;
+        history_rtc.crc = history_crc();
+    }
+    return history_was_restored;
+}
+
+bool history_restored(void) {
+    return history_was_restored;
+}
+
+bool history_restore(sensor_data_t *data, sensor_estimator_t *estimator) {
+    if (!history_was_restored || !history_rtc.last_good_valid) {
+        return false;
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    *data = history_rtc.last_good;
+    *estimator = history_rtc.estimator;
+    xSemaphoreGive(history_mutex);
+
+    // Move the estimator back to the esp_timer time base
+    if (estimator->primed) {
+        estimator->last_time_us = esp_timer_get_time() - (history_time_us() - estimator->last_time_us);
+    }
+    return true;
+}
+
+void history_record(const sensor_data_t *data, const sensor_estimator_t *estimator) {
+    int64_t now_us = history_time_us();
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    history_entry_t *entry = &history_rtc.entries[history_rtc.head];
+    entry->time = now_us / 1000000LL;
+    entry->pressure = data->pressure;
+    entry->voltage = data->voltage;
+    entry->pressure_rate = data->pressure_rate;
+    entry->fault_flags = data->fault_flags;
+    history_rtc.head = (history_rtc.head + 1) % HISTORY_LENGTH;
+    if (history_rtc.count < HISTORY_LENGTH) {
+        history_rtc.count++;
+    }
+
+    if ((data->fault_flags & HISTORY_BAD_FAULTS) == 0) {
+        history_rtc.last_good = *data;
+        history_rtc.last_good_valid = true;
+    }
+    history_rtc.estimator = *estimator;
+    history_rtc.estimator.last_time_us = now_us - (esp_timer_get_time() - estimator->last_time_us);
+
+    history_rtc.crc = history_crc();
+    xSemaphoreGive(history_mutex);
+}
+
+size_t history_get(history_entry_t *entries, size_t max_entries) {
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    size_t count = history_rtc.count < max_entries ? history_rtc.count : max_entries;
+    size_t start = (history_rtc.head + HISTORY_LENGTH - count) % HISTORY_LENGTH;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = history_rtc.entries[(start + i) % HISTORY_LENGTH];
+    }
+    xSemaphoreGive(history_mutex);
+    return count;
+}
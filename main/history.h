@@ -0,0 +1,68 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "common.h"
+#include "sensor.h"
+
+#define HISTORY_LENGTH              64          // readings kept across warm restarts
+#define HISTORY_MAGIC               0x50534849  // "PSHI"
+#define HISTORY_RESUME_WAIT_MS      5000        // maximal wait for the broker before the restored value is published
+
+// Faults which make a reading unusable as the value to resume with (missing calibration is permanent on some chips)
+#define HISTORY_BAD_FAULTS          (SENSOR_FAULT_FILTER_EMPTY | SENSOR_FAULT_SIGNAL_LOW | SENSOR_FAULT_SIGNAL_HIGH)
+
+/**
+ * One reading of the history
+ */
+typedef struct {
+    int64_t time;               // wall clock time of the reading, s (RTC time base, not necessarily synchronized)
+    float pressure;             // Pa
+    float voltage;              // V
+    float pressure_rate;        // Pa/s
+    uint32_t fault_flags;       // SENSOR_FAULT_* flags
+} history_entry_t;
+
+/**
+ * @brief Validate the history retained in RTC memory (checksum, reset reason) or start a new one
+ *
+ * @return true if the history survived the restart
+ */
+bool history_init(void);
+
+/**
+ * @brief Restore the last good reading and the estimator state after a warm restart
+ *
+ * @param data          receives the last good reading
+ * @param estimator     receives the estimator state (esp_timer time base)
+ * @return true if a good reading was restored
+ */
+bool history_restore(sensor_data_t *data, sensor_estimator_t *estimator);
+
+/**
+ * @brief Append a reading and the current estimator state (esp_timer time base)
+ */
+void history_record(const sensor_data_t *data, const sensor_estimator_t *estimator);
+
+/**
+ * @brief Copy the history, oldest first
+ *
+ * @return number of entries copied
+ */
+size_t history_get(history_entry_t *entries, size_t max_entries);
+
+/**
+ * @brief Check if the history was restored at boot
+ */
+bool history_restored(void);
+
+/**
+ * @brief Current wall clock time, s
+ */
+int64_t history_now(void);
+
+#endif
@@ -14,6 +14,10 @@
 #include "mqtt.h"
 #include "zigbee.h"
 #include "status.h"
+#include "radio.h"
+#include "power.h"
+#include "deep_sleep.h"
+#include "history.h"
 
 void app_main(void) {
 
@@ -22,9 +26,20 @@ void app_main(void) {
     // Initialize NVS
     ESP_ERROR_CHECK(nvs_init());
 
+    // Deep sleep cycle wake-up: measure and publish from the RTC retained state, then sleep again
+    if (deep_sleep_is_cycle_wake()) {
+        deep_sleep_run_cycle();
+    }
+
     // Init settings
     ESP_ERROR_CHECK(settings_init());
 
+    // Reading history retained across warm restarts
+    history_init();
+
+    // Power management (DFS / light sleep between the measurement cycles)
+    ESP_ERROR_CHECK(power_init());
+
     // enable filesystem needed for WEB server
     if (_DEVICE_ENABLE_WEB) {
         // init internal filesystem
@@ -47,6 +62,14 @@ void app_main(void) {
     // Initialize the default event loop
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+    // Apply the MQTT settings changes without a reboot
+    if (_DEVICE_ENABLE_MQTT) {
+        ESP_ERROR_CHECK(mqtt_settings_init());
+    }
+
+    // Sampling and publishing coordination
+    ESP_ERROR_CHECK(radio_init());
+
     if (_DEVICE_ENABLE_WIFI) {
         ESP_LOGI(TAG, "WIFI ENABLED!");
 
@@ -91,11 +114,7 @@ void app_main(void) {
                 return;
             }
 
-            // _DEVICE_ENABLE_HA
-            if (_DEVICE_ENABLE_HA) {
-                ESP_LOGI(TAG, "HA device status ENABLED!");
-                xTaskCreate(mqtt_device_config_task, "mqtt_device_config_task", 4096, NULL, 5, NULL);
-            }
+            mqtt_device_config_start();
         }
 
         if (_DEVICE_ENABLE_ZIGBEE) {
@@ -1,18 +1,36 @@
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 #include "mqtt.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "non_volatile_storage.h"
 #include "mqtt_client.h"
 #include "esp_check.h"
+#include "freertos/semphr.h"
 
 #include "settings.h"
 #include "wifi.h"
 #include "sensor.h"  // To access the sensor_data
 #include "hass.h"
+#include "radio.h"
+#include "power.h"
 
 esp_mqtt_client_handle_t mqtt_client = NULL;
 static bool mqtt_connected = false;
+static int32_t mqtt_mode = -1;                      // connection mode, not read yet
+static char *mqtt_ca_cert = NULL;                   // CA certificate of the current client configuration
+static SemaphoreHandle_t mqtt_client_mutex = NULL;  // client creation and reconfiguration
+static TaskHandle_t mqtt_device_config_task_handle = NULL;
+static bool mqtt_start_pending = false;             // runtime start task running, guarded by mqtt_client_mutex
+static settings_mask_t mqtt_connection_keys = 0;
+static settings_mask_t mqtt_discovery_keys = 0;
+
+// Topic settings of the publishing paths, reloaded on a settings change instead of read from NVS per publish
+static char mqtt_topic_prefix[MQTT_PREFIX_LENGTH+1];
+static char mqtt_topic_device_id[DEVICE_ID_LENGTH+1];
+static bool mqtt_topic_loaded = false;
+static portMUX_TYPE mqtt_topic_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
 
 static void log_error_if_nonzero(const char *message, int error_code)
@@ -22,8 +40,35 @@ static void log_error_if_nonzero(const char *message, int error_code)
     }
 }
 
+static const char ca_cert_begin[] = "-----BEGIN CERTIFICATE-----";
+static const char ca_cert_end[] = "-----END CERTIFICATE-----";
+
+/**
+ * @brief Replace the current certificate by the validated new one, if there is one
+ *
+ * SPIFFS renames only to a free name, so the old file is removed first. CA_CERT_NEW_PATH exists only complete and
+ * valid, a reboot between the steps is finished by the next call.
+ */
+static esp_err_t ca_cert_commit(void)
+{
+    FILE *f = fopen(CA_CERT_NEW_PATH, "r");
+    if (f == NULL) {
+        return ESP_OK;
+    }
+    fclose(f);
+
+    remove(CA_CERT_PATH);
+    if (rename(CA_CERT_NEW_PATH, CA_CERT_PATH) != 0) {
+        ESP_LOGE(TAG, "Failed to rename %s to %s", CA_CERT_NEW_PATH, CA_CERT_PATH);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t load_ca_certificate(char **ca_cert)
 {
+    ca_cert_commit();   // replacement interrupted by a reboot
+
     FILE *f = fopen(CA_CERT_PATH, "r");
     if (f == NULL) {
         ESP_LOGE(TAG, "Failed to open CA certificate file");
@@ -59,33 +104,141 @@ esp_err_t load_ca_certificate(char **ca_cert)
     return ESP_OK;
 }
 
-esp_err_t save_ca_certificate(const char *ca_cert)
+static bool ca_cert_base64_line(const char *line)
+{
+    for (; *line; line++) {
+        if (!isalnum((unsigned char)*line) && *line != '+' && *line != '/' && *line != '=') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check a complete line, the lines of the certificate blocks are written
+static esp_err_t ca_cert_writer_line(ca_cert_writer_t *writer)
 {
-    if (ca_cert == NULL) {
-        ESP_LOGE(TAG, "CA certificate data is NULL");
+    char *line = writer->line;
+    size_t length = writer->line_length;
+    bool too_long = writer->line_too_long;
+    writer->line_length = 0;
+    writer->line_too_long = false;
+
+    // Pasted text might come with CR LF line ends and indented
+    while (length > 0 && isspace((unsigned char)line[length - 1])) {
+        length--;
+    }
+    line[length] = '\0';
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+
+    if (!writer->in_certificate) {
+        if (too_long || strcmp(line, ca_cert_begin) != 0) {
+            if (strncmp(line, "-----BEGIN ", 11) == 0) {
+                writer->error = "not a certificate";
+                return ESP_ERR_INVALID_ARG;
+            }
+            return ESP_OK;      // text between the blocks
+        }
+        writer->in_certificate = true;
+    } else if (too_long) {
+        writer->error = "line too long";
+    } else if (strcmp(line, ca_cert_end) == 0) {
+        writer->in_certificate = false;
+        writer->certificates++;
+    } else if (line[0] == '\0') {
+        return ESP_OK;
+    } else if (!ca_cert_base64_line(line)) {
+        writer->error = "invalid line in a certificate";
+    }
+    if (writer->error != NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    FILE *f = fopen(CA_CERT_PATH, "w");
-    if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open CA certificate file for writing");
+    if (fprintf(writer->f, "%s\n", line) < 0) {
+        writer->error = "write failed";
         return ESP_FAIL;
     }
+    return ESP_OK;
+}
 
-    // Write the certificate to the file
-    size_t written = fwrite(ca_cert, 1, strlen(ca_cert), f);
-    if (written != strlen(ca_cert)) {
-        ESP_LOGE(TAG, "Failed to write entire CA certificate to file");
-        fclose(f);
+esp_err_t ca_cert_writer_open(ca_cert_writer_t *writer)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->f = fopen(CA_CERT_UPLOAD_PATH, "w");
+    if (writer->f == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s for writing", CA_CERT_UPLOAD_PATH);
+        writer->error = "write failed";
         return ESP_FAIL;
     }
+    return ESP_OK;
+}
 
-    fclose(f);
-    ESP_LOGI(TAG, "Successfully saved CA certificate");
-
+esp_err_t ca_cert_writer_write(ca_cert_writer_t *writer, const char *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '\n') {
+            esp_err_t err = ca_cert_writer_line(writer);
+            if (err != ESP_OK) {
+                return err;
+            }
+        } else if (writer->line_length < CA_CERT_LINE_LENGTH) {
+            writer->line[writer->line_length++] = data[i];
+        } else {
+            writer->line_too_long = true;
+        }
+    }
     return ESP_OK;
 }
 
+esp_err_t ca_cert_writer_close(ca_cert_writer_t *writer)
+{
+    esp_err_t err = ESP_OK;
+    if (writer->line_length > 0 || writer->line_too_long) {
+        err = ca_cert_writer_line(writer);      // last line without the line end
+    }
+    if (err == ESP_OK && writer->in_certificate) {
+        writer->error = "incomplete certificate";
+        err = ESP_ERR_INVALID_ARG;
+    }
+    if (err == ESP_OK && writer->certificates == 0) {
+        writer->error = "no certificate found";
+        err = ESP_ERR_INVALID_ARG;
+    }
+    if (fclose(writer->f) != 0 && err == ESP_OK) {
+        writer->error = "write failed";
+        err = ESP_FAIL;
+    }
+    writer->f = NULL;
+
+    if (err == ESP_OK) {
+        remove(CA_CERT_NEW_PATH);     // left by a failed replacement, superseded
+    }
+    if (err == ESP_OK && rename(CA_CERT_UPLOAD_PATH, CA_CERT_NEW_PATH) != 0) {
+        ESP_LOGE(TAG, "Failed to rename %s to %s", CA_CERT_UPLOAD_PATH, CA_CERT_NEW_PATH);
+        writer->error = "write failed";
+        err = ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        remove(CA_CERT_UPLOAD_PATH);
+        return err;
+    }
+    err = ca_cert_commit();
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Successfully saved CA certificate, %d certificates", writer->certificates);
+    }
+    return err;
+}
+
+void ca_cert_writer_abort(ca_cert_writer_t *writer)
+{
+    if (writer->f != NULL) {
+        fclose(writer->f);
+        writer->f = NULL;
+    }
+    remove(CA_CERT_UPLOAD_PATH);
+}
+
 /*
  * @brief Event handler registered to receive MQTT events
  *
@@ -96,6 +249,17 @@ esp_err_t save_ca_certificate(const char *ca_cert)
  * @param event_id The id for the received event.
  * @param event_data The data for the event, esp_mqtt_event_handle_t.
  */
+/**
+ * @brief Publish via the MQTT client, keeping the transmission out of the ADC sampling bursts
+ */
+static int mqtt_client_publish(const char *topic, const char *data, int qos, int retain)
+{
+    radio_publish_gate();
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, 0, qos, retain);
+    radio_publish_sent(msg_id, qos);
+    return msg_id;
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     ESP_LOGD(TAG, "Event dispatched from event loop base=%s, event_id=%" PRIi32 "", base, event_id);
@@ -108,10 +272,12 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
         mqtt_connected = true;  // Set flag when connected
+        radio_reset_in_flight();
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
         mqtt_connected = false;  // Reset flag when disconnected
+        radio_reset_in_flight();
         cleanup_mqtt();  // Ensure proper cleanup on disconnection
         break;
     case MQTT_EVENT_SUBSCRIBED:
@@ -122,9 +288,11 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         break;
     case MQTT_EVENT_PUBLISHED:
         ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        radio_publish_acked();
         break;
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG, "MQTT_EVENT_DATA");
+        radio_note_activity();
         printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
         printf("DATA=%.*s\r\n", event->data_len, event->data);
         break;
@@ -144,13 +312,147 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
+static void mqtt_topic_settings_set(const settings_values_t *values) {
+    portENTER_CRITICAL(&mqtt_topic_spinlock);
+    strlcpy(mqtt_topic_prefix, values->mqtt_prefix, sizeof(mqtt_topic_prefix));
+    strlcpy(mqtt_topic_device_id, values->device_id, sizeof(mqtt_topic_device_id));
+    mqtt_topic_loaded = true;
+    portEXIT_CRITICAL(&mqtt_topic_spinlock);
+}
+
+static void mqtt_topic_settings_reload(void) {
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for the MQTT topic settings, keeping the previous ones");
+        return;
+    }
+    settings_set_defaults(values);
+    settings_load(values);
+    mqtt_topic_settings_set(values);
+    free(values);
+}
+
+/**
+ * @brief Copy of the MQTT prefix and the device ID the topics are built from
+ */
+static void mqtt_topic_settings_get(char *prefix, char *device_id) {
+    if (!mqtt_topic_loaded) {
+        mqtt_topic_settings_reload();
+    }
+    portENTER_CRITICAL(&mqtt_topic_spinlock);
+    strcpy(prefix, mqtt_topic_prefix);
+    strcpy(device_id, mqtt_topic_device_id);
+    portEXIT_CRITICAL(&mqtt_topic_spinlock);
+}
+
+/**
+ * @brief Connection mode, cached so the publishing paths do not read NVS and see a change right away
+ */
+static uint16_t mqtt_connection_mode_get(void) {
+    if (mqtt_mode < 0) {
+        uint16_t mode = S_DEFAULT_MQTT_CONNECT;
+        if (nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mode) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read MQTT connection mode from NVS");
+        }
+        mqtt_mode = mode;
+    }
+    return (uint16_t)mqtt_mode;
+}
+
+/**
+ * @brief Fill in the client configuration from the settings
+ *
+ * The URL buffer has to outlive the esp_mqtt_client_init() / esp_mqtt_set_config() call. The CA certificate is kept
+ * by the client, it is freed when replaced by the next configuration.
+ */
+static esp_err_t mqtt_client_config(const settings_values_t *values, esp_mqtt_client_config_t *mqtt_cfg, char *broker_url, size_t url_length) {
+    snprintf(broker_url, url_length, "%s://%s:%d", values->mqtt_protocol, values->mqtt_server, values->mqtt_port);
+    ESP_LOGI(TAG, "MQTT Broker URL: %s", broker_url);
+
+    *mqtt_cfg = (esp_mqtt_client_config_t) {
+        .broker.address.uri = broker_url,
+        .network.timeout_ms = 5000,  // Increase timeout if needed
+    };
+
+    if (values->mqtt_user[0]) {
+        mqtt_cfg->credentials.username = values->mqtt_user;
+    }
+    if (values->mqtt_password[0]) {
+        mqtt_cfg->credentials.authentication.password = values->mqtt_password;
+    }
+    if (strcmp(values->mqtt_protocol, "mqtts") == 0) {
+        // Load the CA certificate
+        char *ca_cert = NULL;
+        if (load_ca_certificate(&ca_cert) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to load CA certificate");
+            ESP_LOGE(TAG, "MQTTS protocol cannot be managed without CA certificate.");
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Loaded CA certificate: %s", CA_CERT_PATH);
+        mqtt_cfg->broker.verification.certificate = ca_cert;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Create the client, or restart the existing one with the new configuration
+ *
+ * The existing client is stopped and reconfigured, not destroyed, so the publishing tasks never see a freed handle.
+ * Called with mqtt_client_mutex held.
+ */
+static esp_err_t mqtt_client_apply(const settings_values_t *values) {
+    // The client keeps its own copies of the configuration strings
+    char broker_url[256];
+    esp_mqtt_client_config_t mqtt_cfg;
+    ESP_RETURN_ON_ERROR(mqtt_client_config(values, &mqtt_cfg, broker_url, sizeof(broker_url)), TAG, "Invalid MQTT configuration");
+
+    esp_err_t ret;
+    if (mqtt_client == NULL) {
+        mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+        ret = mqtt_client != NULL ? ESP_OK : ESP_FAIL;
+        if (ret == ESP_OK) {
+            esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+        }
+    } else {
+        mqtt_connected = false;
+        esp_mqtt_client_stop(mqtt_client);  // fails when not running, nothing to stop then
+        ret = esp_mqtt_set_config(mqtt_client, &mqtt_cfg);
+    }
+    if (ret != ESP_OK) {
+        free((char *)mqtt_cfg.broker.verification.certificate);
+        return ret;
+    }
+
+    // The previous certificate is not referenced any more
+    free(mqtt_ca_cert);
+    mqtt_ca_cert = (char *)mqtt_cfg.broker.verification.certificate;
+
+    return esp_mqtt_client_start(mqtt_client);
+}
+
 // Function to initialize the MQTT client
 esp_err_t mqtt_init(void) {
-    
-    uint16_t mqtt_connection_mode;
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
-    if (mqtt_connection_mode < (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
+
+    if (mqtt_client_mutex == NULL) {
+        mqtt_client_mutex = xSemaphoreCreateMutex();
+    }
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Also used by the deep sleep cycle before settings_init(), missing keys keep the defaults
+    settings_set_defaults(values);
+    esp_err_t ret = settings_load(values);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Failed to load the MQTT settings: %s", esp_err_to_name(ret));
+        free(values);
+        return ret;
+    }
+    mqtt_mode = values->mqtt_connect;
+    mqtt_topic_settings_set(values);
+    if (values->mqtt_connect < (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
         ESP_LOGW(TAG, "MQTT disabled in device settings. Publishing skipped.");
+        free(values);
         return ESP_OK; // not an issue
     }
 
@@ -161,81 +463,117 @@ esp_err_t mqtt_init(void) {
     }
 
     // Proceed with MQTT connection
-    char *mqtt_server = NULL;
-    char *mqtt_protocol = NULL;
-    char *mqtt_user = NULL;
-    char *mqtt_password = NULL;
-    char *mqtt_prefix = NULL;
-    char *device_id = NULL;
-
-    uint16_t mqtt_port;
-
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_SERVER, &mqtt_server));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_PORT, &mqtt_port));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PROTOCOL, &mqtt_protocol));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_USER, &mqtt_user));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PASSWORD, &mqtt_password));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
+    xSemaphoreTake(mqtt_client_mutex, portMAX_DELAY);
+    ret = mqtt_client_apply(values);
+    xSemaphoreGive(mqtt_client_mutex);
 
-    char broker_url[256];
-    snprintf(broker_url, sizeof(broker_url), "%s://%s:%d", mqtt_protocol, mqtt_server, mqtt_port);
-    ESP_LOGI(TAG, "MQTT Broker URL: %s", broker_url);
+    free(values);
+    return ret;
+}
 
-    esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri = broker_url,
-        .network.timeout_ms = 5000,  // Increase timeout if needed
-    };
+void mqtt_device_config_start(void) {
+    if (!_DEVICE_ENABLE_HA) {
+        return;
+    }
+    xSemaphoreTake(mqtt_client_mutex, portMAX_DELAY);
+    if (mqtt_device_config_task_handle == NULL) {
+        ESP_LOGI(TAG, "HA device status ENABLED!");
+        if (xTaskCreate(mqtt_device_config_task, "mqtt_device_config_task", 4096, NULL, 5, &mqtt_device_config_task_handle) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start the HA device configuration task");
+            mqtt_device_config_task_handle = NULL;
+        }
+    }
+    xSemaphoreGive(mqtt_client_mutex);
+}
 
-    if (mqtt_user[0]) {
-        mqtt_cfg.credentials.username = mqtt_user;
+/**
+ * @brief MQTT enabled at runtime: create the client and start the HA discovery
+ *
+ * Runs in its own task, mqtt_init() waits for the Wi-Fi and must not block the event loop task.
+ */
+static void mqtt_start_task(void *param) {
+    if (mqtt_init() == ESP_OK && mqtt_client != NULL) {
+        ESP_LOGI(TAG, "MQTT enabled in device settings, client started");
+        mqtt_device_config_start();
+    } else {
+        ESP_LOGE(TAG, "Unable to start the MQTT client");
     }
-    if (mqtt_password[0]) {
-        mqtt_cfg.credentials.authentication.password = mqtt_password;
+
+    xSemaphoreTake(mqtt_client_mutex, portMAX_DELAY);
+    mqtt_start_pending = false;
+    xSemaphoreGive(mqtt_client_mutex);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Apply the changed connection settings to the running client
+ *
+ * Without a client, one is created once the mode allows connecting.
+ */
+static void mqtt_reconnect(void) {
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for the MQTT settings");
+        return;
     }
-    if (strcmp(mqtt_protocol,"mqtts") == 0) {
-        // Load the CA certificate
-        char *ca_cert = NULL;
-        if (load_ca_certificate(&ca_cert) != ESP_OK) {
-            ESP_LOGW(TAG, "Failed to load CA certificate");
-            if (strcmp(mqtt_protocol,"mqtts") == 0) {
-                ESP_LOGE(TAG, "MQTTS protocol cannot be managed without CA certificate.");
-                return ESP_FAIL;
-            }
+    settings_set_defaults(values);
+    settings_load(values);
+
+    xSemaphoreTake(mqtt_client_mutex, portMAX_DELAY);
+    mqtt_mode = values->mqtt_connect;
+    if (mqtt_client != NULL) {
+        if (values->mqtt_connect < (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
+            mqtt_connected = false;
+            esp_mqtt_client_stop(mqtt_client);
+            ESP_LOGI(TAG, "MQTT disabled in device settings, client stopped");
+        } else if (mqtt_client_apply(values) == ESP_OK) {
+            ESP_LOGI(TAG, "MQTT settings changed, reconnecting...");
         } else {
-            ESP_LOGI(TAG, "Loaded CA certificate: %s", CA_CERT_PATH);
+            ESP_LOGE(TAG, "Failed to apply the changed MQTT settings");
         }
-        if (ca_cert) {
-            mqtt_cfg.broker.verification.certificate = ca_cert;
+    } else if (_DEVICE_ENABLE_MQTT && values->mqtt_connect >= (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT && !mqtt_start_pending) {
+        mqtt_start_pending = true;
+        if (xTaskCreate(mqtt_start_task, "mqtt_start_task", 4096, NULL, 5, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start the MQTT client task");
+            mqtt_start_pending = false;
         }
     }
+    xSemaphoreGive(mqtt_client_mutex);
+    free(values);
+}
 
-    esp_err_t ret;
-    mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
-    esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    ret = esp_mqtt_client_start(mqtt_client);
-    free(mqtt_server);
-    free(mqtt_protocol);
-    free(mqtt_user);
-    free(mqtt_password);
-    free(mqtt_prefix);
-    free(device_id);
+/**
+ * @brief SETTINGS_EVENT_CHANGED handler, runs in the default event loop task
+ */
+static void mqtt_settings_changed(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    settings_mask_t changed = *(const settings_mask_t *)event_data;
 
-    return ret;
+    if (changed & mqtt_connection_keys) {
+        mqtt_reconnect();
+    }
+    if (changed & mqtt_discovery_keys) {
+        mqtt_topic_settings_reload();
+    }
+    // The discovery topics are built from these, republish them right away
+    if ((changed & (mqtt_connection_keys | mqtt_discovery_keys)) && mqtt_device_config_task_handle != NULL) {
+        xTaskNotifyGive(mqtt_device_config_task_handle);
+    }
+}
+
+esp_err_t mqtt_settings_init(void) {
+    if (mqtt_client_mutex == NULL) {
+        mqtt_client_mutex = xSemaphoreCreateMutex();
+    }
+    mqtt_connection_keys = settings_keys_mask(S_KEY_MQTT_CONNECT, S_KEY_MQTT_SERVER, S_KEY_MQTT_PORT, S_KEY_MQTT_PROTOCOL,
+                                              S_KEY_MQTT_USER, S_KEY_MQTT_PASSWORD, NULL);
+    mqtt_discovery_keys = settings_keys_mask(S_KEY_MQTT_PREFIX, S_KEY_DEVICE_ID, S_KEY_HA_PREFIX, S_KEY_HA_UPDATE_INTERVAL, NULL);
+    return esp_event_handler_register(SETTINGS_EVENT, SETTINGS_EVENT_CHANGED, mqtt_settings_changed, NULL);
 }
 
 // Function to publish sensor data
 esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
 
-    uint16_t mqtt_connection_mode;
-    esp_err_t err;
-
-    // Read MQTT connection mode
-    err = nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT connection mode from NVS");
-        return ESP_FAIL;
-    }
+    uint16_t mqtt_connection_mode = mqtt_connection_mode_get();
 
     // Check if MQTT is disabled in the device settings
     if (mqtt_connection_mode < (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
@@ -258,22 +596,10 @@ esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
         }
     }
 
-    /* Declare NULL pointer for string variables */
-    char *mqtt_prefix = NULL;
-    char *device_id = NULL;
-
-    // Read MQTT prefix and device ID from NVS
-    err = nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT prefix from NVS");
-        return ESP_ERR_NVS_BASE;
-    }
+    char mqtt_prefix[MQTT_PREFIX_LENGTH+1];
+    char device_id[DEVICE_ID_LENGTH+1];
 
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read device ID from NVS");
-        return ESP_ERR_NVS_BASE;
-    }
+    mqtt_topic_settings_get(mqtt_prefix, device_id);
 
     // Create MQTT topics based on mqtt_prefix and device_id
     char topic_voltage[256], topic_voltage_raw[256], topic_voltage_offset[256], topic_pressure[256], topic_multiplier[256], topic_state[256];
@@ -291,7 +617,7 @@ esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
 
     // Publish voltage
     snprintf(value, sizeof(value), "%.3f", sensor_data->voltage);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic_voltage, value, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic_voltage, value, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Topic %s not published", topic_voltage);
         is_error = true;
@@ -299,7 +625,7 @@ esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
 
     // Publish voltage_raw
     snprintf(value, sizeof(value), "%d", sensor_data->voltage_raw);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic_voltage_raw, value, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic_voltage_raw, value, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Topic %s not published", topic_voltage_raw);
         is_error = true;
@@ -307,7 +633,7 @@ esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
 
     // Publish voltage_offset
     snprintf(value, sizeof(value), "%.3f", sensor_data->voltage_offset);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic_voltage_offset, value, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic_voltage_offset, value, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Topic %s not published", topic_voltage_offset);
         is_error = true;
@@ -315,7 +641,7 @@ esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
 
     // Publish pressure
     snprintf(value, sizeof(value), "%.2f", sensor_data->pressure);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic_pressure, value, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic_pressure, value, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Topic %s not published", topic_pressure);
         is_error = true;
@@ -323,22 +649,18 @@ esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
 
     // Publish sensor_linear_multiplier
     snprintf(value, sizeof(value), "%lu", (unsigned long)sensor_data->sensor_linear_multiplier);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic_multiplier, value, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic_multiplier, value, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Topic %s not published", topic_multiplier);
         is_error = true;
     }
 
-    // Free allocated resources for MQTT prefix and device ID
-    free(mqtt_prefix);
-    free(device_id);
-
     // Publishing JSON data
     sensor_data_t s_data = get_sensor_data();  // Create a copy of sensor_data to ensure consistency
     char *sensor_data_json = serialize_sensor_state(&s_data);
     if (sensor_data_json != NULL) {
         ESP_LOGI(TAG, "Sensor data serialized:\n%s", sensor_data_json);
-        msg_id = esp_mqtt_client_publish(mqtt_client, topic_state, sensor_data_json, 0, 0, true);
+        msg_id = mqtt_client_publish(topic_state, sensor_data_json, 0, true);
         if (msg_id < 0) {
             ESP_LOGW(TAG, "Topic %s not published", topic_state);
             is_error = true;
@@ -358,6 +680,88 @@ esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data) {
     }
 }
 
+esp_err_t mqtt_publish_sensor_batch(const char *payload) {
+
+    if (mqtt_client == NULL || !mqtt_connected) {
+        ESP_LOGW(TAG, "MQTT client is not connected. Batch not published.");
+        return ESP_FAIL;
+    }
+
+    char mqtt_prefix[MQTT_PREFIX_LENGTH+1];
+    char device_id[DEVICE_ID_LENGTH+1];
+
+    mqtt_topic_settings_get(mqtt_prefix, device_id);
+
+    char topic_batch[256];
+    snprintf(topic_batch, sizeof(topic_batch), "%s/%s/sensor/batch", mqtt_prefix, device_id);
+
+    int msg_id = mqtt_client_publish(topic_batch, payload, 1, 0);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Topic %s not published", topic_batch);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Batch published to %s", topic_batch);
+    return ESP_OK;
+}
+
+bool mqtt_is_connected(void) {
+    return mqtt_client != NULL && mqtt_connected;
+}
+
+esp_err_t mqtt_publish_alarm(const char *rule_name, bool firing, const sensor_data_t *sensor_data) {
+
+    uint16_t mqtt_connection_mode = mqtt_connection_mode_get();
+
+    if (mqtt_connection_mode < (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
+        ESP_LOGW(TAG, "MQTT disabled in device settings. Alarm %s not published.", rule_name);
+        return ESP_OK;
+    }
+
+    // Alarms do not wait for the regular publishing cycle, so restore the connection right away
+    if (mqtt_client == NULL || !mqtt_connected) {
+        if (!g_wifi_ready) {
+            // mqtt_init() would wait for the network, the caller retries with the next reading instead
+            ESP_LOGW(TAG, "Network is not ready. Alarm %s not published.", rule_name);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (mqtt_connection_mode > (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
+            ESP_LOGI(TAG, "Restoring connection to MQTT to publish alarm %s...", rule_name);
+            if (mqtt_init() != ESP_OK) {
+                ESP_LOGE(TAG, "MQTT client re-init failed. Alarm %s not published.", rule_name);
+                return ESP_FAIL;
+            }
+        } else {
+            ESP_LOGW(TAG, "MQTT client is not connected. Alarm %s not published.", rule_name);
+            return ESP_FAIL;
+        }
+    }
+
+    char mqtt_prefix[MQTT_PREFIX_LENGTH+1];
+    char device_id[DEVICE_ID_LENGTH+1];
+
+    mqtt_topic_settings_get(mqtt_prefix, device_id);
+
+    char topic_alarm[256];
+    snprintf(topic_alarm, sizeof(topic_alarm), "%s/%s/alarm/%s", mqtt_prefix, device_id, rule_name);
+
+    char payload[160];
+    snprintf(payload, sizeof(payload),
+             "{\"rule\":\"%s\",\"state\":\"%s\",\"pressure\":%.2f,\"dpdt\":%.2f,\"fault\":%lu}",
+             rule_name, firing ? "firing" : "cleared", sensor_data->pressure, sensor_data->pressure_rate,
+             (unsigned long)sensor_data->fault_flags);
+
+    // Retained, so a subscriber joining later sees the current alarm state
+    int msg_id = mqtt_client_publish(topic_alarm, payload, 1, true);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Topic %s not published", topic_alarm);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Alarm published to %s: %s", topic_alarm, payload);
+    return ESP_OK;
+}
+
 // Call this function when you are shutting down the application or no longer need the MQTT client
 void cleanup_mqtt() {
     if (mqtt_client) {
@@ -365,14 +769,14 @@ void cleanup_mqtt() {
         ESP_RETURN_VOID_ON_ERROR(esp_mqtt_client_stop(mqtt_client), TAG, "Failed to stop the MQTT client");
         ESP_RETURN_VOID_ON_ERROR(esp_mqtt_client_destroy(mqtt_client), TAG, "Failed to destroy the MQTT client");  // Free the resources
         mqtt_client = NULL;
+        free(mqtt_ca_cert);
+        mqtt_ca_cert = NULL;
     }
 }
 
 void mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_prefix, const char *homeassistant_prefix) {
     
-    uint16_t mqtt_connection_mode;
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
-    if (mqtt_connection_mode < (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
+    if (mqtt_connection_mode_get() < (uint16_t)MQTT_SENSOR_MODE_NO_RECONNECT) {
         ESP_LOGW(TAG, "MQTT disabled in device settings. Publishing skipped.");
         return;
     }
@@ -416,13 +820,13 @@ void mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_
     sprintf(discovery_path, "%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY);
     sprintf(topic, "%s/%s/%s/%s", discovery_path, device_id, metric, HA_DEVICE_CONFIG_PATH);
 
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, discovery_json, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic, discovery_json, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Discovery topic %s not published", topic);
         is_error = true;
     }
     // tell we are online
-    msg_id = esp_mqtt_client_publish(mqtt_client, entity_discovery->availability->topic, "online", 0, 0, true);
+    msg_id = mqtt_client_publish(entity_discovery->availability->topic, "online", 0, true);
 
     ha_entity_discovery_free(entity_discovery);
 
@@ -442,7 +846,7 @@ void mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_
     sprintf(discovery_path, "%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY);
     sprintf(topic, "%s/%s/%s/%s", discovery_path, device_id, metric, HA_DEVICE_CONFIG_PATH);
 
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, discovery_json, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic, discovery_json, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Discovery topic %s not published", topic);
         is_error = true;
@@ -465,7 +869,7 @@ void mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_
     sprintf(discovery_path, "%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY);
     sprintf(topic, "%s/%s/%s/%s", discovery_path, device_id, metric, HA_DEVICE_CONFIG_PATH);
 
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, discovery_json, 0, 1, 0);
+    msg_id = mqtt_client_publish(topic, discovery_json, 1, 0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Discovery topic %s not published", topic);
         is_error = true;
@@ -481,33 +885,34 @@ void mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_
 }
 
 void mqtt_device_config_task(void *param) {
-    char *device_id = NULL;
-    char *mqtt_prefix = NULL;
-    char *ha_prefix = NULL;
-    uint32_t ha_upd_intervl;
-
     const char* LOG_TAG = "HA MQTT DEVICE";
-      
-    // Load MQTT prefix from NVS
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
-    ESP_ERROR_CHECK(nvs_read_uint32(S_NAMESPACE, S_KEY_HA_UPDATE_INTERVAL, &ha_upd_intervl));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_HA_PREFIX, &ha_prefix));
 
-    ESP_LOGI(LOG_TAG, "Starting HA MQTT device update task. Update interval: %lu minutes.", (uint32_t) ha_upd_intervl / 1000 / 60);
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(LOG_TAG, "Failed to allocate memory for the settings");
+        mqtt_device_config_task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+    settings_set_defaults(values);
 
     while (true) {
+        // Load the settings, at start and after a change of them woke the task up
+        settings_load(values);
+        uint32_t ha_upd_intervl = values->ha_upd_intervl;
+
+        ESP_LOGI(LOG_TAG, "HA MQTT device update task. Update interval: %lu minutes.", (uint32_t) ha_upd_intervl / 1000 / 60);
+
         // Update Home Assistant device configuration
         ESP_LOGI(LOG_TAG, "Updating HA device configurations");
-        mqtt_publish_home_assistant_config(device_id, mqtt_prefix, ha_prefix);
+        power_publish_begin();
+        mqtt_publish_home_assistant_config(values->device_id, values->mqtt_prefix, values->ha_prefix);
+        power_publish_end();
         ESP_LOGI(LOG_TAG, "HA device configurations update complete");
 
-        // Wait for the defined interval before the next update
-        vTaskDelay(ha_upd_intervl);
+        // Wait for the defined interval before the next update, a settings change cuts the wait short
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ha_upd_intervl));
     }
 
-    free(device_id);
-    free(mqtt_prefix);
-    free(ha_prefix);
+    free(values);
 }
-
@@ -1,6 +1,7 @@
 #ifndef MQTT_H
 #define MQTT_H
 
+#include <stdio.h>
 #include "common.h"
 #include "mqtt_client.h"
 #include "sensor.h"
@@ -13,14 +14,42 @@ typedef enum {
 
 // Define the SPIFFS configuration
 #define CA_CERT_PATH "/spiffs/ca.crt"
+#define CA_CERT_UPLOAD_PATH "/spiffs/ca.tmp"    // certificate being received
+#define CA_CERT_NEW_PATH "/spiffs/ca.new"       // validated certificate, replaces CA_CERT_PATH
+#define CA_CERT_LINE_LENGTH 80                  // longest PEM line, the base64 lines are 64 characters
+
+/**
+ * CA certificate written as it is received
+ *
+ * The text is checked line by line: only CERTIFICATE blocks of base64 lines are kept, the text between the blocks
+ * is dropped. It goes to CA_CERT_UPLOAD_PATH, the current certificate is replaced only when the whole upload is valid.
+ */
+typedef struct {
+    FILE *f;
+    char line[CA_CERT_LINE_LENGTH + 1];
+    size_t line_length;
+    bool line_too_long;
+    bool in_certificate;
+    int certificates;           // complete blocks
+    const char *error;          // why the certificate was rejected, NULL if valid so far
+} ca_cert_writer_t;
 
 static void log_error_if_nonzero(const char *message, int error_code);
 
 // load CA certification from the filesystem
 esp_err_t load_ca_certificate(char **ca_cert);
 
-// save CA certification to the filesystem
-esp_err_t save_ca_certificate(const char *ca_cert);
+// start writing a new CA certificate
+esp_err_t ca_cert_writer_open(ca_cert_writer_t *writer);
+
+// next piece of the certificate text, ESP_ERR_INVALID_ARG if it breaks the PEM framing (writer->error tells why)
+esp_err_t ca_cert_writer_write(ca_cert_writer_t *writer, const char *data, size_t length);
+
+// end of the certificate: check it is complete and replace the current one
+esp_err_t ca_cert_writer_close(ca_cert_writer_t *writer);
+
+// drop the certificate being written, the current one stays
+void ca_cert_writer_abort(ca_cert_writer_t *writer);
 
 // MQTT Event loop handler
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
@@ -28,15 +57,30 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 // Function to initialize the MQTT client
 esp_err_t mqtt_init(void);
 
+// Subscribe to the settings changes: reconnect on the connection settings, republish HA discovery on the topic ones
+esp_err_t mqtt_settings_init(void);
+
 // Function to publish sensor data
 esp_err_t mqtt_publish_sensor_data(const sensor_data_t *sensor_data);
 
+// Function to publish the batch of readings collected in the deep sleep cycle
+esp_err_t mqtt_publish_sensor_batch(const char *payload);
+
+// Check if the client is connected to the broker
+bool mqtt_is_connected(void);
+
+// Function to publish alarm rule state change immediately
+esp_err_t mqtt_publish_alarm(const char *rule_name, bool firing, const sensor_data_t *sensor_data);
+
 // publish device definitions to Home Assistant
 void mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_prefix, const char *homeassistant_prefix);
 
 // HA device update task
 void mqtt_device_config_task(void *param);
 
+// Start the HA device update task, once: at boot or when MQTT is enabled at runtime
+void mqtt_device_config_start(void);
+
 // Call this function when you are shutting down the application or no longer need the MQTT client
 void cleanup_mqtt();
 
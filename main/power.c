@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+
+#include "common.h"
+#include "power.h"
+#include "settings.h"
+#include "non_volatile_storage.h"
+
+/**
+ * Locks are taken only around sampling and publishing. Between the cycles nothing holds them,
+ * so with DFS the CPU drops to POWER_CPU_FREQ_MIN_MHZ and with light sleep the chip sleeps while
+ * the tasks are blocked. esp_pm locks are counting, so sections may overlap between tasks.
+ */
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t sampling_freq_lock = NULL;
+static esp_pm_lock_handle_t sampling_sleep_lock = NULL;
+static esp_pm_lock_handle_t publish_freq_lock = NULL;
+#endif
+
+static portMUX_TYPE power_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static power_stats_t power_stats;
+
+// active time accounting
+static int cpu_active_count = 0;
+static int radio_active_count = 0;
+static int64_t cpu_active_since = 0;
+static int64_t radio_active_since = 0;
+static int64_t cpu_active_us = 0;
+static int64_t radio_active_us = 0;
+static uint64_t wake_latency_total_us = 0;
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// CPU load from the run time of the idle task, light sleep is entered from the idle task and counts as idle. The
+// counters may be 32 bit wide, so their differences are accumulated at least every cycle, long before they wrap.
+static configRUN_TIME_COUNTER_TYPE cpu_idle_last = 0;
+static configRUN_TIME_COUNTER_TYPE cpu_time_last = 0;
+static uint64_t cpu_idle_total = 0;
+static uint64_t cpu_time_total = 0;
+
+static void power_cpu_load_update(void) {
+    configRUN_TIME_COUNTER_TYPE idle = ulTaskGetIdleRunTimeCounter();
+    configRUN_TIME_COUNTER_TYPE run_time = portGET_RUN_TIME_COUNTER_VALUE();
+
+    portENTER_CRITICAL(&power_spinlock);
+    cpu_idle_total += (configRUN_TIME_COUNTER_TYPE)(idle - cpu_idle_last);
+    cpu_time_total += (configRUN_TIME_COUNTER_TYPE)(run_time - cpu_time_last);
+    cpu_idle_last = idle;
+    cpu_time_last = run_time;
+    portEXIT_CRITICAL(&power_spinlock);
+}
+#endif
+
+esp_err_t power_init(void) {
+    uint16_t power_mode = S_DEFAULT_POWER_MODE;
+    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_POWER_MODE, &power_mode));
+    power_stats.mode = power_mode;
+
+#if CONFIG_PM_ENABLE
+    power_stats.pm_supported = true;
+
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = POWER_CPU_FREQ_MAX_MHZ,
+        .min_freq_mhz = power_mode >= POWER_MODE_DFS ? POWER_CPU_FREQ_MIN_MHZ : POWER_CPU_FREQ_MAX_MHZ,
+        .light_sleep_enable = power_mode >= POWER_MODE_LIGHT_SLEEP,
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "sampling", &sampling_freq_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "sampling_nosleep", &sampling_sleep_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "publishing", &publish_freq_lock));
+
+    ESP_LOGI(TAG, "Power management: mode %i, CPU %i-%i MHz, light sleep %s", power_mode,
+             pm_config.min_freq_mhz, pm_config.max_freq_mhz, pm_config.light_sleep_enable ? "enabled" : "disabled");
+#else
+    power_stats.pm_supported = false;
+    if (power_mode != POWER_MODE_PERFORMANCE) {
+        ESP_LOGW(TAG, "Power mode %i requested, but the firmware is built without CONFIG_PM_ENABLE", power_mode);
+    }
+#endif
+
+    return ESP_OK;
+}
+
+static void power_active_enter(int *count, int64_t *since) {
+    portENTER_CRITICAL(&power_spinlock);
+    if ((*count)++ == 0) {
+        *since = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&power_spinlock);
+}
+
+static void power_active_leave(int *count, int64_t since, int64_t *total) {
+    portENTER_CRITICAL(&power_spinlock);
+    if (*count > 0 && --(*count) == 0) {
+        *total += esp_timer_get_time() - since;
+    }
+    portEXIT_CRITICAL(&power_spinlock);
+}
+
+void power_sampling_begin(void) {
+#if CONFIG_PM_ENABLE
+    if (sampling_freq_lock != NULL) {
+        esp_pm_lock_acquire(sampling_freq_lock);
+        esp_pm_lock_acquire(sampling_sleep_lock);
+    }
+#endif
+    power_active_enter(&cpu_active_count, &cpu_active_since);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    power_cpu_load_update();
+#endif
+}
+
+void power_sampling_end(void) {
+    power_active_leave(&cpu_active_count, cpu_active_since, &cpu_active_us);
+#if CONFIG_PM_ENABLE
+    if (sampling_freq_lock != NULL) {
+        esp_pm_lock_release(sampling_sleep_lock);
+        esp_pm_lock_release(sampling_freq_lock);
+    }
+#endif
+}
+
+void power_publish_begin(void) {
+#if CONFIG_PM_ENABLE
+    if (publish_freq_lock != NULL) {
+        esp_pm_lock_acquire(publish_freq_lock);
+    }
+#endif
+    power_active_enter(&cpu_active_count, &cpu_active_since);
+    power_active_enter(&radio_active_count, &radio_active_since);
+}
+
+void power_publish_end(void) {
+    power_active_leave(&radio_active_count, radio_active_since, &radio_active_us);
+    power_active_leave(&cpu_active_count, cpu_active_since, &cpu_active_us);
+#if CONFIG_PM_ENABLE
+    if (publish_freq_lock != NULL) {
+        esp_pm_lock_release(publish_freq_lock);
+    }
+#endif
+}
+
+void power_record_wake_latency(int64_t scheduled_us, int64_t sampling_start_us) {
+    if (scheduled_us <= 0) {
+        return;     // not a scheduled wake-up (first cycle, woken up by the monitor)
+    }
+    uint32_t latency_us = sampling_start_us > scheduled_us ? (uint32_t)(sampling_start_us - scheduled_us) : 0;
+
+    portENTER_CRITICAL(&power_spinlock);
+    power_stats.cycles++;
+    power_stats.wake_latency_us_last = latency_us;
+    if (latency_us > power_stats.wake_latency_us_max) {
+        power_stats.wake_latency_us_max = latency_us;
+    }
+    wake_latency_total_us += latency_us;
+    power_stats.wake_latency_us_avg = (uint32_t)(wake_latency_total_us / power_stats.cycles);
+    portEXIT_CRITICAL(&power_spinlock);
+}
+
+power_stats_t power_get_stats(void) {
+    power_stats_t stats;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    power_cpu_load_update();
+#endif
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&power_spinlock);
+    stats = power_stats;
+    int64_t cpu_us = cpu_active_us + (cpu_active_count > 0 ? now - cpu_active_since : 0);
+    int64_t radio_us = radio_active_us + (radio_active_count > 0 ? now - radio_active_since : 0);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    stats.cpu_stats_supported = true;
+    if (cpu_time_total > 0 && cpu_idle_total <= cpu_time_total) {
+        stats.cpu_active_permille = (uint32_t)(1000 - cpu_idle_total * 1000 / cpu_time_total);
+    }
+#else
+    stats.cpu_stats_supported = false;
+#endif
+    portEXIT_CRITICAL(&power_spinlock);
+
+    if (now > 0) {
+        stats.cpu_max_freq_permille = (uint32_t)(cpu_us * 1000 / now);
+        stats.radio_active_permille = (uint32_t)(radio_us * 1000 / now);
+    }
+    return stats;
+}
@@ -0,0 +1,66 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "common.h"
+
+#define POWER_CPU_FREQ_MAX_MHZ      160         // frequency while sampling or publishing
+#define POWER_CPU_FREQ_MIN_MHZ      40          // XTAL frequency, used between the cycles with DFS
+
+/**
+ * Power management modes
+ */
+typedef enum {
+    POWER_MODE_PERFORMANCE,     // fixed maximal frequency, no sleep
+    POWER_MODE_DFS,             // dynamic frequency scaling between the cycles
+    POWER_MODE_LIGHT_SLEEP,     // dynamic frequency scaling and automatic light sleep between the cycles
+    POWER_MODE_DEEP_SLEEP,      // deep sleep between the cycles (see deep_sleep.h), light sleep while awake
+} power_mode_t;
+
+/**
+ * Power management statistics
+ */
+typedef struct {
+    uint16_t mode;                      // power_mode_t in effect
+    bool pm_supported;                  // firmware is built with power management support (CONFIG_PM_ENABLE)
+    bool cpu_stats_supported;           // firmware is built with CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    uint32_t cpu_active_permille;       // share of time the CPU is not idle (nor light sleeping), 0.1 %
+    uint32_t cpu_max_freq_permille;     // share of time spent sampling or publishing (frequency locked at max), 0.1 %
+    uint32_t radio_active_permille;     // share of time spent publishing, 0.1 %
+    uint32_t wake_latency_us_last;      // delay between the scheduled wake-up and the first ADC read, us
+    uint32_t wake_latency_us_avg;
+    uint32_t wake_latency_us_max;
+    uint32_t cycles;                    // number of measured wake-ups
+} power_stats_t;
+
+/**
+ * @brief Configure esp_pm according to the power mode setting and create the locks
+ */
+esp_err_t power_init(void);
+
+/**
+ * @brief Hold the maximal frequency and prevent light sleep while sampling
+ */
+void power_sampling_begin(void);
+void power_sampling_end(void);
+
+/**
+ * @brief Hold the maximal frequency while publishing
+ */
+void power_publish_begin(void);
+void power_publish_end(void);
+
+/**
+ * @brief Record the delay between the scheduled wake-up time and the start of sampling
+ */
+void power_record_wake_latency(int64_t scheduled_us, int64_t sampling_start_us);
+
+/**
+ * @brief Get a copy of the statistics
+ */
+power_stats_t power_get_stats(void);
+
+#endif
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "common.h"
+#include "radio.h"
+#include "settings.h"
+
+/**
+ * Wi-Fi transmit bursts couple into the ADC input, so sampling and publishing are kept apart:
+ *  - a sampling burst starts only when no publish is in flight (QoS 1 not acknowledged yet,
+ *    or handed to the stack less than RADIO_TX_SETTLE_MS ago);
+ *  - publishes from any task wait until the running burst is over.
+ * Both waits are bounded, so a lost acknowledge or a long burst can only delay, never block.
+ */
+
+#define RADIO_BIT_NOT_SAMPLING  BIT0
+
+static EventGroupHandle_t radio_event_group = NULL;
+static portMUX_TYPE radio_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static radio_stats_t radio_stats;
+static int64_t last_tx_us = 0;
+static uint32_t activity_seq = 0;           // incremented on every radio activity we know about
+
+// burst state
+static uint32_t burst_activity_seq = 0;
+static bool burst_radio_busy = false;
+static bool burst_ps_changed = false;
+static wifi_ps_type_t burst_saved_ps = WIFI_PS_NONE;
+
+// settings snapshot, reloaded when they change instead of read from NVS before every burst
+static volatile uint16_t radio_hold_ps = S_DEFAULT_RADIO_HOLD_PS;
+static settings_mask_t radio_settings_keys = 0;
+
+static void radio_settings_reload(void) {
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for the radio settings, keeping the previous ones");
+        return;
+    }
+    settings_set_defaults(values);
+    settings_load(values);
+    radio_hold_ps = values->radio_hold_ps;
+    free(values);
+}
+
+/**
+ * @brief SETTINGS_EVENT_CHANGED handler, runs in the default event loop task
+ */
+static void radio_settings_changed(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    settings_mask_t changed = *(const settings_mask_t *)event_data;
+    if (changed & radio_settings_keys) {
+        radio_settings_reload();
+    }
+}
+
+esp_err_t radio_init(void) {
+    if (radio_event_group == NULL) {
+        radio_event_group = xEventGroupCreate();
+        if (radio_event_group == NULL) {
+            ESP_LOGE(TAG, "Failed to create radio coordination event group");
+            return ESP_ERR_NO_MEM;
+        }
+        xEventGroupSetBits(radio_event_group, RADIO_BIT_NOT_SAMPLING);
+
+        radio_settings_keys = settings_keys_mask(S_KEY_RADIO_HOLD_PS, NULL);
+        radio_settings_reload();
+        esp_err_t err = esp_event_handler_register(SETTINGS_EVENT, SETTINGS_EVENT_CHANGED, radio_settings_changed, NULL);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to subscribe to the settings changes: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+static bool radio_is_busy(void) {
+    bool busy;
+    portENTER_CRITICAL(&radio_spinlock);
+    busy = radio_stats.publishes_in_flight > 0 || (esp_timer_get_time() - last_tx_us) < (int64_t)RADIO_TX_SETTLE_MS * 1000;
+    portEXIT_CRITICAL(&radio_spinlock);
+    return busy;
+}
+
+void radio_sampling_begin(void) {
+    if (radio_event_group == NULL) {
+        return;
+    }
+
+    // Wait for the publishes in flight to complete
+    int waited_ms = 0;
+    while (radio_is_busy() && waited_ms < RADIO_IDLE_WAIT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(RADIO_IDLE_POLL_MS));
+        waited_ms += RADIO_IDLE_POLL_MS;
+    }
+
+    // Block new publishes
+    xEventGroupClearBits(radio_event_group, RADIO_BIT_NOT_SAMPLING);
+
+    portENTER_CRITICAL(&radio_spinlock);
+    radio_stats.bursts++;
+    if (waited_ms > 0) {
+        radio_stats.bursts_waited++;
+    }
+    burst_activity_seq = activity_seq;
+    burst_radio_busy = radio_stats.publishes_in_flight > 0 || (esp_timer_get_time() - last_tx_us) < (int64_t)RADIO_TX_SETTLE_MS * 1000;
+    portEXIT_CRITICAL(&radio_spinlock);
+
+    // Optionally let the modem sleep as much as possible during the burst
+    uint16_t hold_ps = radio_hold_ps;
+    radio_stats.hold_modem_sleep = hold_ps;
+    burst_ps_changed = false;
+    if (_DEVICE_ENABLE_WIFI && hold_ps) {
+        if (esp_wifi_get_ps(&burst_saved_ps) == ESP_OK && burst_saved_ps != WIFI_PS_MAX_MODEM) {
+            burst_ps_changed = (esp_wifi_set_ps(WIFI_PS_MAX_MODEM) == ESP_OK);
+        }
+    }
+}
+
+void radio_sampling_end(void) {
+    if (radio_event_group == NULL) {
+        return;
+    }
+
+    if (burst_ps_changed) {
+        esp_wifi_set_ps(burst_saved_ps);
+        burst_ps_changed = false;
+    }
+
+    portENTER_CRITICAL(&radio_spinlock);
+    bool overlapped = burst_radio_busy || activity_seq != burst_activity_seq;
+    if (overlapped) {
+        radio_stats.bursts_overlapped++;
+    }
+    portEXIT_CRITICAL(&radio_spinlock);
+
+    if (overlapped) {
+        ESP_LOGD(TAG, "Sampling burst overlapped radio activity");
+    }
+
+    xEventGroupSetBits(radio_event_group, RADIO_BIT_NOT_SAMPLING);
+}
+
+void radio_publish_gate(void) {
+    if (radio_event_group == NULL) {
+        return;
+    }
+    if ((xEventGroupGetBits(radio_event_group) & RADIO_BIT_NOT_SAMPLING) == 0) {
+        portENTER_CRITICAL(&radio_spinlock);
+        radio_stats.publishes_deferred++;
+        portEXIT_CRITICAL(&radio_spinlock);
+        if ((xEventGroupWaitBits(radio_event_group, RADIO_BIT_NOT_SAMPLING, pdFALSE, pdTRUE, pdMS_TO_TICKS(RADIO_DEFER_MAX_MS)) & RADIO_BIT_NOT_SAMPLING) == 0) {
+            ESP_LOGW(TAG, "Sampling burst takes too long, publishing anyway");
+        }
+    }
+}
+
+void radio_publish_sent(int msg_id, int qos) {
+    portENTER_CRITICAL(&radio_spinlock);
+    last_tx_us = esp_timer_get_time();
+    activity_seq++;
+    if (msg_id > 0 && qos > 0) {
+        radio_stats.publishes_in_flight++;
+    }
+    portEXIT_CRITICAL(&radio_spinlock);
+}
+
+void radio_publish_acked(void) {
+    portENTER_CRITICAL(&radio_spinlock);
+    if (radio_stats.publishes_in_flight > 0) {
+        radio_stats.publishes_in_flight--;
+    }
+    activity_seq++;
+    portEXIT_CRITICAL(&radio_spinlock);
+}
+
+void radio_note_activity(void) {
+    portENTER_CRITICAL(&radio_spinlock);
+    activity_seq++;
+    portEXIT_CRITICAL(&radio_spinlock);
+}
+
+void radio_reset_in_flight(void) {
+    portENTER_CRITICAL(&radio_spinlock);
+    radio_stats.publishes_in_flight = 0;
+    activity_seq++;
+    portEXIT_CRITICAL(&radio_spinlock);
+}
+
+radio_stats_t radio_get_stats(void) {
+    radio_stats_t stats;
+    portENTER_CRITICAL(&radio_spinlock);
+    stats = radio_stats;
+    portEXIT_CRITICAL(&radio_spinlock);
+    return stats;
+}
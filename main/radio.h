@@ -0,0 +1,73 @@
+#ifndef RADIO_H
+#define RADIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "common.h"
+
+#define RADIO_TX_SETTLE_MS      50          // radio is considered busy for this long after a publish was handed to the stack
+#define RADIO_IDLE_WAIT_MS      500         // maximal wait for publishes in flight before sampling starts anyway
+#define RADIO_IDLE_POLL_MS      10          // polling period while waiting for the radio to become idle
+#define RADIO_DEFER_MAX_MS      5000        // maximal time a publish is deferred by a sampling burst (auto-tune burst is ~4 s)
+
+/**
+ * Sampling / radio coordination counters
+ */
+typedef struct {
+    uint32_t bursts;                // sampling bursts
+    uint32_t bursts_overlapped;     // bursts which overlapped radio activity
+    uint32_t bursts_waited;         // bursts delayed until publishes in flight completed
+    uint32_t publishes_deferred;    // publishes delayed until a burst completed
+    uint32_t publishes_in_flight;   // QoS 1 publishes waiting for acknowledge right now
+    bool hold_modem_sleep;          // modem sleep is held across the bursts
+} radio_stats_t;
+
+/**
+ * @brief Initialize the coordination (call once, before sampling or publishing starts)
+ */
+esp_err_t radio_init(void);
+
+/**
+ * @brief Start a sampling burst: wait (bounded) until no publish is in flight, block new publishes
+ *        and optionally hold Wi-Fi modem sleep until radio_sampling_end()
+ */
+void radio_sampling_begin(void);
+
+/**
+ * @brief Finish the sampling burst and release the deferred publishes
+ */
+void radio_sampling_end(void);
+
+/**
+ * @brief Wait (bounded) until no sampling burst is running. Called before every publish.
+ */
+void radio_publish_gate(void);
+
+/**
+ * @brief Register a publish handed to the network stack
+ */
+void radio_publish_sent(int msg_id, int qos);
+
+/**
+ * @brief Register the broker acknowledge of a QoS 1 publish
+ */
+void radio_publish_acked(void);
+
+/**
+ * @brief Register other radio activity (incoming data, connection events)
+ */
+void radio_note_activity(void);
+
+/**
+ * @brief Forget publishes in flight (connection was re-established or lost)
+ */
+void radio_reset_in_flight(void);
+
+/**
+ * @brief Get a copy of the counters
+ */
+radio_stats_t radio_get_stats(void);
+
+#endif
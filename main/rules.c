@@ -0,0 +1,547 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "common.h"
+#include "rules.h"
+#include "settings.h"
+#include "mqtt.h"
+
+static alarm_rule_set_t rule_set;
+static SemaphoreHandle_t rules_mutex = NULL;
+
+/**
+ * Variable names as used in the rules text. Order follows rule_var_t.
+ */
+static const char *rule_var_names[RULE_VAR_COUNT] = {
+    "pressure",
+    "dpdt",
+    "voltage",
+    "fault",
+    "fault_cal",
+    "fault_filter",
+    "fault_low",
+    "fault_high",
+};
+
+typedef struct {
+    const char *pos;            // current parsing position
+    const char *begin;          // beginning of the rule, used for error positions
+    alarm_rule_t *rule;
+    int depth;                  // current evaluation stack depth
+    char *error;
+    size_t error_len;
+    bool failed;
+} rule_parser_t;
+
+static void rule_parser_fail(rule_parser_t *p, const char *message) {
+    if (!p->failed && p->error != NULL) {
+        snprintf(p->error, p->error_len, "rule '%s': %s at position %d", p->rule->name, message, (int)(p->pos - p->begin));
+    }
+    p->failed = true;
+}
+
+static void rule_skip_spaces(rule_parser_t *p) {
+    while (*p->pos == ' ' || *p->pos == '\t' || *p->pos == '\r') {
+        p->pos++;
+    }
+}
+
+/**
+ * @brief: Emit operation. `stack_effect` is the change of the evaluation stack depth.
+ */
+static void rule_emit(rule_parser_t *p, rule_op_t op, int stack_effect) {
+    if (p->failed) {
+        return;
+    }
+    if (p->rule->code_len + 1 >= RULE_CODE_SIZE) {
+        rule_parser_fail(p, "expression is too long");
+        return;
+    }
+    p->rule->code[p->rule->code_len++] = (uint8_t)op;
+    p->depth += stack_effect;
+    if (p->depth > RULE_STACK_DEPTH) {
+        rule_parser_fail(p, "expression is too deep");
+    }
+}
+
+static void rule_emit_arg(rule_parser_t *p, rule_op_t op, uint8_t arg) {
+    rule_emit(p, op, 1);
+    if (p->failed) {
+        return;
+    }
+    if (p->rule->code_len + 1 >= RULE_CODE_SIZE) {
+        rule_parser_fail(p, "expression is too long");
+        return;
+    }
+    p->rule->code[p->rule->code_len++] = arg;
+}
+
+/**
+ * @brief: Accept operator symbol
+ */
+static bool rule_accept(rule_parser_t *p, const char *symbol) {
+    rule_skip_spaces(p);
+    size_t len = strlen(symbol);
+    if (strncmp(p->pos, symbol, len) == 0) {
+        p->pos += len;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief: Accept keyword (and, or, not) followed by a non-identifier character
+ */
+static bool rule_accept_word(rule_parser_t *p, const char *word) {
+    rule_skip_spaces(p);
+    size_t len = strlen(word);
+    if (strncasecmp(p->pos, word, len) == 0 && !isalnum((unsigned char)p->pos[len]) && p->pos[len] != '_') {
+        p->pos += len;
+        return true;
+    }
+    return false;
+}
+
+static void rule_parse_or(rule_parser_t *p);
+
+static void rule_parse_primary(rule_parser_t *p) {
+    rule_skip_spaces(p);
+
+    if (rule_accept(p, "(")) {
+        rule_parse_or(p);
+        if (!rule_accept(p, ")")) {
+            rule_parser_fail(p, "')' expected");
+        }
+        return;
+    }
+
+    if (isdigit((unsigned char)*p->pos) || *p->pos == '.') {
+        char *end;
+        float value = strtof(p->pos, &end);
+        if (end == p->pos) {
+            rule_parser_fail(p, "invalid number");
+            return;
+        }
+        p->pos = end;
+        if (p->rule->const_count >= RULE_CONST_MAX) {
+            rule_parser_fail(p, "too many constants");
+            return;
+        }
+        p->rule->consts[p->rule->const_count] = value;
+        rule_emit_arg(p, RULE_OP_CONST, p->rule->const_count++);
+        return;
+    }
+
+    if (isalpha((unsigned char)*p->pos)) {
+        const char *start = p->pos;
+        while (isalnum((unsigned char)*p->pos) || *p->pos == '_') {
+            p->pos++;
+        }
+        size_t len = p->pos - start;
+        for (int i = 0; i < RULE_VAR_COUNT; i++) {
+            if (strlen(rule_var_names[i]) == len && strncasecmp(start, rule_var_names[i], len) == 0) {
+                rule_emit_arg(p, RULE_OP_VAR, (uint8_t)i);
+                return;
+            }
+        }
+        p->pos = start;
+        rule_parser_fail(p, "unknown variable");
+        return;
+    }
+
+    rule_parser_fail(p, "value expected");
+}
+
+static void rule_parse_unary(rule_parser_t *p) {
+    if (rule_accept(p, "-")) {
+        rule_parse_unary(p);
+        rule_emit(p, RULE_OP_NEG, 0);
+        return;
+    }
+    rule_parse_primary(p);
+}
+
+static void rule_parse_term(rule_parser_t *p) {
+    rule_parse_unary(p);
+    while (!p->failed) {
+        if (rule_accept(p, "*")) {
+            rule_parse_unary(p);
+            rule_emit(p, RULE_OP_MUL, -1);
+        } else if (rule_accept(p, "/")) {
+            rule_parse_unary(p);
+            rule_emit(p, RULE_OP_DIV, -1);
+        } else {
+            break;
+        }
+    }
+}
+
+static void rule_parse_sum(rule_parser_t *p) {
+    rule_parse_term(p);
+    while (!p->failed) {
+        if (rule_accept(p, "+")) {
+            rule_parse_term(p);
+            rule_emit(p, RULE_OP_ADD, -1);
+        } else if (rule_accept(p, "-")) {
+            rule_parse_term(p);
+            rule_emit(p, RULE_OP_SUB, -1);
+        } else {
+            break;
+        }
+    }
+}
+
+static void rule_parse_compare(rule_parser_t *p) {
+    rule_parse_sum(p);
+
+    // two-character operators first
+    static const struct { const char *symbol; rule_op_t op; } compare_ops[] = {
+        { "<=", RULE_OP_LE }, { ">=", RULE_OP_GE }, { "==", RULE_OP_EQ }, { "!=", RULE_OP_NE },
+        { "<",  RULE_OP_LT }, { ">",  RULE_OP_GT },
+    };
+    for (size_t i = 0; i < sizeof(compare_ops) / sizeof(compare_ops[0]); i++) {
+        if (rule_accept(p, compare_ops[i].symbol)) {
+            rule_parse_sum(p);
+            rule_emit(p, compare_ops[i].op, -1);
+            return;
+        }
+    }
+}
+
+static void rule_parse_not(rule_parser_t *p) {
+    rule_skip_spaces(p);
+    if ((p->pos[0] == '!' && p->pos[1] != '=' && rule_accept(p, "!")) || rule_accept_word(p, "not")) {
+        rule_parse_not(p);
+        rule_emit(p, RULE_OP_NOT, 0);
+        return;
+    }
+    rule_parse_compare(p);
+}
+
+static void rule_parse_and(rule_parser_t *p) {
+    rule_parse_not(p);
+    while (!p->failed && (rule_accept(p, "&&") || rule_accept_word(p, "and"))) {
+        rule_parse_not(p);
+        rule_emit(p, RULE_OP_AND, -1);
+    }
+}
+
+static void rule_parse_or(rule_parser_t *p) {
+    rule_parse_and(p);
+    while (!p->failed && (rule_accept(p, "||") || rule_accept_word(p, "or"))) {
+        rule_parse_and(p);
+        rule_emit(p, RULE_OP_OR, -1);
+    }
+}
+
+/**
+ * @brief: Compile one `name: expression` statement. `end` points right after the statement.
+ */
+static esp_err_t rule_compile_statement(const char *begin, const char *end, alarm_rule_t *rule, char *error, size_t error_len) {
+    char statement[RULE_STATEMENT_LENGTH + 1];
+    size_t len = end - begin;
+    if (len >= sizeof(statement)) {
+        // A cut statement may still compile, into another rule
+        if (error != NULL) {
+            snprintf(error, error_len, "statement too long (max %d characters): %.16s...", RULE_STATEMENT_LENGTH, begin);
+        }
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(statement, begin, len);
+    statement[len] = '\0';
+
+    memset(rule, 0, sizeof(alarm_rule_t));
+
+    rule_parser_t p = {
+        .pos = statement,
+        .begin = statement,
+        .rule = rule,
+        .depth = 0,
+        .error = error,
+        .error_len = error_len,
+        .failed = false,
+    };
+
+    // rule name
+    rule_skip_spaces(&p);
+    const char *name_start = p.pos;
+    while (isalnum((unsigned char)*p.pos) || *p.pos == '_') {
+        p.pos++;
+    }
+    size_t name_len = p.pos - name_start;
+    if (name_len == 0 || name_len > RULE_NAME_LENGTH) {
+        strcpy(rule->name, "?");
+        rule_parser_fail(&p, "rule name of 1-15 characters expected");
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(rule->name, name_start, name_len);
+    rule->name[name_len] = '\0';
+
+    if (!rule_accept(&p, ":")) {
+        rule_parser_fail(&p, "':' expected");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    rule_parse_or(&p);
+    rule_skip_spaces(&p);
+    if (!p.failed && *p.pos != '\0') {
+        rule_parser_fail(&p, "unexpected character");
+    }
+    rule_emit(&p, RULE_OP_END, 0);
+
+    return p.failed ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+/**
+ * @brief: Compile rules text into bytecode
+ */
+esp_err_t rules_compile(const char *text, alarm_rule_set_t *set, char *error, size_t error_len) {
+    memset(set, 0, sizeof(alarm_rule_set_t));
+    if (error != NULL && error_len > 0) {
+        error[0] = '\0';
+    }
+    if (text == NULL) {
+        return ESP_OK;
+    }
+
+    const char *pos = text;
+    while (*pos) {
+        const char *end = pos;
+        while (*end && *end != ';' && *end != '\n') {
+            end++;
+        }
+
+        // skip empty statements
+        const char *c = pos;
+        while (c < end && isspace((unsigned char)*c)) {
+            c++;
+        }
+        if (c < end) {
+            if (set->count >= RULES_MAX) {
+                if (error != NULL) {
+                    snprintf(error, error_len, "too many rules (max %d)", RULES_MAX);
+                }
+                return ESP_ERR_INVALID_SIZE;
+            }
+            esp_err_t err = rule_compile_statement(c, end, &set->rules[set->count], error, error_len);
+            if (err != ESP_OK) {
+                return err;
+            }
+            set->count++;
+        }
+
+        pos = *end ? end + 1 : end;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Evaluate compiled rule against the variables (indexed by rule_var_t)
+ */
+bool rule_evaluate(const alarm_rule_t *rule, const float *vars) {
+    float stack[RULE_STACK_DEPTH];
+    int sp = 0;
+
+    for (int pc = 0; pc < rule->code_len; pc++) {
+        float a, b;
+        switch ((rule_op_t)rule->code[pc]) {
+            case RULE_OP_END:
+                return sp > 0 && stack[sp - 1] != 0.0f;
+            case RULE_OP_CONST:
+                stack[sp++] = rule->consts[rule->code[++pc]];
+                break;
+            case RULE_OP_VAR:
+                stack[sp++] = vars[rule->code[++pc]];
+                break;
+            case RULE_OP_NEG:
+                stack[sp - 1] = -stack[sp - 1];
+                break;
+            case RULE_OP_NOT:
+                stack[sp - 1] = stack[sp - 1] == 0.0f ? 1.0f : 0.0f;
+                break;
+            default:
+                b = stack[--sp];
+                a = stack[sp - 1];
+                switch ((rule_op_t)rule->code[pc]) {
+                    case RULE_OP_ADD: a = a + b; break;
+                    case RULE_OP_SUB: a = a - b; break;
+                    case RULE_OP_MUL: a = a * b; break;
+                    case RULE_OP_DIV: a = b != 0.0f ? a / b : 0.0f; break;
+                    case RULE_OP_LT:  a = a <  b; break;
+                    case RULE_OP_LE:  a = a <= b; break;
+                    case RULE_OP_GT:  a = a >  b; break;
+                    case RULE_OP_GE:  a = a >= b; break;
+                    case RULE_OP_EQ:  a = a == b; break;
+                    case RULE_OP_NE:  a = a != b; break;
+                    case RULE_OP_AND: a = (a != 0.0f) && (b != 0.0f); break;
+                    case RULE_OP_OR:  a = (a != 0.0f) || (b != 0.0f); break;
+                    default: return false;
+                }
+                stack[sp - 1] = a;
+                break;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief: Load the rules from the settings and compile them
+ */
+esp_err_t rules_init(void) {
+    if (rules_mutex == NULL) {
+        rules_mutex = xSemaphoreCreateMutex();
+        if (rules_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create alarm rules mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return rules_reload();
+}
+
+/**
+ * @brief: Re-compile the rules after they have been changed in the settings. Rules keeping their names keep their state.
+ */
+esp_err_t rules_reload(void) {
+    if (rules_mutex == NULL) {
+        // Not initialized yet, the sensor task will load the rules itself
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The rules just saved, their NVS entry is written later
+    settings_values_t *values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    alarm_rule_set_t *compiled = (alarm_rule_set_t *)malloc(sizeof(alarm_rule_set_t));
+    if (values == NULL || compiled == NULL) {
+        free(values);
+        free(compiled);
+        return ESP_ERR_NO_MEM;
+    }
+    settings_set_defaults(values);
+    esp_err_t err = settings_load(values);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to load the alarm rules from the settings");
+        free(values);
+        free(compiled);
+        return err;
+    }
+
+    char error[RULE_ERROR_LENGTH];
+    err = rules_compile(values->alarm_rules, compiled, error, sizeof(error));
+    free(values);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to compile alarm rules: %s", error);
+        free(compiled);
+        return err;
+    }
+
+    xSemaphoreTake(rules_mutex, portMAX_DELAY);
+    for (int i = 0; i < compiled->count; i++) {
+        for (int j = 0; j < rule_set.count; j++) {
+            if (strcmp(compiled->rules[i].name, rule_set.rules[j].name) == 0) {
+                compiled->rules[i].active = rule_set.rules[j].active;
+                compiled->rules[i].unsent = rule_set.rules[j].unsent;
+                break;
+            }
+        }
+    }
+    memcpy(&rule_set, compiled, sizeof(alarm_rule_set_t));
+    xSemaphoreGive(rules_mutex);
+
+    free(compiled);
+    ESP_LOGI(TAG, "Compiled %d alarm rule(s)", rule_set.count);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Copy the compiled rules together with their state
+ */
+void rules_get(alarm_rule_set_t *set) {
+    if (rules_mutex == NULL) {
+        set->count = 0;
+        return;
+    }
+    xSemaphoreTake(rules_mutex, portMAX_DELAY);
+    memcpy(set, &rule_set, sizeof(alarm_rule_set_t));
+    xSemaphoreGive(rules_mutex);
+}
+
+/**
+ * @brief: Evaluate the rules of the set and flag the state changes as unsent
+ */
+bool rules_update(alarm_rule_set_t *set, const sensor_data_t *s_data) {
+    float vars[RULE_VAR_COUNT] = {
+        [RULE_VAR_PRESSURE] = s_data->pressure,
+        [RULE_VAR_DPDT] = s_data->pressure_rate,
+        [RULE_VAR_VOLTAGE] = s_data->voltage,
+        [RULE_VAR_FAULT] = s_data->fault_flags != SENSOR_FAULT_NONE,
+        [RULE_VAR_FAULT_CAL] = (s_data->fault_flags & SENSOR_FAULT_NO_CALIBRATION) != 0,
+        [RULE_VAR_FAULT_FILTER] = (s_data->fault_flags & SENSOR_FAULT_FILTER_EMPTY) != 0,
+        [RULE_VAR_FAULT_LOW] = (s_data->fault_flags & SENSOR_FAULT_SIGNAL_LOW) != 0,
+        [RULE_VAR_FAULT_HIGH] = (s_data->fault_flags & SENSOR_FAULT_SIGNAL_HIGH) != 0,
+    };
+
+    bool unsent = false;
+    for (int i = 0; i < set->count; i++) {
+        alarm_rule_t *rule = &set->rules[i];
+        bool active = rule_evaluate(rule, vars);
+        if (active != rule->active) {
+            rule->active = active;
+            rule->unsent = true;
+            ESP_LOGW(TAG, "Alarm rule '%s' %s", rule->name, active ? "FIRING" : "cleared");
+        }
+        unsent = unsent || rule->unsent;
+    }
+    return unsent;
+}
+
+/**
+ * @brief: Evaluate all rules after a reading and publish alarm state changes immediately
+ */
+void rules_process(const sensor_data_t *s_data) {
+    if (rules_mutex == NULL) {
+        return;
+    }
+
+    // The states to publish are collected under the lock and published after it, the publish may wait for the network
+    struct {
+        char name[RULE_NAME_LENGTH + 1];
+        bool active;
+    } unsent[RULES_MAX];
+    int unsent_count = 0;
+
+    xSemaphoreTake(rules_mutex, portMAX_DELAY);
+    if (rules_update(&rule_set, s_data)) {
+        for (int i = 0; i < rule_set.count; i++) {
+            alarm_rule_t *rule = &rule_set.rules[i];
+            if (rule->unsent) {
+                strcpy(unsent[unsent_count].name, rule->name);
+                unsent[unsent_count].active = rule->active;
+                unsent_count++;
+            }
+        }
+    }
+    xSemaphoreGive(rules_mutex);
+
+    for (int i = 0; i < unsent_count; i++) {
+        if (mqtt_publish_alarm(unsent[i].name, unsent[i].active, s_data) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to publish alarm '%s', retrying with the next reading", unsent[i].name);
+            continue;
+        }
+        // Done, unless the rules were reloaded or the state changed again in the meantime
+        xSemaphoreTake(rules_mutex, portMAX_DELAY);
+        for (int j = 0; j < rule_set.count; j++) {
+            alarm_rule_t *rule = &rule_set.rules[j];
+            if (strcmp(rule->name, unsent[i].name) == 0 && rule->active == unsent[i].active) {
+                rule->unsent = false;
+                break;
+            }
+        }
+        xSemaphoreGive(rules_mutex);
+    }
+}
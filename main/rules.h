@@ -0,0 +1,126 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include "esp_err.h"
+
+#include "common.h"
+#include "sensor.h"
+
+#define RULES_MAX               8       // Maximal number of alarm rules
+#define RULE_NAME_LENGTH        15      // Maximal length of a rule name
+#define RULE_CODE_SIZE          48      // Bytecode size per rule
+#define RULE_CONST_MAX          8       // Number of numeric constants per rule
+#define RULE_STACK_DEPTH        8       // Evaluation stack depth
+#define RULE_STATEMENT_LENGTH   128     // Maximal length of a single `name: expression` statement
+#define RULE_ERROR_LENGTH       96      // Length of the compilation error message
+
+/**
+ * Rule variables (inputs of the expressions)
+ */
+typedef enum {
+    RULE_VAR_PRESSURE,          // pressure, Pa
+    RULE_VAR_DPDT,              // pressure rate of change, Pa/s
+    RULE_VAR_VOLTAGE,           // sensor voltage, V
+    RULE_VAR_FAULT,             // 1 if any fault flag is set
+    RULE_VAR_FAULT_CAL,         // SENSOR_FAULT_NO_CALIBRATION
+    RULE_VAR_FAULT_FILTER,      // SENSOR_FAULT_FILTER_EMPTY
+    RULE_VAR_FAULT_LOW,         // SENSOR_FAULT_SIGNAL_LOW
+    RULE_VAR_FAULT_HIGH,        // SENSOR_FAULT_SIGNAL_HIGH
+    RULE_VAR_COUNT,
+} rule_var_t;
+
+/**
+ * Bytecode operations. OP_CONST and OP_VAR are followed by a one-byte operand.
+ */
+typedef enum {
+    RULE_OP_END,
+    RULE_OP_CONST,
+    RULE_OP_VAR,
+    RULE_OP_NEG,
+    RULE_OP_ADD,
+    RULE_OP_SUB,
+    RULE_OP_MUL,
+    RULE_OP_DIV,
+    RULE_OP_LT,
+    RULE_OP_LE,
+    RULE_OP_GT,
+    RULE_OP_GE,
+    RULE_OP_EQ,
+    RULE_OP_NE,
+    RULE_OP_AND,
+    RULE_OP_OR,
+    RULE_OP_NOT,
+} rule_op_t;
+
+/**
+ * Compiled alarm rule
+ */
+typedef struct {
+    char name[RULE_NAME_LENGTH + 1];
+    uint8_t code[RULE_CODE_SIZE];
+    uint8_t code_len;
+    float consts[RULE_CONST_MAX];
+    uint8_t const_count;
+    bool active;                // result of the last evaluation, used for edge detection
+    bool unsent;                // the state was not published yet, retried with the next reading
+} alarm_rule_t;
+
+typedef struct {
+    alarm_rule_t rules[RULES_MAX];
+    uint8_t count;
+} alarm_rule_set_t;
+
+/**
+ * @brief Compile rules text into bytecode
+ *
+ * Rules are separated by ';' or new lines, each one is `name: expression`. Expressions support numbers, variables
+ * (pressure, dpdt, voltage, fault, fault_cal, fault_filter, fault_low, fault_high), arithmetic (+ - * /),
+ * comparisons (< <= > >= == !=), logic (and/&&, or/||, not/!) and parentheses. Example:
+ *
+ *     low: pressure < 150000; leak: dpdt < -500 and not fault
+ *
+ * @param[in]  text rules source
+ * @param[out] set compiled rules
+ * @param[out] error error message buffer (RULE_ERROR_LENGTH), may be NULL
+ * @return
+ *         - ESP_OK if compiled
+ *         - ESP_ERR_INVALID_ARG if a statement is not valid
+ *         - ESP_ERR_INVALID_SIZE if there are more than RULES_MAX rules or a statement is longer than RULE_STATEMENT_LENGTH
+ */
+esp_err_t rules_compile(const char *text, alarm_rule_set_t *set, char *error, size_t error_len);
+
+/**
+ * @brief Evaluate compiled rule against the sensor reading
+ */
+bool rule_evaluate(const alarm_rule_t *rule, const float *vars);
+
+/**
+ * @brief Load the rules from the settings and compile them
+ */
+esp_err_t rules_init(void);
+
+/**
+ * @brief Re-compile the rules after they have been changed in the settings
+ */
+esp_err_t rules_reload(void);
+
+/**
+ * @brief Copy the compiled rules together with their state (empty set before rules_init())
+ */
+void rules_get(alarm_rule_set_t *set);
+
+/**
+ * @brief Evaluate the rules of a set without publishing. State changes are flagged as unsent, the caller publishes
+ *        them and clears the flags.
+ *
+ * @return true if any rule of the set has an unsent state
+ */
+bool rules_update(alarm_rule_set_t *set, const sensor_data_t *s_data);
+
+/**
+ * @brief Evaluate all rules after a reading and publish alarm state changes immediately. A state that could not be
+ *        published is retried with the next reading.
+ */
+void rules_process(const sensor_data_t *s_data);
+
+#endif
@@ -2,6 +2,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_check.h"
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
@@ -13,9 +15,37 @@
 #include "settings.h"
 #include "mqtt.h"
 #include "zigbee.h"
+#include "autotune.h"
+#include "rules.h"
+#include "wake_monitor.h"
+#include "radio.h"
+#include "power.h"
+#include "deep_sleep.h"
+#include "history.h"
 #include "non_volatile_storage.h"
 
 sensor_data_t sensor_data;
+static volatile uint32_t sensor_data_gen = 0;       // readings taken since boot
+
+/**
+ * Settings of the measurement cycle. The snapshot is reloaded when they change, not read from NVS every cycle.
+ */
+typedef struct {
+    sensor_sampling_t sampling;
+    float voltage_offset;
+    uint32_t linear_multiplier;
+    uint16_t read_interval;
+    uint16_t mqtt_connect;
+    uint16_t wake_monitor;
+    uint32_t wake_band_low;
+    uint32_t wake_band_high;
+    uint16_t autotune;              // auto-tune at boot
+} sensor_settings_t;
+
+static sensor_settings_t sensor_settings;
+static volatile bool sensor_settings_stale = true;     // set by the settings event, cleared by the reload
+static settings_mask_t sensor_settings_keys = 0;
+static TaskHandle_t sensor_task_handle = NULL;
 
 
 /**
@@ -28,10 +58,16 @@ sensor_data_t get_sensor_data() {
         .voltage = sensor_data.voltage,
         .voltage_offset = sensor_data.voltage_offset,
         .voltage_raw = sensor_data.voltage_raw,
+        .pressure_rate = sensor_data.pressure_rate,
+        .fault_flags = sensor_data.fault_flags,
     };
 
     return s_data;
 }
+
+uint32_t sensor_data_generation(void) {
+    return sensor_data_gen;
+}
 /*---------------------------------------------------------------
         ADC Calibration
 ---------------------------------------------------------------*/
@@ -98,8 +134,161 @@ void sensor_adc_calibration_deinit(adc_cali_handle_t handle)
 }
 
 
+/**
+ * @brief: Initialize ADC1 one-shot unit and calibration for the pressure sensor
+ *
+ * @return true if the calibration is available
+ */
+bool sensor_adc_init(adc_oneshot_unit_handle_t *adc1_handle, adc_cali_handle_t *adc1_cali_handle) {
+    //-------------ADC1 Init---------------//
+    adc_oneshot_unit_init_cfg_t init_config1 = {
+        .unit_id = ADC_UNIT_1,
+    };
+    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, adc1_handle));
+
+    //-------------ADC1 Config---------------//
+    adc_oneshot_chan_cfg_t adc_config = {
+        .atten = ADC_ATTEN,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    ESP_ERROR_CHECK(adc_oneshot_config_channel(*adc1_handle, PRESSURE_SENSOR_PIN, &adc_config));
+
+    //-------------ADC1 Calibration Init---------------//
+    return sensor_adc_calibration_init(ADC_UNIT_1, PRESSURE_SENSOR_PIN, ADC_ATTEN, adc1_cali_handle);
+}
+
+/**
+ * @brief: Reload the settings snapshot, in the sensor task
+ */
+static void sensor_settings_reload(void) {
+    settings_values_t *values = malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for the sensor settings, keeping the previous ones");
+        return;
+    }
+    sensor_settings_stale = false;
+    settings_set_defaults(values);
+    settings_load(values);
+
+    sensor_settings.sampling.samples = values->sensor_samples;
+    sensor_settings.sampling.interval = values->sensor_smp_int;
+    sensor_settings.sampling.deviation = values->sensor_deviate;
+    sensor_settings.voltage_offset = values->sensor_offset;
+    sensor_settings.linear_multiplier = values->sensor_linear_multiplier;
+    sensor_settings.read_interval = values->sensor_intervl;
+    sensor_settings.mqtt_connect = values->mqtt_connect;
+    sensor_settings.wake_monitor = values->wake_monitor;
+    sensor_settings.wake_band_low = values->wake_band_low;
+    sensor_settings.wake_band_high = values->wake_band_high;
+    sensor_settings.autotune = values->sensor_autotune;
+    free(values);
+}
+
+/**
+ * @brief: SETTINGS_EVENT_CHANGED handler. Marks the snapshot stale and wakes the sensor task up, so the new settings
+ *         apply to the next measurement, which starts right away.
+ */
+static void sensor_settings_changed(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    settings_mask_t changed = *(const settings_mask_t *)event_data;
+    if ((changed & sensor_settings_keys) == 0) {
+        return;
+    }
+    sensor_settings_stale = true;
+    if (sensor_task_handle != NULL) {
+        xTaskNotifyGive(sensor_task_handle);
+    }
+}
+
+// ADC raw value to mV converter used by the wake monitor
+static int sensor_raw_to_mv(int raw, void *ctx) {
+    int voltage_mv = 0;
+    adc_cali_raw_to_voltage((adc_cali_handle_t)ctx, raw, &voltage_mv);
+    return voltage_mv;
+}
+
+/**
+ * @brief: Wait for the next measurement. With the wake monitor enabled the ADC digital monitor watches
+ *         the pressure band meanwhile and wakes the task as soon as the pressure leaves it.
+ *
+ * @return true if woken up by the monitor
+ */
+static bool sensor_wait_for_wake(uint16_t interval_ms, int current_mv, bool monitor_available) {
+    ulTaskNotifyTake(pdTRUE, 0);    // drop a notification left from the previous cycle
+    if (sensor_settings_stale) {
+        return false;               // changed during the measurement, start over with the new settings
+    }
+
+    // A settings change wakes the task up as well
+    if (!sensor_settings.wake_monitor || !monitor_available) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(interval_ms));
+        return false;
+    }
+
+    // No band configured (or no calibration to convert it) is the same as the monitor off, the failure is reported once
+    static bool arm_failed = false;
+    wake_band_t band = wake_band_from_pressure(sensor_settings.wake_band_low, sensor_settings.wake_band_high,
+                                               sensor_data.voltage_offset, sensor_data.sensor_linear_multiplier);
+    esp_err_t err = wake_monitor_arm(&band, current_mv);
+    if (err != ESP_OK) {
+        if (err != ESP_ERR_INVALID_ARG && !arm_failed) {
+            ESP_LOGW(TAG, "Failed to arm the wake monitor (%s), falling back to periodic sampling", esp_err_to_name(err));
+        }
+        arm_failed = (err != ESP_ERR_INVALID_ARG);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(interval_ms));
+        return false;
+    }
+    arm_failed = false;
+
+    bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(interval_ms)) > 0;
+    wake_monitor_disarm();  // one-shot sampling needs the ADC back
+    wake_event_t event = wake_monitor_take_event();
+    if (!notified || event == WAKE_EVENT_NONE) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Woken up by the pressure monitor: pressure %s the band", event == WAKE_EVENT_ABOVE_HIGH ? "went above" : "went below");
+    return true;
+}
+
+/**
+ * @brief: Publish the reading restored after a warm restart, as soon as the broker is connected
+ */
+static void sensor_publish_resumed(void) {
+    if (sensor_settings.mqtt_connect == MQTT_SENSOR_MODE_DISABLE) {
+        return;
+    }
+
+    int waited_ms = 0;
+    while (!mqtt_is_connected() && waited_ms < HISTORY_RESUME_WAIT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        waited_ms += 100;
+    }
+    if (!mqtt_is_connected()) {
+        ESP_LOGW(TAG, "MQTT is not connected, the restored reading is not published");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Publishing the last good reading restored after restart: %.2f Pa", sensor_data.pressure);
+    if (mqtt_publish_sensor_data(&sensor_data) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to publish the restored reading");
+    }
+}
+
 void sensor_run(void *pvParameters) {
 
+    // Follow the settings changes instead of reading them every cycle
+    sensor_task_handle = xTaskGetCurrentTaskHandle();
+    sensor_settings_keys = settings_keys_mask(S_KEY_SENSOR_SAMPLING_COUNT, S_KEY_SENSOR_SAMPLING_INTERVAL,
+                                              S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, S_KEY_SENSOR_OFFSET,
+                                              S_KEY_SENSOR_LINEAR_MULTIPLIER, S_KEY_SENSOR_READ_INTERVAL, S_KEY_MQTT_CONNECT,
+                                              S_KEY_WAKE_MONITOR, S_KEY_WAKE_BAND_LOW, S_KEY_WAKE_BAND_HIGH, NULL);
+    ESP_ERROR_CHECK(esp_event_handler_register(SETTINGS_EVENT, SETTINGS_EVENT_CHANGED, sensor_settings_changed, NULL));
+    sensor_settings_reload();
+
+    // After a warm restart continue from the last good reading, so the consumers do not see a drop to 0
+    sensor_estimator_t estimator = { 0 };
+    bool resumed = history_restore(&sensor_data, &estimator);
+
     // wait for the device to become ready
     ESP_LOGI(TAG, "Waiting for device to become ready");
     int attempt = 0;
@@ -117,62 +306,120 @@ void sensor_run(void *pvParameters) {
     
 
     // Initialize ADC for the pressure sensor
-    //-------------ADC1 Init---------------//
     adc_oneshot_unit_handle_t adc1_handle;
-    adc_oneshot_unit_init_cfg_t init_config1 = {
-        .unit_id = ADC_UNIT_1,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, &adc1_handle));
+    adc_cali_handle_t adc1_cali_pressure_sensor_handle = NULL;
+    bool do_calibration1_pressure_sensor = sensor_adc_init(&adc1_handle, &adc1_cali_pressure_sensor_handle);
+    
 
-    //-------------ADC1 Config---------------//
-    adc_oneshot_chan_cfg_t adc_config = {
-        .atten = ADC_ATTEN,
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, PRESSURE_SENSOR_PIN, &adc_config));
+    if (!resumed) {
+        ESP_LOGI(TAG, "Preparing sensor data structure");
+        sensor_data.pressure = 0;
+        sensor_data.pressure_rate = 0;
+        sensor_data.fault_flags = SENSOR_FAULT_NONE;
+    }
 
+    // Compile alarm rules
+    if (rules_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Alarm rules are not active. Fix them on the device WEB interface.");
+    }
 
-    //-------------ADC1 Calibration Init---------------//
-    adc_cali_handle_t adc1_cali_pressure_sensor_handle = NULL;
-    bool do_calibration1_pressure_sensor = sensor_adc_calibration_init(ADC_UNIT_1, PRESSURE_SENSOR_PIN, ADC_ATTEN, &adc1_cali_pressure_sensor_handle);
-    
+    // Auto-tune sampling parameters at boot if requested
+    autotune_init();
+    if (sensor_settings.autotune) {
+        autotune_request();
+    }
 
-    ESP_LOGI(TAG, "Preparing sensor data structure");
-    sensor_data.pressure = 0;
+    // Pressure band wake-up monitor. Thresholds are converted via the calibration scheme, so it is required.
+    bool wake_monitor_available = false;
+    int burst_remaining = 0;
+    if (do_calibration1_pressure_sensor) {
+        wake_monitor_available = (wake_monitor_init(&wake_monitor_adc_ops, xTaskGetCurrentTaskHandle(), PRESSURE_SENSOR_PIN,
+                                                    sensor_raw_to_mv, adc1_cali_pressure_sensor_handle) == ESP_OK);
+    }
+
+    if (resumed) {
+        sensor_publish_resumed();
+    }
 
     ESP_LOGI(TAG, "Starting pressure sensing cycle");
 
+    int64_t scheduled_wake_us = 0;     // when the current cycle was due to start, for the wake-up latency
     while (1) {
+        // Run auto-tune if it was requested (at boot or from the WEB interface)
+        if (autotune_take_request()) {
+            autotune_run(adc1_handle, adc1_cali_pressure_sensor_handle, PRESSURE_SENSOR_PIN, do_calibration1_pressure_sensor);
+        }
+
+        // Apply the settings changed since the last cycle (including the auto-tune result)
+        if (sensor_settings_stale) {
+            sensor_settings_reload();
+        }
+
         // Read the raw sensor value from ADC
-        sensor_data.voltage_raw = perform_smart_sampling(adc1_cali_pressure_sensor_handle, adc1_handle, PRESSURE_SENSOR_PIN, do_calibration1_pressure_sensor);
+        // Keep the burst out of Wi-Fi transmissions: publishes in flight complete first, new ones wait for the burst
+        uint32_t fault_flags = SENSOR_FAULT_NONE;
+        sensor_sampling_t sampling = sensor_settings.sampling;
+        power_sampling_begin();
+        radio_sampling_begin();
+        power_record_wake_latency(scheduled_wake_us, esp_timer_get_time());
+        sensor_data.voltage_raw = perform_smart_sampling(adc1_cali_pressure_sensor_handle, adc1_handle, PRESSURE_SENSOR_PIN, do_calibration1_pressure_sensor, &sampling, &fault_flags);
+        radio_sampling_end();
+        power_sampling_end();
+        sensor_data.fault_flags = fault_flags;
 
         // Obtain the voltage in Volts
         sensor_data.voltage = sensor_data.voltage_raw / 1000.0;
 
         // Calculate pressure in KPa using the provided formula
-        ESP_ERROR_CHECK(nvs_read_float(S_NAMESPACE, S_KEY_SENSOR_OFFSET, &sensor_data.voltage_offset));
-        ESP_ERROR_CHECK(nvs_read_uint32(S_NAMESPACE, S_KEY_SENSOR_LINEAR_MULTIPLIER, &sensor_data.sensor_linear_multiplier));
+        sensor_data.voltage_offset = sensor_settings.voltage_offset;
+        sensor_data.sensor_linear_multiplier = sensor_settings.linear_multiplier;
         sensor_data.pressure = (sensor_data.voltage - sensor_data.voltage_offset) * sensor_data.sensor_linear_multiplier;  // Convert voltage to pressure in Pa
+        sensor_data.pressure_rate = sensor_estimator_update(&estimator, sensor_data.pressure, esp_timer_get_time());
+        history_record(&sensor_data, &estimator);
+        sensor_data_gen++;
 
         // Print voltage and pressure to Serial Monitor
         ESP_LOGI(TAG, "Raw ADC Value: %d, Voltage: %.3f V, Pressure: %.2f Pa", 
                  sensor_data.voltage_raw, sensor_data.voltage, sensor_data.pressure);
 
-        uint16_t mqtt_connection_mode;
-        ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
-        if (mqtt_connection_mode > MQTT_SENSOR_MODE_DISABLE) {
+        power_publish_begin();
+
+        // Evaluate alarm rules. Firing rules are published immediately.
+        rules_process(&sensor_data);
+
+        if (sensor_settings.mqtt_connect > MQTT_SENSOR_MODE_DISABLE) {
             ESP_LOGD(TAG, "Sensor Run - Before MQTT::Publish - Free Stack Space: %d", uxTaskGetStackHighWaterMark(NULL));
 
             // Publish the sensor data via MQTT
-            ESP_ERROR_CHECK(mqtt_publish_sensor_data(&sensor_data));
+            if (mqtt_publish_sensor_data(&sensor_data) != ESP_OK) {
+                ESP_LOGW(TAG, "Sensor data not published to MQTT");
+            }
 
             ESP_LOGD(TAG, "Sensor Run - After MQTT::Publish - Free Stack Space: %d", uxTaskGetStackHighWaterMark(NULL));
         }
 
-        uint16_t sensor_intervl = S_DEFAULT_SENSOR_READ_INTERVAL;
-        ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_READ_INTERVAL, &sensor_intervl));
+        power_publish_end();
+
+        // Deep sleep power mode: once the configuration window is over continue in the deep sleep cycle
+        if (deep_sleep_due()) {
+            deep_sleep_enter(&estimator);
+        }
+
+        // High-rate burst after a wake-up, slow periodic sampling otherwise
+        if (burst_remaining > 0) {
+            burst_remaining--;
+            scheduled_wake_us = esp_timer_get_time() + WAKE_BURST_INTERVAL_MS * 1000LL;
+            vTaskDelay(pdMS_TO_TICKS(WAKE_BURST_INTERVAL_MS));
+            continue;
+        }
+
+        uint16_t sensor_intervl = sensor_settings.read_interval;
         ESP_LOGI(TAG, "Next pressure measurement cycle will start in %i seconds", (int) sensor_intervl / 1000);
-        vTaskDelay(pdMS_TO_TICKS(sensor_intervl));
+        scheduled_wake_us = esp_timer_get_time() + sensor_intervl * 1000LL;
+        if (sensor_wait_for_wake(sensor_intervl, sensor_data.voltage_raw, wake_monitor_available)) {
+            burst_remaining = WAKE_BURST_READINGS - 1;     // the measurement right after the wake-up is the first one
+            scheduled_wake_us = 0;
+        }
     }
 
     //Tear Down
@@ -204,20 +451,16 @@ int calculate_median(int* data, int size) {
 }
 
 // Function to perform smart sampling and calculate average voltage
-float perform_smart_sampling(adc_cali_handle_t adc1_cali_handle, adc_oneshot_unit_handle_t adc1_handle, adc_channel_t channel, bool do_calibration1_pressure_sensor) {
+float perform_smart_sampling(adc_cali_handle_t adc1_cali_handle, adc_oneshot_unit_handle_t adc1_handle, adc_channel_t channel, bool do_calibration1_pressure_sensor, const sensor_sampling_t *sampling, uint32_t *fault_flags) {
     int adc_raw;
-    int voltage_mv;
+    int voltage_mv = 0;
     float average_voltage = 0.0;
-    uint16_t sensor_samples = (uint16_t) S_DEFAULT_SENSOR_SAMPLING_COUNT;
-    uint16_t sensor_smp_int = (uint16_t) S_DEFAULT_SENSOR_SAMPLING_INTERVAL;
-    uint16_t sensor_deviate = (uint16_t) S_DEFAULT_SENSOR_SAMPLING_MEDIAN_DEVIATION;
-
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_COUNT, &sensor_samples));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_INTERVAL, &sensor_smp_int));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, &sensor_deviate));
+    uint16_t sensor_samples = sampling->samples;
+    uint16_t sensor_smp_int = sampling->interval;
+    uint16_t sensor_deviate = sampling->deviation;
 
     int samples[sensor_samples];
-    float filtered_samples[sensor_smp_int];
+    float filtered_samples[sensor_samples];
     int num_filtered_samples = 0;
 
     // Collect NUM_SAMPLES samples every SAMPLE_INTERVAL_MS
@@ -252,7 +495,32 @@ float perform_smart_sampling(adc_cali_handle_t adc1_cali_handle, adc_oneshot_uni
     } else {
         ESP_LOGW("Sampling", "No valid samples after filtering.");
         average_voltage = median;  // Fall back to median if no samples pass the filter
+        *fault_flags |= SENSOR_FAULT_FILTER_EMPTY;
+    }
+
+    if (!do_calibration1_pressure_sensor) {
+        *fault_flags |= SENSOR_FAULT_NO_CALIBRATION;
+    }
+    if (average_voltage < SENSOR_SIGNAL_LOW_MV) {
+        *fault_flags |= SENSOR_FAULT_SIGNAL_LOW;
+    } else if (average_voltage > SENSOR_SIGNAL_HIGH_MV) {
+        *fault_flags |= SENSOR_FAULT_SIGNAL_HIGH;
     }
 
     return average_voltage;
 }
+
+// Function to update the pressure rate of change (Pa/s) estimate with a new reading
+float sensor_estimator_update(sensor_estimator_t *estimator, float pressure, int64_t time_us) {
+    if (estimator->primed && time_us > estimator->last_time_us) {
+        float rate = (pressure - estimator->last_pressure) * 1000000.0f / (float)(time_us - estimator->last_time_us);
+        estimator->rate += SENSOR_RATE_SMOOTHING * (rate - estimator->rate);
+    } else {
+        estimator->rate = 0;
+    }
+    estimator->last_pressure = pressure;
+    estimator->last_time_us = time_us;
+    estimator->primed = true;
+
+    return estimator->rate;
+}
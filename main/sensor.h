@@ -9,6 +9,19 @@
 #define ADC_WIDTH               ADC_WIDTH_BIT_12        // 12-bit ADC width for higher resolution
 #define ADC_ATTEN               ADC_ATTEN_DB_2_5        // Set attenuation
 
+#define SENSOR_SIGNAL_LOW_MV        50          // Below this voltage the sensor is considered disconnected
+#define SENSOR_SIGNAL_HIGH_MV       1200        // Above this voltage the ADC is considered saturated
+#define SENSOR_RATE_SMOOTHING       0.5         // EMA factor of the pressure rate of change estimator
+
+/**
+ * Sensor fault flags
+ */
+#define SENSOR_FAULT_NONE               0
+#define SENSOR_FAULT_NO_CALIBRATION     (1 << 0)    // ADC calibration is not available
+#define SENSOR_FAULT_FILTER_EMPTY       (1 << 1)    // no samples passed the median filter
+#define SENSOR_FAULT_SIGNAL_LOW         (1 << 2)    // signal is below the sensor output range (open circuit)
+#define SENSOR_FAULT_SIGNAL_HIGH        (1 << 3)    // signal is at the ADC full scale (saturation)
+
 /**
  * Sensor readings information
  */
@@ -18,16 +31,45 @@ typedef struct {
     float voltage_offset;
     float pressure;
     uint32_t sensor_linear_multiplier;
+    float pressure_rate;        // pressure rate of change, Pa/s
+    uint32_t fault_flags;       // SENSOR_FAULT_* flags
 } sensor_data_t;
 
+/**
+ * Pressure rate of change estimator state
+ */
+typedef struct {
+    float last_pressure;
+    int64_t last_time_us;
+    float rate;
+    bool primed;
+} sensor_estimator_t;
+
+/**
+ * Sampling parameters of one measurement
+ */
+typedef struct {
+    uint16_t samples;           // number of samples
+    uint16_t interval;          // interval between the samples, ms
+    uint16_t deviation;         // median filter threshold, %
+} sensor_sampling_t;
+
 extern sensor_data_t sensor_data;
 
 sensor_data_t get_sensor_data();
+
+/**
+ * @brief Generation of sensor_data, incremented by the sensor loop after each reading
+ */
+uint32_t sensor_data_generation(void);
+
 bool sensor_adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle);
 void sensor_adc_calibration_deinit(adc_cali_handle_t handle);
+bool sensor_adc_init(adc_oneshot_unit_handle_t *adc1_handle, adc_cali_handle_t *adc1_cali_handle);
 
 int calculate_median(int* data, int size);
-float perform_smart_sampling(adc_cali_handle_t adc1_cali_handle, adc_oneshot_unit_handle_t adc1_handle, adc_channel_t channel, bool do_calibration1_pressure_sensor);
+float perform_smart_sampling(adc_cali_handle_t adc1_cali_handle, adc_oneshot_unit_handle_t adc1_handle, adc_channel_t channel, bool do_calibration1_pressure_sensor, const sensor_sampling_t *sampling, uint32_t *fault_flags);
+float sensor_estimator_update(sensor_estimator_t *estimator, float pressure, int64_t time_us);
 
 void sensor_run(void *pvParameters);
 
@@ -1,6 +1,19 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <float.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
 
 #include "settings.h"
 #include "sensor.h"
@@ -8,313 +21,594 @@
 
 int device_ready = 0;
 
+ESP_EVENT_DEFINE_BASE(SETTINGS_EVENT);
+
+#define SETTING_NUMBER(key, type, member, default_value, min, max, field, flags) \
+    { key, type, offsetof(settings_values_t, member), 0, default_value, NULL, min, max, field, flags }
+#define SETTING_STRING(key, member, default_value, field, flags) \
+    { key, NVS_VALUE_STRING, offsetof(settings_values_t, member), sizeof(((settings_values_t *)0)->member) - 1, 0, default_value, 0, 0, field, flags }
+
+#define F_FORM      SETTING_FLAG_FORM
+#define F_RANGE     SETTING_FLAG_RANGE
+
 /*
- * Routines implementation
+ * All settings, in the NVS load order
  */
-esp_err_t settings_init() {
+const setting_t settings_table[] = {
+    SETTING_NUMBER(S_KEY_SENSOR_OFFSET, NVS_VALUE_FLOAT, sensor_offset, S_DEFAULT_SENSOR_OFFSET, SENSOR_OFFSET_MIN, SENSOR_OFFSET_MAX, "SENSOR_OFFSET", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_SENSOR_LINEAR_MULTIPLIER, NVS_VALUE_UINT32, sensor_linear_multiplier, S_DEFAULT_SENSOR_LINEAR_MULTIPLIER, SENSOR_LINEAR_MULTIPLIER_MIN, SENSOR_LINEAR_MULTIPLIER_MAX, "SENSOR_LINEAR_MULTIPLIER", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_MQTT_CONNECT, NVS_VALUE_UINT16, mqtt_connect, S_DEFAULT_MQTT_CONNECT, MQTT_SENSOR_MODE_DISABLE, MQTT_SENSOR_MODE_AUTOCONNECT, "MQTT_CONNECT", F_FORM | F_RANGE),
+    SETTING_STRING(S_KEY_MQTT_SERVER, mqtt_server, S_DEFAULT_MQTT_SERVER, "MQTT_SERVER", F_FORM),
+    SETTING_NUMBER(S_KEY_MQTT_PORT, NVS_VALUE_UINT16, mqtt_port, S_DEFAULT_MQTT_PORT, MQTT_PORT_MIN, MQTT_PORT_MAX, "MQTT_PORT", F_FORM | F_RANGE),
+    SETTING_STRING(S_KEY_MQTT_PROTOCOL, mqtt_protocol, S_DEFAULT_MQTT_PROTOCOL, "MQTT_PROTOCOL", F_FORM),
+    SETTING_STRING(S_KEY_MQTT_USER, mqtt_user, S_DEFAULT_MQTT_USER, "MQTT_USER", F_FORM),
+    SETTING_STRING(S_KEY_MQTT_PASSWORD, mqtt_password, S_DEFAULT_MQTT_PASSWORD, "MQTT_PASSWORD", F_FORM | SETTING_FLAG_SECRET),
+    SETTING_STRING(S_KEY_MQTT_PREFIX, mqtt_prefix, S_DEFAULT_MQTT_PREFIX, "MQTT_PREFIX", F_FORM),
+    SETTING_STRING(S_KEY_HA_PREFIX, ha_prefix, S_DEFAULT_HA_PREFIX, "HA_PREFIX", F_FORM),
+    SETTING_STRING(S_KEY_ALARM_RULES, alarm_rules, S_DEFAULT_ALARM_RULES, "ALARM_RULES", F_FORM),
+    SETTING_STRING(S_KEY_DEVICE_ID, device_id, S_DEFAULT_DEVICE_ID, "DEVICE_ID", SETTING_FLAG_DEVICE),
+    SETTING_STRING(S_KEY_DEVICE_SERIAL, device_serial, S_DEFAULT_DEVICE_SERIAL, "DEVICE_SERIAL", SETTING_FLAG_DEVICE),
+    SETTING_NUMBER(S_KEY_SENSOR_READ_INTERVAL, NVS_VALUE_UINT16, sensor_intervl, S_DEFAULT_SENSOR_READ_INTERVAL, SENSOR_READ_INTERVAL_MIN, SENSOR_READ_INTERVAL_MAX, "SENSOR_READ_INTERVAL", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_SENSOR_SAMPLING_COUNT, NVS_VALUE_UINT16, sensor_samples, S_DEFAULT_SENSOR_SAMPLING_COUNT, SENSOR_SAMPLING_COUNT_MIN, SENSOR_SAMPLING_COUNT_MAX, "SENSOR_SAMPLING_COUNT", F_FORM | F_RANGE | SETTING_FLAG_SAMPLING),
+    SETTING_NUMBER(S_KEY_SENSOR_SAMPLING_INTERVAL, NVS_VALUE_UINT16, sensor_smp_int, S_DEFAULT_SENSOR_SAMPLING_INTERVAL, SENSOR_SAMPLING_INTERVAL_MIN, SENSOR_SAMPLING_INTERVAL_MAX, "SENSOR_SAMPLING_INTERVAL", F_FORM | F_RANGE | SETTING_FLAG_SAMPLING),
+    SETTING_NUMBER(S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, NVS_VALUE_UINT16, sensor_deviate, S_DEFAULT_SENSOR_SAMPLING_MEDIAN_DEVIATION, SENSOR_SAMPLING_MEDIAN_DEVIATION_MIN, SENSOR_SAMPLING_MEDIAN_DEVIATION_MAX, "SENSOR_SAMPLING_MEDIAN_DEVIATION", F_FORM | F_RANGE | SETTING_FLAG_SAMPLING),
+    SETTING_NUMBER(S_KEY_SENSOR_NOISE_TARGET, NVS_VALUE_UINT16, sensor_noise_tg, S_DEFAULT_SENSOR_NOISE_TARGET, SENSOR_NOISE_TARGET_MIN, SENSOR_NOISE_TARGET_MAX, "SENSOR_NOISE_TARGET", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_SENSOR_AUTOTUNE, NVS_VALUE_UINT16, sensor_autotune, S_DEFAULT_SENSOR_AUTOTUNE, 0, 1, "SENSOR_AUTOTUNE", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_WAKE_MONITOR, NVS_VALUE_UINT16, wake_monitor, S_DEFAULT_WAKE_MONITOR, 0, 1, "WAKE_MONITOR", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_WAKE_BAND_LOW, NVS_VALUE_UINT32, wake_band_low, S_DEFAULT_WAKE_BAND_LOW, WAKE_BAND_MIN, WAKE_BAND_MAX, "WAKE_BAND_LOW", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_WAKE_BAND_HIGH, NVS_VALUE_UINT32, wake_band_high, S_DEFAULT_WAKE_BAND_HIGH, WAKE_BAND_MIN, WAKE_BAND_MAX, "WAKE_BAND_HIGH", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_RADIO_HOLD_PS, NVS_VALUE_UINT16, radio_hold_ps, S_DEFAULT_RADIO_HOLD_PS, 0, 1, "RADIO_HOLD_PS", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_POWER_MODE, NVS_VALUE_UINT16, power_mode, S_DEFAULT_POWER_MODE, 0, POWER_MODE_MAX, "POWER_MODE", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_SLEEP_INTERVAL, NVS_VALUE_UINT32, sleep_interval, S_DEFAULT_SLEEP_INTERVAL, SLEEP_INTERVAL_MIN, SLEEP_INTERVAL_MAX, "SLEEP_INTERVAL", F_FORM | F_RANGE),
+    SETTING_NUMBER(S_KEY_HA_UPDATE_INTERVAL, NVS_VALUE_UINT32, ha_upd_intervl, S_DEFAULT_HA_UPDATE_INTERVAL, HA_UPDATE_INTERVAL_MIN, HA_UPDATE_INTERVAL_MAX, "HA_UPDATE_INTERVAL", F_FORM | F_RANGE),
+};
 
-    // reset device readiness
-    device_ready = 0;
-    bool is_dynamically_allocated = false;
+const size_t settings_count = sizeof(settings_table) / sizeof(settings_table[0]);
 
-    // Parameter: sensor offset
-    if (nvs_read_float(S_NAMESPACE, S_KEY_SENSOR_OFFSET, &sensor_data.voltage_offset) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %f", S_KEY_SENSOR_OFFSET, sensor_data.voltage_offset);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSOR_OFFSET);
-        sensor_data.voltage_offset = S_DEFAULT_SENSOR_OFFSET;
-        if (nvs_write_float(S_NAMESPACE, S_KEY_SENSOR_OFFSET, sensor_data.voltage_offset) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %f", S_KEY_SENSOR_OFFSET, sensor_data.voltage_offset);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %f", S_KEY_SENSOR_OFFSET, sensor_data.voltage_offset);
-            return ESP_FAIL;
+_Static_assert(sizeof(settings_table) / sizeof(settings_table[0]) <= sizeof(settings_mask_t) * 8,
+               "settings_mask_t is too narrow for settings_table");
+
+/*
+ * Current settings, kept from settings_init() on. Saves update them at once and mark the changed keys dirty,
+ * the commit task woken by the timer writes the dirty keys and the blob in one transaction.
+ */
+static settings_values_t *settings_current = NULL;
+static settings_mask_t settings_dirty = 0;
+static settings_stats_t settings_stats;
+static uint32_t settings_gen = 0;
+static SemaphoreHandle_t settings_mutex = NULL;
+static esp_timer_handle_t settings_commit_timer = NULL;
+static TaskHandle_t settings_commit_task_handle = NULL;
+
+settings_mask_t setting_mask(const setting_t *setting) {
+    return (settings_mask_t)1 << (setting - settings_table);
+}
+
+settings_mask_t settings_keys_mask(const char *key, ...) {
+    settings_mask_t mask = 0;
+    va_list args;
+    va_start(args, key);
+    for (; key != NULL; key = va_arg(args, const char *)) {
+        const setting_t *setting = setting_find(key);
+        if (setting != NULL) {
+            mask |= setting_mask(setting);
         }
     }
+    va_end(args);
+    return mask;
+}
 
-    // Parameter: sensor linear multiplier
-    if (nvs_read_uint32(S_NAMESPACE, S_KEY_SENSOR_LINEAR_MULTIPLIER, &sensor_data.sensor_linear_multiplier) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %lu", S_KEY_SENSOR_LINEAR_MULTIPLIER, sensor_data.sensor_linear_multiplier);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSOR_LINEAR_MULTIPLIER);
-        sensor_data.sensor_linear_multiplier = S_DEFAULT_SENSOR_LINEAR_MULTIPLIER;
-        if (nvs_write_uint32(S_NAMESPACE, S_KEY_SENSOR_LINEAR_MULTIPLIER, sensor_data.sensor_linear_multiplier) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %lu", S_KEY_SENSOR_LINEAR_MULTIPLIER, sensor_data.sensor_linear_multiplier);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %lu", S_KEY_SENSOR_LINEAR_MULTIPLIER, sensor_data.sensor_linear_multiplier);
-            return ESP_FAIL;
+void *setting_value(settings_values_t *values, const setting_t *setting) {
+    return (char *)values + setting->offset;
+}
+
+static const void *setting_value_const(const settings_values_t *values, const setting_t *setting) {
+    return (const char *)values + setting->offset;
+}
+
+const setting_t *setting_find(const char *key) {
+    for (size_t i = 0; i < settings_count; i++) {
+        if (strcmp(settings_table[i].key, key) == 0) {
+            return &settings_table[i];
         }
     }
+    return NULL;
+}
 
-    // Parameter: MQTT connection mode
-    mqtt_connection_mode_t mqtt_connection_mode;
-    if (nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_MQTT_CONNECT, mqtt_connection_mode);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_CONNECT);
-        mqtt_connection_mode = S_DEFAULT_MQTT_CONNECT;
-        if (nvs_write_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, mqtt_connection_mode) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_MQTT_CONNECT, mqtt_connection_mode);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_MQTT_CONNECT, mqtt_connection_mode);
-            return ESP_FAIL;
+void settings_set_defaults(settings_values_t *values) {
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        void *value = setting_value(values, setting);
+        switch (setting->type) {
+            case NVS_VALUE_UINT16:
+                *(uint16_t *)value = (uint16_t)setting->default_number;
+                break;
+            case NVS_VALUE_UINT32:
+                *(uint32_t *)value = (uint32_t)setting->default_number;
+                break;
+            case NVS_VALUE_FLOAT:
+                *(float *)value = (float)setting->default_number;
+                break;
+            case NVS_VALUE_STRING:
+                snprintf((char *)value, setting->length + 1, "%s", setting->default_string);
+                break;
+            default:
+                break;
         }
-    }  
+    }
 
-    // Parameter: MQTT server
-    char *mqtt_server = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_MQTT_SERVER, &mqtt_server) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_MQTT_SERVER, mqtt_server);
-        is_dynamically_allocated = true;
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_SERVER);
-        mqtt_server = S_DEFAULT_MQTT_SERVER;
-        if (nvs_write_string(S_NAMESPACE, S_KEY_MQTT_SERVER, mqtt_server) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_MQTT_SERVER, mqtt_server);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_MQTT_SERVER, mqtt_server);
-            return ESP_FAIL;
-        }
+    // Device ID (actually, MAC)
+    uint8_t mac[6];  // Array to hold the MAC address
+    ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_WIFI_STA));  // Use esp_read_mac to get the MAC address
+    snprintf(values->device_id, sizeof(values->device_id), "%02X%02X%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    // Device Serial (to be used for API)
+    generate_serial_number(values->device_serial);
+}
+
+// Batch read of the whole table, the results are left in items
+static esp_err_t settings_read(settings_values_t *values, nvs_batch_item_t *items) {
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        items[i] = (nvs_batch_item_t) {
+            .key = setting->key,
+            .type = setting->type,
+            .value = setting_value(values, setting),
+            .length = setting->type == NVS_VALUE_STRING ? setting->length + 1 : 0,
+            .result = ESP_ERR_NVS_NOT_FOUND,    // until read
+        };
     }
-    if (is_dynamically_allocated) {
-        free(mqtt_server); // for string (char*) params only
-        is_dynamically_allocated = false;
+    return nvs_read_batch(S_NAMESPACE, items, settings_count);
+}
+
+/*
+ * Settings blob: the whole settings_values_t, checked by version, size and CRC32
+ */
+typedef struct {
+    uint16_t version;
+    uint16_t size;                  // sizeof(settings_values_t) when written
+    settings_values_t values;
+    uint32_t crc;                   // CRC32 of everything above
+} settings_blob_t;
+
+static uint32_t settings_blob_crc(const settings_blob_t *blob) {
+    return esp_rom_crc32_le(0, (const uint8_t *)blob, offsetof(settings_blob_t, crc));
+}
+
+/**
+ * @brief Read the settings blob
+ *
+ * @return
+ *         - ESP_OK if the blob is valid, values are updated
+ *         - ESP_ERR_NVS_NOT_FOUND if there is no blob yet
+ *         - ESP_ERR_INVALID_VERSION if the blob was written by another settings layout
+ *         - ESP_ERR_INVALID_CRC if the blob is corrupted
+ *         - ESP_ERR_NO_MEM or the NVS error
+ */
+static esp_err_t settings_blob_read(settings_values_t *values) {
+    settings_blob_t *blob = (settings_blob_t *)malloc(sizeof(settings_blob_t));
+    if (blob == NULL) {
+        return ESP_ERR_NO_MEM;
     }
+    memset(blob, 0, sizeof(settings_blob_t));
 
-    // Parameter: MQTT port
-    uint16_t mqtt_port;
-    if (nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_PORT, &mqtt_port) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_MQTT_PORT, mqtt_port);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_PORT);
-        mqtt_port = S_DEFAULT_MQTT_PORT;
-        if (nvs_write_uint16(S_NAMESPACE, S_KEY_MQTT_PORT, mqtt_port) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_MQTT_PORT, mqtt_port);
+    esp_err_t err = nvs_read_blob(S_NAMESPACE, S_KEY_SETTINGS_BLOB, blob, sizeof(settings_blob_t));
+    if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+        err = ESP_ERR_INVALID_VERSION;      // larger than this layout
+    } else if (err == ESP_OK) {
+        if (blob->version != SETTINGS_BLOB_VERSION || blob->size != sizeof(settings_values_t)) {
+            err = ESP_ERR_INVALID_VERSION;
+        } else if (blob->crc != settings_blob_crc(blob)) {
+            err = ESP_ERR_INVALID_CRC;
         } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_MQTT_PORT, mqtt_port);
-            return ESP_FAIL;
+            memcpy(values, &blob->values, sizeof(settings_values_t));
         }
     }
+    free(blob);
+    return err;
+}
 
-    // Parameter: MQTT protocol
-    char *mqtt_protocol = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PROTOCOL, &mqtt_protocol) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_MQTT_PROTOCOL, mqtt_protocol);
-        is_dynamically_allocated = true;
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_PROTOCOL);
-        mqtt_protocol = S_DEFAULT_MQTT_PROTOCOL;
-        if (nvs_write_string(S_NAMESPACE, S_KEY_MQTT_PROTOCOL, mqtt_protocol) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_MQTT_PROTOCOL, mqtt_protocol);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_MQTT_PROTOCOL, mqtt_protocol);
-            return ESP_FAIL;
-        }
+static void settings_blob_stage(nvs_transaction_t tx, const settings_values_t *values) {
+    settings_blob_t *blob = (settings_blob_t *)malloc(sizeof(settings_blob_t));
+    if (blob == NULL) {
+        ESP_LOGE(TAG, "Memory allocation failed");
+        nvs_transaction_set_blob(tx, S_KEY_SETTINGS_BLOB, NULL, 0);     // fails the transaction
+        return;
     }
-    if (is_dynamically_allocated) {
-        free(mqtt_protocol); // for string (char*) params only
-        is_dynamically_allocated = false;
+    memset(blob, 0, sizeof(settings_blob_t));
+    blob->version = SETTINGS_BLOB_VERSION;
+    blob->size = sizeof(settings_values_t);
+    memcpy(&blob->values, values, sizeof(settings_values_t));
+    blob->crc = settings_blob_crc(blob);
+    nvs_transaction_set_blob(tx, S_KEY_SETTINGS_BLOB, blob, sizeof(settings_blob_t));
+    free(blob);
+}
+
+esp_err_t settings_load(settings_values_t *values) {
+    if (settings_current != NULL) {
+        xSemaphoreTake(settings_mutex, portMAX_DELAY);
+        memcpy(values, settings_current, sizeof(settings_values_t));
+        xSemaphoreGive(settings_mutex);
+        return ESP_OK;
     }
 
-    // Parameter: MQTT user
-    char *mqtt_user = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_MQTT_USER, &mqtt_user) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_MQTT_USER, mqtt_user);
-        is_dynamically_allocated = true;
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_USER);
-        mqtt_user = S_DEFAULT_MQTT_USER;
-        if (nvs_write_string(S_NAMESPACE, S_KEY_MQTT_USER, mqtt_user) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_MQTT_USER, mqtt_user);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_MQTT_USER, mqtt_user);
-            return ESP_FAIL;
-        }
+    if (SETTINGS_STORAGE_BLOB && settings_blob_read(values) == ESP_OK) {
+        return ESP_OK;
     }
-    if (is_dynamically_allocated) {
-        free(mqtt_user); // for string (char*) params only
-        is_dynamically_allocated = false;
+
+    nvs_batch_item_t *items = (nvs_batch_item_t *)malloc(sizeof(nvs_batch_item_t) * settings_count);
+    if (items == NULL) {
+        ESP_LOGE(TAG, "Memory allocation failed");
+        return ESP_ERR_NO_MEM;
     }
+    esp_err_t err = settings_read(values, items);
+    free(items);
+    return err;
+}
 
-    // Parameter: MQTT password
-    char *mqtt_password = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PASSWORD, &mqtt_password) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_MQTT_PASSWORD, mqtt_password);
-        is_dynamically_allocated = true;
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_PASSWORD);
-        mqtt_password = S_DEFAULT_MQTT_PASSWORD;
-        if (nvs_write_string(S_NAMESPACE, S_KEY_MQTT_PASSWORD, mqtt_password) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_MQTT_PASSWORD, mqtt_password);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_MQTT_PASSWORD, mqtt_password);
-            return ESP_FAIL;
+static size_t setting_size(const setting_t *setting) {
+    switch (setting->type) {
+        case NVS_VALUE_UINT16:
+            return sizeof(uint16_t);
+        case NVS_VALUE_UINT32:
+            return sizeof(uint32_t);
+        case NVS_VALUE_FLOAT:
+            return sizeof(float);
+        default:
+            return setting->length + 1;
+    }
+}
+
+static bool setting_equal(const setting_t *setting, const settings_values_t *a, const settings_values_t *b) {
+    const void *value_a = setting_value_const(a, setting);
+    const void *value_b = setting_value_const(b, setting);
+    if (setting->type == NVS_VALUE_STRING) {
+        return strcmp((const char *)value_a, (const char *)value_b) == 0;
+    }
+    return memcmp(value_a, value_b, setting_size(setting)) == 0;
+}
+
+esp_err_t settings_save(const settings_values_t *values, uint8_t flags, settings_mask_t *changed) {
+    if (changed != NULL) {
+        *changed = 0;
+    }
+    if (settings_current == NULL) {
+        ESP_LOGE(TAG, "%s(): settings are not initialized, call settings_init() first!", __func__);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    settings_mask_t mask = 0;
+    xSemaphoreTake(settings_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        if ((setting->flags & flags) != flags) {
+            continue;
         }
+        if (setting_equal(setting, values, settings_current)) {
+            settings_stats.unchanged++;
+            continue;
+        }
+        memcpy(setting_value(settings_current, setting), setting_value_const(values, setting), setting_size(setting));
+        mask |= setting_mask(setting);
+        settings_stats.changed++;
     }
-    if (is_dynamically_allocated) {
-        free(mqtt_password); // for string (char*) params only
-        is_dynamically_allocated = false;
+    settings_dirty |= mask;
+    if (mask != 0) {
+        settings_gen++;
     }
+    settings_stats.saves++;
+    xSemaphoreGive(settings_mutex);
 
-    // Parameter: MQTT prefix
-    char *mqtt_prefix = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_MQTT_PREFIX, mqtt_prefix);
-        is_dynamically_allocated = true;
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_PREFIX);
-        mqtt_prefix = S_DEFAULT_MQTT_PREFIX;
-        if (nvs_write_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, mqtt_prefix) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_MQTT_PREFIX, mqtt_prefix);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_MQTT_PREFIX, mqtt_prefix);
-            return ESP_FAIL;
+    // The window starts with the first save, later saves join it
+    if (mask != 0 && !esp_timer_is_active(settings_commit_timer)) {
+        esp_timer_start_once(settings_commit_timer, SETTINGS_COMMIT_DELAY_MS * 1000ULL);
+    }
+
+    // The subscribers apply the new values right away, the NVS write does not hold them back
+    if (mask != 0) {
+        esp_err_t err = esp_event_post(SETTINGS_EVENT, SETTINGS_EVENT_CHANGED, &mask, sizeof(mask), pdMS_TO_TICKS(100));
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            ESP_LOGW(TAG, "Failed to post the settings change: %s", esp_err_to_name(err));
         }
     }
-    if (is_dynamically_allocated) {
-        free(mqtt_prefix); // for string (char*) params only
-        is_dynamically_allocated = false;
+
+    if (changed != NULL) {
+        *changed = mask;
     }
+    return ESP_OK;
+}
 
-    // Parameter: HomeAssistant MQTT Integration prefix
-    char *ha_prefix = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_HA_PREFIX, &ha_prefix) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_HA_PREFIX, ha_prefix);
-        is_dynamically_allocated = true;
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_HA_PREFIX);
-        ha_prefix = S_DEFAULT_HA_PREFIX;
-        if (nvs_write_string(S_NAMESPACE, S_KEY_HA_PREFIX, ha_prefix) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_HA_PREFIX, ha_prefix);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_HA_PREFIX, ha_prefix);
-            return ESP_FAIL;
+esp_err_t settings_flush(void) {
+    if (settings_current == NULL) {
+        return ESP_OK;
+    }
+    esp_timer_stop(settings_commit_timer);
+
+    xSemaphoreTake(settings_mutex, portMAX_DELAY);
+    settings_mask_t dirty = settings_dirty;
+    if (dirty == 0) {
+        xSemaphoreGive(settings_mutex);
+        return ESP_OK;
+    }
+
+    nvs_transaction_t tx = NULL;
+    esp_err_t err = nvs_transaction_begin(S_NAMESPACE, &tx);
+    if (err == ESP_OK) {
+        // The blob goes first: if it does not fit, nothing is written. A key failing after it leaves the new blob
+        // with a part of the new per-key entries, all of them stay dirty and are written again.
+        if (SETTINGS_STORAGE_BLOB) {
+            settings_blob_stage(tx, settings_current);
         }
+        for (size_t i = 0; i < settings_count; i++) {
+            const setting_t *setting = &settings_table[i];
+            if (dirty & setting_mask(setting)) {
+                nvs_transaction_set(tx, setting->key, setting->type, setting_value(settings_current, setting), 0);
+            }
+        }
+        err = nvs_transaction_commit(tx);
     }
-    if (is_dynamically_allocated) {
-        free(ha_prefix); // for string (char*) params only
-        is_dynamically_allocated = false;
+    if (err == ESP_OK) {
+        settings_dirty = 0;
+        settings_stats.commits++;
     }
+    xSemaphoreGive(settings_mutex);
 
-    // Parameter: Device ID (actually, MAC)
-    char *device_id = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_DEVICE_ID, device_id);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write the changed settings: %s, retrying in %d ms", esp_err_to_name(err), SETTINGS_COMMIT_RETRY_MS);
+        if (!esp_timer_is_active(settings_commit_timer)) {
+            esp_timer_start_once(settings_commit_timer, SETTINGS_COMMIT_RETRY_MS * 1000ULL);
+        }
     } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_DEVICE_ID);
+        ESP_LOGI(TAG, "Changed settings written to NVS");
+    }
+    return err;
+}
 
-        char new_device_id[DEVICE_ID_LENGTH+1];
-        uint8_t mac[6];  // Array to hold the MAC address
-        ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_WIFI_STA));  // Use esp_read_mac to get the MAC address
+// The commit window is over, the write is left to the commit task
+static void settings_commit_cb(void *arg) {
+    xTaskNotifyGive(settings_commit_task_handle);
+}
 
-        // Extract the last 3 bytes (6 characters in hexadecimal) of the MAC address
-        snprintf(new_device_id, sizeof(new_device_id), "%02X%02X%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+static void settings_commit_task(void *arg) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        settings_flush();
+    }
+}
 
-        if (nvs_write_string(S_NAMESPACE, S_KEY_DEVICE_ID, new_device_id) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_DEVICE_ID, new_device_id);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_DEVICE_ID, new_device_id);
-            return ESP_FAIL;
-        }
+settings_stats_t settings_get_stats(void) {
+    settings_stats_t stats = {0};
+    if (settings_mutex == NULL) {
+        return stats;
     }
-    // free(device_id); // for string (char*) params only
+    xSemaphoreTake(settings_mutex, portMAX_DELAY);
+    stats = settings_stats;
+    stats.pending = (uint32_t)__builtin_popcount(settings_dirty);
+    xSemaphoreGive(settings_mutex);
+    return stats;
+}
 
-    // Parameter: Device Serial (to be used for API)
-    char *device_serial = NULL;
-    if (nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_SERIAL, &device_serial) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_DEVICE_SERIAL, device_serial);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_DEVICE_SERIAL);
-        char new_device_serial[DEVICE_SERIAL_LENGTH+1];
-        generate_serial_number(new_device_serial);       
-        if (nvs_write_string(S_NAMESPACE, S_KEY_DEVICE_SERIAL, new_device_serial) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_DEVICE_SERIAL, new_device_serial);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_DEVICE_SERIAL, new_device_serial);
-            return ESP_FAIL;
+uint32_t settings_generation(void) {
+    return settings_gen;        // one aligned word, written under the mutex
+}
+
+esp_err_t setting_from_string(const setting_t *setting, settings_values_t *values, const char *text) {
+    void *value = setting_value(values, setting);
+
+    if (setting->type == NVS_VALUE_STRING) {
+        if (strlen(text) > setting->length) {
+            return ESP_ERR_INVALID_SIZE;
         }
+        strcpy((char *)value, text);
+        return ESP_OK;
     }
-    // free(device_serial); // for string (char*) params only
 
-    // Parameter: Sensor read interval
-    uint16_t sensor_intervl;
-    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_READ_INTERVAL, &sensor_intervl) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_SENSOR_READ_INTERVAL, sensor_intervl);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSOR_READ_INTERVAL);
-        sensor_intervl = S_DEFAULT_SENSOR_READ_INTERVAL;
-        if (nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_READ_INTERVAL, sensor_intervl) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_SENSOR_READ_INTERVAL, sensor_intervl);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_SENSOR_READ_INTERVAL, sensor_intervl);
-            return ESP_FAIL;
-        }
+    char *end;
+    double number = strtod(text, &end);
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    if (end == text || *end != '\0') {
+        return ESP_ERR_INVALID_ARG;     // empty or trailing garbage
     }
+    return setting_from_number(setting, values, number);
+}
 
-    // Parameter: Number of samples to collect per measurement
-    uint16_t sensor_samples;
-    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_COUNT, &sensor_samples) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_SENSOR_SAMPLING_COUNT, sensor_samples);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSOR_SAMPLING_COUNT);
-        sensor_samples = S_DEFAULT_SENSOR_SAMPLING_COUNT;
-        if (nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_COUNT, sensor_samples) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_SENSOR_SAMPLING_COUNT, sensor_samples);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_SENSOR_SAMPLING_COUNT, sensor_samples);
+esp_err_t setting_from_number(const setting_t *setting, settings_values_t *values, double number) {
+    void *value = setting_value(values, setting);
+    if (number != number) {
+        return ESP_ERR_INVALID_ARG;     // NaN
+    }
+
+    double min = 0, max = 0;
+    switch (setting->type) {
+        case NVS_VALUE_UINT16:
+            max = UINT16_MAX;
+            break;
+        case NVS_VALUE_UINT32:
+            max = UINT32_MAX;
+            break;
+        case NVS_VALUE_FLOAT:
+            min = -FLT_MAX;
+            max = FLT_MAX;
+            break;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+    if (setting->flags & SETTING_FLAG_RANGE) {
+        min = setting->min;
+        max = setting->max;
+    }
+    if (number < min || number > max) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    switch (setting->type) {
+        case NVS_VALUE_UINT16:
+            if (number != (double)(uint16_t)number) {
+                return ESP_ERR_INVALID_ARG;     // fractional part
+            }
+            *(uint16_t *)value = (uint16_t)number;
+            break;
+        case NVS_VALUE_UINT32:
+            if (number != (double)(uint32_t)number) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            *(uint32_t *)value = (uint32_t)number;
+            break;
+        default:
+            *(float *)value = (float)number;
+            break;
+    }
+    return ESP_OK;
+}
+
+const char *setting_to_string(const setting_t *setting, const settings_values_t *values, char *buf, size_t length) {
+    const void *value = setting_value_const(values, setting);
+    switch (setting->type) {
+        case NVS_VALUE_STRING:
+            return (const char *)value;
+        case NVS_VALUE_UINT16:
+            snprintf(buf, length, "%u", *(const uint16_t *)value);
+            break;
+        case NVS_VALUE_UINT32:
+            snprintf(buf, length, "%lu", (unsigned long) *(const uint32_t *)value);
+            break;
+        case NVS_VALUE_FLOAT:
+            snprintf(buf, length, "%.3f", *(const float *)value);
+            break;
+        default:
+            snprintf(buf, length, "?");
+            break;
+    }
+    return buf;
+}
+
+// Printable value for the log, secrets are masked
+static const char *settings_log_value(const setting_t *setting, const settings_values_t *values, char *buf, size_t length) {
+    if (setting->flags & SETTING_FLAG_SECRET) {
+        return "********";
+    }
+    return setting_to_string(setting, values, buf, length);
+}
+
+// Apply the loaded settings and mark the device ready, values become the current settings
+static void settings_ready(settings_values_t *values, int64_t start_us) {
+
+    // Sensor calibration
+    sensor_data.voltage_offset = values->sensor_offset;
+    sensor_data.sensor_linear_multiplier = values->sensor_linear_multiplier;
+
+    xSemaphoreTake(settings_mutex, portMAX_DELAY);
+    free(settings_current);
+    settings_current = values;
+    settings_dirty = 0;
+    xSemaphoreGive(settings_mutex);
+
+    // device ready
+    device_ready = 1;
+
+    int64_t now_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Settings loaded in %lli us (%s layout), device ready %lli ms after boot",
+             (long long)(now_us - start_us), SETTINGS_STORAGE_BLOB ? "blob" : "per-key", (long long)(now_us / 1000));
+}
+
+/*
+ * Routines implementation
+ */
+esp_err_t settings_init() {
+
+    // reset device readiness
+    device_ready = 0;
+    int64_t start_us = esp_timer_get_time();
+
+    if (settings_mutex == NULL) {
+        settings_mutex = xSemaphoreCreateMutex();
+        const esp_timer_create_args_t timer_args = {
+            .callback = settings_commit_cb,
+            .name = "settings_commit",
+        };
+        if (settings_mutex == NULL || esp_timer_create(&timer_args, &settings_commit_timer) != ESP_OK
+            || xTaskCreate(settings_commit_task, "settings_commit", SETTINGS_COMMIT_TASK_STACK, NULL, 3, &settings_commit_task_handle) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create the settings mutex, commit timer or commit task");
             return ESP_FAIL;
         }
     }
 
-    // Parameter: Interval between samples in milliseconds
-    uint16_t sensor_smp_int;
-    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_INTERVAL, &sensor_smp_int) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_SENSOR_SAMPLING_INTERVAL, sensor_smp_int);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSOR_SAMPLING_INTERVAL);
-        sensor_smp_int = S_DEFAULT_SENSOR_SAMPLING_INTERVAL;
-        if (nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_INTERVAL, sensor_smp_int) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_SENSOR_SAMPLING_INTERVAL, sensor_smp_int);
+    settings_values_t *values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    nvs_batch_item_t *items = (nvs_batch_item_t *)malloc(sizeof(nvs_batch_item_t) * settings_count);
+    if (values == NULL || items == NULL) {
+        ESP_LOGE(TAG, "Memory allocation failed");
+        free(values);
+        free(items);
+        return ESP_FAIL;
+    }
+    settings_set_defaults(values);
+
+    // A valid settings blob holds everything, the per-key entries were written with it
+    if (SETTINGS_STORAGE_BLOB) {
+        esp_err_t err = settings_blob_read(values);
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "Settings loaded from the settings blob");
+            free(items);
+            settings_ready(values, start_us);
+            return ESP_OK;
+        } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGI(TAG, "No settings blob found, upgrading from the per-key settings");
+        } else if (err == ESP_ERR_INVALID_VERSION) {
+            ESP_LOGI(TAG, "Settings blob layout changed, upgrading from the per-key settings");
         } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_SENSOR_SAMPLING_INTERVAL, sensor_smp_int);
-            return ESP_FAIL;
+            ESP_LOGE(TAG, "Settings blob is not valid (%s), rebuilding from the per-key settings and defaults", esp_err_to_name(err));
         }
+        settings_set_defaults(values);
     }
 
-    // Parameter: Threshold percentage for filtering
-    uint16_t sensor_deviate;
-    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, &sensor_deviate) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, sensor_deviate);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION);
-        sensor_deviate = S_DEFAULT_SENSOR_SAMPLING_MEDIAN_DEVIATION;
-        if (nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, sensor_deviate) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, sensor_deviate);
+    // Load all parameters in one pass, the missing ones keep their default values
+    settings_read(values, items);
+
+    // Initiate the missing parameters with a single commit
+    nvs_transaction_t tx = NULL;
+    if (nvs_transaction_begin(S_NAMESPACE, &tx) != ESP_OK) {
+        free(values);
+        free(items);
+        return ESP_FAIL;
+    }
+
+    // The blob first, as in settings_flush()
+    if (SETTINGS_STORAGE_BLOB) {
+        settings_blob_stage(tx, values);
+    }
+
+    char value_str[16];
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        const nvs_batch_item_t *item = &items[i];
+        if (item->result == ESP_OK) {
+            ESP_LOGI(TAG, "Found parameter %s in NVS: %s", setting->key, settings_log_value(setting, values, value_str, sizeof(value_str)));
+        } else if (item->result == ESP_ERR_NVS_INVALID_LENGTH) {
+            ESP_LOGW(TAG, "Parameter %s in NVS is longer than %u characters, left unchanged", setting->key, (unsigned)setting->length);
         } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, sensor_deviate);
-            return ESP_FAIL;
+            ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", setting->key);
+            nvs_transaction_set(tx, item->key, item->type, item->value, 0);
         }
     }
 
-    // Parameter: Update Home Assistant definitions every X minutes
-    uint32_t ha_upd_intervl;
-    if (nvs_read_uint32(S_NAMESPACE, S_KEY_HA_UPDATE_INTERVAL, &ha_upd_intervl) == ESP_OK) {
-        ESP_LOGI(TAG, "Found parameter %s in NVS: %li", S_KEY_HA_UPDATE_INTERVAL, ha_upd_intervl);
-    } else {
-        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_HA_UPDATE_INTERVAL);
-        ha_upd_intervl = S_DEFAULT_HA_UPDATE_INTERVAL;
-        if (nvs_write_uint32(S_NAMESPACE, S_KEY_HA_UPDATE_INTERVAL, ha_upd_intervl) == ESP_OK) {
-            ESP_LOGI(TAG, "Successfully created key %s with value %li", S_KEY_HA_UPDATE_INTERVAL, ha_upd_intervl);
-        } else {
-            ESP_LOGE(TAG, "Failed creating key %s with value %li", S_KEY_HA_UPDATE_INTERVAL, ha_upd_intervl);
-            return ESP_FAIL;
+    if (nvs_transaction_commit(tx) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed creating missing parameters");
+        free(values);
+        free(items);
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        if (items[i].result != ESP_OK && items[i].result != ESP_ERR_NVS_INVALID_LENGTH) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %s", setting->key, settings_log_value(setting, values, value_str, sizeof(value_str)));
         }
-    }  
+    }
 
-    // device ready
-    device_ready = 1;
-    
+    free(items);
+    settings_ready(values, start_us);
     return ESP_OK;
-
 }
 
 void generate_serial_number(char *serial_number) {
@@ -1,8 +1,14 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_event.h"
+
 #include "common.h"
 #include "mqtt.h"
+#include "non_volatile_storage.h"
 
 /**
  * Initialization variables
@@ -20,6 +26,7 @@ extern int device_ready;
 #define MQTT_PASSWORD_LENGTH     64
 #define MQTT_PREFIX_LENGTH       128
 #define HA_PREFIX_LENGTH         128
+#define ALARM_RULES_LENGTH       256
 
 #define SENSOR_OFFSET_MIN    -5.0
 #define SENSOR_OFFSET_MAX    5.0
@@ -36,13 +43,27 @@ extern int device_ready;
 #define SENSOR_SAMPLING_MEDIAN_DEVIATION_MIN    1
 #define SENSOR_SAMPLING_MEDIAN_DEVIATION_MAX    100
 
+#define SENSOR_NOISE_TARGET_MIN     10          // uV
+#define SENSOR_NOISE_TARGET_MAX     10000       // uV
+
 
 #define SENSOR_LINEAR_MULTIPLIER_MIN    1
 #define SENSOR_LINEAR_MULTIPLIER_MAX    1000000
 
+#define WAKE_BAND_MIN           0               // Pa, 0 disables the band side
+#define WAKE_BAND_MAX           10000000        // Pa
+
+#define SLEEP_INTERVAL_MIN      10              // s
+#define SLEEP_INTERVAL_MAX      86400           // s, once a day
+
 #define HA_UPDATE_INTERVAL_MIN  60000           // Once a minute
 #define HA_UPDATE_INTERVAL_MAX  86400000        // Once a day (24 hr)
 
+#define MQTT_PORT_MIN           1
+#define MQTT_PORT_MAX           65535
+
+#define POWER_MODE_MAX          3               // power_mode_t: deep sleep cycle
+
 /**
  * General constants
  */
@@ -81,6 +102,46 @@ extern int device_ready;
 #define S_KEY_SENSOR_SAMPLING_INTERVAL             "sensor_smp_int"
 #define S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION     "sensor_deviate"
 
+#define S_KEY_SENSOR_NOISE_TARGET                  "sensor_noise_tg"
+#define S_KEY_SENSOR_AUTOTUNE                      "sensor_autotune"
+#define S_KEY_SENSOR_AUTOTUNE_RESULT               "sensor_tune"
+
+#define S_KEY_ALARM_RULES                          "alarm_rules"
+
+#define S_KEY_WAKE_MONITOR                         "wake_monitor"
+#define S_KEY_WAKE_BAND_LOW                        "wake_band_low"
+#define S_KEY_WAKE_BAND_HIGH                       "wake_band_high"
+
+#define S_KEY_RADIO_HOLD_PS                        "radio_hold_ps"
+#define S_KEY_POWER_MODE                           "power_mode"
+#define S_KEY_SLEEP_INTERVAL                       "sleep_interval"
+
+#define S_KEY_SETTINGS_BLOB                        "settings_blob"
+
+
+/**
+ * Settings storage layout
+ *
+ * The modules take the settings from settings_load(), or from a snapshot of it reloaded on SETTINGS_EVENT_CHANGED;
+ * the per-key entries are read at boot only. With SETTINGS_STORAGE_BLOB the whole settings_values_t is also kept in
+ * one versioned blob with a CRC32, so boot and settings_load() take a single NVS read. The blob is written together
+ * with the per-key entries by settings_save(), all settings writes have to go through it.
+ */
+#define SETTINGS_STORAGE_BLOB       true
+#define SETTINGS_BLOB_VERSION       1           // bump on any settings_values_t change
+
+/**
+ * Write coalescing
+ *
+ * settings_save() writes only the changed keys, and not right away: the saves within SETTINGS_COMMIT_DELAY_MS of the
+ * first one are written together, with one commit. The per-key entries may lag behind settings_load() for that long,
+ * call settings_flush() before reading them directly, restarting or sleeping. A failed write is retried after
+ * SETTINGS_COMMIT_RETRY_MS. The write runs in its own task, the timer only wakes it up: esp_timer callbacks must not
+ * block on the flash.
+ */
+#define SETTINGS_COMMIT_DELAY_MS    500
+#define SETTINGS_COMMIT_RETRY_MS    10000       // a failed write is retried after this time, the keys stay dirty
+#define SETTINGS_COMMIT_TASK_STACK  3072
 
 /**
  * Settings default values
@@ -107,6 +168,111 @@ extern int device_ready;
 #define S_DEFAULT_SENSOR_SAMPLING_INTERVAL              10  // Interval between samples in milliseconds
 #define S_DEFAULT_SENSOR_SAMPLING_MEDIAN_DEVIATION      10  // Threshold percentage for filtering
 
+#define S_DEFAULT_SENSOR_NOISE_TARGET       500     // Auto-tune noise target of the averaged reading, uV
+#define S_DEFAULT_SENSOR_AUTOTUNE           0       // Run auto-tune at boot (0 - no, 1 - yes)
+
+#define S_DEFAULT_ALARM_RULES               ""      // No alarm rules
+
+#define S_DEFAULT_WAKE_MONITOR              0       // Wake up on pressure leaving the band (0 - no, 1 - yes)
+#define S_DEFAULT_WAKE_BAND_LOW             0       // Pa, 0 - not monitored
+#define S_DEFAULT_WAKE_BAND_HIGH            0       // Pa, 0 - not monitored
+
+#define S_DEFAULT_RADIO_HOLD_PS             0       // Hold Wi-Fi modem sleep across sampling bursts (0 - no, 1 - yes)
+#define S_DEFAULT_POWER_MODE                0       // power_mode_t: 0 - performance, 1 - DFS, 2 - DFS + light sleep, 3 - deep sleep cycle
+#define S_DEFAULT_SLEEP_INTERVAL            600     // Deep sleep between the measurements, s
+
+
+/**
+ * Values of all settings
+ */
+typedef struct {
+    float sensor_offset;
+    uint32_t sensor_linear_multiplier;
+    uint16_t mqtt_connect;
+    char mqtt_server[MQTT_SERVER_LENGTH+1];
+    uint16_t mqtt_port;
+    char mqtt_protocol[MQTT_PROTOCOL_LENGTH+1];
+    char mqtt_user[MQTT_USER_LENGTH+1];
+    char mqtt_password[MQTT_PASSWORD_LENGTH+1];
+    char mqtt_prefix[MQTT_PREFIX_LENGTH+1];
+    char ha_prefix[HA_PREFIX_LENGTH+1];
+    char alarm_rules[ALARM_RULES_LENGTH+1];
+    char device_id[DEVICE_ID_LENGTH+1];
+    char device_serial[DEVICE_SERIAL_LENGTH+1];
+    uint16_t sensor_intervl;
+    uint16_t sensor_samples;
+    uint16_t sensor_smp_int;
+    uint16_t sensor_deviate;
+    uint16_t sensor_noise_tg;
+    uint16_t sensor_autotune;
+    uint16_t wake_monitor;
+    uint32_t wake_band_low;
+    uint32_t wake_band_high;
+    uint16_t radio_hold_ps;
+    uint16_t power_mode;
+    uint32_t sleep_interval;
+    uint32_t ha_upd_intervl;
+} settings_values_t;
+
+/**
+ * Settings descriptor flags
+ */
+#define SETTING_FLAG_FORM       (1 << 0)        // edited on the config page, the form field is named after the key
+#define SETTING_FLAG_RANGE      (1 << 1)        // numeric value limited to min..max
+#define SETTING_FLAG_SECRET     (1 << 2)        // value is never logged
+#define SETTING_FLAG_DEVICE     (1 << 3)        // default is generated per device, see settings_set_defaults()
+#define SETTING_FLAG_SAMPLING   (1 << 4)        // sampling parameters, also written by the auto-tune
+
+/**
+ * Settings descriptor
+ *
+ * One entry of the settings table drives the initialization, the NVS load, the form parsing and the page rendering.
+ * Adding a setting takes a settings_values_t member and a line in settings_table (settings.c).
+ */
+typedef struct {
+    const char *key;                // NVS key
+    nvs_value_type_t type;          // NVS_VALUE_UINT16, NVS_VALUE_UINT32, NVS_VALUE_FLOAT or NVS_VALUE_STRING
+    size_t offset;                  // settings_values_t member
+    size_t length;                  // maximum string length, without the terminating zero
+    double default_number;
+    const char *default_string;
+    double min;                     // SETTING_FLAG_RANGE only
+    double max;
+    const char *field;              // page placeholder {VAL_<field>}
+    uint8_t flags;
+} setting_t;
+
+extern const setting_t settings_table[];
+extern const size_t settings_count;
+
+/**
+ * Set of settings, one bit per settings_table entry
+ */
+typedef uint32_t settings_mask_t;
+
+/**
+ * Settings change notification
+ *
+ * settings_save() posts SETTINGS_EVENT_CHANGED to the default event loop with the settings_mask_t of the changed
+ * settings as the event data. The values are already in settings_load() then, the subscribers reload what they use
+ * and ignore the other bits.
+ */
+ESP_EVENT_DECLARE_BASE(SETTINGS_EVENT);
+
+typedef enum {
+    SETTINGS_EVENT_CHANGED,
+} settings_event_id_t;
+
+/**
+ * Settings write statistics since boot
+ */
+typedef struct {
+    uint32_t saves;             // settings_save() calls
+    uint32_t changed;           // values found changed and written
+    uint32_t unchanged;         // values found unchanged and skipped
+    uint32_t commits;           // coalesced writes to NVS
+    uint32_t pending;           // values waiting for the next commit
+} settings_stats_t;
 
 /**
  * Routines
@@ -119,6 +285,104 @@ extern int device_ready;
  */
 esp_err_t settings_init();
 
+/**
+ * @brief Fill in all settings with the default values, including the generated device ID and serial
+ */
+void settings_set_defaults(settings_values_t *values);
+
+/**
+ * @brief Load all settings
+ *
+ * After settings_init() this is a copy of the current settings, including the saves not written yet. Before, the
+ * settings blob is used when it is valid, otherwise the per-key entries are read in one batch and the keys not
+ * found keep their current values.
+ *
+ * @return
+ *         - ESP_OK if all settings were read
+ *         - ESP_ERR_NVS_NOT_FOUND if some keys are missing
+ *         - ESP_ERR_NO_MEM or the first other NVS error
+ */
+esp_err_t settings_load(settings_values_t *values);
+
+/**
+ * @brief Save the given settings
+ *
+ * The values are compared with the current settings, only the changed ones are written, after SETTINGS_COMMIT_DELAY_MS
+ * together with the other saves of that window.
+ *
+ * @param[in]  flags Only the settings having all these flags are saved (0 - all settings)
+ * @param[out] changed Settings that changed, may be NULL
+ * @return
+ *         - ESP_OK if the settings were saved (or unchanged)
+ *         - ESP_ERR_INVALID_STATE if settings_init() was not called
+ */
+esp_err_t settings_save(const settings_values_t *values, uint8_t flags, settings_mask_t *changed);
+
+/**
+ * @brief Write the pending saves now
+ *
+ * @return
+ *         - ESP_OK if nothing was pending or the values were written
+ *         - One of the NVS errors otherwise, the values stay pending
+ */
+esp_err_t settings_flush(void);
+
+/**
+ * @brief Write statistics since boot
+ */
+settings_stats_t settings_get_stats(void);
+
+/**
+ * @brief Generation of the settings, counts the saves that changed something since boot
+ *
+ * Anything derived from the settings (a rendered page, say) is current while the generation is the same.
+ */
+uint32_t settings_generation(void);
+
+/**
+ * @brief Find a setting by its NVS key, NULL if not found
+ */
+const setting_t *setting_find(const char *key);
+
+/**
+ * @brief Bit of a setting in settings_mask_t
+ */
+settings_mask_t setting_mask(const setting_t *setting);
+
+/**
+ * @brief Set of the settings with the given NVS keys, the list ends with NULL
+ */
+settings_mask_t settings_keys_mask(const char *key, ...);
+
+/**
+ * @brief Pointer to the value of a setting
+ */
+void *setting_value(settings_values_t *values, const setting_t *setting);
+
+/**
+ * @brief Parse and validate a setting value
+ *
+ * The value is only changed when the text is valid.
+ *
+ * @return
+ *         - ESP_OK if the value was assigned
+ *         - ESP_ERR_INVALID_ARG if the text is not a number
+ *         - ESP_ERR_INVALID_SIZE if the number is out of range or the string is too long
+ */
+esp_err_t setting_from_string(const setting_t *setting, settings_values_t *values, const char *text);
+
+/**
+ * @brief Validate and assign the value of a numeric setting, same checks and results as setting_from_string()
+ */
+esp_err_t setting_from_number(const setting_t *setting, settings_values_t *values, double number);
+
+/**
+ * @brief Format a setting value, strings are returned as they are
+ *
+ * @return Pointer to the value text (buf, or the string value itself)
+ */
+const char *setting_to_string(const setting_t *setting, const settings_values_t *values, char *buf, size_t length);
+
 /**
  * @brief Generate serial number for the device
  * 
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_log.h"
+
+#include "common.h"
+#include "template.h"
+
+static esp_err_t template_add_segment(template_t *tpl, size_t *capacity, uint32_t offset, uint32_t length, int32_t var) {
+    // Adjacent literal text is kept in one span
+    if (var == TEMPLATE_LITERAL && tpl->segment_count > 0) {
+        template_segment_t *last = &tpl->segments[tpl->segment_count - 1];
+        if (last->var == TEMPLATE_LITERAL && last->offset + last->length == offset) {
+            last->length += length;
+            return ESP_OK;
+        }
+    }
+    if (tpl->segment_count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 32;
+        template_segment_t *segments = realloc(tpl->segments, grown * sizeof(template_segment_t));
+        if (segments == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        tpl->segments = segments;
+        *capacity = grown;
+    }
+    tpl->segments[tpl->segment_count++] = (template_segment_t) { offset, length, var };
+    return ESP_OK;
+}
+
+static bool template_name_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+esp_err_t template_compile(template_t *tpl, const char *text, size_t length, template_lookup_t lookup, void *ctx) {
+    memset(tpl, 0, sizeof(template_t));
+    tpl->text = text;
+    tpl->length = length;
+
+    size_t capacity = 0;
+    size_t literal = 0;         // start of the pending literal text
+    char name[TEMPLATE_NAME_LENGTH + 1];
+    esp_err_t err = ESP_OK;
+
+    for (size_t pos = 0; pos < length && err == ESP_OK; pos++) {
+        if (text[pos] != '{') {
+            continue;
+        }
+        size_t end = pos + 1;
+        while (end < length && end - pos - 1 < TEMPLATE_NAME_LENGTH && template_name_char(text[end])) {
+            end++;
+        }
+        if (end == pos + 1 || end >= length || text[end] != '}') {
+            continue;
+        }
+        memcpy(name, text + pos + 1, end - pos - 1);
+        name[end - pos - 1] = '\0';
+        int32_t var = lookup(name, ctx);
+        if (var == TEMPLATE_LITERAL) {
+            continue;
+        }
+
+        if (pos > literal) {
+            err = template_add_segment(tpl, &capacity, literal, pos - literal, TEMPLATE_LITERAL);
+        }
+        if (err == ESP_OK) {
+            err = template_add_segment(tpl, &capacity, pos, end + 1 - pos, var);
+        }
+        literal = end + 1;
+        pos = end;
+    }
+    if (err == ESP_OK && length > literal) {
+        err = template_add_segment(tpl, &capacity, literal, length - literal, TEMPLATE_LITERAL);
+    }
+
+    if (err != ESP_OK) {
+        template_free(tpl);
+        return err;
+    }
+    ESP_LOGD(TAG, "Template compiled: %u bytes, %u segments", (unsigned)length, (unsigned)tpl->segment_count);
+    return ESP_OK;
+}
+
+esp_err_t template_render(const template_t *tpl, template_writer_t *out, template_value_t value, void *ctx) {
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < tpl->segment_count && err == ESP_OK; i++) {
+        const template_segment_t *segment = &tpl->segments[i];
+        if (segment->var != TEMPLATE_LITERAL) {
+            err = value(segment->var, out, ctx);
+        } else {
+            err = template_write(out, tpl->text + segment->offset, segment->length);
+        }
+    }
+    if (err == ESP_OK) {
+        err = template_flush(out);
+    }
+    return err;
+}
+
+void template_free(template_t *tpl) {
+    free(tpl->segments);
+    tpl->segments = NULL;
+    tpl->segment_count = 0;
+}
+
+void template_writer_init(template_writer_t *out, char *window, size_t size, template_sink_t sink, void *ctx) {
+    *out = (template_writer_t) {
+        .window = window,
+        .size = size,
+        .sink = sink,
+        .ctx = ctx,
+    };
+}
+
+esp_err_t template_flush(template_writer_t *out) {
+    if (out->used > 0 && out->err == ESP_OK) {
+        out->err = out->sink(out->window, out->used, out->ctx);
+    }
+    out->used = 0;
+    return out->err;
+}
+
+esp_err_t template_write(template_writer_t *out, const char *data, size_t length) {
+    while (length > 0 && out->err == ESP_OK) {
+        if (out->used == out->size) {
+            template_flush(out);
+            continue;
+        }
+        size_t chunk = MIN(length, out->size - out->used);
+        memcpy(out->window + out->used, data, chunk);
+        out->used += chunk;
+        out->total += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return out->err;
+}
+
+esp_err_t template_write_str(template_writer_t *out, const char *str) {
+    return template_write(out, str, strlen(str));
+}
+
+esp_err_t template_write_html(template_writer_t *out, const char *str) {
+    const char *plain = str;
+    for (; *str; str++) {
+        const char *entity = NULL;
+        switch (*str) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+        }
+        if (entity != NULL) {
+            template_write(out, plain, str - plain);
+            template_write_str(out, entity);
+            plain = str + 1;
+        }
+    }
+    return template_write(out, plain, str - plain);
+}
+
+esp_err_t template_write_file(template_writer_t *out, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        ESP_LOGW(TAG, "Failed to open %s", path);
+        return ESP_OK;
+    }
+    while (out->err == ESP_OK) {
+        if (out->used == out->size) {
+            template_flush(out);
+            continue;
+        }
+        size_t read = fread(out->window + out->used, 1, out->size - out->used, f);
+        if (read == 0) {
+            break;
+        }
+        out->used += read;
+        out->total += read;
+    }
+    fclose(f);
+    return out->err;
+}
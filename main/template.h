@@ -0,0 +1,122 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TEMPLATE_NAME_LENGTH    48          // longest placeholder name, without the braces
+#define TEMPLATE_WINDOW_SIZE    256         // output window of the page handlers
+
+/**
+ * Page templates
+ *
+ * A template is parsed once into a list of segments: literal spans of the source and the variables found in it.
+ * A placeholder is {NAME}, NAME made of A-Z, 0-9 and _. The names are resolved to variable IDs at compile time,
+ * placeholders of unknown names (and all other braces, e.g. in the page scripts) stay literal text.
+ *
+ * Rendering is a single forward pass over the segments. The literal spans are copied from the source, the variables
+ * are written by a callback, everything goes through a small output window flushed to a sink, so the rendered page
+ * never has to fit in memory.
+ */
+
+/**
+ * One segment of a compiled template
+ */
+typedef struct {
+    uint32_t offset;            // span of the source (the placeholder itself for variables)
+    uint32_t length;
+    int32_t var;                // variable ID, TEMPLATE_LITERAL for literal text
+} template_segment_t;
+
+#define TEMPLATE_LITERAL        (-1)
+
+/**
+ * Compiled template
+ */
+typedef struct {
+    const char *text;           // source, has to outlive the template
+    size_t length;              // source length
+    template_segment_t *segments;
+    size_t segment_count;
+} template_t;
+
+/**
+ * @brief Output sink, receives the content of the full output window
+ */
+typedef esp_err_t (*template_sink_t)(const char *data, size_t length, void *ctx);
+
+/**
+ * Buffered output of the rendering
+ */
+typedef struct {
+    char *window;
+    size_t size;
+    size_t used;
+    size_t total;               // bytes written so far
+    esp_err_t err;              // first sink error, the following writes are dropped
+    template_sink_t sink;
+    void *ctx;
+} template_writer_t;
+
+/**
+ * @brief Resolve a placeholder name at compile time
+ *
+ * @return variable ID (0 or more), TEMPLATE_LITERAL if the name is not a variable
+ */
+typedef int32_t (*template_lookup_t)(const char *name, void *ctx);
+
+/**
+ * @brief Write the value of a variable
+ */
+typedef esp_err_t (*template_value_t)(int32_t var, template_writer_t *out, void *ctx);
+
+/**
+ * @brief Compile a template kept in memory, the text has to outlive the template
+ */
+esp_err_t template_compile(template_t *tpl, const char *text, size_t length, template_lookup_t lookup, void *ctx);
+
+/**
+ * @brief Render the template into the writer, the writer is flushed at the end
+ *
+ * @return ESP_OK or the first error of the sink or the value callback
+ */
+esp_err_t template_render(const template_t *tpl, template_writer_t *out, template_value_t value, void *ctx);
+
+/**
+ * @brief Free the segment list
+ */
+void template_free(template_t *tpl);
+
+/**
+ * @brief Start an output with the given window
+ */
+void template_writer_init(template_writer_t *out, char *window, size_t size, template_sink_t sink, void *ctx);
+
+/**
+ * @brief Write data to the output
+ */
+esp_err_t template_write(template_writer_t *out, const char *data, size_t length);
+
+/**
+ * @brief Write a string to the output
+ */
+esp_err_t template_write_str(template_writer_t *out, const char *str);
+
+/**
+ * @brief Write a string escaped for the HTML text and attribute values
+ */
+esp_err_t template_write_html(template_writer_t *out, const char *str);
+
+/**
+ * @brief Copy a file to the output, missing file writes nothing
+ */
+esp_err_t template_write_file(template_writer_t *out, const char *path);
+
+/**
+ * @brief Pass the buffered data to the sink
+ */
+esp_err_t template_flush(template_writer_t *out);
+
+#endif
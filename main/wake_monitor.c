@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "common.h"
+#include "wake_monitor.h"
+
+static const wake_monitor_ops_t *monitor_ops = NULL;
+static TaskHandle_t monitor_task = NULL;
+static volatile wake_event_t pending_event = WAKE_EVENT_NONE;
+static bool monitor_armed = false;
+
+/**
+ * @brief: Convert the pressure band (Pa) into the sensor voltage band (mV), inverse of the pressure formula in sensor_run()
+ */
+wake_band_t wake_band_from_pressure(uint32_t low_pa, uint32_t high_pa, float voltage_offset, uint32_t multiplier) {
+    wake_band_t band = { WAKE_THRESHOLD_DISABLED, WAKE_THRESHOLD_DISABLED };
+    if (multiplier == 0) {
+        return band;
+    }
+    if (low_pa > 0) {
+        band.low_mv = (int)(((float)low_pa / multiplier + voltage_offset) * 1000.0f);
+    }
+    if (high_pa > 0) {
+        band.high_mv = (int)(((float)high_pa / multiplier + voltage_offset) * 1000.0f);
+    }
+    return band;
+}
+
+/**
+ * @brief: Classify the signal value against the thresholds
+ */
+wake_event_t wake_band_classify(const wake_band_t *thresholds, int mv) {
+    if (thresholds->high_mv != WAKE_THRESHOLD_DISABLED && mv > thresholds->high_mv) {
+        return WAKE_EVENT_ABOVE_HIGH;
+    }
+    if (thresholds->low_mv != WAKE_THRESHOLD_DISABLED && mv < thresholds->low_mv) {
+        return WAKE_EVENT_BELOW_LOW;
+    }
+    return WAKE_EVENT_NONE;
+}
+
+/**
+ * @brief: Choose the thresholds to arm for the current signal value
+ */
+void wake_band_arm_thresholds(const wake_band_t *band, int mv, wake_band_t *armed) {
+    switch (wake_band_classify(band, mv)) {
+        case WAKE_EVENT_ABOVE_HIGH:
+            // wake when the signal comes back into the band
+            armed->low_mv = band->high_mv - WAKE_BAND_HYSTERESIS_MV;
+            armed->high_mv = WAKE_THRESHOLD_DISABLED;
+            break;
+        case WAKE_EVENT_BELOW_LOW:
+            armed->low_mv = WAKE_THRESHOLD_DISABLED;
+            armed->high_mv = band->low_mv + WAKE_BAND_HYSTERESIS_MV;
+            break;
+        default:
+            *armed = *band;
+            break;
+    }
+}
+
+/**
+ * @brief: Find the smallest raw ADC value which converts to at least `mv`
+ */
+int wake_mv_to_raw(int mv, wake_raw_to_mv_t raw_to_mv, void *ctx) {
+    int lo = 0, hi = WAKE_RAW_MAX;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (raw_to_mv(mid, ctx) < mv) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+esp_err_t wake_monitor_init(const wake_monitor_ops_t *ops, TaskHandle_t task, int channel, wake_raw_to_mv_t raw_to_mv, void *ctx) {
+    monitor_task = task;
+    pending_event = WAKE_EVENT_NONE;
+    esp_err_t err = ops->init(channel, raw_to_mv, ctx);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Wake monitor backend '%s' is not available: %s", ops->name, esp_err_to_name(err));
+        monitor_ops = NULL;
+        return err;
+    }
+    monitor_ops = ops;
+    ESP_LOGI(TAG, "Wake monitor backend: %s", ops->name);
+    return ESP_OK;
+}
+
+esp_err_t wake_monitor_arm(const wake_band_t *band, int current_mv) {
+    if (monitor_ops == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (monitor_armed) {
+        wake_monitor_disarm();
+    }
+
+    wake_band_t armed;
+    wake_band_arm_thresholds(band, current_mv, &armed);
+    if (armed.low_mv == WAKE_THRESHOLD_DISABLED && armed.high_mv == WAKE_THRESHOLD_DISABLED) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pending_event = WAKE_EVENT_NONE;
+    esp_err_t err = monitor_ops->start(&armed);
+    if (err == ESP_OK) {
+        monitor_armed = true;
+        ESP_LOGD(TAG, "Wake monitor armed: low %d mV, high %d mV", armed.low_mv, armed.high_mv);
+    }
+    return err;
+}
+
+esp_err_t wake_monitor_disarm(void) {
+    if (monitor_ops == NULL || !monitor_armed) {
+        return ESP_OK;
+    }
+    monitor_armed = false;
+    return monitor_ops->stop();
+}
+
+wake_event_t wake_monitor_take_event(void) {
+    wake_event_t event = pending_event;
+    pending_event = WAKE_EVENT_NONE;
+    return event;
+}
+
+/**
+ * @brief: Report the event to the waiting task. Only the first event after arming wakes the task,
+ *         the monitor keeps firing on every conversion until it is disarmed.
+ */
+bool wake_monitor_signal_from_isr(wake_event_t event) {
+    if (pending_event != WAKE_EVENT_NONE || monitor_task == NULL) {
+        return false;
+    }
+    pending_event = event;
+    BaseType_t high_task_awoken = pdFALSE;
+    vTaskNotifyGiveFromISR(monitor_task, &high_task_awoken);
+    return high_task_awoken == pdTRUE;
+}
+
+
+/*---------------------------------------------------------------
+        Simulation backend
+---------------------------------------------------------------*/
+static wake_band_t sim_thresholds;
+static bool sim_running = false;
+
+static esp_err_t sim_init(int channel, wake_raw_to_mv_t raw_to_mv, void *ctx) {
+    sim_running = false;
+    return ESP_OK;
+}
+
+static esp_err_t sim_start(const wake_band_t *thresholds) {
+    sim_thresholds = *thresholds;
+    sim_running = true;
+    return ESP_OK;
+}
+
+static esp_err_t sim_stop(void) {
+    sim_running = false;
+    return ESP_OK;
+}
+
+void wake_monitor_sim_feed(int mv) {
+    if (!sim_running) {
+        return;
+    }
+    wake_event_t event = wake_band_classify(&sim_thresholds, mv);
+    if (event != WAKE_EVENT_NONE) {
+        if (pending_event == WAKE_EVENT_NONE && monitor_task != NULL) {
+            pending_event = event;
+            xTaskNotifyGive(monitor_task);
+        }
+    }
+}
+
+const wake_monitor_ops_t wake_monitor_sim_ops = {
+    .name = "simulation",
+    .init = sim_init,
+    .start = sim_start,
+    .stop = sim_stop,
+};
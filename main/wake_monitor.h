@@ -0,0 +1,109 @@
+#ifndef WAKE_MONITOR_H
+#define WAKE_MONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "common.h"
+
+#define WAKE_THRESHOLD_DISABLED     (-1)        // threshold side is not monitored
+#define WAKE_BAND_HYSTERESIS_MV     10          // distance from the band edge before a return into the band is reported
+#define WAKE_RAW_MAX                4095        // 12-bit ADC full scale
+#define WAKE_BURST_READINGS         10          // measurements taken after a wake-up
+#define WAKE_BURST_INTERVAL_MS      100         // pause between the burst measurements
+#define WAKE_MONITOR_SAMPLE_FREQ_HZ 1000        // conversion rate of the ADC digital controller while monitoring
+
+/**
+ * Wake-up event reported by the monitor
+ */
+typedef enum {
+    WAKE_EVENT_NONE,
+    WAKE_EVENT_ABOVE_HIGH,      // signal crossed the high threshold
+    WAKE_EVENT_BELOW_LOW,       // signal crossed the low threshold
+} wake_event_t;
+
+/**
+ * Monitored band (or armed thresholds), mV. Either side may be WAKE_THRESHOLD_DISABLED.
+ */
+typedef struct {
+    int low_mv;
+    int high_mv;
+} wake_band_t;
+
+/**
+ * ADC raw value to mV converter (calibration scheme or linear approximation)
+ */
+typedef int (*wake_raw_to_mv_t)(int raw, void *ctx);
+
+/**
+ * Monitor backend. The hardware backend uses the ADC digital monitor in continuous mode,
+ * the simulation backend is fed with values by wake_monitor_sim_feed() (host tests, targets without the monitor).
+ */
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(int channel, wake_raw_to_mv_t raw_to_mv, void *ctx);
+    esp_err_t (*start)(const wake_band_t *thresholds);     // thresholds are in mV
+    esp_err_t (*stop)(void);
+} wake_monitor_ops_t;
+
+extern const wake_monitor_ops_t wake_monitor_adc_ops;
+extern const wake_monitor_ops_t wake_monitor_sim_ops;
+
+/**
+ * @brief Convert the pressure band (Pa) into the sensor voltage band (mV)
+ */
+wake_band_t wake_band_from_pressure(uint32_t low_pa, uint32_t high_pa, float voltage_offset, uint32_t multiplier);
+
+/**
+ * @brief Classify the signal value (mV) against the thresholds
+ */
+wake_event_t wake_band_classify(const wake_band_t *thresholds, int mv);
+
+/**
+ * @brief Choose the thresholds to arm for the current signal value. Inside the band both edges are armed.
+ *        Outside of it only the return into the band (with hysteresis) is armed, so a steady out-of-band
+ *        value does not keep waking the device.
+ */
+void wake_band_arm_thresholds(const wake_band_t *band, int mv, wake_band_t *armed);
+
+/**
+ * @brief Find the smallest raw ADC value which converts to at least `mv` (binary search, converter is monotonic)
+ */
+int wake_mv_to_raw(int mv, wake_raw_to_mv_t raw_to_mv, void *ctx);
+
+/**
+ * @brief Select the backend and the task to be notified on wake-up
+ */
+esp_err_t wake_monitor_init(const wake_monitor_ops_t *ops, TaskHandle_t task, int channel, wake_raw_to_mv_t raw_to_mv, void *ctx);
+
+/**
+ * @brief Start monitoring the band for the current signal value (mV)
+ *
+ * @return ESP_ERR_INVALID_ARG if the band has no threshold to watch, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t wake_monitor_arm(const wake_band_t *band, int current_mv);
+
+/**
+ * @brief Stop monitoring (the ADC is released for one-shot sampling)
+ */
+esp_err_t wake_monitor_disarm(void);
+
+/**
+ * @brief Get (and clear) the last wake-up event
+ */
+wake_event_t wake_monitor_take_event(void);
+
+/**
+ * @brief Report the event to the waiting task. Called by the backends, safe in ISR context.
+ */
+bool wake_monitor_signal_from_isr(wake_event_t event);
+
+/**
+ * @brief Feed a simulated signal value (mV) into the simulation backend
+ */
+void wake_monitor_sim_feed(int mv);
+
+#endif
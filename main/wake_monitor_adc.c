@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "soc/soc_caps.h"
+
+#include "common.h"
+#include "sensor.h"
+#include "wake_monitor.h"
+
+#if SOC_ADC_MONITOR_SUPPORTED && SOC_ADC_DMA_SUPPORTED
+
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_monitor.h"
+
+/**
+ * ADC digital monitor backend. The ADC digital controller keeps converting in continuous mode and compares
+ * every result against the thresholds in hardware, so the CPU stays idle until the signal leaves the band.
+ * One-shot and continuous modes cannot share ADC1, so the monitor is stopped before every measurement.
+ */
+
+#define WAKE_ADC_FRAME_SIZE     (SOC_ADC_DIGI_RESULT_BYTES * 16)
+#define WAKE_ADC_POOL_SIZE      (WAKE_ADC_FRAME_SIZE * 4)
+
+static adc_continuous_handle_t adc_cont_handle = NULL;
+static adc_monitor_handle_t adc_monitor_handle = NULL;
+static int adc_channel;
+static wake_raw_to_mv_t adc_raw_to_mv = NULL;
+static void *adc_raw_to_mv_ctx = NULL;
+
+static bool IRAM_ATTR adc_over_high_cb(adc_monitor_handle_t monitor_handle, const adc_monitor_evt_data_t *event_data, void *user_data) {
+    return wake_monitor_signal_from_isr(WAKE_EVENT_ABOVE_HIGH);
+}
+
+static bool IRAM_ATTR adc_below_low_cb(adc_monitor_handle_t monitor_handle, const adc_monitor_evt_data_t *event_data, void *user_data) {
+    return wake_monitor_signal_from_isr(WAKE_EVENT_BELOW_LOW);
+}
+
+static esp_err_t adc_monitor_init(int channel, wake_raw_to_mv_t raw_to_mv, void *ctx) {
+    adc_channel = channel;
+    adc_raw_to_mv = raw_to_mv;
+    adc_raw_to_mv_ctx = ctx;
+
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = WAKE_ADC_POOL_SIZE,
+        .conv_frame_size = WAKE_ADC_FRAME_SIZE,
+    };
+    ESP_RETURN_ON_ERROR(adc_continuous_new_handle(&handle_config, &adc_cont_handle), TAG, "Failed to create continuous ADC handle");
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN,
+        .channel = channel,
+        .unit = ADC_UNIT_1,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    adc_continuous_config_t config = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = WAKE_MONITOR_SAMPLE_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+    };
+    esp_err_t err = adc_continuous_config(adc_cont_handle, &config);
+    if (err != ESP_OK) {
+        adc_continuous_deinit(adc_cont_handle);
+        adc_cont_handle = NULL;
+    }
+    return err;
+}
+
+static esp_err_t adc_monitor_start(const wake_band_t *thresholds) {
+    adc_monitor_config_t monitor_config = {
+        .adc_unit = ADC_UNIT_1,
+        .channel = adc_channel,
+        .h_threshold = thresholds->high_mv == WAKE_THRESHOLD_DISABLED ? -1 : wake_mv_to_raw(thresholds->high_mv, adc_raw_to_mv, adc_raw_to_mv_ctx),
+        .l_threshold = thresholds->low_mv == WAKE_THRESHOLD_DISABLED ? -1 : wake_mv_to_raw(thresholds->low_mv, adc_raw_to_mv, adc_raw_to_mv_ctx),
+    };
+    ESP_RETURN_ON_ERROR(adc_new_continuous_monitor(adc_cont_handle, &monitor_config, &adc_monitor_handle), TAG, "Failed to create ADC monitor");
+
+    adc_monitor_evt_cbs_t callbacks = {
+        .on_over_high_thresh = adc_over_high_cb,
+        .on_below_low_thresh = adc_below_low_cb,
+    };
+    esp_err_t err = adc_continuous_monitor_register_event_callbacks(adc_monitor_handle, &callbacks, NULL);
+    if (err == ESP_OK) {
+        err = adc_continuous_monitor_enable(adc_monitor_handle);
+    }
+    if (err == ESP_OK) {
+        err = adc_continuous_start(adc_cont_handle);
+    }
+    if (err != ESP_OK) {
+        adc_del_continuous_monitor(adc_monitor_handle);
+        adc_monitor_handle = NULL;
+    }
+    return err;
+}
+
+static esp_err_t adc_monitor_stop(void) {
+    ESP_RETURN_ON_ERROR(adc_continuous_stop(adc_cont_handle), TAG, "Failed to stop continuous ADC");
+    if (adc_monitor_handle != NULL) {
+        adc_continuous_monitor_disable(adc_monitor_handle);
+        adc_del_continuous_monitor(adc_monitor_handle);
+        adc_monitor_handle = NULL;
+    }
+    return ESP_OK;
+}
+
+#else
+
+static esp_err_t adc_monitor_init(int channel, wake_raw_to_mv_t raw_to_mv, void *ctx) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t adc_monitor_start(const wake_band_t *thresholds) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t adc_monitor_stop(void) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
+
+const wake_monitor_ops_t wake_monitor_adc_ops = {
+    .name = "ADC digital monitor",
+    .init = adc_monitor_init,
+    .start = adc_monitor_start,
+    .stop = adc_monitor_stop,
+};
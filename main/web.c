@@ -1,10 +1,16 @@
 
 #include <ctype.h>
+#include <inttypes.h>
 #include "esp_spiffs.h"  // Include for SPIFFS
 #include "esp_vfs.h"
 #include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "esp_http_server.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
 #include "non_volatile_storage.h"
 
 #include "common.h"
@@ -15,6 +21,41 @@
 #include "status.h"
 #include "hass.h"
 #include "mqtt.h"
+#include "autotune.h"
+#include "rules.h"
+#include "history.h"
+#include "template.h"
+#include "web_events.h"
+#include "form.h"
+
+// Pages and static assets embedded into the image by the build (see main/CMakeLists.txt)
+extern const char status_html_start[] asm("_binary_status_html_start");
+extern const char status_html_end[] asm("_binary_status_html_end");
+extern const uint8_t config_html_gz_start[] asm("_binary_config_html_gz_start");
+extern const uint8_t config_html_gz_end[] asm("_binary_config_html_gz_end");
+extern const uint8_t app_css_gz_start[] asm("_binary_app_css_gz_start");
+extern const uint8_t app_css_gz_end[] asm("_binary_app_css_gz_end");
+extern const uint8_t app_js_gz_start[] asm("_binary_app_js_gz_start");
+extern const uint8_t app_js_gz_end[] asm("_binary_app_js_gz_end");
+extern const uint8_t config_js_gz_start[] asm("_binary_config_js_gz_start");
+extern const uint8_t config_js_gz_end[] asm("_binary_config_js_gz_end");
+extern const uint8_t status_js_gz_start[] asm("_binary_status_js_gz_start");
+extern const uint8_t status_js_gz_end[] asm("_binary_status_js_gz_end");
+
+// Page compiled at the first request, the literal text stays in flash
+static web_page_t status_page = { "status.html", status_html_start, status_html_end };
+
+static web_asset_t web_assets[] = {
+    { "/", "text/html", config_html_gz_start, config_html_gz_end },
+    { "/app.css", "text/css", app_css_gz_start, app_css_gz_end },
+    { "/app.js", "text/javascript", app_js_gz_start, app_js_gz_end },
+    { "/config.js", "text/javascript", config_js_gz_start, config_js_gz_end },
+    { "/status.js", "text/javascript", status_js_gz_start, status_js_gz_end },
+};
+
+// Page ETag parts: the boot covers the firmware and the generations restarting, the CA certificate is not a setting
+static uint32_t web_boot_id = 0;
+static uint32_t ca_cert_generation = 0;
 
 void init_filesystem() {
     esp_vfs_spiffs_conf_t conf = {
@@ -40,30 +81,77 @@ void init_filesystem() {
     }
 }
 
+#if WEB_HEAP_LOG
+/**
+ * Memory measurement of the request handlers: the free heap before the handler, the lowest free heap while it runs
+ * (the local minimum of heap_caps_monitor_local_minimum_free_size_start()) and the free heap after it. Other tasks
+ * allocate meanwhile too, so the peak is an upper bound. The stack is the high water mark of the httpd task so far.
+ */
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+} web_measured_handler_t;
+
+static web_measured_handler_t web_measured_handlers[WEB_MAX_URI_HANDLERS];
+static size_t web_measured_count = 0;
+
+static esp_err_t web_measured_handler(httpd_req_t *req) {
+    const web_measured_handler_t *measured = (const web_measured_handler_t *)req->user_ctx;
+    req->user_ctx = measured->user_ctx;
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    bool monitored = (heap_caps_monitor_local_minimum_free_size_start() == ESP_OK);
+    esp_err_t err = measured->handler(req);
+    size_t free_min = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    if (monitored) {
+        heap_caps_monitor_local_minimum_free_size_stop();
+    }
+    size_t free_after = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+
+    ESP_LOGI(TAG, "Heap of %s %s: peak %u B, retained %d B, free before %u B%s; httpd stack unused %u B",
+             http_method_str(req->method), req->uri, (unsigned)(free_before - free_min),
+             (int)free_before - (int)free_after, (unsigned)free_before, monitored ? "" : " (peak since boot)",
+             (unsigned)uxTaskGetStackHighWaterMark(NULL));
+    return err;
+}
+#endif
+
+// Register a request handler, measured with WEB_HEAP_LOG
+static esp_err_t web_register_uri_handler(httpd_handle_t server, const httpd_uri_t *uri) {
+#if WEB_HEAP_LOG
+    if (web_measured_count < WEB_MAX_URI_HANDLERS) {
+        web_measured_handler_t *measured = &web_measured_handlers[web_measured_count++];
+        measured->handler = uri->handler;
+        measured->user_ctx = uri->user_ctx;
+
+        httpd_uri_t wrapped = *uri;
+        wrapped.handler = web_measured_handler;
+        wrapped.user_ctx = measured;
+        return httpd_register_uri_handler(server, &wrapped);
+    }
+#endif
+    return httpd_register_uri_handler(server, uri);
+}
 
 void start_webserver(void) {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.stack_size = WEB_SERVER_STACK_SIZE;     // the handlers keep their receive and output buffers on the stack
+    config.max_uri_handlers = WEB_MAX_URI_HANDLERS;
+
+    web_boot_id = esp_random();
 
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
-        // Set URI handlers
-        httpd_uri_t config_uri = {
-            .uri       = "/",
-            .method    = HTTP_GET,
-            .handler   = config_get_handler,
-            .user_ctx  = NULL
-        };
-        httpd_register_uri_handler(server, &config_uri);
-
+        // Set URI handlers, the config page is one of the static assets below
         httpd_uri_t status_uri = {
             .uri       = "/status",
             .method    = HTTP_GET,
             .handler   = status_get_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &status_uri);
+        web_register_uri_handler(server, &status_uri);
 
         httpd_uri_t submit_uri = {
             .uri       = "/submit",
@@ -71,7 +159,7 @@ void start_webserver(void) {
             .handler   = submit_post_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &submit_uri);
+        web_register_uri_handler(server, &submit_uri);
 
         // URI handler for reboot action
         httpd_uri_t reboot_uri = {
@@ -80,7 +168,7 @@ void start_webserver(void) {
             .handler = reboot_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &reboot_uri);
+        web_register_uri_handler(server, &reboot_uri);
 
         // Register the Zigbee connect handler
         httpd_uri_t connect_zigbee_uri = {
@@ -89,7 +177,7 @@ void start_webserver(void) {
             .handler   = connect_zigbee_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &connect_zigbee_uri);
+        web_register_uri_handler(server, &connect_zigbee_uri);
 
         // Register the status web service handler
         httpd_uri_t status_webserver_get_uri = {
@@ -98,7 +186,7 @@ void start_webserver(void) {
             .handler   = status_data_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &status_webserver_get_uri);
+        web_register_uri_handler(server, &status_webserver_get_uri);
 
         httpd_uri_t ca_cert_uri = {
             .uri       = "/ca-cert",
@@ -108,7 +196,84 @@ void start_webserver(void) {
         };
 
         // Register the handler
-        httpd_register_uri_handler(server, &ca_cert_uri);  
+        web_register_uri_handler(server, &ca_cert_uri);  
+
+        httpd_uri_t ca_cert_get_uri = {
+            .uri       = "/ca-cert",
+            .method    = HTTP_GET,
+            .handler   = ca_cert_get_handler,
+            .user_ctx  = NULL
+        };
+        web_register_uri_handler(server, &ca_cert_get_uri);
+
+        // URI handler for sampling parameters auto-tune
+        httpd_uri_t autotune_uri = {
+            .uri       = "/autotune",
+            .method    = HTTP_POST,
+            .handler   = autotune_post_handler,
+            .user_ctx  = NULL
+        };
+        web_register_uri_handler(server, &autotune_uri);
+
+        // Reading history web service
+        httpd_uri_t history_data_uri = {
+            .uri       = "/history-data",
+            .method    = HTTP_GET,
+            .handler   = history_data_handler,
+            .user_ctx  = NULL
+        };
+        web_register_uri_handler(server, &history_data_uri);
+
+        // NVS access counters web service
+        httpd_uri_t nvs_stats_uri = {
+            .uri       = "/api/nvs-stats",
+            .method    = HTTP_GET,
+            .handler   = nvs_stats_handler,
+            .user_ctx  = NULL
+        };
+        web_register_uri_handler(server, &nvs_stats_uri);
+
+        // Configuration API of the config page
+        httpd_uri_t config_api_get_uri = {
+            .uri       = "/api/config",
+            .method    = HTTP_GET,
+            .handler   = config_api_get_handler,
+            .user_ctx  = NULL
+        };
+        web_register_uri_handler(server, &config_api_get_uri);
+
+        httpd_uri_t config_api_patch_uri = {
+            .uri       = "/api/config",
+            .method    = HTTP_PATCH,
+            .handler   = config_api_patch_handler,
+            .user_ctx  = NULL
+        };
+        web_register_uri_handler(server, &config_api_patch_uri);
+
+        httpd_uri_t schema_api_uri = {
+            .uri       = "/api/schema",
+            .method    = HTTP_GET,
+            .handler   = schema_api_handler,
+            .user_ctx  = NULL
+        };
+        web_register_uri_handler(server, &schema_api_uri);
+
+        // Live readings
+        web_events_register(server);
+
+        // Static assets, gzipped in flash
+        for (size_t i = 0; i < sizeof(web_assets) / sizeof(web_assets[0]); i++) {
+            uint32_t crc = esp_rom_crc32_le(0, web_assets[i].start, web_assets[i].end - web_assets[i].start);
+            snprintf(web_assets[i].etag, sizeof(web_assets[i].etag), "\"%08" PRIx32 "\"", crc);
+
+            httpd_uri_t asset_uri = {
+                .uri       = web_assets[i].uri,
+                .method    = HTTP_GET,
+                .handler   = asset_get_handler,
+                .user_ctx  = (void *)&web_assets[i]
+            };
+            web_register_uri_handler(server, &asset_uri);
+        }
 
     } else {
         ESP_LOGI(TAG, "Error starting server!");
@@ -116,545 +281,466 @@ void start_webserver(void) {
 }
 
 
-static esp_err_t config_get_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "Processing config web request");
+// Resolve the page placeholders {VAL_<field>} to the settings_table index
+static int32_t page_variable_lookup(const char *name, void *ctx) {
+    if (strncmp(name, "VAL_", 4) != 0) {
+        return TEMPLATE_LITERAL;
+    }
+    for (size_t i = 0; i < settings_count; i++) {
+        const setting_t *setting = &settings_table[i];
+        if (setting->field != NULL && strcmp(setting->field, name + 4) == 0) {
+            return (int32_t)i;
+        }
+    }
+    return TEMPLATE_LITERAL;
+}
 
-    // empty message
-    const char* message = "";
+// Write the value of a page placeholder
+static esp_err_t page_variable_value(int32_t var, template_writer_t *out, void *ctx) {
+    const page_context_t *page = (const page_context_t *)ctx;
+    char value_str[16];
 
-    // Allocate memory dynamically for template and output
-    char *html_template = (char *)malloc(MAX_TEMPLATE_SIZE);
-    char *html_output = (char *)malloc(MAX_TEMPLATE_SIZE);
+    const setting_t *setting = &settings_table[var];
+    const char *value = setting_to_string(setting, page->values, value_str, sizeof(value_str));
+    return setting->type == NVS_VALUE_STRING ? template_write_html(out, value) : template_write_str(out, value);
+}
 
-    if (html_template == NULL || html_output == NULL) {
-        ESP_LOGE(TAG, "Memory allocation failed");
-        if (html_template) free(html_template);
-        if (html_output) free(html_output);
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+// Send the full output window as one chunk of the response
+static esp_err_t page_chunk_sink(const char *data, size_t length, void *ctx) {
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, length);
+}
+
+// True if If-None-Match of the request lists the ETag (or is "*")
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+    char if_none_match[WEB_IF_NONE_MATCH_LENGTH];
+    if (httpd_req_get_hdr_value_len(req, "If-None-Match") == 0) {
+        return false;
     }
+    // A longer list is cut, the ETags at its end are then not found and the response is sent in full
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, etag) != NULL;
+}
 
-    // Read the template from SPIFFS (assuming you're loading it from SPIFFS)
-    FILE *f = fopen("/spiffs/config.html", "r");
-    if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open file for reading");
-        free(html_template);
-        free(html_output);
-        httpd_resp_send_404(req);
-        return ESP_FAIL;
+// Set the validators of the response and answer 304 Not Modified if the client has this version already
+static bool send_not_modified(httpd_req_t *req, const char *etag, const char *cache_control) {
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+    if (!etag_matches(req, etag)) {
+        return false;
     }
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_send(req, NULL, 0);
+    return true;
+}
 
-    // Load the template into html_template
-    size_t len = fread(html_template, 1, MAX_TEMPLATE_SIZE, f);
-    fclose(f);
-    html_template[len] = '\0';  // Null-terminate the string
-
-    // Copy template into html_output for modification
-    strcpy(html_output, html_template);
-
-    // Allocate memory for the strings you will retrieve from NVS
-    char *mqtt_server = NULL;
-    char *mqtt_protocol = NULL;
-    char *mqtt_user = NULL;
-    char *mqtt_password = NULL;
-    char *mqtt_prefix = NULL;
-    char *ha_prefix = NULL;
-    char *device_id = NULL;
-    char *device_serial = NULL;
-    char *ca_cert = NULL;
-
-    uint16_t mqtt_connect;
-    uint16_t mqtt_port;
-    float sensor_offset;
-    uint32_t sensor_linear_multiplier;
-
-    uint32_t ha_upd_intervl;
-    uint16_t sensor_samples;
-    uint16_t sensor_smp_int;
-    uint16_t sensor_deviate;
-
-    uint16_t sensor_intervl;
-
-    // Load settings from NVS (use default values if not set)
-    ESP_ERROR_CHECK(nvs_read_float(S_NAMESPACE, S_KEY_SENSOR_OFFSET, &sensor_offset));
-    ESP_ERROR_CHECK(nvs_read_uint32(S_NAMESPACE, S_KEY_SENSOR_LINEAR_MULTIPLIER, &sensor_linear_multiplier));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_SERVER, &mqtt_server));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_PORT, &mqtt_port));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PROTOCOL, &mqtt_protocol));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_USER, &mqtt_user));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PASSWORD, &mqtt_password));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_HA_PREFIX, &ha_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_SERIAL, &device_serial));
-    ESP_ERROR_CHECK(nvs_read_uint32(S_NAMESPACE, S_KEY_HA_UPDATE_INTERVAL, &ha_upd_intervl));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_COUNT, &sensor_samples));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_INTERVAL, &sensor_smp_int));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, &sensor_deviate));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_READ_INTERVAL, &sensor_intervl));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connect));
-
-    // Load the CA certificate
-    if (load_ca_certificate(&ca_cert) != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to load CA certificate from %s", CA_CERT_PATH);
+// ETag of the rendered pages, taken before the settings are loaded so the page is never older than its tag
+static void page_etag(char *etag, size_t size) {
+    snprintf(etag, size, "\"%08" PRIx32 "-%" PRIu32 "-%" PRIu32 "\"", web_boot_id, settings_generation(), ca_cert_generation);
+}
+
+// Render a page template (compiled at the first request) straight into the chunked response
+static esp_err_t send_page(httpd_req_t *req, web_page_t *page, const page_context_t *context) {
+    if (page->tpl.segments == NULL &&
+        template_compile(&page->tpl, page->start, page->end - page->start, page_variable_lookup, NULL) != ESP_OK) {
+        httpd_resp_send_500(req);
         return ESP_FAIL;
-    } else {
-        ESP_LOGI(TAG, "Loaded CA certificate: %s", CA_CERT_PATH);
-    }
-
-    // Replace placeholders in the template with actual values
-    char mqtt_port_str[6];
-    char sensor_offset_str[10];
-    char sensor_linear_multiplier_str[10];
-    char ha_upd_intervl_str[10];
-    char sensor_samples_str[10];
-    char sensor_smp_int_str[10];
-    char sensor_deviate_str[10];
-    char sensor_intervl_str[10];
-    char mqtt_connect_str[10];
-    snprintf(mqtt_port_str, sizeof(mqtt_port_str), "%u", mqtt_port);
-    snprintf(sensor_offset_str, sizeof(sensor_offset_str), "%.3f", sensor_offset);
-    snprintf(sensor_linear_multiplier_str, sizeof(sensor_linear_multiplier_str), "%lu", sensor_linear_multiplier);
-    snprintf(ha_upd_intervl_str, sizeof(ha_upd_intervl_str), "%li", (uint32_t) ha_upd_intervl);
-    snprintf(sensor_samples_str, sizeof(sensor_samples_str), "%i", (uint16_t) sensor_samples);
-    snprintf(sensor_smp_int_str, sizeof(sensor_smp_int_str), "%i", (uint16_t) sensor_smp_int);
-    snprintf(sensor_deviate_str, sizeof(sensor_deviate_str), "%i", (uint16_t) sensor_deviate);
-    snprintf(sensor_intervl_str, sizeof(sensor_intervl_str), "%i", (uint16_t) sensor_intervl);
-    snprintf(mqtt_connect_str, sizeof(mqtt_connect_str), "%i", (uint16_t) mqtt_connect);
-
-    replace_placeholder(html_output, "{VAL_DEVICE_ID}", device_id);
-    replace_placeholder(html_output, "{VAL_DEVICE_SERIAL}", device_serial);
-    replace_placeholder(html_output, "{VAL_MQTT_SERVER}", mqtt_server);
-    replace_placeholder(html_output, "{VAL_MQTT_PORT}", mqtt_port_str);
-    replace_placeholder(html_output, "{VAL_MQTT_PROTOCOL}", mqtt_protocol);
-    replace_placeholder(html_output, "{VAL_MQTT_USER}", mqtt_user);
-    replace_placeholder(html_output, "{VAL_MQTT_PASSWORD}", mqtt_password);
-    replace_placeholder(html_output, "{VAL_MQTT_PREFIX}", mqtt_prefix);
-    replace_placeholder(html_output, "{VAL_HA_PREFIX}", ha_prefix);
-    replace_placeholder(html_output, "{VAL_SENSOR_OFFSET}", sensor_offset_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_LINEAR_MULTIPLIER}", sensor_linear_multiplier_str);
-    replace_placeholder(html_output, "{VAL_MESSAGE}", message);
-    replace_placeholder(html_output, "{VAL_HA_UPDATE_INTERVAL}", ha_upd_intervl_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_SAMPLING_COUNT}", sensor_samples_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_SAMPLING_INTERVAL}", sensor_smp_int_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_SAMPLING_MEDIAN_DEVIATION}", sensor_deviate_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_READ_INTERVAL}", sensor_intervl_str);
-    replace_placeholder(html_output, "{VAL_MQTT_CONNECT}", mqtt_connect_str);
-    replace_placeholder(html_output, "{VAL_CA_CERT}", ca_cert);
-
-    // replace static fields
-    assign_static_page_variables(html_output);
-
-
-    // Send the final HTML response
+    }
+
+    // The page is never held in memory, only the window of the output
+    char window[TEMPLATE_WINDOW_SIZE];
+    template_writer_t out;
+    template_writer_init(&out, window, sizeof(window), page_chunk_sink, req);
+
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, html_output, strlen(html_output));
-
-    // Free dynamically allocated memory
-    free(html_template);
-    free(html_output);
-    free(mqtt_server);
-    free(mqtt_protocol);
-    free(mqtt_user);
-    free(mqtt_password);
-    free(mqtt_prefix);
-    free(ha_prefix);
-    free(device_id);
-    free(device_serial);
-    free(ca_cert);
+    esp_err_t err = template_render(&page->tpl, &out, page_variable_value, (void *)context);
+    if (err != ESP_OK) {
+        // The headers are out already, the truncated response is ended below and the client sees it incomplete
+        ESP_LOGE(TAG, "Failed to render %s: %s", page->name, esp_err_to_name(err));
+    } else {
+        ESP_LOGD(TAG, "Sent %s: %u bytes", page->name, (unsigned)out.total);
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
 
-    return ESP_OK;
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
 }
 
-static esp_err_t submit_post_handler(httpd_req_t *req) {
-    // Extract form data
-    char buf[1024];
-    memset(buf, 0, sizeof(buf));  // Initialize the buffer with zeros to avoid any garbage
-    int ret, remaining = req->content_len;
+// Send a static asset as it is in flash, the browser inflates it
+static esp_err_t asset_get_handler(httpd_req_t *req) {
+    const web_asset_t *asset = req->user_ctx;
+
+    // Only the gzipped copy is kept, every browser accepts it. The caches are told the body depends on the encoding.
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    if (send_not_modified(req, asset->etag, WEB_ASSET_CACHE_CONTROL)) {
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)asset->start, asset->end - asset->start);
+}
+
+// Compile the alarm rules of the edited settings, the error message is returned when they are broken
+static bool config_rules_check(const settings_values_t *values, char *error, size_t error_size) {
+    alarm_rule_set_t *rule_set = (alarm_rule_set_t *)malloc(sizeof(alarm_rule_set_t));
+    if (rule_set == NULL) {
+        snprintf(error, error_size, "Out of memory");
+        return false;
+    }
+    bool valid = (rules_compile(values->alarm_rules, rule_set, error, error_size) == ESP_OK);
+    free(rule_set);
+    return valid;
+}
+
+// Save the edited settings of the config page (the alarm rules have been checked) and apply what is not applied by the
+// settings change event
+static settings_mask_t config_save(const settings_values_t *values) {
+    // Only the changed ones are written, together with the saves that follow shortly
+    settings_mask_t changed = 0;
+    ESP_ERROR_CHECK(settings_save(values, SETTING_FLAG_FORM, &changed));
+    ESP_LOGI(TAG, "%u settings changed", (unsigned)__builtin_popcount(changed));
+    if (changed & setting_mask(setting_find(S_KEY_ALARM_RULES))) {
+        // The rules take effect from the next measurement, no reboot required
+        rules_reload();
+    }
+
+    // Sensor calibration
+    sensor_data.voltage_offset = values->sensor_offset;
+    sensor_data.sensor_linear_multiplier = values->sensor_linear_multiplier;
+    return changed;
+}
+
+// Feed the request body to the form parser as it arrives
+static esp_err_t form_receive(httpd_req_t *req, form_parser_t *parser) {
+    char buf[WEB_RECV_CHUNK_SIZE];
+    size_t remaining = req->content_len;
 
     while (remaining > 0) {
-        if ((ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)))) <= 0) {
+        int ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)));
+        if (ret <= 0) {
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 continue;
             }
             return ESP_FAIL;
         }
         remaining -= ret;
+        esp_err_t err = form_parser_feed(parser, buf, ret);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return form_parser_finish(parser);
+}
+
+/**
+ * Settings form being received. The value of the current field is collected up to the maximum of its setting,
+ * invalid values are reported and keep the current ones.
+ */
+typedef struct {
+    settings_values_t *values;
+    bool in_field;                  // a value piece of the current field has been seen
+    const setting_t *setting;       // setting of the current field, NULL if it is not a form setting
+    char value[WEB_FORM_VALUE_LENGTH + 1];
+    size_t length;
+    bool too_long;
+    char invalid_fields[WEB_INVALID_FIELDS_LENGTH];
+} submit_form_t;
+
+// Form parser callback: dispatch the submitted value to its setting
+static esp_err_t submit_form_value(const char *key, const char *data, size_t length, bool last, void *ctx) {
+    submit_form_t *form = ctx;
+
+    if (!form->in_field) {
+        form->in_field = true;
+        form->setting = setting_find(key);
+        if (form->setting != NULL && !(form->setting->flags & SETTING_FLAG_FORM)) {
+            form->setting = NULL;
+        }
+        form->length = 0;
+        form->too_long = false;
+    }
+    const setting_t *setting = form->setting;
+    if (setting == NULL) {
+        form->in_field = !last;
+        return ESP_OK;      // not a setting of the form, ignored
     }
 
-    // See what we got from client
-    ESP_LOGI(TAG, "Received request: %s", buf);
+    size_t max = setting->type == NVS_VALUE_STRING ? setting->length : WEB_FORM_NUMBER_LENGTH;
+    if (form->length + length > max) {
+        form->too_long = true;
+    } else {
+        memcpy(form->value + form->length, data, length);
+        form->length += length;
+    }
+    if (!last) {
+        return ESP_OK;
+    }
+    form->in_field = false;
+    form->value[form->length] = '\0';
+
+    esp_err_t err = form->too_long ? ESP_ERR_INVALID_SIZE : setting_from_string(setting, form->values, form->value);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "%s: rejected (%s)", setting->key, err == ESP_ERR_INVALID_SIZE ? "too long or out of range" : "invalid format");
+        size_t used = strlen(form->invalid_fields);
+        snprintf(form->invalid_fields + used, sizeof(form->invalid_fields) - used, "%s%s", used ? ", " : "", setting->key);
+        return ESP_OK;
+    }
+    char value_str[16];
+    ESP_LOGI(TAG, "%s: %s", setting->key, (setting->flags & SETTING_FLAG_SECRET) ? "********" : setting_to_string(setting, form->values, value_str, sizeof(value_str)));
+    return ESP_OK;
+}
 
+static esp_err_t submit_post_handler(httpd_req_t *req) {
     // empty message
-    const char* success_message = "<div class=\"alert alert-primary alert-dismissible fade show\" role=\"alert\"> Parameters saved successfully. A device reboot might be required for the setting to come into effect.<button type=\"button\" class=\"btn-close\" data-bs-dismiss=\"alert\" aria-label=\"Close\"></button></div>";
-    
-    // Allocate memory dynamically for template and output
-    char *html_template = (char *)malloc(MAX_TEMPLATE_SIZE);
-    char *html_output = (char *)malloc(MAX_TEMPLATE_SIZE);
+    const char* success_message = "<div class=\"alert alert-primary alert-dismissible fade show\" role=\"alert\"> Parameters saved successfully. MQTT, Home Assistant, sensor and alarm settings apply right away, the power settings after a device reboot.<button type=\"button\" class=\"btn-close\" data-bs-dismiss=\"alert\" aria-label=\"Close\"></button></div>";
+    char warning_message[RULE_ERROR_LENGTH * 2 + WEB_INVALID_FIELDS_LENGTH + 256];
 
-    if (html_template == NULL || html_output == NULL) {
+    // Current settings, the submitted fields are parsed over them
+    settings_values_t *values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    if (values == NULL) {
         ESP_LOGE(TAG, "Memory allocation failed");
-        if (html_template) free(html_template);
-        if (html_output) free(html_output);
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    settings_set_defaults(values);
+    settings_load(values);
+    char current_rules[ALARM_RULES_LENGTH + 1];     // kept if the submitted rules are rejected
+    strcpy(current_rules, values->alarm_rules);
+
+    // The body is parsed as it arrives, each field goes to its setting in a single pass
+    ESP_LOGI(TAG, "Received setting parameters (%u bytes)", (unsigned)req->content_len);
+    submit_form_t form = { .values = values };
+    form_parser_t parser;
+    form_parser_init(&parser, submit_form_value, &form);
+    if (form_receive(req, &parser) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to receive the form data");
+        free(values);
+        return ESP_FAIL;
+    }
 
-    // Read the template from SPIFFS (assuming you're loading it from SPIFFS)
-    FILE *f = fopen("/spiffs/config.html", "r");
-    if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open file for reading");
-        free(html_template);
-        free(html_output);
-        httpd_resp_send_404(req);
+    // Validate the alarm rules before saving them, so the working set is never replaced by a broken one
+    const char *message = success_message;
+    char rules_error[RULE_ERROR_LENGTH];
+    bool rules_valid = config_rules_check(values, rules_error, sizeof(rules_error));
+    if (!rules_valid) {
+        ESP_LOGW(TAG, "Alarm rules rejected: %s", rules_error);
+        strcpy(values->alarm_rules, current_rules);
+    }
+
+    if (!rules_valid || form.invalid_fields[0] != '\0') {
+        char fields_part[WEB_INVALID_FIELDS_LENGTH + 48] = "";
+        char rules_part[RULE_ERROR_LENGTH * 2 + 48] = "";
+        if (form.invalid_fields[0] != '\0') {
+            snprintf(fields_part, sizeof(fields_part), " Invalid values were not saved: %s.", form.invalid_fields);
+        }
+        if (!rules_valid) {
+            char rules_error_html[RULE_ERROR_LENGTH * 2];
+            html_escape(rules_error, rules_error_html, sizeof(rules_error_html));
+            snprintf(rules_part, sizeof(rules_part), " Alarm rules were not saved: %s.", rules_error_html);
+        }
+        snprintf(warning_message, sizeof(warning_message), "<div class=\"alert alert-warning alert-dismissible fade show\" role=\"alert\">%s%s Other parameters saved successfully.<button type=\"button\" class=\"btn-close\" data-bs-dismiss=\"alert\" aria-label=\"Close\"></button></div>", fields_part, rules_part);
+        message = warning_message;
+    }
+
+    config_save(values);
+    free(values);
+
+    // Form post (the config page uses /api/config): show the result and return to the config page
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_sendstr_chunk(req, "<html>"
+                                    "<head>"
+                                        "<title>Settings</title>"
+                                        "<link href=\"/app.css\" rel=\"stylesheet\">"
+                                        "<meta http-equiv=\"refresh\" content=\"10;url=/\" />"
+                                    "</head>"
+                                    "<body><div class=\"container py-3\">");
+    httpd_resp_sendstr_chunk(req, message);
+    httpd_resp_sendstr_chunk(req, "<p>You will be redirected to the <a href=\"/\">configuration page</a> in 10 seconds.</p>"
+                                  "</div></body>"
+                                  "</html>");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static esp_err_t send_json(httpd_req_t *req, char *json) {
+    if (json == NULL) {
+        httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send(req, json, strlen(json));
+    free(json);
+    return err;
+}
 
-    // Load the template into html_template
-    size_t len = fread(html_template, 1, MAX_TEMPLATE_SIZE, f);
-    fclose(f);
-    html_template[len] = '\0';  // Null-terminate the string
-
-    // Copy template into html_output for modification
-    strcpy(html_output, html_template);
-
-    // Allocate memory for the strings you will retrieve from NVS
-    // We need to pre-allocate memory as we are loading those values from POST request
-    char *mqtt_server = (char *)malloc(MQTT_SERVER_LENGTH);
-    char *mqtt_protocol = (char *)malloc(MQTT_PROTOCOL_LENGTH);
-    char *mqtt_user = (char *)malloc(MQTT_USER_LENGTH);
-    char *mqtt_password = (char *)malloc(MQTT_PASSWORD_LENGTH);
-    char *mqtt_prefix = (char *)malloc(MQTT_PREFIX_LENGTH);
-    char *ha_prefix = (char *)malloc(HA_PREFIX_LENGTH);
-    char *ca_cert = NULL;
-
-    char mqtt_port_str[6], sensor_offset_str[10], sensor_linear_multiplier_str[10];
-    char ha_upd_intervl_str[10];
-    char sensor_samples_str[10];
-    char sensor_smp_int_str[10];
-    char sensor_deviate_str[10];
-    char sensor_intervl_str[10];
-    char mqtt_connect_str[10];
-
-    // Extract parameters from the buffer
-    extract_param_value(buf, "mqtt_server=", mqtt_server, MQTT_SERVER_LENGTH);
-    extract_param_value(buf, "mqtt_protocol=", mqtt_protocol, MQTT_PROTOCOL_LENGTH);
-    extract_param_value(buf, "mqtt_user=", mqtt_user, MQTT_USER_LENGTH);
-    extract_param_value(buf, "mqtt_password=", mqtt_password, MQTT_PASSWORD_LENGTH);
-    extract_param_value(buf, "mqtt_prefix=", mqtt_prefix, MQTT_PREFIX_LENGTH);
-    extract_param_value(buf, "ha_prefix=", ha_prefix, HA_PREFIX_LENGTH);
-    extract_param_value(buf, "mqtt_port=", mqtt_port_str, sizeof(mqtt_port_str));
-    extract_param_value(buf, "sensor_offset=", sensor_offset_str, sizeof(sensor_offset_str));
-    extract_param_value(buf, "sensor_multipl=", sensor_linear_multiplier_str, sizeof(sensor_linear_multiplier_str));
-    extract_param_value(buf, "ha_upd_intervl=", ha_upd_intervl_str, sizeof(ha_upd_intervl_str));
-    extract_param_value(buf, "sensor_samples=", sensor_samples_str, sizeof(sensor_samples_str));
-    extract_param_value(buf, "sensor_smp_int=", sensor_smp_int_str, sizeof(sensor_smp_int_str));
-    extract_param_value(buf, "sensor_deviate=", sensor_deviate_str, sizeof(sensor_deviate_str));
-    extract_param_value(buf, "sensor_intervl=", sensor_intervl_str, sizeof(sensor_intervl_str));
-    extract_param_value(buf, "mqtt_connect=", mqtt_connect_str, sizeof(mqtt_connect_str));
-
-
-    // Convert mqtt_port and sensor_offset to their respective types
-    uint16_t mqtt_port = (uint16_t)atoi(mqtt_port_str);  // Convert to uint16_t
-    uint32_t sensor_linear_multiplier = (uint32_t)atoi(sensor_linear_multiplier_str);
-    float sensor_offset = strtof(sensor_offset_str, NULL);  // Convert to float
-    uint32_t ha_upd_intervl = (uint32_t)atoi(ha_upd_intervl_str);
-    uint16_t sensor_samples = (uint16_t)atoi(sensor_samples_str);
-    uint16_t sensor_smp_int = (uint16_t)atoi(sensor_smp_int_str);
-    uint16_t sensor_deviate = (uint16_t)atoi(sensor_deviate_str);
-    uint16_t sensor_intervl = (uint16_t)atoi(sensor_intervl_str);
-    uint16_t mqtt_connect = (uint16_t)atoi(mqtt_connect_str);
-
-    // Decode potentially URL-encoded parameters
-    url_decode(mqtt_server);
-    url_decode(mqtt_protocol);
-    url_decode(mqtt_user);
-    url_decode(mqtt_password);
-    url_decode(mqtt_prefix);
-    url_decode(ha_prefix);
-
-    // dump parameters for debugging pursposes
-    ESP_LOGI(TAG, "Received setting parameters");
-    ESP_LOGI(TAG, "mqtt_server: %s", mqtt_server);
-    ESP_LOGI(TAG, "mqtt_protocol: %s", mqtt_protocol);
-    ESP_LOGI(TAG, "mqtt_user: %s", mqtt_user);
-    ESP_LOGI(TAG, "mqtt_password: %s", mqtt_password);
-    ESP_LOGI(TAG, "mqtt_prefix: %s", mqtt_prefix);
-    ESP_LOGI(TAG, "ha_prefix: %s", ha_prefix);
-    ESP_LOGI(TAG, "mqtt_port: %i", mqtt_port);
-    ESP_LOGI(TAG, "sensor_offset: %f", sensor_offset);
-    ESP_LOGI(TAG, "sensor_linear_multiplier: %lu", sensor_linear_multiplier);
-    ESP_LOGI(TAG, "ha_upd_intervl: %li", ha_upd_intervl);
-    ESP_LOGI(TAG, "sensor_samples: %i", sensor_samples);
-    ESP_LOGI(TAG, "sensor_smp_int: %i", sensor_smp_int);
-    ESP_LOGI(TAG, "sensor_deviate: %i", sensor_deviate);
-    ESP_LOGI(TAG, "sensor_intervl: %i", sensor_intervl);
-    ESP_LOGI(TAG, "mqtt_connect: %i", mqtt_connect);
-
-    // Save parsed values to NVS or apply them directly
-    ESP_ERROR_CHECK(nvs_write_float(S_NAMESPACE, S_KEY_SENSOR_OFFSET, sensor_offset));
-    ESP_ERROR_CHECK(nvs_write_uint32(S_NAMESPACE, S_KEY_SENSOR_LINEAR_MULTIPLIER, sensor_linear_multiplier));
-    ESP_ERROR_CHECK(nvs_write_string(S_NAMESPACE, S_KEY_MQTT_SERVER, mqtt_server));
-    ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_MQTT_PORT, mqtt_port));
-    ESP_ERROR_CHECK(nvs_write_string(S_NAMESPACE, S_KEY_MQTT_PROTOCOL, mqtt_protocol));
-    ESP_ERROR_CHECK(nvs_write_string(S_NAMESPACE, S_KEY_MQTT_USER, mqtt_user));
-    ESP_ERROR_CHECK(nvs_write_string(S_NAMESPACE, S_KEY_MQTT_PASSWORD, mqtt_password));
-    ESP_ERROR_CHECK(nvs_write_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_write_string(S_NAMESPACE, S_KEY_HA_PREFIX, ha_prefix));
-    ESP_ERROR_CHECK(nvs_write_uint32(S_NAMESPACE, S_KEY_HA_UPDATE_INTERVAL, ha_upd_intervl));
-    ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_COUNT, sensor_samples));
-    ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_INTERVAL, sensor_smp_int));
-    ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, sensor_deviate));
-    ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_SENSOR_READ_INTERVAL, sensor_intervl));
-    ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, mqtt_connect));
-
-    /** Load and display settings */
-
-    // Free pointers to previosly used strings
-    free(mqtt_server);
-    free(mqtt_protocol);
-    free(mqtt_user);
-    free(mqtt_password);
-    free(mqtt_prefix);
-    free(ha_prefix);
-
-    // declaring NULL pointers for neccessary variables
-    char *device_id = NULL;
-    char *device_serial = NULL;
-
-    // resetting the pointers
-    mqtt_server = NULL;
-    mqtt_protocol = NULL;
-    mqtt_user = NULL;
-    mqtt_password = NULL;
-    mqtt_prefix = NULL;
-    ha_prefix = NULL;
-
-    // Load settings from NVS (use default values if not set)
-    ESP_ERROR_CHECK(nvs_read_float(S_NAMESPACE, S_KEY_SENSOR_OFFSET, &sensor_data.voltage_offset));
-    ESP_ERROR_CHECK(nvs_read_uint32(S_NAMESPACE, S_KEY_SENSOR_LINEAR_MULTIPLIER, &sensor_data.sensor_linear_multiplier));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_SERVER, &mqtt_server));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_PORT, &mqtt_port));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PROTOCOL, &mqtt_protocol));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_USER, &mqtt_user));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PASSWORD, &mqtt_password));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_HA_PREFIX, &ha_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_SERIAL, &device_serial));
-    ESP_ERROR_CHECK(nvs_read_uint32(S_NAMESPACE, S_KEY_HA_UPDATE_INTERVAL, &ha_upd_intervl));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_COUNT, &sensor_samples));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_INTERVAL, &sensor_smp_int));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_SAMPLING_MEDIAN_DEVIATION, &sensor_deviate));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_READ_INTERVAL, &sensor_intervl));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connect));
-
-    // Load the CA certificate
-    if (load_ca_certificate(&ca_cert) != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to load CA certificate from %s", CA_CERT_PATH);
+static esp_err_t config_api_get_handler(httpd_req_t *req) {
+    char etag[WEB_ETAG_LENGTH];
+    page_etag(etag, sizeof(etag));
+    if (send_not_modified(req, etag, WEB_PAGE_CACHE_CONTROL)) {
+        return ESP_OK;
+    }
+
+    settings_values_t *values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        httpd_resp_send_500(req);
         return ESP_FAIL;
-    } else {
-        ESP_LOGI(TAG, "Loaded CA certificate: %s", CA_CERT_PATH);
-    }
-
-    // Replace placeholders in the template with actual values
-    snprintf(mqtt_port_str, sizeof(mqtt_port_str), "%u", mqtt_port);
-    snprintf(sensor_offset_str, sizeof(sensor_offset_str), "%.3f", sensor_data.voltage_offset);
-    snprintf(sensor_linear_multiplier_str, sizeof(sensor_linear_multiplier_str), "%lu", sensor_data.sensor_linear_multiplier);
-    snprintf(ha_upd_intervl_str, sizeof(ha_upd_intervl_str), "%li", (uint32_t) ha_upd_intervl);
-    snprintf(sensor_samples_str, sizeof(sensor_samples_str), "%i", (uint16_t) sensor_samples);
-    snprintf(sensor_smp_int_str, sizeof(sensor_smp_int_str), "%i", (uint16_t) sensor_smp_int);
-    snprintf(sensor_deviate_str, sizeof(sensor_deviate_str), "%i", (uint16_t) sensor_deviate);
-    snprintf(sensor_intervl_str, sizeof(sensor_intervl_str), "%i", (uint16_t) sensor_intervl);
-    snprintf(mqtt_connect_str, sizeof(mqtt_connect_str), "%i", (uint16_t) mqtt_connect);
-
-    // ESP_LOGI(TAG, "Current HTML output size: %i, MAX_TEMPLATE_SIZE: %i", sizeof(html_output), MAX_TEMPLATE_SIZE);
-
-    replace_placeholder(html_output, "{VAL_DEVICE_ID}", device_id);
-    replace_placeholder(html_output, "{VAL_DEVICE_SERIAL}", device_serial);
-    replace_placeholder(html_output, "{VAL_MQTT_SERVER}", mqtt_server);
-    replace_placeholder(html_output, "{VAL_MQTT_PORT}", mqtt_port_str);
-    replace_placeholder(html_output, "{VAL_MQTT_PROTOCOL}", mqtt_protocol);
-    replace_placeholder(html_output, "{VAL_MQTT_USER}", mqtt_user);
-    replace_placeholder(html_output, "{VAL_MQTT_PASSWORD}", mqtt_password);
-    replace_placeholder(html_output, "{VAL_MQTT_PREFIX}", mqtt_prefix);
-    replace_placeholder(html_output, "{VAL_HA_PREFIX}", ha_prefix);
-    replace_placeholder(html_output, "{VAL_SENSOR_OFFSET}", sensor_offset_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_LINEAR_MULTIPLIER}", sensor_linear_multiplier_str);
-    replace_placeholder(html_output, "{VAL_MESSAGE}", success_message);
-    replace_placeholder(html_output, "{VAL_HA_UPDATE_INTERVAL}", ha_upd_intervl_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_SAMPLING_COUNT}", sensor_samples_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_SAMPLING_INTERVAL}", sensor_smp_int_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_SAMPLING_MEDIAN_DEVIATION}", sensor_deviate_str);
-    replace_placeholder(html_output, "{VAL_SENSOR_READ_INTERVAL}", sensor_intervl_str);
-    replace_placeholder(html_output, "{VAL_MQTT_CONNECT}", mqtt_connect_str);
-    replace_placeholder(html_output, "{VAL_CA_CERT}", ca_cert);
-
-    // replace static fields
-    assign_static_page_variables(html_output);
-
-    // ESP_LOGI(TAG, "Final HTML output size: %i, MAX_TEMPLATE_SIZE: %i", sizeof(html_output), MAX_TEMPLATE_SIZE);
-
-    // Send the final HTML response
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, html_output, strlen(html_output));
-
-    // Free dynamically allocated memory
-    free(html_template);
-    free(html_output);
-    free(mqtt_server);
-    free(mqtt_protocol);
-    free(mqtt_user);
-    free(mqtt_password);
-    free(mqtt_prefix);
-    free(ha_prefix);
-    free(device_id);
-    free(device_serial);
-    free(ca_cert);
+    }
+    settings_set_defaults(values);
+    settings_load(values);
+    char *json = serialize_settings(values);
+    free(values);
 
-    return ESP_OK;
+    return send_json(req, json);
 }
 
-// Helper function to fill in the static variables in the template
-void assign_static_page_variables(char *html_output) {
-
-    // replace size fields
-    char f_len[10];
-    snprintf(f_len, sizeof(f_len), "%i", MQTT_SERVER_LENGTH);
-    replace_placeholder(html_output, "{LEN_MQTT_SERVER}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", MQTT_PROTOCOL_LENGTH);
-    replace_placeholder(html_output, "{LEN_MQTT_PROTOCOL}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", MQTT_USER_LENGTH);
-    replace_placeholder(html_output, "{LEN_MQTT_USER}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", MQTT_PASSWORD_LENGTH);
-    replace_placeholder(html_output, "{LEN_MQTT_PASSWORD}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", MQTT_PREFIX_LENGTH);
-    replace_placeholder(html_output, "{LEN_MQTT_PREFIX}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", HA_PREFIX_LENGTH);
-    replace_placeholder(html_output, "{LEN_HA_PREFIX}", f_len);
-    
-    snprintf(f_len, sizeof(f_len), "%li", (long int) HA_UPDATE_INTERVAL_MIN);
-    replace_placeholder(html_output, "{MIN_HA_UPDATE_INTERVAL}", f_len);
-    snprintf(f_len, sizeof(f_len), "%li", (long int) HA_UPDATE_INTERVAL_MAX);
-    replace_placeholder(html_output, "{MAX_HA_UPDATE_INTERVAL}", f_len);
-    snprintf(f_len, sizeof(f_len), "%.3f", SENSOR_OFFSET_MIN);
-    replace_placeholder(html_output, "{MIN_SENSOR_OFFSET}", f_len);
-    snprintf(f_len, sizeof(f_len), "%.3f", SENSOR_OFFSET_MAX);
-    replace_placeholder(html_output, "{MAX_SENSOR_OFFSET}", f_len);
-
-    snprintf(f_len, sizeof(f_len), "%li", (long int) SENSOR_LINEAR_MULTIPLIER_MIN);
-    replace_placeholder(html_output, "{MIN_SENSOR_LINEAR_MULTIPLIER}", f_len);
-    snprintf(f_len, sizeof(f_len), "%li", (long int) SENSOR_LINEAR_MULTIPLIER_MAX);
-    replace_placeholder(html_output, "{MAX_SENSOR_LINEAR_MULTIPLIER}", f_len);
-
-
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_SAMPLING_COUNT_MIN);
-    replace_placeholder(html_output, "{MIN_SENSOR_SAMPLING_COUNT}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_SAMPLING_COUNT_MAX);
-    replace_placeholder(html_output, "{MAX_SENSOR_SAMPLING_COUNT}", f_len);
-
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_SAMPLING_INTERVAL_MIN);
-    replace_placeholder(html_output, "{MIN_SENSOR_SAMPLING_INTERVAL}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_SAMPLING_INTERVAL_MAX);
-    replace_placeholder(html_output, "{MAX_SENSOR_SAMPLING_INTERVAL}", f_len);
-
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_SAMPLING_MEDIAN_DEVIATION_MIN);
-    replace_placeholder(html_output, "{MIN_SENSOR_SAMPLING_MEDIAN_DEVIATION}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_SAMPLING_MEDIAN_DEVIATION_MAX);
-    replace_placeholder(html_output, "{MAX_SENSOR_SAMPLING_MEDIAN_DEVIATION}", f_len);  
-
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_READ_INTERVAL_MIN);
-    replace_placeholder(html_output, "{MIN_SENSOR_READ_INTERVAL}", f_len);
-    snprintf(f_len, sizeof(f_len), "%i", SENSOR_READ_INTERVAL_MAX);
-    replace_placeholder(html_output, "{MAX_SENSOR_READ_INTERVAL}", f_len); 
-}
-
-// Helper function to replace placeholders in the template
-void replace_placeholder(char *html_output, const char *placeholder, const char *value) {
-    char *pos;
-    while ((pos = strstr(html_output, placeholder)) != NULL) {
-        size_t len_before = pos - html_output;
-        size_t len_placeholder = strlen(placeholder);
-        size_t len_value = strlen(value);
-        size_t len_after = strlen(pos + len_placeholder);
-
-        // Shift the rest of the string to make space for the replacement value
-        memmove(pos + len_value, pos + len_placeholder, len_after + 1);
-
-        // Copy the replacement value into the position of the placeholder
-        memcpy(pos, value, len_value);
-    }
-}
-
-// Function to safely extract a single parameter value from the POST buffer
-int extract_param_value(const char *buf, const char *param_name, char *output, size_t output_size) {
-    char *start = strstr(buf, param_name);
-    if (start != NULL) {
-        start += strlen(param_name);  // Move to the value part
-        char *end = strchr(start, '&');  // Find the next '&'
-        if (end == NULL) {
-            end = start + strlen(start);  // If no '&' found, take till the end of the string
-        }
-        size_t len = end - start;
-        if (len >= output_size) {
-            len = output_size - 1;  // Ensure we don't overflow the output buffer
+static esp_err_t schema_api_handler(httpd_req_t *req) {
+    // Same for the whole firmware, so for the whole boot
+    char etag[WEB_ETAG_LENGTH];
+    snprintf(etag, sizeof(etag), "\"%08" PRIx32 "\"", web_boot_id);
+    if (send_not_modified(req, etag, WEB_ASSET_CACHE_CONTROL)) {
+        return ESP_OK;
+    }
+    return send_json(req, serialize_settings_schema());
+}
+
+// Assign one member of the PATCH /api/config body, the error of the field is returned otherwise
+static const char *config_field_from_json(const cJSON *item, settings_values_t *values) {
+    const setting_t *setting = setting_find(item->string);
+    if (setting == NULL || !(setting->flags & (SETTING_FLAG_FORM | SETTING_FLAG_DEVICE))) {
+        return "unknown setting";
+    }
+    if (!(setting->flags & SETTING_FLAG_FORM)) {
+        return "read-only";
+    }
+
+    esp_err_t err;
+    if (setting->type == NVS_VALUE_STRING) {
+        if (!cJSON_IsString(item)) {
+            return "must be a string";
         }
-        strncpy(output, start, len);
-        output[len] = '\0';  // Null-terminate the result
-        return len;  // Return the length of the extracted value
+        err = setting_from_string(setting, values, item->valuestring);
     } else {
-        output[0] = '\0';  // If not found, return an empty string
-        return 0;  // Return 0 length when not found
+        if (!cJSON_IsNumber(item)) {
+            return "must be a number";
+        }
+        err = setting_from_number(setting, values, item->valuedouble);
+    }
+    if (err == ESP_ERR_INVALID_SIZE) {
+        return setting->type == NVS_VALUE_STRING ? "too long" : "out of range";
+    }
+    if (err != ESP_OK) {
+        return "must be a whole number";
     }
+    return NULL;
 }
 
-// helper function that will find the last occurrence of the given substring (lookup) in the input string (str) and truncate the string at that point
-void str_trunc_after(char *str, const char *lookup) {
-    if (str == NULL || lookup == NULL) {
-        return; // Return if either input is NULL
+/**
+ * @brief: Partial settings update, a JSON object of key to value
+ *
+ * All fields are validated first, any error rejects the whole update with 422 and {"errors": {key: message}}.
+ * Otherwise the changed settings are saved and {"changed": [keys], "reboot": bool} is returned.
+ */
+static esp_err_t config_api_patch_handler(httpd_req_t *req) {
+    if (req->content_len == 0 || req->content_len > WEB_API_BODY_SIZE) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request body is empty or too long");
+        return ESP_FAIL;
+    }
+    char *body = (char *)malloc(req->content_len);
+    if (body == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, body + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (ret <= 0) {
+            free(body);
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    cJSON *root = cJSON_ParseWithLength(body, received);
+    free(body);
+    if (!cJSON_IsObject(root)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "JSON object expected");
+        return ESP_FAIL;
     }
 
-    char *last_occurrence = NULL;
-    char *current_position = str;
-
-    // Find the last occurrence of the substring 'lookup' in 'str'
-    while ((current_position = strstr(current_position, lookup)) != NULL) {
-        last_occurrence = current_position;
-        current_position += strlen(lookup); // Move past the current match
+    settings_values_t *values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    cJSON *reply = cJSON_CreateObject();
+    if (values == NULL || reply == NULL) {
+        free(values);
+        cJSON_Delete(reply);
+        cJSON_Delete(root);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    settings_set_defaults(values);
+    settings_load(values);
+
+    cJSON *errors = cJSON_AddObjectToObject(reply, "errors");
+    const cJSON *item;
+    cJSON_ArrayForEach(item, root) {
+        const char *error = config_field_from_json(item, values);
+        if (error != NULL) {
+            ESP_LOGW(TAG, "%s: rejected (%s)", item->string, error);
+            cJSON_AddStringToObject(errors, item->string, error);
+        }
     }
+    char rules_error[RULE_ERROR_LENGTH];
+    if (cJSON_HasObjectItem(root, S_KEY_ALARM_RULES) && !cJSON_HasObjectItem(errors, S_KEY_ALARM_RULES)
+        && !config_rules_check(values, rules_error, sizeof(rules_error))) {
+        cJSON_AddStringToObject(errors, S_KEY_ALARM_RULES, rules_error);
+    }
+    cJSON_Delete(root);
 
-    // If the 'lookup' substring was found, truncate the string after its last occurrence
-    if (last_occurrence != NULL) {
-        last_occurrence[strlen(lookup)] = '\0'; // Null-terminate after the last occurrence
+    if (cJSON_GetArraySize(errors) > 0) {
+        httpd_resp_set_status(req, "422 Unprocessable Entity");
+    } else {
+        cJSON_DeleteItemFromObject(reply, "errors");
+        settings_mask_t changed = config_save(values);
+        cJSON *keys = cJSON_AddArrayToObject(reply, "changed");
+        for (size_t i = 0; i < settings_count; i++) {
+            if (changed & setting_mask(&settings_table[i])) {
+                cJSON_AddItemToArray(keys, cJSON_CreateString(settings_table[i].key));
+            }
+        }
+        cJSON_AddBoolToObject(reply, "reboot", (changed & setting_mask(setting_find(S_KEY_POWER_MODE))) != 0);
     }
-}
+    free(values);
 
-// Helper function to convert a hexadecimal character to its decimal value
-int hex_to_dec(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    return -1;
+    char *json = cJSON_PrintUnformatted(reply);
+    cJSON_Delete(reply);
+    return send_json(req, json);
 }
 
-// URL decoding function
-void url_decode(char *src) {
-    char *dst = src;
-    while (*src) {
-        if (*src == '%' && src[1] && src[2]) {
-            // Convert hex to character
-            *dst = (char)((hex_to_dec(src[1]) << 4) | hex_to_dec(src[2]));
-            src += 2;
-        } else if (*src == '+') {
-            // Replace '+' with space
-            *dst = ' ';
+// Helper function to escape text placed into the HTML (e.g. textarea content)
+void html_escape(const char *src, char *dst, size_t dst_size) {
+    size_t pos = 0;
+    for (; *src; src++) {
+        const char *entity = NULL;
+        switch (*src) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+        }
+        size_t len = entity ? strlen(entity) : 1;
+        if (pos + len >= dst_size) {
+            break;  // Truncate rather than overflow
+        }
+        if (entity) {
+            memcpy(dst + pos, entity, len);
         } else {
-            *dst = *src;
+            dst[pos] = *src;
         }
-        src++;
-        dst++;
+        pos += len;
     }
-    *dst = '\0'; // Null-terminate the decoded string
+    dst[pos] = '\0';
 }
 
 static esp_err_t reboot_handler(httpd_req_t *req) {
@@ -683,10 +769,40 @@ static esp_err_t reboot_handler(httpd_req_t *req) {
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 
     // Reboot the device
+    settings_flush();
+    nvs_close_all();
     esp_restart();
     return ESP_OK;
 }
 
+// Handle auto-tune request
+static esp_err_t autotune_post_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "Received sampling auto-tune request");
+
+    // Send HTML response with a redirect after 10 seconds
+    const char *autotune_html = "<html>"
+                                "<head>"
+                                    "<title>Auto-tune scheduled</title>"
+                                    "<meta http-equiv=\"refresh\" content=\"10;url=/status\" />"
+                                    "<script>"
+                                        "setTimeout(function() { window.location.href = '/status'; }, 10000);"
+                                    "</script>"
+                                "</head>"
+                                "<body>"
+                                    "<h2>Sampling auto-tune will run before the next measurement.</h2>"
+                                    "<p>Please wait, you will be redirected to the <a href=\"/status\">status page</a> in 10 seconds.</p>"
+                                "</body>"
+                              "</html>";
+
+    // The sensor task owns the ADC, so it runs the tuning itself
+    autotune_request();
+
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_send(req, autotune_html, HTTPD_RESP_USE_STRLEN);
+
+    return ESP_OK;
+}
+
 // Handle Zigbee connection request
 static esp_err_t connect_zigbee_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "Received Zigbee connection request");
@@ -744,80 +860,125 @@ static esp_err_t status_data_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-static esp_err_t status_get_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "Processing status web request");
-
-    // Allocate memory dynamically for template and output
-    char *html_template = (char *)malloc(MAX_TEMPLATE_SIZE);
-    char *html_output = (char *)malloc(MAX_TEMPLATE_SIZE);
+/**
+ * @brief: Reading history web-service
+ */
+static esp_err_t history_data_handler(httpd_req_t *req) {
 
-    if (html_template == NULL || html_output == NULL) {
-        ESP_LOGE(TAG, "Memory allocation failed");
-        if (html_template) free(html_template);
-        if (html_output) free(html_output);
+    history_entry_t *entries = malloc(sizeof(history_entry_t) * HISTORY_LENGTH);
+    if (entries == NULL) {
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    size_t count = history_get(entries, HISTORY_LENGTH);
 
-    // Read the template from SPIFFS (assuming you're loading it from SPIFFS)
-    FILE *f = fopen("/spiffs/status.html", "r");
-    if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open file for reading");
-        free(html_template);
-        free(html_output);
-        httpd_resp_send_404(req);
+    char *json_response = serialize_history(entries, count, history_now(), history_restored());
+    free(entries);
+    if (json_response == NULL) {
+        httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
-    // Load the template into html_template
-    size_t len = fread(html_template, 1, MAX_TEMPLATE_SIZE, f);
-    fclose(f);
-    html_template[len] = '\0';  // Null-terminate the string
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json_response, strlen(json_response));
+    free(json_response);
 
-    // Copy template into html_output for modification
-    strcpy(html_output, html_template);
+    return ESP_OK;
+}
 
-    // Allocate memory for the strings you will retrieve from NVS
-    char *device_id = NULL;
-    char *device_serial = NULL;
-    uint16_t sensor_intervl;
+// Most expensive keys first
+static int nvs_key_stats_compare(const void *a, const void *b) {
+    uint64_t time_a = ((const nvs_key_stats_t *)a)->time_us;
+    uint64_t time_b = ((const nvs_key_stats_t *)b)->time_us;
+    return (time_a < time_b) - (time_a > time_b);
+}
 
-    // Load settings from NVS (use default values if not set)
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_SERIAL, &device_serial));
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_SENSOR_READ_INTERVAL, &sensor_intervl));
+static esp_err_t nvs_stats_handler(httpd_req_t *req) {
 
-    char sensor_intervl_str[10];
-    snprintf(sensor_intervl_str, sizeof(sensor_intervl_str), "%i", (uint16_t) sensor_intervl);
+    nvs_key_stats_t *keys = malloc(sizeof(nvs_key_stats_t) * NVS_STATS_MAX_KEYS);
+    nvs_namespace_stats_t *namespaces = malloc(sizeof(nvs_namespace_stats_t) * NVS_STATS_MAX_NAMESPACES);
+    if (keys == NULL || namespaces == NULL) {
+        free(keys);
+        free(namespaces);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    nvs_write_stats_t write_stats = nvs_get_write_stats();
+    size_t namespace_count = nvs_get_namespace_stats(namespaces, NVS_STATS_MAX_NAMESPACES);
+    size_t key_count = nvs_get_key_stats(keys, NVS_STATS_MAX_KEYS);
+    qsort(keys, key_count, sizeof(nvs_key_stats_t), nvs_key_stats_compare);
+
+    char *json_response = serialize_nvs_stats(&write_stats, namespaces, namespace_count, keys, key_count);
+    free(keys);
+    free(namespaces);
+    if (json_response == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
 
-    replace_placeholder(html_output, "{VAL_DEVICE_ID}", device_id);
-    replace_placeholder(html_output, "{VAL_DEVICE_SERIAL}", device_serial);
-    replace_placeholder(html_output, "{VAL_SENSOR_READ_INTERVAL}", sensor_intervl_str);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json_response, strlen(json_response));
+    free(json_response);
 
-    // replace static fields
-    assign_static_page_variables(html_output);
+    return ESP_OK;
+}
 
+static esp_err_t status_get_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "Processing status web request");
 
-    // Send the final HTML response
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, html_output, strlen(html_output));
+    char etag[WEB_ETAG_LENGTH];
+    page_etag(etag, sizeof(etag));
+    if (send_not_modified(req, etag, WEB_PAGE_CACHE_CONTROL)) {
+        return ESP_OK;
+    }
 
-    // Free dynamically allocated memory
-    free(html_template);
-    free(html_output);
-    free(device_id);
-    free(device_serial);
+    settings_values_t *values = (settings_values_t *)malloc(sizeof(settings_values_t));
+    if (values == NULL) {
+        ESP_LOGE(TAG, "Memory allocation failed");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    settings_set_defaults(values);
+    settings_load(values);
 
-    return ESP_OK;
+    page_context_t page = {
+        .values = values,
+    };
+    esp_err_t err = send_page(req, &status_page, &page);
+
+    free(values);
+    return err;
 }
 
-static esp_err_t ca_cert_post_handler(httpd_req_t *req) {
-    // Buffer to hold the received certificate
-    char buf[512];
-    memset(buf, 0, sizeof(buf));  // Initialize the buffer with zeros to avoid any garbage
-    int total_len = req->content_len;
-    int received = 0;
+static esp_err_t ca_cert_get_handler(httpd_req_t *req) {
+    char etag[WEB_ETAG_LENGTH];
+    page_etag(etag, sizeof(etag));
+    if (send_not_modified(req, etag, WEB_PAGE_CACHE_CONTROL)) {
+        return ESP_OK;
+    }
+
+    // Streamed from the file through a small window, an empty response if there is no certificate
+    char window[TEMPLATE_WINDOW_SIZE];
+    template_writer_t out;
+    template_writer_init(&out, window, sizeof(window), page_chunk_sink, req);
+    httpd_resp_set_type(req, "text/plain");
+    esp_err_t err = template_write_file(&out, CA_CERT_PATH);
+    if (err == ESP_OK) {
+        err = template_flush(&out);
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
 
+// Form parser callback: the certificate goes to the writer as it is decoded, the other fields are ignored
+static esp_err_t ca_cert_form_value(const char *key, const char *data, size_t length, bool last, void *ctx) {
+    if (strcmp(key, "ca_cert") != 0) {
+        return ESP_OK;
+    }
+    return ca_cert_writer_write((ca_cert_writer_t *)ctx, data, length);
+}
+
+static esp_err_t ca_cert_post_handler(httpd_req_t *req) {
     // Send HTML response with a redirect after 30 seconds
     const char *success_html = "<html>"
                                 "<head>"
@@ -833,63 +994,33 @@ static esp_err_t ca_cert_post_handler(httpd_req_t *req) {
                                 "</body>"
                               "</html>";
 
-
-    // Allocate memory for the certificate outside the stack
-    char *content = (char *)malloc(total_len + 1);
-    if (content == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for CA certificate");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_ERR_NO_MEM;
-    }
-
-    // Read the certificate data from the request in chunks
-    while (received < total_len) {
-        int ret = httpd_req_recv(req, buf, MIN(total_len - received, sizeof(buf)));
-        if (ret <= 0) {
-            ESP_LOGE(TAG, "Failed to receive POST data");
-            free(content); // Free the allocated memory in case of failure
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive data");
-            return ESP_FAIL;
-        }
-        memcpy(content + received, buf, ret);
-        received += ret;
-    }
-
-    ESP_LOGI(TAG, "POST Content:\n%s", content);
-
-    // extract ca_cert from the output
-    char *ca_cert = (char *)malloc(MAX_CA_CERT_SIZE);
-    // Extract the certificate
-    int cert_length = extract_param_value(content, "ca_cert=", ca_cert, MAX_CA_CERT_SIZE);
-    if (cert_length <= 0) {
-        ESP_LOGE(TAG, "Failed to extract CA certificate from the received data");
-        free(content);
-        free(ca_cert);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to extract certificate");
+    // The certificate is checked and written as it arrives, the current one is replaced only by a valid upload
+    ESP_LOGI(TAG, "Receiving CA certificate (%u bytes)", (unsigned)req->content_len);
+    ca_cert_writer_t writer;
+    if (ca_cert_writer_open(&writer) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save certificate");
         return ESP_FAIL;
     }
+    form_parser_t parser;
+    form_parser_init(&parser, ca_cert_form_value, &writer);
+    esp_err_t err = form_receive(req, &parser);
+    if (err != ESP_OK) {
+        ca_cert_writer_abort(&writer);
+    } else {
+        err = ca_cert_writer_close(&writer);
+    }
 
-    // Decode the URL-encoded certificate
-    url_decode(ca_cert);
-
-    // Null-terminate the decoded certificate
-    str_trunc_after(ca_cert, "-----END CERTIFICATE-----");
-
-    // Save the certificate
-    esp_err_t err = save_ca_certificate(ca_cert);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save CA certificate");
-        free(content);
-        free(ca_cert);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save certificate");
+        const char *reason = writer.error ? writer.error : "receive failed";
+        ESP_LOGE(TAG, "CA certificate rejected: %s", reason);
+        char message[96];
+        snprintf(message, sizeof(message), "Certificate not saved: %s", reason);
+        httpd_resp_send_err(req, err == ESP_ERR_INVALID_ARG ? HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR, message);
         return ESP_FAIL;
     }
+    ca_cert_generation++;
 
-    free(content);
-    free(ca_cert); // Free the allocated memory after saving
     // Send a response indicating success
     httpd_resp_sendstr(req, success_html);
-    ESP_LOGI(TAG, "CA certificate saved successfully");
-
     return ESP_OK;
 }
\ No newline at end of file
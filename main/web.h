@@ -3,28 +3,78 @@
 
 #include "esp_http_server.h"
 
-#define MAX_TEMPLATE_SIZE       16384
-#define MAX_CA_CERT_SIZE        8192
+#include "settings.h"
+#include "template.h"
+
+#define WEB_SERVER_STACK_SIZE   8192
+#define WEB_MAX_URI_HANDLERS    24
+#define WEB_HEAP_LOG            false       // log the heap and stack taken by every request, for measurements
+
+#define WEB_INVALID_FIELDS_LENGTH   128                             // List of the rejected form fields
+#define WEB_API_BODY_SIZE           4096                            // PATCH /api/config body, all fields escaped fit
+#define WEB_RECV_CHUNK_SIZE         256                             // receive buffer of the streamed form bodies
+#define WEB_FORM_VALUE_LENGTH       ALARM_RULES_LENGTH              // longest form setting, decoded
+#define WEB_FORM_NUMBER_LENGTH      24                              // longest number accepted by the form
+
+/**
+ * Conditional requests
+ *
+ * The static assets carry a hash of their content as the ETag, the pages the boot, settings and CA certificate
+ * generations they were rendered from. A request with a matching If-None-Match gets 304 Not Modified without a body.
+ */
+#define WEB_ETAG_LENGTH             32
+#define WEB_IF_NONE_MATCH_LENGTH    128
+#define WEB_PAGE_CACHE_CONTROL      "private, no-cache"         // revalidated on every load, the page holds secrets
+#define WEB_ASSET_CACHE_CONTROL     "public, max-age=3600"      // revalidated hourly, the URLs are not versioned
+
+/**
+ * Values of a page rendering
+ */
+typedef struct {
+    const settings_values_t *values;
+} page_context_t;
+
+/**
+ * Page template embedded into the image
+ */
+typedef struct {
+    const char *name;
+    const char *start;                  // text in flash, not null-terminated
+    const char *end;
+    template_t tpl;                     // compiled at the first request
+} web_page_t;
+
+/**
+ * Static asset embedded gzipped into the image
+ */
+typedef struct {
+    const char *uri;
+    const char *type;
+    const uint8_t *start;
+    const uint8_t *end;
+    char etag[WEB_ETAG_LENGTH];         // CRC32 of the content, set by start_webserver()
+} web_asset_t;
 
 /// @brief Initiate the SPIFFS
 void init_filesystem();
 
 void start_webserver(void);
 
-static esp_err_t config_get_handler(httpd_req_t *req);
 static esp_err_t submit_post_handler(httpd_req_t *req);
 static esp_err_t reboot_handler(httpd_req_t *req);
 static esp_err_t connect_zigbee_handler(httpd_req_t *req);
 static esp_err_t status_data_handler(httpd_req_t *req);
 static esp_err_t status_get_handler(httpd_req_t *req);
 static esp_err_t ca_cert_post_handler(httpd_req_t *req);
+static esp_err_t ca_cert_get_handler(httpd_req_t *req);
+static esp_err_t config_api_get_handler(httpd_req_t *req);
+static esp_err_t config_api_patch_handler(httpd_req_t *req);
+static esp_err_t schema_api_handler(httpd_req_t *req);
+static esp_err_t autotune_post_handler(httpd_req_t *req);
+static esp_err_t nvs_stats_handler(httpd_req_t *req);
+static esp_err_t history_data_handler(httpd_req_t *req);
+static esp_err_t asset_get_handler(httpd_req_t *req);
 
-void assign_static_page_variables(char *html_output);
-void replace_placeholder(char *html_output, const char *placeholder, const char *value);
-int extract_param_value(const char *buf, const char *param_name, char *output, size_t output_size);
-
-int hex2dec(char c);
-void url_decode(char *str);
-void str_trunc_after(char *str, const char *lookup);
+void html_escape(const char *src, char *dst, size_t dst_size);
 
 #endif
\ No newline at end of file
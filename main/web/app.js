@@ -0,0 +1,66 @@
+/*
+ * Helpers of the device pages, in place of jQuery and the Bootstrap bundle.
+ */
+
+function $id(id) {
+    return document.getElementById(id);
+}
+
+// Set the text of an element, missing elements are skipped
+function setText(id, text) {
+    const element = $id(id);
+    if (element) {
+        element.textContent = text;
+    }
+}
+
+// GET a JSON document
+function getJSON(url, success, error) {
+    fetch(url, { cache: 'no-cache' })
+        .then(function(response) {
+            if (!response.ok) {
+                throw new Error(url + ': HTTP ' + response.status);
+            }
+            return response.json();
+        })
+        .then(success)
+        .catch(error || function(e) { console.error(e); });
+}
+
+// GET a text document
+function getText(url, success, error) {
+    fetch(url, { cache: 'no-cache' })
+        .then(function(response) {
+            if (!response.ok) {
+                throw new Error(url + ': HTTP ' + response.status);
+            }
+            return response.text();
+        })
+        .then(success)
+        .catch(error || function(e) { console.error(e); });
+}
+
+// Show a dismissible alert (kind: primary, warning) in the element, in place of the previous one
+function showAlert(id, kind, text) {
+    const alert = document.createElement('div');
+    alert.className = 'alert alert-' + kind + ' alert-dismissible fade show';
+    alert.setAttribute('role', 'alert');
+    alert.textContent = text;
+    const button = document.createElement('button');
+    button.type = 'button';
+    button.className = 'btn-close';
+    button.setAttribute('data-bs-dismiss', 'alert');
+    button.setAttribute('aria-label', 'Close');
+    alert.appendChild(button);
+    $id(id).replaceChildren(alert);
+}
+
+// Dismissible alerts (data-bs-dismiss="alert")
+document.addEventListener('click', function(event) {
+    const button = event.target.closest('[data-bs-dismiss="alert"]');
+    const alert = button && button.closest('.alert');
+    if (alert) {
+        alert.classList.remove('show');
+        setTimeout(function() { alert.remove(); }, 150);
+    }
+});
@@ -0,0 +1,140 @@
+/*
+ * Config page: the form is filled from /api/config and /api/schema, the edited fields are saved with PATCH /api/config.
+ */
+
+let schema = {};
+const edited = new Set();
+
+// Set the current value, which is also the one the reset button restores
+function setFieldValue(element, value) {
+    if (element.tagName == 'SELECT') {
+        for (const option of element.options) {
+            option.defaultSelected = option.value == String(value);
+        }
+    } else {
+        element.defaultValue = value;
+    }
+    element.value = value;
+}
+
+// Error of a field, shown after its input (empty text clears it)
+function setFieldError(element, text) {
+    let error = element.parentElement.querySelector('.field-error');
+    if (!error) {
+        error = document.createElement('small');
+        error.className = 'field-error text-danger ms-3';
+        element.parentElement.appendChild(error);
+    }
+    error.textContent = text;
+}
+
+function applySchema(form) {
+    for (const key in schema) {
+        const element = form.elements[key];
+        const field = schema[key];
+        if (!element) {
+            continue;
+        }
+        if (field.type == 'string') {
+            element.maxLength = field.length;
+        }
+        if ('min' in field) {
+            element.min = field.min;
+            element.max = field.max;
+            setText('range_' + key, '(' + field.min + ' - ' + field.max + ')');
+        }
+        if (field.secret) {
+            element.placeholder = 'unchanged';
+        }
+    }
+}
+
+function fillForm(form, config) {
+    setText('device_id', config.device_id);
+    setText('device_serial', config.device_serial);
+    document.title += ': ' + config.device_id;
+    for (const key in config) {
+        if (form.elements[key]) {
+            setFieldValue(form.elements[key], config[key]);
+        }
+    }
+    edited.clear();
+}
+
+// Value of the field in its schema type, a number field left empty is sent as null and rejected
+function fieldValue(element, key) {
+    if (schema[key] && schema[key].type != 'string') {
+        return element.value.trim() === '' ? null : Number(element.value);
+    }
+    return element.value;
+}
+
+function saveConfig(form) {
+    const changes = {};
+    edited.forEach(function(key) {
+        changes[key] = fieldValue(form.elements[key], key);
+    });
+    if (Object.keys(changes).length == 0) {
+        showAlert('message', 'primary', 'Nothing changed.');
+        return;
+    }
+
+    fetch('/api/config', {
+        method: 'PATCH',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify(changes)
+    })
+        .then(function(response) {
+            return response.json().then(function(result) { return { ok: response.ok, result: result }; });
+        })
+        .then(function(reply) {
+            for (const key in changes) {
+                setFieldError(form.elements[key], '');
+            }
+            if (!reply.ok) {
+                const errors = reply.result.errors || {};
+                for (const key in errors) {
+                    if (form.elements[key]) {
+                        setFieldError(form.elements[key], errors[key]);
+                    }
+                }
+                showAlert('message', 'warning', 'Nothing was saved, please correct: ' + Object.keys(errors).join(', ') + '.');
+                return;
+            }
+            for (const key in changes) {
+                setFieldValue(form.elements[key], form.elements[key].value);
+            }
+            edited.clear();
+            showAlert('message', 'primary', 'Parameters saved successfully. MQTT, Home Assistant, sensor and alarm settings apply right away'
+                + (reply.result.reboot ? ', the power settings after a device reboot.' : '.'));
+        })
+        .catch(function(e) {
+            console.error(e);
+            showAlert('message', 'warning', 'Failed to save the settings.');
+        });
+}
+
+document.addEventListener('DOMContentLoaded', function() {
+    const form = $id('config_form');
+    form.addEventListener('input', function(event) {
+        edited.add(event.target.name);
+    });
+    form.addEventListener('reset', function() {
+        edited.clear();
+    });
+    form.addEventListener('submit', function(event) {
+        event.preventDefault();
+        saveConfig(form);
+    });
+
+    getJSON('/api/schema', function(result) {
+        schema = result;
+        applySchema(form);
+        getJSON('/api/config', function(config) {
+            fillForm(form, config);
+        });
+    });
+    getText('/ca-cert', function(text) {
+        setFieldValue($id('ca_cert_id'), text);
+    });
+});
@@ -0,0 +1,96 @@
+/*
+ * Status page: the readings are pushed by the device (/events), the rest of /status-data is refreshed now and then.
+ * Without EventSource, or with the device serving too many clients, the page polls /status-data instead.
+ */
+
+const STATUS_REFRESH_MS = 30000;   // autotune, radio, power and storage counters
+
+function formatTimeSinceBoot(microseconds) {
+    let total_seconds = Math.floor(microseconds / 1000000); // Convert microseconds to seconds
+
+    let days = Math.floor(total_seconds / (24 * 60 * 60)); // Calculate days
+    total_seconds %= (24 * 60 * 60); // Get remaining seconds after calculating days
+
+    let hours = Math.floor(total_seconds / (60 * 60)); // Calculate hours
+    total_seconds %= (60 * 60); // Get remaining seconds after calculating hours
+
+    let minutes = Math.floor(total_seconds / 60); // Calculate minutes
+    let seconds = total_seconds % 60; // Remaining seconds
+
+    return days + ' days ' + hours + ' hours ' + minutes + ' minutes ' + seconds + ' seconds';
+}
+
+// Sensor reading and heap, both in /status-data and in the event frames
+function showReading(response) {
+    setText('val_pressure', response.sensor.pressure.toFixed(2));
+    setText('val_voltage', response.sensor.voltage.toFixed(3));
+    setText('val_voltage_offset', response.sensor.voltage_offset.toFixed(3));
+    setText('val_sensor_linear_multiplier', response.sensor.sensor_linear_multiplier);
+    setText('val_voltage_raw', response.sensor.voltage_raw);
+    setText('val_pressure_rate', response.sensor.pressure_rate.toFixed(2));
+    setText('val_fault_flags', response.sensor.fault_flags == 0 ? 'none' : response.sensor.fault_flags);
+
+    setText('val_free_heap', response.status.free_heap);
+    setText('val_min_free_heap', response.status.min_free_heap);
+    // Convert time since boot to a readable format and update the element
+    setText('val_time_since_boot', formatTimeSinceBoot(response.status.time_since_boot));
+}
+
+function showStatus(response) {
+    showReading(response);
+
+    if (response.autotune.valid) {
+        setText('val_tune_params', response.autotune.sensor_samples + ' / ' + response.autotune.sensor_smp_int + ' ms / ' + response.autotune.sensor_deviate + ' %');
+        setText('val_tune_noise', response.autotune.expected_noise_uv);
+        setText('val_tune_target', response.autotune.noise_target_uv + (response.autotune.target_met ? '' : ', not reached'));
+        setText('val_tune_raw_noise', response.autotune.raw_noise_uv);
+        setText('val_tune_cost', response.autotune.cycle_time_ms + ' ms, CPU ' + response.autotune.cycle_cpu_us + ' us');
+    } else {
+        setText('val_tune_params', 'not tuned yet');
+    }
+
+    setText('val_radio_bursts', response.radio.bursts);
+    setText('val_radio_overlapped', response.radio.bursts_overlapped);
+    setText('val_radio_deferred', response.radio.bursts_waited + ' / ' + response.radio.publishes_deferred);
+
+    const power_modes = ['Performance', 'DFS', 'DFS + light sleep', 'Deep sleep cycle'];
+    setText('val_power_mode', (power_modes[response.power.mode] || response.power.mode) + (response.power.pm_supported ? '' : ' (not supported by firmware)'));
+    const cpu_active = response.power.cpu_active_pct === null ? 'n/a' : response.power.cpu_active_pct.toFixed(1) + ' %';
+    setText('val_power_active', cpu_active + ' / ' + response.power.radio_active_pct.toFixed(1) + ' %');
+    setText('val_power_max_freq', response.power.cpu_max_freq_pct.toFixed(1));
+    setText('val_power_latency', response.power.wake_latency_us_last + ' / ' + response.power.wake_latency_us_avg + ' / ' + response.power.wake_latency_us_max);
+    setText('val_deep_sleep', response.deep_sleep.wake_count + ' / ' + response.deep_sleep.pending + ' / ' + response.deep_sleep.dropped);
+    setText('val_boot_to_publish', response.deep_sleep.boot_to_publish_ms);
+
+    setText('val_nvs_writes', response.nvs.writes + ' / ' + response.nvs.commits);
+    setText('val_settings_saves', response.settings.saves + ' / ' + response.settings.changed + ' / ' + response.settings.unchanged + ' / ' + response.settings.commits);
+}
+
+function updateSensorData() {
+    getJSON('/status-data', showStatus, function() {
+        console.error("Failed to fetch sensor data");
+    });
+}
+
+// Called by the page with the sensor read interval, ms
+function startStatus(interval) {
+    updateSensorData();
+    if (!window.EventSource) {
+        setInterval(updateSensorData, interval);
+        return;
+    }
+
+    const refresh = setInterval(updateSensorData, STATUS_REFRESH_MS);
+    const events = new EventSource('/events');
+    events.onmessage = function(event) {
+        showReading(JSON.parse(event.data));
+    };
+    events.onerror = function() {
+        // A lost connection is retried by the browser, a refused one (client limit) is not
+        if (events.readyState == EventSource.CLOSED) {
+            console.error("Live updates refused, polling the status");
+            clearInterval(refresh);
+            setInterval(updateSensorData, interval);
+        }
+    };
+}
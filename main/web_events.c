@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "common.h"
+#include "sensor.h"
+#include "status.h"
+#include "web_events.h"
+
+/**
+ * Connected client. The table is used by the server task only: the handler, the broadcast work and the session
+ * close callback all run there.
+ */
+typedef struct {
+    int fd;                     // -1 if the slot is free
+    bool closing;               // send failed, the slot is released when the server closes the session
+} web_events_client_t;
+
+static httpd_handle_t events_server = NULL;
+static web_events_client_t events_clients[WEB_EVENTS_MAX_CLIENTS];
+static volatile uint32_t events_client_count = 0;
+static volatile bool events_broadcast_queued = false;
+static uint32_t events_sent_gen = 0;
+static esp_timer_handle_t events_timer = NULL;
+
+static const char events_headers[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+/**
+ * @brief Compact frame of the current reading, the keys are those of /status-data
+ */
+static int events_frame(char *buf, size_t size, uint32_t gen) {
+    sensor_data_t sensor = get_sensor_data();
+    sensor_status_t status;
+    sensor_status_init(&status);
+
+    int length = snprintf(buf, size,
+        "id: %" PRIu32 "\n"
+        "data: {\"sensor\":{\"pressure\":%.2f,\"voltage\":%.3f,\"voltage_offset\":%.3f,"
+        "\"sensor_linear_multiplier\":%" PRIu32 ",\"voltage_raw\":%d,\"pressure_rate\":%.2f,\"fault_flags\":%" PRIu32 "},"
+        "\"status\":{\"free_heap\":%u,\"min_free_heap\":%u,\"time_since_boot\":%lld}}\n\n",
+        gen,
+        sensor.pressure, sensor.voltage, sensor.voltage_offset,
+        sensor.sensor_linear_multiplier, sensor.voltage_raw, sensor.pressure_rate, sensor.fault_flags,
+        (unsigned)status.free_heap, (unsigned)status.min_free_heap, (long long)status.time_since_boot);
+    return length < (int)size ? length : -1;
+}
+
+static esp_err_t events_send(int fd, const char *data, size_t length) {
+    return httpd_socket_send(events_server, fd, data, length, 0) == (int)length ? ESP_OK : ESP_FAIL;
+}
+
+// Session close callback of the server, the client is gone
+static void events_client_free(void *ctx) {
+    web_events_client_t *client = ctx;
+    ESP_LOGI(TAG, "Event client %d disconnected", client->fd);
+    client->fd = -1;
+    client->closing = false;
+    events_client_count--;
+    if (events_client_count == 0) {
+        esp_timer_stop(events_timer);
+    }
+}
+
+// Server task work: send the new reading to all clients
+static void events_broadcast(void *arg) {
+    events_broadcast_queued = false;
+
+    uint32_t gen = sensor_data_generation();
+    if (gen == events_sent_gen) {
+        return;
+    }
+    events_sent_gen = gen;
+
+    char frame[WEB_EVENTS_FRAME_SIZE];
+    int length = events_frame(frame, sizeof(frame), gen);
+    if (length < 0) {
+        ESP_LOGE(TAG, "Event frame does not fit %d bytes", WEB_EVENTS_FRAME_SIZE);
+        return;
+    }
+    for (int i = 0; i < WEB_EVENTS_MAX_CLIENTS; i++) {
+        web_events_client_t *client = &events_clients[i];
+        if (client->fd < 0 || client->closing) {
+            continue;
+        }
+        if (events_send(client->fd, frame, length) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to send the event to client %d, closing", client->fd);
+            client->closing = true;
+            httpd_sess_trigger_close(events_server, client->fd);
+        }
+    }
+}
+
+// Timer callback: hand the broadcast over to the server task once the sensor loop has a new reading
+static void events_timer_cb(void *arg) {
+    if (events_client_count == 0 || events_broadcast_queued || sensor_data_generation() == events_sent_gen) {
+        return;
+    }
+    events_broadcast_queued = true;
+    if (httpd_queue_work(events_server, events_broadcast, NULL) != ESP_OK) {
+        events_broadcast_queued = false;
+    }
+}
+
+static esp_err_t events_get_handler(httpd_req_t *req) {
+    web_events_client_t *client = NULL;
+    for (int i = 0; i < WEB_EVENTS_MAX_CLIENTS && client == NULL; i++) {
+        if (events_clients[i].fd < 0) {
+            client = &events_clients[i];
+        }
+    }
+    if (client == NULL) {
+        ESP_LOGW(TAG, "Event client rejected, %d clients connected", WEB_EVENTS_MAX_CLIENTS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "Too many event clients");
+        return ESP_OK;
+    }
+
+    // The response never ends, so it bypasses the server: the headers and the frames go to the socket as they are
+    int fd = httpd_req_to_sockfd(req);
+    char frame[WEB_EVENTS_FRAME_SIZE];
+    int length = snprintf(frame, sizeof(frame), "retry: %d\n\n", WEB_EVENTS_RETRY_MS);
+    if (events_send(fd, events_headers, sizeof(events_headers) - 1) != ESP_OK
+        || events_send(fd, frame, length) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    length = events_frame(frame, sizeof(frame), sensor_data_generation());
+    if (length > 0 && events_send(fd, frame, length) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    client->fd = fd;
+    client->closing = false;
+    events_client_count++;
+    req->sess_ctx = client;
+    req->free_ctx = events_client_free;
+
+    if (!esp_timer_is_active(events_timer)) {
+        esp_timer_start_periodic(events_timer, WEB_EVENTS_POLL_MS * 1000ULL);
+    }
+    ESP_LOGI(TAG, "Event client %d connected, %" PRIu32 " of %d", fd, events_client_count, WEB_EVENTS_MAX_CLIENTS);
+    return ESP_OK;
+}
+
+esp_err_t web_events_register(httpd_handle_t server) {
+    events_server = server;
+    for (int i = 0; i < WEB_EVENTS_MAX_CLIENTS; i++) {
+        events_clients[i].fd = -1;
+    }
+    events_sent_gen = sensor_data_generation();
+
+    if (events_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = events_timer_cb,
+            .name = "web_events",
+        };
+        esp_err_t err = esp_timer_create(&timer_args, &events_timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create the events timer: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    httpd_uri_t events_uri = {
+        .uri       = "/events",
+        .method    = HTTP_GET,
+        .handler   = events_get_handler,
+        .user_ctx  = NULL
+    };
+    return httpd_register_uri_handler(server, &events_uri);
+}
@@ -0,0 +1,26 @@
+#ifndef WEB_EVENTS_H
+#define WEB_EVENTS_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include "common.h"
+
+/**
+ * Live readings pushed as Server-Sent Events (/events)
+ *
+ * Every client gets the current reading when it connects and then one frame per new reading. The clients keep their
+ * sockets open, WEB_EVENTS_MAX_CLIENTS has to leave some of the server's max_open_sockets (7 by default) to the page
+ * and API requests. Clients over the cap get 503, the status page then falls back to polling /status-data.
+ */
+#define WEB_EVENTS_MAX_CLIENTS      3
+#define WEB_EVENTS_POLL_MS          250         // sensor generation check, runs only while clients are connected
+#define WEB_EVENTS_RETRY_MS         5000        // browser reconnect delay after the connection is lost
+#define WEB_EVENTS_FRAME_SIZE       384
+
+/**
+ * @brief Register the /events handler on the web server
+ */
+esp_err_t web_events_register(httpd_handle_t server);
+
+#endif
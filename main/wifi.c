@@ -11,6 +11,8 @@
 #include "esp_event.h"
 
 #include "wifi.h"
+#include "deep_sleep.h"
+#include "non_volatile_storage.h"
 
 char softap_ssid[32];       // Buffer for the generated SSID
 char softap_password[64];   // Buffer for the generated password
@@ -44,12 +46,14 @@ static void wifi_provisioning_event_handler(void* arg, esp_event_base_t event_ba
     } else if (event_base == WIFI_PROV_EVENT && event_id == WIFI_PROV_END) {
         wifi_prov_mgr_deinit();
         ESP_LOGI(TAG, "Wi-Fi Provisioning completed. Restarting the device now.");
+        nvs_close_all();
         esp_restart();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {  // Corrected event
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         g_wifi_ready = true;
+        deep_sleep_cache_wifi();
         log_network_configuration(event->esp_netif);
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         ESP_LOGI(TAG, "Disconnected from Wi-Fi network, reconnecting...");
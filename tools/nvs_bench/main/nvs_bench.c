@@ -0,0 +1,336 @@
+/*
+ * Host checks and benchmarks of the ESP32_NVS component, on the in-memory backend of the linux target.
+ *
+ * Floats and doubles: every value has to come back with the same bit pattern, through the single, batch and
+ * transaction paths. Values written in the old "%f" string format have to be read and migrated to the binary entry
+ * on the first read (or replaced by the first write), also after a failed migration. The read path is measured
+ * against the old one, which read the string entry into an allocated buffer and parsed it.
+ *
+ * Handle cache: reads per second with the namespace handles kept open, against an open and close around every access
+ * as before the cache, with the flash timing simulated by the backend. The read and open delays are assumptions, not
+ * device measurements, and can be set with NVS_BENCH_READ_US and NVS_BENCH_OPEN_US.
+ *
+ * The process exits with 1 when a check fails.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nvs.h"
+
+#include "non_volatile_storage.h"
+#include "non_volatile_storage_host.h"
+
+#define BENCH_NAMESPACE         "bench"
+#define BENCH_ROUND_TRIPS       20000       // random bit patterns per type
+#define BENCH_READS             100000
+#define BENCH_CACHE_READS       5000
+#define BENCH_CACHE_KEYS        8           // keys per namespace
+#define BENCH_READ_US           30          // default simulated delays
+#define BENCH_OPEN_US           40
+
+static int failures = 0;
+
+#define BENCH_CHECK(condition, ...) do {    \
+        if (!(condition)) {                 \
+            printf("  FAILED: " __VA_ARGS__); \
+            printf("\n");                   \
+            failures++;                     \
+        }                                   \
+    } while (0)
+
+static double bench_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// xorshift64, the sequence is the same on every run
+static uint64_t bench_random(void) {
+    static uint64_t state = 0x9E3779B97F4A7C15ULL;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static float bench_float_bits(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static double bench_double_bits(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static bool bench_float_same(float a, float b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static bool bench_double_same(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Zeros, infinities, NaN with a payload, subnormals and the limits, then random bit patterns
+static float bench_float_sample(int i) {
+    static const uint32_t special[] = {
+        0x00000000, 0x80000000, 0x7F800000, 0xFF800000, 0x7FC00001, 0xFFA12345, 0x00000001, 0x807FFFFF,
+    };
+    static const float limits[] = { FLT_MIN, FLT_MAX, -FLT_MAX, FLT_EPSILON, 0.1f, 101325.0f, -1.0e-7f };
+    int special_count = sizeof(special) / sizeof(special[0]);
+    int limit_count = sizeof(limits) / sizeof(limits[0]);
+    if (i < special_count) {
+        return bench_float_bits(special[i]);
+    }
+    if (i < special_count + limit_count) {
+        return limits[i - special_count];
+    }
+    return bench_float_bits((uint32_t)bench_random());
+}
+
+static double bench_double_sample(int i) {
+    static const uint64_t special[] = {
+        0x0000000000000000ULL, 0x8000000000000000ULL, 0x7FF0000000000000ULL, 0xFFF0000000000000ULL,
+        0x7FF8000000000001ULL, 0x0000000000000001ULL, 0x800FFFFFFFFFFFFFULL,
+    };
+    static const double limits[] = { DBL_MIN, DBL_MAX, -DBL_MAX, DBL_EPSILON, 0.1, 101325.0, -1.0e-300 };
+    int special_count = sizeof(special) / sizeof(special[0]);
+    int limit_count = sizeof(limits) / sizeof(limits[0]);
+    if (i < special_count) {
+        return bench_double_bits(special[i]);
+    }
+    if (i < special_count + limit_count) {
+        return limits[i - special_count];
+    }
+    return bench_double_bits(bench_random());
+}
+
+static void check_round_trip(void) {
+    printf("Round trip of %d floats and %d doubles\n", BENCH_ROUND_TRIPS, BENCH_ROUND_TRIPS);
+    nvs_host_reset();
+
+    int float_errors = 0;
+    int double_errors = 0;
+    for (int i = 0; i < BENCH_ROUND_TRIPS; i++) {
+        float f = bench_float_sample(i);
+        float f_read = 0;
+        if (nvs_write_float(BENCH_NAMESPACE, "f", f) != ESP_OK || nvs_read_float(BENCH_NAMESPACE, "f", &f_read) != ESP_OK
+            || !bench_float_same(f, f_read)) {
+            float_errors++;
+        }
+
+        double d = bench_double_sample(i);
+        double d_read = 0;
+        if (nvs_write_double(BENCH_NAMESPACE, "d", d) != ESP_OK || nvs_read_double(BENCH_NAMESPACE, "d", &d_read) != ESP_OK
+            || !bench_double_same(d, d_read)) {
+            double_errors++;
+        }
+    }
+    BENCH_CHECK(float_errors == 0, "%d floats changed", float_errors);
+    BENCH_CHECK(double_errors == 0, "%d doubles changed", double_errors);
+
+    // Transaction writes, batch reads
+    int path_errors = 0;
+    for (int i = 0; i < 1000; i++) {
+        float f = bench_float_sample(i);
+        double d = bench_double_sample(i);
+        nvs_transaction_t tx;
+        if (nvs_transaction_begin(BENCH_NAMESPACE, &tx) != ESP_OK) {
+            path_errors++;
+            continue;
+        }
+        nvs_transaction_set_float(tx, "tf", f);
+        nvs_transaction_set_double(tx, "td", d);
+        if (nvs_transaction_commit(tx) != ESP_OK) {
+            path_errors++;
+            continue;
+        }
+
+        float f_read = 0;
+        double d_read = 0;
+        nvs_batch_item_t items[] = {
+            { .key = "tf", .type = NVS_VALUE_FLOAT, .value = &f_read },
+            { .key = "td", .type = NVS_VALUE_DOUBLE, .value = &d_read },
+        };
+        if (nvs_read_batch(BENCH_NAMESPACE, items, 2) != ESP_OK || !bench_float_same(f, f_read)
+            || !bench_double_same(d, d_read)) {
+            path_errors++;
+        }
+    }
+    BENCH_CHECK(path_errors == 0, "%d values changed through a transaction and a batch read", path_errors);
+    BENCH_CHECK(nvs_host_count() == 4, "%u entries stored instead of 4", (unsigned)nvs_host_count());
+}
+
+static void check_legacy(void) {
+    printf("Legacy \"%%f\" strings\n");
+    nvs_host_reset();
+
+    // Stored as the old nvs_write_float() / nvs_write_double() did
+    char string[64];
+    snprintf(string, sizeof(string), "%f", 0.123456789f);
+    nvs_write_string(BENCH_NAMESPACE, "f", string);
+    snprintf(string, sizeof(string), "%lf", -101325.0123456789);
+    nvs_write_string(BENCH_NAMESPACE, "d", string);
+
+    float f = 0;
+    BENCH_CHECK(nvs_read_float(BENCH_NAMESPACE, "f", &f) == ESP_OK, "legacy float not read");
+    BENCH_CHECK(bench_float_same(f, strtof("0.123457", NULL)), "legacy float read as %.9g", f);
+    double d = 0;
+    BENCH_CHECK(nvs_read_double(BENCH_NAMESPACE, "d", &d) == ESP_OK, "legacy double not read");
+    BENCH_CHECK(bench_double_same(d, strtod("-101325.012346", NULL)), "legacy double read as %.17g", d);
+
+    // Migrated: the string entries are replaced, the value does not change any more
+    char *legacy = NULL;
+    BENCH_CHECK(nvs_read_string(BENCH_NAMESPACE, "f", &legacy) == ESP_ERR_NVS_NOT_FOUND, "legacy float not migrated");
+    free(legacy);
+    legacy = NULL;
+    BENCH_CHECK(nvs_read_string(BENCH_NAMESPACE, "d", &legacy) == ESP_ERR_NVS_NOT_FOUND, "legacy double not migrated");
+    free(legacy);
+    BENCH_CHECK(nvs_host_count() == 2, "%u entries stored after the migration instead of 2", (unsigned)nvs_host_count());
+    float f_again = 0;
+    nvs_read_float(BENCH_NAMESPACE, "f", &f_again);
+    BENCH_CHECK(bench_float_same(f, f_again), "migrated float changed to %.9g", f_again);
+
+    // A failed migration still returns the value and is retried by the next read
+    nvs_write_string(BENCH_NAMESPACE, "retry", "2.500000");
+    nvs_host_inject_fault(NVS_HOST_OP_WRITE, "retry", ESP_ERR_NVS_NOT_ENOUGH_SPACE, 0, 1);
+    f = 0;
+    BENCH_CHECK(nvs_read_float(BENCH_NAMESPACE, "retry", &f) == ESP_OK && f == 2.5f, "value lost by a failed migration");
+    char buffer[16];
+    BENCH_CHECK(nvs_read_string_into(BENCH_NAMESPACE, "retry", buffer, sizeof(buffer)) == ESP_OK,
+                "legacy entry lost by a failed migration");
+    f = 0;
+    BENCH_CHECK(nvs_read_float(BENCH_NAMESPACE, "retry", &f) == ESP_OK && f == 2.5f, "value lost by the retry");
+    BENCH_CHECK(nvs_read_string_into(BENCH_NAMESPACE, "retry", buffer, sizeof(buffer)) == ESP_ERR_NVS_NOT_FOUND,
+                "migration not retried");
+
+    // A write replaces the string entry, no stale string is left behind
+    nvs_write_string(BENCH_NAMESPACE, "w", "1.000000");
+    nvs_write_float(BENCH_NAMESPACE, "w", 3.0f);
+    BENCH_CHECK(nvs_read_string_into(BENCH_NAMESPACE, "w", buffer, sizeof(buffer)) == ESP_ERR_NVS_NOT_FOUND,
+                "legacy entry left next to the written value");
+    f = 0;
+    BENCH_CHECK(nvs_read_float(BENCH_NAMESPACE, "w", &f) == ESP_OK && f == 3.0f, "written value read as %.9g", f);
+    BENCH_CHECK(nvs_host_count() == 4, "%u entries stored instead of 4", (unsigned)nvs_host_count());
+}
+
+// The nvs_read_float() before the binary format: allocated string read and strtof()
+static esp_err_t read_float_string(const char *namespace, const char *key, float *out_value) {
+    char *string = NULL;
+    esp_err_t err = nvs_read_string(namespace, key, &string);
+    if (err == ESP_OK) {
+        *out_value = strtof(string, NULL);
+        free(string);
+    }
+    return err;
+}
+
+static void bench_read_path(void) {
+    printf("Read path, %d reads\n", BENCH_READS);
+    nvs_host_reset();
+
+    char string[64];
+    snprintf(string, sizeof(string), "%f", 101325.25f);
+    nvs_write_string(BENCH_NAMESPACE, "old", string);
+    nvs_write_float(BENCH_NAMESPACE, "new", 101325.25f);
+
+    float value = 0;
+    double start = bench_now_us();
+    for (int i = 0; i < BENCH_READS; i++) {
+        read_float_string(BENCH_NAMESPACE, "old", &value);
+    }
+    double string_ns = (bench_now_us() - start) * 1000.0 / BENCH_READS;
+    BENCH_CHECK(value == 101325.25f, "string value read as %.9g", value);
+
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_READS; i++) {
+        nvs_read_float(BENCH_NAMESPACE, "new", &value);
+    }
+    double binary_ns = (bench_now_us() - start) * 1000.0 / BENCH_READS;
+    BENCH_CHECK(value == 101325.25f, "binary value read as %.9g", value);
+
+    printf("  \"%%f\" string: %.0f ns per read\n", string_ns);
+    printf("  binary:       %.0f ns per read\n", binary_ns);
+}
+
+static uint32_t bench_env(const char *name, uint32_t default_value) {
+    const char *value = getenv(name);
+    return value != NULL ? (uint32_t)strtoul(value, NULL, 10) : default_value;
+}
+
+// Reads per second over the given number of namespaces, accessed round robin
+static double bench_reads_per_second(int namespaces, bool cache, uint32_t open_us, uint32_t *opens) {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_host_set_handles(open_us, cache);
+    uint32_t opens_before = nvs_host_open_count();
+
+    int errors = 0;
+    double start = bench_now_us();
+    for (int i = 0; i < BENCH_CACHE_READS; i++) {
+        snprintf(namespace, sizeof(namespace), "ns%d", i % namespaces);
+        snprintf(key, sizeof(key), "k%d", (i / namespaces) % BENCH_CACHE_KEYS);
+        uint32_t value = 0;
+        if (nvs_read_uint32(namespace, key, &value) != ESP_OK || value != (uint32_t)(i / namespaces) % BENCH_CACHE_KEYS) {
+            errors++;
+        }
+    }
+    double elapsed_us = bench_now_us() - start;
+    BENCH_CHECK(errors == 0, "%d reads failed", errors);
+
+    *opens = nvs_host_open_count() - opens_before;
+    return BENCH_CACHE_READS * 1e6 / elapsed_us;
+}
+
+static void bench_handle_cache(void) {
+    uint32_t read_us = bench_env("NVS_BENCH_READ_US", BENCH_READ_US);
+    uint32_t open_us = bench_env("NVS_BENCH_OPEN_US", BENCH_OPEN_US);
+    printf("Handle cache, %d reads, simulated read %u us, open %u us, cache of %d handles\n", BENCH_CACHE_READS,
+           (unsigned)read_us, (unsigned)open_us, NVS_HANDLE_CACHE_SIZE);
+    nvs_host_reset();
+
+    static const int namespace_counts[] = { 1, NVS_HANDLE_CACHE_SIZE - 1, NVS_HANDLE_CACHE_SIZE + 2 };
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (int n = 0; n < NVS_HANDLE_CACHE_SIZE + 2; n++) {
+        snprintf(namespace, sizeof(namespace), "ns%d", n);
+        for (int k = 0; k < BENCH_CACHE_KEYS; k++) {
+            snprintf(key, sizeof(key), "k%d", k);
+            nvs_write_uint32(namespace, key, k);
+        }
+    }
+    nvs_host_set_latency(read_us, 0, 0);
+
+    for (size_t i = 0; i < sizeof(namespace_counts) / sizeof(namespace_counts[0]); i++) {
+        int namespaces = namespace_counts[i];
+        uint32_t opens_before_cache, opens_cached;
+        double before = bench_reads_per_second(namespaces, false, open_us, &opens_before_cache);
+        double cached = bench_reads_per_second(namespaces, true, open_us, &opens_cached);
+        printf("  %d namespace(s): %.0f reads/s with an open per read (%u opens), %.0f reads/s cached (%u opens)\n",
+               namespaces, before, (unsigned)opens_before_cache, cached, (unsigned)opens_cached);
+        if (namespaces <= NVS_HANDLE_CACHE_SIZE) {
+            BENCH_CHECK(opens_cached == (uint32_t)namespaces, "%u opens for %d cached namespaces", (unsigned)opens_cached,
+                        namespaces);
+        }
+    }
+}
+
+void app_main(void) {
+    nvs_init();
+
+    check_round_trip();
+    check_legacy();
+    bench_read_path();
+    bench_handle_cache();
+
+    printf("%s\n", failures == 0 ? "All checks passed" : "Checks FAILED");
+    exit(failures == 0 ? 0 : 1);
+}
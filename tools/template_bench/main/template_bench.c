@@ -0,0 +1,212 @@
+/*
+ * Host benchmark of the page rendering: compiled templates (main/template.c) against the replace_placeholder() loop
+ * they replaced.
+ *
+ * Every {NAME} placeholder of the page is a variable. Its value is stored in NVS (the in-memory backend of the linux
+ * target). The old way reads the values from NVS and replaces the placeholders one by one in a copy of the page, as
+ * the removed assign_*_page_variables() did. The new way compiles the page once and renders it from a snapshot of
+ * the values, as the web handlers do now. Both outputs have to be identical.
+ *
+ * The page is the status page of the firmware, or the file given by TEMPLATE_BENCH_PAGE (any older page from the git
+ * history can be measured this way).
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "non_volatile_storage.h"
+#include "template.h"
+
+#define BENCH_ITERATIONS        2000
+#define BENCH_PAGE_SIZE         16384       // rendered page limit, MAX_TEMPLATE_SIZE of the firmware
+#define BENCH_MAX_VARS          128
+#define BENCH_VALUE_LENGTH      16
+#define BENCH_NAMESPACE         "bench"
+
+extern const char status_html_start[] asm("_binary_status_html_start");
+extern const char status_html_end[] asm("_binary_status_html_end");
+
+typedef struct {
+    char name[BENCH_MAX_VARS][TEMPLATE_NAME_LENGTH + 1];
+    char value[BENCH_MAX_VARS][BENCH_VALUE_LENGTH];     // snapshot of the stored values
+    size_t count;
+} bench_vars_t;
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t used;
+} bench_buffer_t;
+
+static double bench_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench_key(size_t index, char *key, size_t size) {
+    snprintf(key, size, "v%u", (unsigned)index);
+}
+
+static char *bench_read_page(const char *path, size_t *length) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    if (text != NULL) {
+        *length = fread(text, 1, size, f);
+        text[*length] = '\0';
+    }
+    fclose(f);
+    return text;
+}
+
+// The removed replace_placeholder() of web.c
+static void replace_placeholder(char *html_output, const char *placeholder, const char *value) {
+    char *pos;
+    while ((pos = strstr(html_output, placeholder)) != NULL) {
+        size_t len_placeholder = strlen(placeholder);
+        size_t len_value = strlen(value);
+        size_t len_after = strlen(pos + len_placeholder);
+
+        // Shift the rest of the string to make space for the replacement value
+        memmove(pos + len_value, pos + len_placeholder, len_after + 1);
+
+        // Copy the replacement value into the position of the placeholder
+        memcpy(pos, value, len_value);
+    }
+}
+
+static void render_replace(char *html_output, const char *text, const bench_vars_t *vars) {
+    char placeholder[TEMPLATE_NAME_LENGTH + 3];
+    char key[16];
+    char value[BENCH_VALUE_LENGTH];
+
+    strcpy(html_output, text);
+    for (size_t i = 0; i < vars->count; i++) {
+        bench_key(i, key, sizeof(key));
+        if (nvs_read_string_into(BENCH_NAMESPACE, key, value, sizeof(value)) != ESP_OK) {
+            value[0] = '\0';
+        }
+        snprintf(placeholder, sizeof(placeholder), "{%s}", vars->name[i]);
+        replace_placeholder(html_output, placeholder, value);
+    }
+}
+
+static int32_t bench_variable_lookup(const char *name, void *ctx) {
+    bench_vars_t *vars = (bench_vars_t *)ctx;
+    for (size_t i = 0; i < vars->count; i++) {
+        if (strcmp(vars->name[i], name) == 0) {
+            return (int32_t)i;
+        }
+    }
+    if (vars->count == BENCH_MAX_VARS) {
+        return TEMPLATE_LITERAL;
+    }
+    strcpy(vars->name[vars->count], name);
+    return (int32_t)vars->count++;
+}
+
+static esp_err_t bench_variable_value(int32_t var, template_writer_t *out, void *ctx) {
+    const bench_vars_t *vars = (const bench_vars_t *)ctx;
+    return template_write_str(out, vars->value[var]);
+}
+
+static esp_err_t bench_sink(const char *data, size_t length, void *ctx) {
+    bench_buffer_t *buffer = (bench_buffer_t *)ctx;
+    if (buffer->used + length > buffer->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buffer->data + buffer->used, data, length);
+    buffer->used += length;
+    return ESP_OK;
+}
+
+static bool bench_page(const char *name, const char *text, size_t length) {
+    static bench_vars_t vars;
+    template_t tpl;
+    memset(&vars, 0, sizeof(vars));
+
+    double start = bench_now_us();
+    esp_err_t err = template_compile(&tpl, text, length, bench_variable_lookup, &vars);
+    double compile_us = bench_now_us() - start;
+    if (err != ESP_OK) {
+        printf("%s: failed to compile: %s\n", name, esp_err_to_name(err));
+        return false;
+    }
+
+    // Values of different lengths, the page grows and shrinks as with the real settings
+    char key[16];
+    for (size_t i = 0; i < vars.count; i++) {
+        snprintf(vars.value[i], sizeof(vars.value[i]), "%.*s", (int)(1 + i % 12), "123456789.123");
+        bench_key(i, key, sizeof(key));
+        nvs_write_string(BENCH_NAMESPACE, key, vars.value[i]);
+    }
+
+    char *old_page = malloc(BENCH_PAGE_SIZE);
+    char *new_page = malloc(BENCH_PAGE_SIZE);
+    if (old_page == NULL || new_page == NULL || length >= BENCH_PAGE_SIZE) {
+        printf("%s: page too large\n", name);
+        free(old_page);
+        free(new_page);
+        template_free(&tpl);
+        return false;
+    }
+
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        render_replace(old_page, text, &vars);
+    }
+    double replace_us = (bench_now_us() - start) / BENCH_ITERATIONS;
+
+    char window[TEMPLATE_WINDOW_SIZE];
+    template_writer_t out;
+    bench_buffer_t buffer = { new_page, BENCH_PAGE_SIZE, 0 };
+    start = bench_now_us();
+    for (int i = 0; i < BENCH_ITERATIONS && err == ESP_OK; i++) {
+        buffer.used = 0;
+        template_writer_init(&out, window, sizeof(window), bench_sink, &buffer);
+        err = template_render(&tpl, &out, bench_variable_value, &vars);
+    }
+    double render_us = (bench_now_us() - start) / BENCH_ITERATIONS;
+
+    bool identical = err == ESP_OK && strlen(old_page) == buffer.used && memcmp(old_page, new_page, buffer.used) == 0;
+    printf("%s: %u bytes, %u variables, %u segments\n", name, (unsigned)length, (unsigned)vars.count,
+           (unsigned)tpl.segment_count);
+    printf("  replace_placeholder: %.1f us per page\n", replace_us);
+    printf("  compiled template:   %.1f us per page (compiled once in %.1f us)\n", render_us, compile_us);
+    printf("  output %s\n", identical ? "identical" : "DIFFERS");
+
+    free(old_page);
+    free(new_page);
+    template_free(&tpl);
+    return identical;
+}
+
+void app_main(void) {
+    nvs_init();
+
+    bool ok;
+    const char *path = getenv("TEMPLATE_BENCH_PAGE");
+    if (path != NULL) {
+        size_t length = 0;
+        char *text = bench_read_page(path, &length);
+        if (text == NULL) {
+            printf("Failed to read %s\n", path);
+            exit(1);
+        }
+        ok = bench_page(path, text, length);
+        free(text);
+    } else {
+        // EMBED_TXTFILES adds a terminating zero
+        ok = bench_page("status.html", status_html_start, status_html_end - status_html_start - 1);
+    }
+    exit(ok ? 0 : 1);
+}
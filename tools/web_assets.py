@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Build step of the web assets: minify an HTML, CSS or JS file and optionally gzip it.
+
+The output is embedded into the application image (see main/CMakeLists.txt), the pages are rendered from it and the
+static assets are sent as they are with Content-Encoding: gzip.
+
+Usage: web_assets.py <input> <output> [--gzip]
+"""
+
+import gzip
+import os
+import re
+import sys
+
+
+def minify_js(text):
+    # Line based, so the statements keep their line breaks and automatic semicolon insertion is not affected.
+    # The assets keep '//' out of the string literals.
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    lines = []
+    for line in text.splitlines():
+        line = re.sub(r'(^|\s)//.*$', '', line).strip()
+        if line:
+            lines.append(line)
+    return '\n'.join(lines)
+
+
+def minify_css(text):
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    text = re.sub(r'\s+', ' ', text)
+    text = re.sub(r'\s*([{};:,>])\s*', r'\1', text)
+    return text.replace(';}', '}').strip()
+
+
+def minify_html(text):
+    text = re.sub(r'<!--.*?-->', '', text, flags=re.S)
+    # Scripts are minified as JS, textarea and pre content is kept as it is
+    parts = re.split(r'(<script\b[^>]*>.*?</script>|<textarea\b[^>]*>.*?</textarea>|<pre\b[^>]*>.*?</pre>)', text,
+                     flags=re.S | re.I)
+    out = []
+    for i, part in enumerate(parts):
+        if i % 2:
+            script = re.match(r'(<script\b[^>]*>)(.*?)(</script>)$', part, flags=re.S | re.I)
+            if script:
+                part = script.group(1) + minify_js(script.group(2)) + script.group(3)
+            out.append(part)
+            continue
+        # One space is kept, it separates the inline elements
+        out.append(re.sub(r'\s+', ' ', part))
+    return ''.join(out).strip()
+
+
+MINIFIERS = {
+    '.html': minify_html,
+    '.css': minify_css,
+    '.js': minify_js,
+}
+
+
+def main(argv):
+    if len(argv) < 3:
+        sys.stderr.write(__doc__)
+        return 1
+    source, target = argv[1], argv[2]
+    compress = '--gzip' in argv[3:]
+
+    with open(source, encoding='utf-8') as f:
+        text = f.read()
+    minify = MINIFIERS.get(os.path.splitext(source)[1].lower())
+    data = (minify(text) if minify else text).encode('utf-8')
+    if compress:
+        # mtime 0 keeps the output, and so the image, reproducible
+        data = gzip.compress(data, compresslevel=9, mtime=0)
+
+    with open(target, 'wb') as f:
+        f.write(data)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))